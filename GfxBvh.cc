@@ -0,0 +1,916 @@
+#include "GfxBvh.h"
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <mutex>
+#include <thread>
+
+#include "calc.h"
+#include "utility.h"
+
+namespace gfx
+{
+
+constexpr int bvh_max_leaf_segments = 4;
+constexpr int bvh_max_stack_depth = 64;
+
+// Number of nodes of a tree over count segments split at the middle.
+int bvh_num_nodes(int count)
+{
+	if (count <= bvh_max_leaf_segments)
+		return 1;
+	return 1 + bvh_num_nodes(count / 2) + bvh_num_nodes(count - count / 2);
+}
+
+// Slab test. Returns the entry distance, or infinity on a miss.
+float ray_box_distance(
+	const calc::Vec3& o, 
+	const calc::Vec3& inv_d, 
+	const calc::Vec3& inf, 
+	const calc::Vec3& sup, 
+	float s_max)
+{
+	float s_near = 0.f, s_far = s_max;
+	for (int i = 0; i < 3; ++i) {
+		float s0 = (inf[i] - o[i]) * inv_d[i];
+		float s1 = (sup[i] - o[i]) * inv_d[i];
+		if (s0 > s1)
+			std::swap(s0, s1);
+		s_near = std::max(s_near, s0);
+		s_far = std::min(s_far, s1);
+	}
+	if (s_near > s_far)
+		return std::numeric_limits<float>::infinity();
+	return s_near;
+}
+
+// Ray with unit direction d against the capsule [a,b] of radius r.
+// Returns the hit distance, or a negative value on a miss.
+float ray_capsule_distance(
+	const calc::Vec3& o, 
+	const calc::Vec3& d, 
+	const calc::Vec3& a, 
+	const calc::Vec3& b, 
+	float r)
+{
+	auto ba = b - a;
+	auto oa = o - a;
+	float baba = calc::dot(ba, ba);
+	float bard = calc::dot(ba, d);
+	float baoa = calc::dot(ba, oa);
+	float rdoa = calc::dot(d, oa);
+	float oaoa = calc::dot(oa, oa);
+
+	float qa = baba - bard * bard;
+	float qb = baba * rdoa - baoa * bard;
+	float qc = baba * oaoa - baoa * baoa - r * r * baba;
+	float h = qb * qb - qa * qc;
+
+	if (qa > calc::eps * baba && h >= 0.f) {
+		// Cylinder body.
+		float s = (-qb - std::sqrt(h)) / qa;
+		float y = baoa + s * bard;
+		if (y > 0.f && y < baba)
+			return s;
+	}
+
+	// Spherical caps.
+	float s_min = -1.f;
+	for (const auto* c : { &a, &b }) {
+		auto oc = o - *c;
+		float cb = calc::dot(d, oc);
+		float cc = calc::dot(oc, oc) - r * r;
+		float ch = cb * cb - cc;
+		if (ch < 0.f)
+			continue;
+		float s = -cb - std::sqrt(ch);
+		if (s >= 0.f && (s_min < 0.f || s < s_min))
+			s_min = s;
+	}
+	return s_min;
+}
+
+float point_segment_distance2(
+	const calc::Vec3& p, 
+	const calc::Vec3& a, 
+	const calc::Vec3& b)
+{
+	auto ba = b - a;
+	auto pa = p - a;
+	float baba = calc::dot(ba, ba);
+	float t = baba > 0.f ? 
+		calc::clamp(calc::dot(pa, ba) / baba, 0.f, 1.f) : 0.f;
+	auto q = pa - ba * t;
+	return calc::dot(q, q);
+}
+
+float point_box_distance2(
+	const calc::Vec3& p, 
+	const calc::Vec3& inf, 
+	const calc::Vec3& sup)
+{
+	auto q = calc::maximum(calc::minimum(p, sup), inf);
+	return calc::dot(p - q, p - q);
+}
+
+void SegmentBvh::build(const Model& hair, float radius)
+{
+	positions_ = hair.positions();
+	radius_ = radius;
+
+	segments_.clear();
+	for (int f = 0; f < hair.num_fibers(); ++f) {
+		const auto& fiber = hair.fiber(f);
+		for (int v = 0; v < fiber.vcount - 1; ++v)
+			segments_.push_back(fiber.vstart + v);
+	}
+
+	nodes_.clear();
+	subtrees_.clear();
+	top_nodes_.clear();
+	int num_segments = segments_.size();
+	if (num_segments == 0)
+		return;
+
+	std::vector<calc::Vec3> centroids(positions_.size());
+	util::parallel_for(0, num_segments, 1 << 14, [&](int lo, int hi) {
+		for (int s = lo; s < hi; ++s) {
+			int v = segments_[s];
+			centroids[v] = (positions_[v] + positions_[v+1]) * .5f;
+		}
+	});
+
+	nodes_.resize(bvh_num_nodes(num_segments));
+
+	////
+	// Split the top of the tree serially until 
+	// there are enough subtrees to keep all 
+	// threads busy, then build those in parallel.
+	////
+
+	class Job {
+	public:
+		int node;
+		int begin;
+		int end;
+	};
+
+	const int num_jobs = 8 * util::scheduler().num_threads();
+	std::vector<Job> jobs{ {0, 0, num_segments} };
+	while (static_cast<int>(jobs.size()) < num_jobs) {
+		auto largest = std::max_element(jobs.begin(), jobs.end(),
+			[](const Job& lhs, const Job& rhs) {
+				return lhs.end - lhs.begin < rhs.end - rhs.begin; });
+		auto job = *largest;
+		if (job.end - job.begin <= bvh_max_leaf_segments)
+			break;
+
+		build_node(job.node, job.begin, job.end, centroids, false);
+		top_nodes_.push_back(job.node);
+
+		int mid = job.begin + (job.end - job.begin) / 2;
+		*largest = Job{ job.node + 1, job.begin, mid };
+		jobs.push_back(Job{ nodes_[job.node].first, mid, job.end });
+	}
+	std::sort(top_nodes_.begin(), top_nodes_.end());
+
+	for (const auto& job : jobs)
+		subtrees_.push_back(Subtree{ job.node, bvh_num_nodes(job.end - job.begin) });
+
+	util::parallel_for(0, jobs.size(), 1, [&](int lo, int hi) {
+		for (int j = lo; j < hi; ++j)
+			build_node(jobs[j].node, jobs[j].begin, jobs[j].end, centroids, true);
+	});
+
+	refit(positions_);
+}
+
+void SegmentBvh::build_node(int node, int begin, int end,
+	const std::vector<calc::Vec3>& centroids, bool recursive)
+{
+	int count = end - begin;
+	if (count <= bvh_max_leaf_segments) {
+		nodes_[node].first = begin;
+		nodes_[node].count = count;
+		return;
+	}
+
+	// Median split along the largest extent of the centroids.
+	calc::Box3D box{};
+	for (int s = begin; s < end; ++s)
+		box.update(centroids[segments_[s]]);
+	auto size = box.size();
+	int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+
+	int mid = begin + count / 2;
+	std::nth_element(
+		segments_.begin() + begin, 
+		segments_.begin() + mid, 
+		segments_.begin() + end,
+		[&centroids, axis](int lhs, int rhs) {
+			return centroids[lhs][axis] < centroids[rhs][axis]; });
+
+	int left = node + 1;
+	int right = left + bvh_num_nodes(mid - begin);
+	nodes_[node].first = right;
+	nodes_[node].count = 0;
+
+	if (recursive) {
+		build_node(left, begin, mid, centroids, true);
+		build_node(right, mid, end, centroids, true);
+	}
+}
+
+void SegmentBvh::refit_node(int node)
+{
+	auto& n = nodes_[node];
+	if (n.count > 0) {
+		calc::Vec3 r{ radius_, radius_, radius_ };
+		int v = segments_[n.first];
+		n.inf = calc::minimum(positions_[v], positions_[v+1]) - r;
+		n.sup = calc::maximum(positions_[v], positions_[v+1]) + r;
+		for (int s = n.first + 1; s < n.first + n.count; ++s) {
+			v = segments_[s];
+			n.inf = calc::minimum(n.inf, 
+				calc::minimum(positions_[v], positions_[v+1]) - r);
+			n.sup = calc::maximum(n.sup, 
+				calc::maximum(positions_[v], positions_[v+1]) + r);
+		}
+		return;
+	}
+
+	const auto& left = nodes_[node + 1];
+	const auto& right = nodes_[n.first];
+	n.inf = calc::minimum(left.inf, right.inf);
+	n.sup = calc::maximum(left.sup, right.sup);
+}
+
+void SegmentBvh::refit(const std::vector<calc::Vec3>& positions)
+{
+	if (&positions != &positions_)
+		positions_ = positions;
+
+	// Children are stored after their parents.
+	util::parallel_for(0, subtrees_.size(), 1, [&](int lo, int hi) {
+		for (int t = lo; t < hi; ++t) {
+			const auto& subtree = subtrees_[t];
+			for (int n = subtree.node + subtree.num_nodes - 1; n >= subtree.node; --n)
+				refit_node(n);
+		}
+	});
+	for (auto n = top_nodes_.rbegin(); n != top_nodes_.rend(); ++n)
+		refit_node(*n);
+}
+
+bool SegmentBvh::intersect(const calc::Ray& ray, Hit& hit) const
+{
+	if (nodes_.empty())
+		return false;
+
+	float d_len = calc::length(ray.d);
+	auto d = ray.d / d_len;
+	calc::Vec3 inv_d{ 1.f / d.x, 1.f / d.y, 1.f / d.z };
+
+	float s_max = std::numeric_limits<float>::infinity();
+	int found = -1;
+
+	int stack[bvh_max_stack_depth];
+	int top = 0;
+	stack[top++] = 0;
+
+	while (top > 0) {
+		int node = stack[--top];
+		const auto& n = nodes_[node];
+
+		if (n.count > 0) {
+			for (int s = n.first; s < n.first + n.count; ++s) {
+				int v = segments_[s];
+				float dist = ray_capsule_distance(
+					ray.o, d, positions_[v], positions_[v+1], radius_);
+				if (dist >= calc::eps && dist < s_max) {
+					s_max = dist;
+					found = v;
+				}
+			}
+			continue;
+		}
+
+		// Visit the nearer child first.
+		int left = node + 1, right = n.first;
+		float s_left = ray_box_distance(
+			ray.o, inv_d, nodes_[left].inf, nodes_[left].sup, s_max);
+		float s_right = ray_box_distance(
+			ray.o, inv_d, nodes_[right].inf, nodes_[right].sup, s_max);
+		if (s_left > s_right) {
+			std::swap(left, right);
+			std::swap(s_left, s_right);
+		}
+		if (s_right < s_max)
+			stack[top++] = right;
+		if (s_left < s_max)
+			stack[top++] = left;
+	}
+
+	if (found < 0)
+		return false;
+
+	hit.segment = found;
+	hit.s = s_max / d_len;
+	ray.s = hit.s;
+	return true;
+}
+
+void SegmentBvh::overlap(
+	const calc::Sphere& sphere, 
+	std::vector<int>& segments) const
+{
+	if (nodes_.empty())
+		return;
+
+	float r = sphere.r + radius_;
+	float r2 = r * r;
+
+	int stack[bvh_max_stack_depth];
+	int top = 0;
+	stack[top++] = 0;
+
+	while (top > 0) {
+		int node = stack[--top];
+		const auto& n = nodes_[node];
+
+		if (point_box_distance2(sphere.o, n.inf, n.sup) > sphere.r * sphere.r)
+			continue;
+
+		if (n.count > 0) {
+			for (int s = n.first; s < n.first + n.count; ++s) {
+				int v = segments_[s];
+				if (point_segment_distance2(
+						sphere.o, positions_[v], positions_[v+1]) <= r2)
+					segments.push_back(v);
+			}
+			continue;
+		}
+
+		stack[top++] = n.first;
+		stack[top++] = node + 1;
+	}
+}
+
+
+////
+// TriangleBvh.
+////
+
+constexpr int bvh_num_bins = 16;
+constexpr int bvh_max_leaf_triangles = 4;
+// Ranges above this are binned in parallel.
+constexpr int bvh_parallel_bin_size = 1 << 16;
+
+float half_area(const calc::Vec3& inf, const calc::Vec3& sup)
+{
+	auto e = sup - inf;
+	return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+// Ray for slab tests, with the origin scaled ahead.
+class SlabRay {
+public:
+	calc::Vec3 inv_d;
+	calc::Vec3 o_inv_d;
+
+	explicit SlabRay(const calc::Ray& ray)
+	{
+		for (int i = 0; i < 3; ++i) {
+			inv_d[i] = 1.f / ray.d[i];
+			o_inv_d[i] = ray.o[i] * inv_d[i];
+		}
+	}
+
+	// Entry distance, or infinity on a miss or past s_max.
+	float entry(const calc::Vec3& inf, const calc::Vec3& sup, float s_max) const
+	{
+		float s_near = 0.f, s_far = s_max;
+		for (int i = 0; i < 3; ++i) {
+			float s0 = inf[i] * inv_d[i] - o_inv_d[i];
+			float s1 = sup[i] * inv_d[i] - o_inv_d[i];
+			s_near = std::max(s_near, std::min(s0, s1));
+			s_far = std::min(s_far, std::max(s0, s1));
+		}
+		return s_near <= s_far ? s_near : std::numeric_limits<float>::infinity();
+	}
+};
+
+// Separating axis test, Akenine-Moller 2001.
+bool triangle_box_overlap(
+	const calc::Vec3& center,
+	const calc::Vec3& half,
+	const calc::Vec3& a,
+	const calc::Vec3& b,
+	const calc::Vec3& c)
+{
+	calc::Vec3 v[3] = { a - center, b - center, c - center };
+
+	// Box faces.
+	for (int i = 0; i < 3; ++i) {
+		float lo = std::min(v[0][i], std::min(v[1][i], v[2][i]));
+		float hi = std::max(v[0][i], std::max(v[1][i], v[2][i]));
+		if (lo > half[i] || hi < -half[i])
+			return false;
+	}
+
+	// Triangle plane.
+	calc::Vec3 e[3] = { v[1] - v[0], v[2] - v[1], v[0] - v[2] };
+	auto n = calc::cross(e[0], e[1]);
+	if (std::abs(calc::dot(n, v[0])) > calc::dot(half, calc::abs(n)))
+		return false;
+
+	// Box edges crossed with triangle edges.
+	const calc::Vec3 axes[3] = { {1.f, 0.f, 0.f}, {0.f, 1.f, 0.f}, {0.f, 0.f, 1.f} };
+	for (int i = 0; i < 3; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			auto axis = calc::cross(axes[i], e[j]);
+			float p0 = calc::dot(axis, v[0]);
+			float p1 = calc::dot(axis, v[1]);
+			float p2 = calc::dot(axis, v[2]);
+			float r = calc::dot(half, calc::abs(axis));
+			if (std::min(p0, std::min(p1, p2)) > r ||
+				std::max(p0, std::max(p1, p2)) < -r)
+				return false;
+		}
+	}
+	return true;
+}
+
+bool box_box_overlap(
+	const calc::Vec3& inf0,
+	const calc::Vec3& sup0,
+	const calc::Vec3& inf1,
+	const calc::Vec3& sup1)
+{
+	return inf0.x <= sup1.x && inf1.x <= sup0.x &&
+		inf0.y <= sup1.y && inf1.y <= sup0.y &&
+		inf0.z <= sup1.z && inf1.z <= sup0.z;
+}
+
+class TriangleBvh::Build {
+public:
+
+	// Bounding box of a triangle.
+	class Prim {
+	public:
+		calc::Vec3 inf;
+		int triangle;
+		calc::Vec3 sup;
+
+		float centroid(int axis) const { return .5f * (inf[axis] + sup[axis]); }
+	};
+
+	class Bin {
+	public:
+		static constexpr float big = std::numeric_limits<float>::max();
+
+		calc::Vec3 inf{ big, big, big };
+		calc::Vec3 sup{ -big, -big, -big };
+		int count = 0;
+
+		void add(const calc::Vec3& box_inf, const calc::Vec3& box_sup, int box_count)
+		{
+			for (int i = 0; i < 3; ++i) {
+				inf[i] = std::min(inf[i], box_inf[i]);
+				sup[i] = std::max(sup[i], box_sup[i]);
+			}
+			count += box_count;
+		}
+
+		void add(const Bin& other) { add(other.inf, other.sup, other.count); }
+	};
+
+	class Bins {
+	public:
+		Bin bins[3][bvh_num_bins];
+
+		void add(const Bins& other)
+		{
+			for (int axis = 0; axis < 3; ++axis)
+				for (int b = 0; b < bvh_num_bins; ++b)
+					bins[axis][b].add(other.bins[axis][b]);
+		}
+	};
+
+	// Bounds of a range of prims and of their centroids.
+	class Bounds {
+	public:
+		Bin box;
+		Bin centroids;
+
+		void add(const Bounds& other)
+		{
+			box.add(other.box);
+			centroids.add(other.centroids);
+		}
+	};
+
+	class Job {
+	public:
+		int slot;
+		int begin;
+		int end;
+		int depth;
+	};
+
+	std::vector<Prim> prims;
+	// Node over [begin,end) is at a slot with the 2*(end-begin)-1
+	// slots after it free for its subtree.
+	std::vector<Node> slots;
+
+	////
+	// f(lo, hi, result) over [begin,end), merging
+	// per chunk results for ranges large enough to
+	// go in parallel.
+	////
+	template<typename Result, typename Func>
+	void reduce(int begin, int end, Result& result, Func f)
+	{
+		if (end - begin < bvh_parallel_bin_size) {
+			f(begin, end, result);
+			return;
+		}
+
+		std::mutex mutex;
+		util::parallel_for(begin, end, bvh_parallel_bin_size / 4, [&](int lo, int hi) {
+			Result local;
+			f(lo, hi, local);
+			std::lock_guard<std::mutex> lock(mutex);
+			result.add(local);
+		});
+	}
+
+	Bounds range_bounds(int begin, int end)
+	{
+		Bounds bounds;
+		reduce(begin, end, bounds, [this](int lo, int hi, Bounds& result) {
+			for (int k = lo; k < hi; ++k) {
+				const auto& prim = prims[k];
+				calc::Vec3 c{ prim.centroid(0), prim.centroid(1), prim.centroid(2) };
+				result.box.add(prim.inf, prim.sup, 1);
+				result.centroids.add(c, c, 1);
+			}
+		});
+		return bounds;
+	}
+
+	////
+	// Split [begin,end) of a node with the given bounds.
+	// Returns the end of the left range, or begin if the
+	// node should be a leaf.
+	////
+	int split(int begin, int end, int depth, const Bounds& bounds)
+	{
+		int count = end - begin;
+		// Deeper nodes would overflow the traversal stacks.
+		if (count == 1 || depth >= bvh_max_stack_depth - 2)
+			return begin;
+
+		// Small nodes need fewer bins.
+		int num_bins = std::min(bvh_num_bins, 2 * count);
+		const auto& origin = bounds.centroids.inf;
+		calc::Vec3 scale{};
+		for (int i = 0; i < 3; ++i) {
+			float extent = bounds.centroids.sup[i] - origin[i];
+			scale[i] = extent > 0.f ? num_bins / extent * (1.f - 1e-6f) : 0.f;
+		}
+		auto bin_of = [&origin, &scale, num_bins](const Prim& prim, int axis) {
+			int b = static_cast<int>((prim.centroid(axis) - origin[axis]) * scale[axis]);
+			return std::min(num_bins - 1, std::max(0, b));
+		};
+
+		Bins bins;
+		reduce(begin, end, bins, [&](int lo, int hi, Bins& result) {
+			for (int k = lo; k < hi; ++k) {
+				const auto& prim = prims[k];
+				for (int axis = 0; axis < 3; ++axis)
+					result.bins[axis][bin_of(prim, axis)].add(prim.inf, prim.sup, 1);
+			}
+		});
+
+		////
+		// Cost of a split after bin b, relative to the
+		// cost of intersecting one triangle, for a node
+		// traversal cost of 1.
+		////
+		float best_cost = std::numeric_limits<float>::max();
+		int best_axis = -1, best_bin = 0;
+		float inv_area = 1.f / std::max(half_area(bounds.box.inf, bounds.box.sup), 1e-30f);
+		for (int axis = 0; axis < 3; ++axis) {
+			if (scale[axis] == 0.f)
+				continue;
+			const auto& axis_bins = bins.bins[axis];
+			float right_cost[bvh_num_bins];
+			Bin right;
+			for (int b = num_bins - 1; b > 0; --b) {
+				right.add(axis_bins[b]);
+				right_cost[b] = right.count ? right.count * half_area(right.inf, right.sup) : 0.f;
+			}
+			Bin left;
+			for (int b = 0; b < num_bins - 1; ++b) {
+				left.add(axis_bins[b]);
+				if (left.count == 0 || left.count == count)
+					continue;
+				float cost = 1.f + inv_area *
+					(left.count * half_area(left.inf, left.sup) + right_cost[b + 1]);
+				if (cost < best_cost) {
+					best_cost = cost;
+					best_axis = axis;
+					best_bin = b;
+				}
+			}
+		}
+
+		if (count <= bvh_max_leaf_triangles && (best_axis < 0 || best_cost >= count))
+			return begin;
+
+		// Coincident centroids, split at the middle.
+		if (best_axis < 0)
+			return begin + count / 2;
+
+		auto mid = std::partition(prims.begin() + begin, prims.begin() + end,
+			[&](const Prim& prim) { return bin_of(prim, best_axis) <= best_bin; });
+		return mid - prims.begin();
+	}
+
+	// Writes the node at slot, and returns the number of jobs for
+	// its children, 0 for a leaf.
+	int build_node(const Job& job, Job children[2])
+	{
+		auto bounds = range_bounds(job.begin, job.end);
+		auto& node = slots[job.slot];
+		node.inf = bounds.box.inf;
+		node.sup = bounds.box.sup;
+
+		int mid = split(job.begin, job.end, job.depth, bounds);
+		if (mid == job.begin) {
+			node.first = job.begin;
+			node.count = job.end - job.begin;
+			return 0;
+		}
+
+		int left = job.slot + 1;
+		int right = left + 2 * (mid - job.begin) - 1;
+		node.first = right;
+		node.count = 0;
+		children[0] = Job{ left, job.begin, mid, job.depth + 1 };
+		children[1] = Job{ right, mid, job.end, job.depth + 1 };
+		return 2;
+	}
+
+	void build_subtree(const Job& job)
+	{
+		Job children[2];
+		if (build_node(job, children) == 0)
+			return;
+		build_subtree(children[0]);
+		build_subtree(children[1]);
+	}
+};
+
+void TriangleBvh::build(const Model& mesh)
+{
+	build(mesh.positions(), mesh.indices());
+}
+
+void TriangleBvh::build(
+	const std::vector<calc::Vec3>& positions,
+	const std::vector<unsigned>& indices)
+{
+	nodes_.clear();
+	triangles_.clear();
+	int num_tris = indices.size() / 3;
+	if (num_tris == 0)
+		return;
+
+	Build b;
+	b.prims.resize(num_tris);
+	util::parallel_for(0, num_tris, 1 << 14, [&](int lo, int hi) {
+		for (int t = lo; t < hi; ++t) {
+			const auto& v0 = positions[indices[3 * t]];
+			const auto& v1 = positions[indices[3 * t + 1]];
+			const auto& v2 = positions[indices[3 * t + 2]];
+			b.prims[t] = Build::Prim{ calc::minimum(v0, calc::minimum(v1, v2)), t,
+				calc::maximum(v0, calc::maximum(v1, v2)) };
+		}
+	});
+	b.slots.resize(2 * num_tris - 1);
+
+	////
+	// Split the top of the tree serially, binning
+	// large nodes in parallel, until there are
+	// enough subtrees to keep all threads busy.
+	////
+
+	using Job = Build::Job;
+	const int num_jobs = 8 * util::scheduler().num_threads();
+	std::vector<Job> jobs{ {0, 0, num_tris, 0} };
+	std::vector<Job> subtrees;
+	while (!jobs.empty() &&
+		static_cast<int>(jobs.size() + subtrees.size()) < num_jobs) {
+		auto largest = std::max_element(jobs.begin(), jobs.end(),
+			[](const Job& lhs, const Job& rhs) {
+				return lhs.end - lhs.begin < rhs.end - rhs.begin; });
+		auto job = *largest;
+		jobs.erase(largest);
+		if (job.end - job.begin <= bvh_max_leaf_triangles) {
+			subtrees.push_back(job);
+			continue;
+		}
+
+		Job children[2];
+		int num_children = b.build_node(job, children);
+		jobs.insert(jobs.end(), children, children + num_children);
+	}
+	subtrees.insert(subtrees.end(), jobs.begin(), jobs.end());
+
+	util::parallel_for(0, subtrees.size(), 1, [&](int lo, int hi) {
+		for (int j = lo; j < hi; ++j)
+			b.build_subtree(subtrees[j]);
+	});
+
+	////
+	// Compact the used slots, in depth-first order,
+	// and copy the triangles in leaf order.
+	////
+
+	std::vector<int> order;
+	std::vector<int> new_index(b.slots.size(), -1);
+	std::vector<int> stack{ 0 };
+	while (!stack.empty()) {
+		int slot = stack.back();
+		stack.pop_back();
+		new_index[slot] = order.size();
+		order.push_back(slot);
+		const auto& n = b.slots[slot];
+		if (n.count == 0) {
+			stack.push_back(n.first);
+			stack.push_back(slot + 1);
+		}
+	}
+
+	nodes_.resize(order.size());
+	for (int i = 0; i < static_cast<int>(order.size()); ++i) {
+		nodes_[i] = b.slots[order[i]];
+		if (nodes_[i].count == 0)
+			nodes_[i].first = new_index[nodes_[i].first];
+	}
+
+	triangles_.resize(num_tris);
+	util::parallel_for(0, num_tris, 1 << 14, [&](int lo, int hi) {
+		for (int k = lo; k < hi; ++k) {
+			int t = b.prims[k].triangle;
+			const auto& v0 = positions[indices[3 * t]];
+			triangles_[k] = Triangle{ v0,
+				positions[indices[3 * t + 1]] - v0,
+				positions[indices[3 * t + 2]] - v0, t };
+		}
+	});
+}
+
+bool TriangleBvh::intersect(const calc::Ray& ray, Hit& hit) const
+{
+	if (nodes_.empty())
+		return false;
+
+	SlabRay slab{ ray };
+
+	float s_max = std::numeric_limits<float>::infinity();
+	int found = -1;
+	float found_u = 0.f, found_v = 0.f;
+
+	// Nodes to visit, with their entry distances.
+	int stack[bvh_max_stack_depth];
+	float stack_s[bvh_max_stack_depth];
+	int top = 0;
+	stack[top] = 0;
+	stack_s[top++] = 0.f;
+
+	while (top > 0) {
+		--top;
+		// Closer hits found since the node was pushed.
+		if (stack_s[top] >= s_max)
+			continue;
+		int node = stack[top];
+		const auto& n = nodes_[node];
+
+		if (n.count > 0) {
+			for (int k = n.first; k < n.first + n.count; ++k) {
+				const auto& tri = triangles_[k];
+				float u = 0.f, v = 0.f;
+				float s = calc::hit_distance(tri.v0, tri.e1, tri.e2, ray, u, v);
+				if (s < s_max) {
+					s_max = s;
+					found = k;
+					found_u = u;
+					found_v = v;
+				}
+			}
+			continue;
+		}
+
+		// Visit the nearer child first.
+		int left = node + 1, right = n.first;
+		float s_left = slab.entry(nodes_[left].inf, nodes_[left].sup, s_max);
+		float s_right = slab.entry(nodes_[right].inf, nodes_[right].sup, s_max);
+		if (s_left > s_right) {
+			std::swap(left, right);
+			std::swap(s_left, s_right);
+		}
+		if (s_right < s_max) {
+			stack[top] = right;
+			stack_s[top++] = s_right;
+		}
+		if (s_left < s_max) {
+			stack[top] = left;
+			stack_s[top++] = s_left;
+		}
+	}
+
+	if (found < 0)
+		return false;
+
+	hit.triangle = triangles_[found].index;
+	hit.s = s_max;
+	hit.bary = calc::Vec2{ found_u, found_v };
+	ray.s = hit.s;
+	return true;
+}
+
+bool TriangleBvh::occluded(const calc::Ray& ray, float s_max) const
+{
+	if (nodes_.empty())
+		return false;
+
+	SlabRay slab{ ray };
+
+	int stack[bvh_max_stack_depth];
+	int top = 0;
+	stack[top++] = 0;
+
+	while (top > 0) {
+		int node = stack[--top];
+		const auto& n = nodes_[node];
+		if (slab.entry(n.inf, n.sup, s_max) >= s_max)
+			continue;
+
+		if (n.count > 0) {
+			for (int k = n.first; k < n.first + n.count; ++k) {
+				const auto& tri = triangles_[k];
+				float u = 0.f, v = 0.f;
+				if (calc::hit_distance(tri.v0, tri.e1, tri.e2, ray, u, v) < s_max)
+					return true;
+			}
+			continue;
+		}
+
+		stack[top++] = n.first;
+		stack[top++] = node + 1;
+	}
+	return false;
+}
+
+void TriangleBvh::overlap(
+	const calc::Box3D& box,
+	std::vector<int>& triangles) const
+{
+	if (nodes_.empty())
+		return;
+
+	auto inf = box.inf(), sup = box.sup();
+	auto center = box.center();
+	auto half = box.size() * .5f;
+
+	int stack[bvh_max_stack_depth];
+	int top = 0;
+	stack[top++] = 0;
+
+	while (top > 0) {
+		int node = stack[--top];
+		const auto& n = nodes_[node];
+
+		if (!box_box_overlap(inf, sup, n.inf, n.sup))
+			continue;
+
+		if (n.count > 0) {
+			for (int k = n.first; k < n.first + n.count; ++k) {
+				const auto& tri = triangles_[k];
+				if (triangle_box_overlap(center, half,
+						tri.v0, tri.v0 + tri.e1, tri.v0 + tri.e2))
+					triangles.push_back(tri.index);
+			}
+			continue;
+		}
+
+		stack[top++] = n.first;
+		stack[top++] = node + 1;
+	}
+}
+
+}
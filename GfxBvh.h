@@ -0,0 +1,147 @@
+#ifndef GFX_BVH_H
+#define GFX_BVH_H
+
+#include <vector>
+#include "calc.h"
+#include "GfxModel.h"
+
+namespace gfx
+{
+
+////
+// Bounding volume hierarchy over hair segments.
+// Each segment is a capsule of a fixed radius
+// around two consecutive vertices of a fiber.
+//
+// Nodes are stored depth first: the left child
+// of an internal node follows it, the right one
+// is at `first`. Splits are always at the middle
+// of a node's segments, so the layout is known
+// before the build, subtrees are built in
+// parallel, and refit after simulation only
+// recomputes boxes in O(n).
+////
+
+class SegmentBvh {
+public:
+
+	class Node {
+	public:
+		calc::Vec3 inf;
+		int first;  // Leaf: first segment. Internal: right child.
+		calc::Vec3 sup;
+		int count;  // Leaf: #segments. Internal: 0.
+	};
+
+	class Hit {
+	public:
+		int segment;  // Index of the segment's first vertex.
+		float s;      // Hit point: ray.o+s*ray.d.
+	};
+
+	SegmentBvh() {}
+
+	void build(const Model& hair, float radius);
+
+	// Recompute boxes for moved vertices. Topology is unchanged.
+	void refit(const std::vector<calc::Vec3>& positions);
+
+	// Closest capsule hit along the ray.
+	bool intersect(const calc::Ray& ray, Hit& hit) const;
+
+	// Segments whose capsules overlap the sphere.
+	void overlap(const calc::Sphere& sphere, std::vector<int>& segments) const;
+
+	int num_nodes() const { return nodes_.size(); }
+	int num_segments() const { return segments_.size(); }
+	const Node& node(int idx) const { return nodes_[idx]; }
+
+private:
+
+	class Subtree {
+	public:
+		int node;
+		int num_nodes;
+	};
+
+	void build_node(int node, int begin, int end,
+		const std::vector<calc::Vec3>& centroids, bool recursive);
+	void refit_node(int node);
+
+	std::vector<Node> nodes_;
+	std::vector<int> segments_;
+	std::vector<calc::Vec3> positions_;
+	float radius_ = 0.f;
+
+	// Roots of the subtrees built and refit in parallel, and the
+	// internal nodes above them in depth-first order.
+	std::vector<Subtree> subtrees_;
+	std::vector<int> top_nodes_;
+};
+
+////
+// Bounding volume hierarchy over the triangles
+// of a static mesh.
+//
+// Splits minimize the surface area heuristic over
+// 16 centroid bins per axis, and nodes have the
+// depth-first layout of SegmentBvh's. As subtree
+// sizes are not known before the split, a node
+// over n triangles is built into a slot with room
+// for 2n-1 nodes below it, subtrees are built in
+// parallel, and the slots are compacted after.
+// Leaf triangles are copied in leaf order, as a
+// vertex and two edges.
+////
+
+class TriangleBvh {
+public:
+
+	using Node = SegmentBvh::Node;
+
+	class Hit {
+	public:
+		int triangle;     // Index of the triangle's first index / 3.
+		float s;          // Hit point: ray.o+s*ray.d.
+		calc::Vec2 bary;  // Weights of the second and third vertices.
+	};
+
+	TriangleBvh() {}
+
+	void build(const Model& mesh);
+	void build(
+		const std::vector<calc::Vec3>& positions,
+		const std::vector<unsigned>& indices);
+
+	// Closest hit along the ray, with s >= eps.
+	bool intersect(const calc::Ray& ray, Hit& hit) const;
+
+	// Whether any triangle is hit with eps <= s < s_max.
+	bool occluded(const calc::Ray& ray, float s_max) const;
+
+	// Triangles overlapping the box.
+	void overlap(const calc::Box3D& box, std::vector<int>& triangles) const;
+
+	int num_nodes() const { return nodes_.size(); }
+	int num_triangles() const { return triangles_.size(); }
+	const Node& node(int idx) const { return nodes_[idx]; }
+
+private:
+
+	class Triangle {
+	public:
+		calc::Vec3 v0;
+		calc::Vec3 e1;  // v1-v0.
+		calc::Vec3 e2;  // v2-v0.
+		int index;
+	};
+
+	class Build;
+
+	std::vector<Node> nodes_;
+	std::vector<Triangle> triangles_;
+};
+
+}
+
+#endif
@@ -129,4 +129,40 @@ void ArcballCamera::process_input(const Input& input)
 
 }
 
+float projected_size(
+	const Camera& camera, 
+	calc::Box3D bounds, 
+	calc::iVec2 viewport)
+{
+	auto transform = camera.world_transform();
+	const float fmax = std::numeric_limits<float>::max();
+	calc::Vec2 inf{ fmax, fmax }, sup{ -fmax, -fmax };
+
+	for (int c = 0; c < 8; ++c) {
+		calc::Vec3 corner{
+			c & 1 ? .5f : -.5f,
+			c & 2 ? .5f : -.5f,
+			c & 4 ? .5f : -.5f };
+		corner = corner * bounds.size() + bounds.center();
+
+		auto clip = calc::dot(transform, 
+			calc::Vec4{ corner.x, corner.y, corner.z, 1.f });
+		if (clip.w < calc::eps)
+			return std::numeric_limits<float>::infinity();
+
+		calc::Vec2 ndc{ clip.x / clip.w, clip.y / clip.w };
+		inf = calc::minimum(inf, ndc);
+		sup = calc::maximum(sup, ndc);
+	}
+
+	inf = calc::maximum(inf, calc::Vec2{ -1, -1 });
+	sup = calc::minimum(sup, calc::Vec2{ 1, 1 });
+	if (sup.x < inf.x || sup.y < inf.y)
+		return 0.f;
+
+	return std::max(
+		(sup.x - inf.x) * .5f * viewport.x,
+		(sup.y - inf.y) * .5f * viewport.y);
+}
+
 }
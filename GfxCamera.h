@@ -1,3 +1,6 @@
+#ifndef GFX_CAMERA_H
+#define GFX_CAMERA_H
+
 #include "calc.h"
 #include "GfxInput.h"
 
@@ -35,5 +38,13 @@ private:
 	calc::Vec3 init_pos_;
 };
 
+// Larger side, in pixels, of the screen rectangle covering bounds.
+// Bounds crossing the eye plane are reported as infinitely large.
+float projected_size(
+	const Camera& camera, 
+	calc::Box3D bounds, 
+	calc::iVec2 viewport);
+
 }
 
+#endif
@@ -7,10 +7,36 @@
 namespace gfxconfig
 {
 
-static const std::string shader_dir{"E:\\repo\\GfxDemo\\asset\\shaders"};
-static const std::string asset_dir{"E:\\repo\\GfxDemo\\asset"};
-static calc::Vec3 point_light_pos{1,1,1};
-static calc::iVec2 winsize{1024,1024};
+#ifdef GFX_ASSET_DIR
+static const std::string asset_dir{GFX_ASSET_DIR};
+#else
+static const std::string asset_dir{"E:/repo/GfxDemo/asset"};
+#endif
+static const std::string shader_dir{asset_dir + "/shaders"};
+static constexpr calc::Vec3 point_light_pos{1,1,1};
+static constexpr calc::iVec2 winsize{1024,1024};
+static const std::string hair_file{asset_dir + "/woman_straight_hair/wStraight.ind"};
+static constexpr bool draw_hair{true};
+static constexpr calc::Vec3 hair_color{.35f,.22f,.12f};
+static constexpr float hair_width{.002f};
+static constexpr bool hair_shadow{true};
+static constexpr int hair_shadow_slices{8};
+static constexpr int hair_shadow_resolution{1024};
+static constexpr bool hair_shading_lut{true};
+// Evaluate Marschner per fragment, takes precedence over hair_shading_lut.
+static constexpr bool hair_shading_analytic{false};
+static constexpr bool hair_oit{true};
+static constexpr float hair_alpha{.6f};
+// Opaque hair only, hair_oit takes precedence.
+static constexpr bool hair_half_res{false};
+// Frustum and backface culling of fibers, for line strips.
+static constexpr bool hair_culling{true};
+// Compute shader strand rasterizer instead of line strips.
+static constexpr bool hair_strand_raster{false};
+// Bind roots to the head and re-evaluate the fibers every frame.
+static constexpr bool hair_root_binding{false};
+// Log the GPU time of each hair pass every this many frames, 0 disables.
+static constexpr int hair_timing_frames{300};
 
 }
 
@@ -3,9 +3,11 @@
 
 #include <string>
 #include <numeric>
+#include <memory>
 #include "utility.h"
 #include "GfxModel.h"
 #include "GfxDemo.h"
+#include "GfxRootBinding.h"
 #include "GfxInput.h"
 
 #include "glad/glad.h"
@@ -16,6 +18,22 @@
 
 using namespace std;
 
+// Latest GPU time of each hair pass.
+void log_hair_timings(const Renderer& renderer, const gfx::StrandRasterizer& raster)
+{
+	if (gfxconfig::hair_strand_raster) {
+		util::log_info(UTIL_FMT("hair ms: bin={:.3} raster={:.3}\n"),
+			raster.bin_timer().elapsed_ms(), raster.raster_timer().elapsed_ms());
+		return;
+	}
+	const auto& shadow = renderer.hair_shadow();
+	util::log_info(UTIL_FMT(
+		"hair ms: depth={:.3} opacity={:.3} hair={:.3} resolve={:.3} upsample={:.3}\n"),
+		shadow.depth_timer().elapsed_ms(), shadow.opacity_timer().elapsed_ms(),
+		renderer.hair_timer().elapsed_ms(), renderer.resolve_timer().elapsed_ms(),
+		renderer.upsample_timer().elapsed_ms());
+}
+
 int main()
 {
 	glfwInit();
@@ -25,20 +43,34 @@ int main()
 	glfwMakeContextCurrent(context);
 	gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
 
-	std::string obj_inputfile{gfxconfig::asset_dir + "\\woman\\woman.obj"};
+	std::string obj_inputfile{gfxconfig::asset_dir + "/woman/woman.obj"};
 	auto acode = gfx::vertex_attrib::PosNormUV;
 	auto placement = calc::Box3D{{0,0,0},{2,2,2}};
 
 	auto obj = gfx::Model::load_from_obj_file(obj_inputfile, gfx::vertex_attrib::PosNormUV);
 
-	util::print("{}\n", obj.num_parts());
-	util::print("#vert={}\n", obj.num_verts());
-
-	//std::string hair_inputfile{"F:\\repo\\GfxDemo\\asset\\woman_straight_hair\\wStraight.ind"};
-	//
-	//auto hair = gfx::Model::load_from_ind_file(hair_inputfile, gfx::vertex_attrib::PosTan);
-
-	//util::print("#hair groups={}\n", hair.num_parts());
+	util::log_info(UTIL_FMT("{}\n"), obj.num_parts());
+	util::log_info(UTIL_FMT("#vert={}\n"), obj.num_verts());
+
+	std::unique_ptr<gfx::Model> hair;
+	std::unique_ptr<gfx::HairCuller> hair_culler;
+	gfx::StrandRasterizer hair_raster{};
+	gfx::TriangleGrid head_grid{};
+	gfx::HairRootBinding hair_binding{};
+	if (gfxconfig::draw_hair) {
+		hair = std::make_unique<gfx::Model>(gfx::Model::load_from_ind_file(
+			gfxconfig::hair_file, gfx::vertex_attrib::PosTan));
+		util::log_info(UTIL_FMT("#hair groups={}\n"), hair->num_parts());
+
+		if (gfxconfig::hair_culling)
+			hair_culler = std::make_unique<gfx::HairCuller>(*hair);
+		if (gfxconfig::hair_strand_raster)
+			hair_raster.init(*hair);
+		if (gfxconfig::hair_root_binding) {
+			head_grid.build(obj);
+			hair_binding.bind(*hair, obj, head_grid);
+		}
+	}
 
 	Renderer renderer{};
 	renderer.init();
@@ -52,11 +84,32 @@ int main()
 
 	gfx::init_input_with_glfw(context);
 
+	int frame = 0;
 	while (!glfwWindowShouldClose(context)) {
 		glfwPollEvents();
 		gfx::fill_input_with_glfw(context, &input);
 		camera.process_input(input);
 		auto fbo = renderer.render(obj, camera);
+		if (hair) {
+			if (gfxconfig::hair_root_binding) {
+				// After moving the head vertices.
+				std::vector<calc::Vec3> hair_positions, hair_tangents;
+				hair_binding.evaluate(obj.positions(), hair_positions, hair_tangents);
+				hair->update_vertices(hair_positions, hair_tangents);
+				if (hair_culler)
+					hair_culler->update(*hair);
+				if (gfxconfig::hair_strand_raster)
+					hair_raster.update(*hair);
+			}
+			if (gfxconfig::hair_strand_raster)
+				fbo = renderer.render_hair_strands(*hair, camera, hair_raster);
+			else
+				fbo = renderer.render_hair(*hair, camera, hair_culler.get());
+
+			if (gfxconfig::hair_timing_frames > 0 &&
+				++frame % gfxconfig::hair_timing_frames == 0)
+				log_hair_timings(renderer, hair_raster);
+		}
 
 		glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
 		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
@@ -70,6 +123,7 @@ int main()
 		glfwSwapBuffers(context);
 	}
 
+	hair_raster.destroy();
 	renderer.destory_resource();
 
 	return 0;
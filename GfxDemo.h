@@ -7,11 +7,13 @@
 #include "glad/glad.h"
 #include "GfxCamera.h"
 #include "GfxModel.h"
+#include "GfxHair.h"
+#include "GfxMarschner.h"
 #include "GfxShader.h"
 #include "calc.h"
 #include "GfxConfig.h"
 
-void fbo_with_color_rgba8_texture_depth_24_renderbuffer(
+void fbo_with_color_rgba8_texture_depth_24_texture(
     calc::iVec2 size, GLuint* fbo, GLuint* color, GLuint* depth)
 {
 
@@ -23,16 +25,19 @@ void fbo_with_color_rgba8_texture_depth_24_renderbuffer(
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, size.x, size.y);
 
-	glGenRenderbuffers(1, depth);
-	glBindRenderbuffer(GL_RENDERBUFFER, *depth);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size.x, size.y);
-	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glGenTextures(1, depth);
+    glBindTexture(GL_TEXTURE_2D, *depth);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, size.x, size.y);
 
     glGenFramebuffers(1, fbo);
     glBindFramebuffer(GL_FRAMEBUFFER, *fbo);
 
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, *color, 0);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, *depth);  
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, *depth, 0);
 
     GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
     if(status != GL_FRAMEBUFFER_COMPLETE) {
@@ -41,26 +46,136 @@ void fbo_with_color_rgba8_texture_depth_24_renderbuffer(
     }
 }
 
+// Weighted blended OIT targets, sharing the depth texture of the
+// opaque pass so hair is still tested against the scene.
+void fbo_with_oit_textures(
+    calc::iVec2 size, GLuint depth, GLuint* fbo, GLuint* accum, GLuint* reveal)
+{
+    GLuint* textures[2] = { accum, reveal };
+    GLenum formats[2] = { GL_RGBA16F, GL_R16F };
+    for (int i = 0; i < 2; ++i) {
+        glGenTextures(1, textures[i]);
+        glBindTexture(GL_TEXTURE_2D, *textures[i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexStorage2D(GL_TEXTURE_2D, 1, formats[i], size.x, size.y);
+    }
+
+    glGenFramebuffers(1, fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, *fbo);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, *accum, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, *reveal, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+    GLenum draw_buffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, draw_buffers);
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if(status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "oit framebuffer incomplete.\n";
+        exit(1);
+    }
+}
+
+// Hair pipeline options, gfxconfig by default.
+class RendererSettings {
+public:
+    bool hair_shadow = gfxconfig::hair_shadow;
+    bool hair_shading_lut = gfxconfig::hair_shading_lut;
+    // Takes precedence over hair_shading_lut.
+    bool hair_shading_analytic = gfxconfig::hair_shading_analytic;
+    bool hair_oit = gfxconfig::hair_oit;
+    // Opaque hair only, hair_oit takes precedence.
+    bool hair_half_res = gfxconfig::hair_half_res;
+};
+
 class Renderer : public gfx::Shader {
 public:
 
     Renderer()
     {}
 
-    void init()
+    void init(const RendererSettings& settings = RendererSettings{})
     {
+        settings_ = settings;
+        const char* shading = "";
+        if (settings_.hair_shading_analytic)
+            shading = "#define MARSCHNER_ANALYTIC";
+        else if (settings_.hair_shading_lut)
+            shading = "#define MARSCHNER_LUT";
+
         program_ = gfx::create_glsl_program(
             std::unordered_map<std::string, std::string>{
                 {"version", "#version 450 core"}
             },
-            gfxconfig::shader_dir + "\\mesh_with_texture.glsl");
+            gfxconfig::shader_dir + "/mesh_with_texture.glsl");
+        hair_program_ = gfx::create_glsl_program(
+            std::unordered_map<std::string, std::string>{
+                {"version", "#version 450 core"},
+                {"shading", shading},
+                {"output", settings_.hair_oit ? 
+                    "#define OIT_OUTPUT" : ""}
+            },
+            gfxconfig::shader_dir + "/hair.glsl");
+        oit_resolve_program_ = gfx::create_glsl_program(
+            std::unordered_map<std::string, std::string>{
+                {"version", "#version 450 core"}
+            },
+            gfxconfig::shader_dir + "/oit_resolve.glsl");
+        upsample_program_ = gfx::create_glsl_program(
+            std::unordered_map<std::string, std::string>{
+                {"version", "#version 450 core"}
+            },
+            gfxconfig::shader_dir + "/hair_upsample.glsl");
+        glGenVertexArrays(1, &resolve_vao_);
+
+        if (settings_.hair_shading_lut && !settings_.hair_shading_analytic) {
+            hair_shading_lut_ = gfx::MarschnerLut::load_or_bake(
+                gfxconfig::asset_dir + "/hair_marschner.lut", 
+                hair_shading_params_, 128);
+            hair_shading_lut_.upload();
+        }
+
+        gfx::DeepOpacityMapSettings shadow_settings{};
+        shadow_settings.num_slices = gfxconfig::hair_shadow_slices;
+        shadow_settings.resolution = gfxconfig::hair_shadow_resolution;
+        hair_shadow_.init(shadow_settings);
     }
 
     void create_framebuffer(calc::iVec2 rtsize)
     {
-        fbo_with_color_rgba8_texture_depth_24_renderbuffer(
+        fbo_with_color_rgba8_texture_depth_24_texture(
             rtsize, &fbo_, &color_, &depth_);
+        fbo_with_oit_textures(rtsize, depth_, &oit_fbo_, &accum_, &reveal_);
         rtsize_ = rtsize;
+
+        ////
+        // Half resolution hair. half_depth_ is tested and
+        // written by the hair, half_scene_depth_ keeps the 
+        // scene alone for the upsample weights, which also
+        // read depth_, so the upsample writes color_ through
+        // composite_fbo_.
+        ////
+        half_rtsize_ = calc::iVec2{ (rtsize.x + 1) / 2, (rtsize.y + 1) / 2 };
+        fbo_with_color_rgba8_texture_depth_24_texture(
+            half_rtsize_, &half_fbo_, &half_color_, &half_depth_);
+
+        glGenTextures(1, &half_scene_depth_);
+        glBindTexture(GL_TEXTURE_2D, half_scene_depth_);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, 
+            half_rtsize_.x, half_rtsize_.y);
+
+        glGenFramebuffers(1, &composite_fbo_);
+        glBindFramebuffer(GL_FRAMEBUFFER, composite_fbo_);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color_, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "composite framebuffer incomplete.\n";
+            exit(1);
+        }
     }
 
 	GLuint render(gfx::Model& model, gfx::Camera& camera)
@@ -83,6 +198,8 @@ public:
         set_uniform(program_, "g_Eye", camera.pos());
         set_uniform(program_, "g_PointLightPos", gfxconfig::point_light_pos);
         set_uniform(program_, "g_LocalTransform", local_transform);
+        set_uniform(program_, "g_NormalTransform", 
+            calc::normal_matrix(calc::Affine3{local_transform}));
 
 		int num_parts = model.num_parts();
 
@@ -99,16 +216,246 @@ public:
 		return fbo_;
     }
 
+    // Draw hair over the current render target, without clearing it.
+    // With a culler, only the visible fibers of the LOD are drawn.
+    // RendererSettings::hair_half_res draws opaque hair at half resolution 
+    // and upsamples it; OIT hair is always drawn at full resolution.
+    GLuint render_hair(gfx::Model& hair, gfx::Camera& camera, 
+        gfx::HairCuller* culler = nullptr)
+    {
+        hair_lod_ = gfx::select_hair_lod(
+            hair, camera, rtsize_, hair_lod_settings_);
+
+        if (settings_.hair_shadow)
+            hair_shadow_.render(
+                hair, gfxconfig::point_light_pos, hair_lod_.num_fibers);
+
+        bool half_res = settings_.hair_half_res && !settings_.hair_oit;
+
+        hair_timer_.begin();
+
+        glViewport(0, 0, rtsize_.x, rtsize_.y);
+        glEnable(GL_DEPTH_TEST);
+
+        if (half_res) {
+            // Downsample the scene depth; the blits are timed with
+            // the hair, as they are part of the cost of this mode.
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo_);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, half_fbo_);
+            glBlitFramebuffer(0, 0, rtsize_.x, rtsize_.y, 
+                0, 0, half_rtsize_.x, half_rtsize_.y, 
+                GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+            glCopyImageSubData(half_depth_, GL_TEXTURE_2D, 0, 0, 0, 0, 
+                half_scene_depth_, GL_TEXTURE_2D, 0, 0, 0, 0, 
+                half_rtsize_.x, half_rtsize_.y, 1);
+
+            glBindFramebuffer(GL_FRAMEBUFFER, half_fbo_);
+            glViewport(0, 0, half_rtsize_.x, half_rtsize_.y);
+            const GLfloat zero[4] = { 0, 0, 0, 0 };
+            glClearBufferfv(GL_COLOR, 0, zero);
+        }
+        else if (settings_.hair_oit) {
+            ////
+            // Accumulate premultiplied color and revealage
+            // without depth writes, then composite over fbo_.
+            ////
+            glBindFramebuffer(GL_FRAMEBUFFER, oit_fbo_);
+            const GLfloat zero[4] = { 0, 0, 0, 0 }, one[4] = { 1, 1, 1, 1 };
+            glClearBufferfv(GL_COLOR, 0, zero);
+            glClearBufferfv(GL_COLOR, 1, one);
+
+            glDepthMask(GL_FALSE);
+            glEnable(GL_BLEND);
+            glBlendFunci(0, GL_ONE, GL_ONE);
+            glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+        }
+        else {
+            glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+        }
+
+        glUseProgram(hair_program_);
+
+        if (settings_.hair_shading_analytic) {
+            set_uniform(hair_program_, "g_MarschnerEta", hair_shading_params_.eta);
+            set_uniform(hair_program_, "g_MarschnerAbsorption", 
+                hair_shading_params_.absorption);
+            set_uniform(hair_program_, "g_MarschnerShift", hair_shading_params_.shift);
+            set_uniform(hair_program_, "g_MarschnerWidth", hair_shading_params_.width);
+        }
+        else if (settings_.hair_shading_lut)
+            hair_shading_lut_.bind();
+
+        if (settings_.hair_shadow)
+            hair_shadow_.bind(hair_program_);
+        else
+            set_uniform(hair_program_, "g_DomEnabled", 0);
+
+        set_uniform(hair_program_, "g_WorldTransform", camera.world_transform());
+        set_uniform(hair_program_, "g_Eye", camera.pos());
+        set_uniform(hair_program_, "g_PointLightPos", gfxconfig::point_light_pos);
+        set_uniform(hair_program_, "g_LocalTransform", hair.local_transform());
+        set_uniform(hair_program_, "g_HairColor", gfxconfig::hair_color);
+        set_uniform(hair_program_, "g_HairWidth", 
+            gfxconfig::hair_width * hair_lod_.width_scale);
+        set_uniform(hair_program_, "g_HairAlpha", gfxconfig::hair_alpha);
+
+		hair.bind_mesh();
+		if (culler) {
+			float width = gfxconfig::hair_width * hair_lod_.width_scale;
+			const auto& commands = culler->cull(
+				hair, camera, hair_lod_.num_fibers, .5f * width);
+			if (indirect_buffer_ == 0)
+				glGenBuffers(1, &indirect_buffer_);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer_);
+			glBufferData(GL_DRAW_INDIRECT_BUFFER, 
+				commands.size() * sizeof(commands[0]), 
+				commands.data(), GL_STREAM_DRAW);
+			hair.multi_draw_indirect(commands.size());
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		}
+		else {
+			for (int p = 0; p < hair.num_parts(); ++p)
+				hair.draw(p, hair_lod_.num_fibers);
+		}
+		hair.unbind_mesh();
+
+        hair_timer_.end();
+
+        if (settings_.hair_oit) {
+            resolve_timer_.begin();
+            glDepthMask(GL_TRUE);
+            glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+            glDisable(GL_DEPTH_TEST);
+            glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
+
+            glUseProgram(oit_resolve_program_);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, accum_);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, reveal_);
+            glActiveTexture(GL_TEXTURE0);
+
+            glBindVertexArray(resolve_vao_);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glBindVertexArray(0);
+
+            glDisable(GL_BLEND);
+            glEnable(GL_DEPTH_TEST);
+            resolve_timer_.end();
+        }
+        else if (half_res) {
+            ////
+            // Joint bilateral upsample. Hair is premultiplied by
+            // coverage in half_color_, as it was cleared to zero.
+            ////
+            upsample_timer_.begin();
+            glBindFramebuffer(GL_FRAMEBUFFER, composite_fbo_);
+            glViewport(0, 0, rtsize_.x, rtsize_.y);
+            glDisable(GL_DEPTH_TEST);
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+            glUseProgram(upsample_program_);
+            set_uniform(upsample_program_, "g_InvWorldTransform", 
+                calc::inv(camera.world_transform()));
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, half_color_);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, half_scene_depth_);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, depth_);
+            glActiveTexture(GL_TEXTURE0);
+
+            glBindVertexArray(resolve_vao_);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glBindVertexArray(0);
+
+            glDisable(GL_BLEND);
+            glEnable(GL_DEPTH_TEST);
+            upsample_timer_.end();
+        }
+		return fbo_;
+    }
+
+    // Draw hair with the compute strand rasterizer instead of 
+    // line strips, blended over the current render target.
+    GLuint render_hair_strands(gfx::Model& hair, gfx::Camera& camera, 
+        gfx::StrandRasterizer& raster)
+    {
+        hair_lod_ = gfx::select_hair_lod(
+            hair, camera, rtsize_, hair_lod_settings_);
+
+        gfx::StrandShading shading{};
+        shading.light_pos = gfxconfig::point_light_pos;
+        shading.color = gfxconfig::hair_color;
+        shading.width = gfxconfig::hair_width * hair_lod_.width_scale;
+        shading.alpha = gfxconfig::hair_alpha;
+        raster.render(hair, camera, hair_lod_.num_fibers, shading, 
+            color_, depth_, rtsize_);
+        return fbo_;
+    }
+
+    gfx::HairLodSettings& hair_lod_settings() { return hair_lod_settings_; }
+    const gfx::HairLod& hair_lod() const { return hair_lod_; }
+    const gfx::DeepOpacityMap& hair_shadow() const { return hair_shadow_; }
+    const gfx::GpuTimer& hair_timer() const { return hair_timer_; }
+    const gfx::GpuTimer& resolve_timer() const { return resolve_timer_; }
+    const gfx::GpuTimer& upsample_timer() const { return upsample_timer_; }
+
     void destory_resource()
     {
         glDeleteProgram(program_);
+        glDeleteProgram(hair_program_);
+        glDeleteBuffers(1, &indirect_buffer_);
+        hair_shadow_.destroy();
+        hair_shading_lut_.destroy();
+        hair_timer_.destroy();
+        glDeleteProgram(oit_resolve_program_);
+        glDeleteVertexArrays(1, &resolve_vao_);
+        resolve_timer_.destroy();
+        glDeleteFramebuffers(1, &oit_fbo_);
+        glDeleteTextures(1, &accum_);
+        glDeleteTextures(1, &reveal_);
+        glDeleteProgram(upsample_program_);
+        upsample_timer_.destroy();
+        glDeleteFramebuffers(1, &half_fbo_);
+        glDeleteFramebuffers(1, &composite_fbo_);
+        glDeleteTextures(1, &half_color_);
+        glDeleteTextures(1, &half_depth_);
+        glDeleteTextures(1, &half_scene_depth_);
         glDeleteFramebuffers(1, &fbo_);
         glDeleteTextures(1, &color_);
         glDeleteTextures(1, &depth_);
     }
 
+    const RendererSettings& settings() const { return settings_; }
+
 private:
+    RendererSettings settings_;
     GLuint program_ = 0;
+    GLuint hair_program_ = 0;
+
+    gfx::HairLodSettings hair_lod_settings_;
+    gfx::HairLod hair_lod_{};
+    GLuint indirect_buffer_ = 0;
+    gfx::DeepOpacityMap hair_shadow_;
+    gfx::MarschnerParams hair_shading_params_;
+    gfx::MarschnerLut hair_shading_lut_;
+    gfx::GpuTimer hair_timer_;
+
+    // Weighted blended OIT
+    GLuint oit_resolve_program_ = 0;
+    GLuint resolve_vao_ = 0;
+    GLuint oit_fbo_ = 0, accum_ = 0, reveal_ = 0;
+    gfx::GpuTimer resolve_timer_;
+
+    // Half resolution hair
+    GLuint upsample_program_ = 0;
+    calc::iVec2 half_rtsize_;
+    GLuint half_fbo_ = 0, half_color_ = 0, half_depth_ = 0;
+    GLuint half_scene_depth_ = 0;
+    GLuint composite_fbo_ = 0;
+    gfx::GpuTimer upsample_timer_;
 
     // Render target
     calc::iVec2 rtsize_;
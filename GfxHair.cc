@@ -0,0 +1,508 @@
+#include "GfxHair.h"
+
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+#include <iostream>
+
+#include "calc.h"
+#include "utility.h"
+#include "GfxConfig.h"
+
+namespace gfx
+{
+
+HairLod select_hair_lod(
+	const Model& hair, 
+	const Camera& camera, 
+	calc::iVec2 viewport,
+	const HairLodSettings& settings)
+{
+	int total = hair.num_fibers();
+	auto size = projected_size(camera, hair.bounds(), viewport);
+
+	float ratio = calc::clamp(size / settings.full_detail_size, 
+		settings.min_fiber_ratio, 1.f);
+
+	HairLod lod{};
+	lod.num_fibers = std::max(1, 
+		static_cast<int>(std::ceil(ratio * total)));
+	lod.num_fibers = std::min(lod.num_fibers, total);
+
+	// Coverage of N strands of width w is about N*w.
+	lod.width_scale = std::min(settings.max_width_scale,
+		static_cast<float>(total) / std::max(1, lod.num_fibers));
+
+	return lod;
+}
+
+enum FiberVisibility : unsigned char {
+	Visible = 0,
+	FrustumCulled = 1,
+	BackfaceCulled = 2
+};
+
+HairCuller::HairCuller(const Model& hair)
+{
+	update(hair);
+}
+
+void HairCuller::update(const Model& hair)
+{
+	int num_fibers = hair.num_fibers();
+	const auto& positions = hair.positions();
+
+	centers_.resize(num_fibers);
+	for (auto* soa : { &radius_, &root_x_, &root_y_, &root_z_,
+			&axis_x_, &axis_y_, &axis_z_, &cutoff_ })
+		soa->resize(num_fibers);
+
+	util::parallel_for(0, num_fibers, 256, [&](int lo, int hi) {
+		for (int f = lo; f < hi; ++f) {
+			const auto& fiber = hair.fiber(f);
+			const auto* verts = &positions[fiber.vstart];
+
+			calc::Box3D box{};
+			for (int v = 0; v < fiber.vcount; ++v)
+				box.update(verts[v]);
+			auto center = box.center();
+			float radius = 0.f;
+			for (int v = 0; v < fiber.vcount; ++v)
+				radius = std::max(radius, calc::length(verts[v] - center));
+
+			// The first segment approximates the scalp normal at the root.
+			auto root = verts[0];
+			auto axis = calc::normalize(verts[1] - verts[0]);
+
+			// Cone of directions from the root covering the whole strand.
+			float cos_spread = 1.f;
+			for (int v = 1; v < fiber.vcount; ++v) {
+				auto d = verts[v] - root;
+				auto len = calc::length(d);
+				if (len > calc::eps)
+					cos_spread = std::min(cos_spread, calc::dot(axis, d) / len);
+			}
+
+			centers_[f] = center;
+			radius_[f] = radius;
+			root_x_[f] = root.x;
+			root_y_[f] = root.y;
+			root_z_[f] = root.z;
+			axis_x_[f] = axis.x;
+			axis_y_[f] = axis.y;
+			axis_z_[f] = axis.z;
+			// Culled if the eye sees the root from behind by more than 
+			// the spread. Spreads over 90 degrees are never culled.
+			cutoff_[f] = cos_spread > 0.f ? 
+				std::sqrt(1.f - cos_spread * cos_spread) : 2.f;
+		}
+	});
+}
+
+const std::vector<DrawElementsIndirectCommand>& HairCuller::cull(
+	const Model& hair, 
+	const Camera& camera, 
+	int num_fibers, 
+	float pad)
+{
+	num_fibers = std::min(num_fibers, static_cast<int>(radius_.size()));
+	num_fibers = std::max(num_fibers, 0);
+
+	// Frustum in model space, moved out by pad to widen the spheres.
+	auto local_transform = hair.local_transform();
+	calc::Frustum frustum{ calc::dot(camera.world_transform(), local_transform) };
+	frustum_mask_.resize((num_fibers + 7) / 8);
+	calc::visible_mask(calc::expand(frustum, pad), centers_.data(), radius_.data(),
+		num_fibers, frustum_mask_.data());
+
+	auto eye = calc::point_transform(
+		calc::inv(calc::Affine3{ local_transform }), camera.pos());
+
+	visibility_.resize(num_fibers);
+	for (int f = 0; f < num_fibers; ++f) {
+		unsigned char visibility = 
+			frustum_mask_[f / 8] >> f % 8 & 1 ? Visible : FrustumCulled;
+
+		float vx = root_x_[f] - eye.x;
+		float vy = root_y_[f] - eye.y;
+		float vz = root_z_[f] - eye.z;
+		float cos_view = vx * axis_x_[f] + vy * axis_y_[f] + vz * axis_z_[f];
+		float view_len = std::sqrt(vx * vx + vy * vy + vz * vz);
+		if (visibility == Visible && cos_view >= cutoff_[f] * view_len)
+			visibility = BackfaceCulled;
+
+		visibility_[f] = visibility;
+	}
+
+	// Compact, merging runs of visible fibers into one command, since 
+	// neighbouring fibers are separated by the primitive restart index.
+	commands_.clear();
+	stats_ = HairCullStats{};
+	stats_.num_tested = num_fibers;
+	for (int f = 0; f < num_fibers; ++f) {
+		if (visibility_[f] == FrustumCulled) {
+			stats_.num_frustum_culled++;
+			continue;
+		}
+		if (visibility_[f] == BackfaceCulled) {
+			stats_.num_backface_culled++;
+			continue;
+		}
+		stats_.num_drawn++;
+
+		const auto& fiber = hair.fiber(f);
+		if (f > 0 && visibility_[f-1] == Visible) {
+			auto& command = commands_.back();
+			command.count = fiber.istart + fiber.icount - command.first_index;
+			continue;
+		}
+
+		DrawElementsIndirectCommand command{};
+		command.count = fiber.icount;
+		command.instance_count = 1;
+		command.first_index = fiber.istart;
+		commands_.push_back(command);
+	}
+
+	return commands_;
+}
+
+void DeepOpacityMap::init(const DeepOpacityMapSettings& settings)
+{
+	settings_ = settings;
+	num_slice_groups_ = std::min(4, std::max(1, (settings.num_slices + 3) / 4));
+	settings_.num_slices = 4 * num_slice_groups_;
+	int res = settings_.resolution;
+
+	depth_program_ = create_glsl_program(
+		std::unordered_map<std::string, std::string>{
+			{"version", "#version 450 core"},
+			{"pass", "#define DEPTH_PASS"}
+		},
+		gfxconfig::shader_dir + "/hair_deep_opacity.glsl");
+	opacity_program_ = create_glsl_program(
+		std::unordered_map<std::string, std::string>{
+			{"version", "#version 450 core"},
+			{"pass", "#define NUM_SLICE_GROUPS " + std::to_string(num_slice_groups_)}
+		},
+		gfxconfig::shader_dir + "/hair_deep_opacity.glsl");
+
+	glGenTextures(1, &depth_);
+	glBindTexture(GL_TEXTURE_2D, depth_);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, res, res);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+	glGenFramebuffers(1, &depth_fbo_);
+	glBindFramebuffer(GL_FRAMEBUFFER, depth_fbo_);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, depth_, 0);
+
+	glGenTextures(1, &opacity_);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, opacity_);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA16F, res, res, num_slice_groups_);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+	glGenFramebuffers(1, &opacity_fbo_);
+	glBindFramebuffer(GL_FRAMEBUFFER, opacity_fbo_);
+	std::vector<GLenum> draw_buffers;
+	for (int g = 0; g < num_slice_groups_; ++g) {
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, 
+			GL_COLOR_ATTACHMENT0 + g, opacity_, 0, g);
+		draw_buffers.push_back(GL_COLOR_ATTACHMENT0 + g);
+	}
+	glDrawBuffers(draw_buffers.size(), draw_buffers.data());
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "deep opacity map framebuffer incomplete.\n";
+		exit(1);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void DeepOpacityMap::render(
+	Model& hair, const calc::Vec3& light_pos, int num_fibers)
+{
+	// Fit a perspective frustum around the bounding sphere of the hair.
+	auto bounds = hair.bounds();
+	auto center = bounds.center();
+	float radius = .5f * calc::length(bounds.size());
+	float dist = calc::length(center - light_pos);
+
+	auto forward = calc::normalize(center - light_pos);
+	calc::Vec3 up{ 0, 1, 0 };
+	if (std::abs(calc::dot(forward, up)) > .99f)
+		up = calc::Vec3{ 1, 0, 0 };
+
+	float fovy = dist > radius ? 
+		2.f * std::asin(radius / dist) : calc::to_radian(120.f);
+	float nearp = std::max(dist - radius, 1e-3f * radius);
+	float farp = dist + radius;
+	light_transform_ = calc::dot(
+		calc::projective_transform(fovy, 1.f, nearp, farp),
+		calc::lookat(light_pos, center, up));
+	layer_depth_ = settings_.depth_range * 2.f * radius / settings_.num_slices;
+
+	int res = settings_.resolution;
+	glViewport(0, 0, res, res);
+	glDisable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+
+	hair.bind_mesh();
+
+	// Nearest hair.
+	depth_timer_.begin();
+	glBindFramebuffer(GL_FRAMEBUFFER, depth_fbo_);
+	GLfloat far_depth[] = { std::numeric_limits<float>::max(), 0, 0, 0 };
+	glClearBufferfv(GL_COLOR, 0, far_depth);
+	glBlendEquation(GL_MIN);
+	glUseProgram(depth_program_);
+	set_uniform(depth_program_, "g_LocalTransform", hair.local_transform());
+	set_uniform(depth_program_, "g_LightTransform", light_transform_);
+	set_uniform(depth_program_, "g_LightPos", light_pos);
+	for (int p = 0; p < hair.num_parts(); ++p)
+		hair.draw(p, num_fibers);
+	depth_timer_.end();
+
+	// Opacity slices.
+	opacity_timer_.begin();
+	glBindFramebuffer(GL_FRAMEBUFFER, opacity_fbo_);
+	GLfloat zeros[] = { 0, 0, 0, 0 };
+	for (int g = 0; g < num_slice_groups_; ++g)
+		glClearBufferfv(GL_COLOR, g, zeros);
+	glBlendEquation(GL_FUNC_ADD);
+	glBlendFunc(GL_ONE, GL_ONE);
+	glUseProgram(opacity_program_);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, depth_);
+	set_uniform(opacity_program_, "g_DomDepth", 0);
+	set_uniform(opacity_program_, "g_LocalTransform", hair.local_transform());
+	set_uniform(opacity_program_, "g_LightTransform", light_transform_);
+	set_uniform(opacity_program_, "g_LightPos", light_pos);
+	set_uniform(opacity_program_, "g_DomLayerDepth", layer_depth_);
+	set_uniform(opacity_program_, "g_HairOpacity", settings_.strand_opacity);
+	for (int p = 0; p < hair.num_parts(); ++p)
+		hair.draw(p, num_fibers);
+	opacity_timer_.end();
+
+	hair.unbind_mesh();
+
+	glDisable(GL_BLEND);
+	glEnable(GL_DEPTH_TEST);
+}
+
+void DeepOpacityMap::bind(GLuint program)
+{
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, depth_);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, opacity_);
+	glActiveTexture(GL_TEXTURE0);
+
+	set_uniform(program, "g_DomEnabled", 1);
+	set_uniform(program, "g_DomNumSlices", settings_.num_slices);
+	set_uniform(program, "g_DomLayerDepth", layer_depth_);
+	set_uniform(program, "g_LightTransform", light_transform_);
+}
+
+void DeepOpacityMap::destroy()
+{
+	glDeleteProgram(depth_program_);
+	glDeleteProgram(opacity_program_);
+	glDeleteFramebuffers(1, &depth_fbo_);
+	glDeleteFramebuffers(1, &opacity_fbo_);
+	glDeleteTextures(1, &depth_);
+	glDeleteTextures(1, &opacity_);
+	depth_timer_.destroy();
+	opacity_timer_.destroy();
+}
+
+GLuint create_storage_buffer(std::size_t size, const void* data = nullptr)
+{
+	GLuint buffer;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, size, data, 
+		data ? GL_STATIC_DRAW : GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	return buffer;
+}
+
+// Segments in fiber order, so a LOD is a prefix. fiber_segments 
+// gets the number of segments of the first f fibers.
+void strand_segments(const Model& hair, 
+	std::vector<calc::Vec4>& segments, std::vector<int>& fiber_segments)
+{
+	const auto& positions = hair.positions();
+	segments.clear();
+	fiber_segments.assign(1, 0);
+	for (int f = 0; f < hair.num_fibers(); ++f) {
+		const auto& fiber = hair.fiber(f);
+		for (int v = fiber.vstart + 1; v < fiber.vstart + fiber.vcount; ++v) {
+			const auto& a = positions[v - 1];
+			const auto& b = positions[v];
+			segments.push_back(calc::Vec4{ a.x, a.y, a.z, 1.f });
+			segments.push_back(calc::Vec4{ b.x, b.y, b.z, 1.f });
+		}
+		fiber_segments.push_back(static_cast<int>(segments.size() / 2));
+	}
+}
+
+void StrandRasterizer::init(const Model& hair, const StrandRasterSettings& settings)
+{
+	settings_ = settings;
+
+	auto create_pass = [](const std::string& pass) {
+		return create_glsl_program(
+			std::unordered_map<std::string, std::string>{
+				{"version", "#version 450 core"},
+				{"pass", "#define " + pass}
+			},
+			gfxconfig::shader_dir + "/hair_strand_raster.glsl");
+	};
+	bin_program_ = create_pass("BIN_PASS");
+	scan_program_ = create_pass("SCAN_PASS");
+	fill_program_ = create_pass("FILL_PASS");
+	raster_program_ = create_pass("RASTER_PASS");
+
+	std::vector<calc::Vec4> segments;
+	strand_segments(hair, segments, fiber_segments_);
+	segments_ = create_storage_buffer(
+		segments.size() * sizeof(segments[0]), segments.data());
+	projected_ = create_storage_buffer(
+		3 * fiber_segments_.back() * sizeof(calc::Vec4));
+	tile_entries_ = create_storage_buffer(
+		settings_.max_tile_entries * sizeof(GLuint));
+}
+
+void StrandRasterizer::update(const Model& hair)
+{
+	std::vector<calc::Vec4> segments;
+	std::vector<int> fiber_segments;
+	strand_segments(hair, segments, fiber_segments);
+	assert(fiber_segments == fiber_segments_);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, segments_);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, 
+		segments.size() * sizeof(segments[0]), segments.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void StrandRasterizer::render(
+	const Model& hair, 
+	const Camera& camera, 
+	int num_fibers, 
+	const StrandShading& shading,
+	GLuint color, 
+	GLuint depth, 
+	calc::iVec2 size)
+{
+	if (size.x != size_.x || size.y != size_.y) {
+		glDeleteBuffers(1, &tile_counts_);
+		glDeleteBuffers(1, &tile_offsets_);
+		glDeleteBuffers(1, &tile_cursors_);
+		size_ = size;
+		num_tiles_ = calc::iVec2{ 
+			(size.x + tile_size_ - 1) / tile_size_, 
+			(size.y + tile_size_ - 1) / tile_size_ };
+		std::size_t bytes = num_tiles_.x * num_tiles_.y * sizeof(GLuint);
+		tile_counts_ = create_storage_buffer(bytes);
+		tile_offsets_ = create_storage_buffer(bytes);
+		tile_cursors_ = create_storage_buffer(bytes);
+	}
+
+	num_fibers = std::min(num_fibers, hair.num_fibers());
+	int num_segments = fiber_segments_[num_fibers];
+	GLuint num_groups = (num_segments + 255) / 256;
+
+	GLuint buffers[] = { segments_, projected_, 
+		tile_counts_, tile_offsets_, tile_cursors_, tile_entries_ };
+	for (int b = 0; b < 6; ++b)
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, b, buffers[b]);
+
+	// Pixels per unit length at unit distance, from the 
+	// second row of the projection.
+	auto world = camera.world_transform();
+	float pixel_scale = .5f * size.y * calc::length(
+		calc::Vec3{ world[0][1], world[1][1], world[2][1] });
+	calc::Vec2 viewport{ static_cast<float>(size.x), static_cast<float>(size.y) };
+
+	auto set_common = [&](GLuint program) {
+		glUseProgram(program);
+		set_uniform(program, "g_NumSegments", num_segments);
+		set_uniform(program, "g_NumTilesX", num_tiles_.x);
+		set_uniform(program, "g_NumTilesY", num_tiles_.y);
+		set_uniform(program, "g_MaxTileEntries", settings_.max_tile_entries);
+		set_uniform(program, "g_Viewport", viewport);
+	};
+
+	bin_timer_.begin();
+
+	GLuint zero = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, tile_counts_);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 
+		GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	set_common(bin_program_);
+	set_uniform(bin_program_, "g_LocalTransform", hair.local_transform());
+	set_uniform(bin_program_, "g_WorldTransform", world);
+	set_uniform(bin_program_, "g_Eye", camera.pos());
+	set_uniform(bin_program_, "g_PointLightPos", shading.light_pos);
+	set_uniform(bin_program_, "g_HairColor", shading.color);
+	set_uniform(bin_program_, "g_HairWidth", shading.width);
+	set_uniform(bin_program_, "g_PixelScale", pixel_scale);
+	if (num_groups > 0)
+		glDispatchCompute(num_groups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	set_common(scan_program_);
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	set_common(fill_program_);
+	if (num_groups > 0)
+		glDispatchCompute(num_groups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	bin_timer_.end();
+
+	raster_timer_.begin();
+	set_common(raster_program_);
+	set_uniform(raster_program_, "g_HairAlpha", shading.alpha);
+	glBindImageTexture(0, color, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA8);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, depth);
+	glDispatchCompute(num_tiles_.x, num_tiles_.y, 1);
+	glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT | 
+		GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	raster_timer_.end();
+
+	glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA8);
+	for (int b = 0; b < 6; ++b)
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, b, 0);
+}
+
+void StrandRasterizer::destroy()
+{
+	glDeleteProgram(bin_program_);
+	glDeleteProgram(scan_program_);
+	glDeleteProgram(fill_program_);
+	glDeleteProgram(raster_program_);
+	GLuint buffers[] = { segments_, projected_, 
+		tile_counts_, tile_offsets_, tile_cursors_, tile_entries_ };
+	glDeleteBuffers(6, buffers);
+	segments_ = projected_ = tile_entries_ = 0;
+	tile_counts_ = tile_offsets_ = tile_cursors_ = 0;
+	size_ = calc::iVec2{ 0, 0 };
+	bin_timer_.destroy();
+	raster_timer_.destroy();
+}
+
+}
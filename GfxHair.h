@@ -0,0 +1,217 @@
+#ifndef GFX_HAIR_H
+#define GFX_HAIR_H
+
+#include "calc.h"
+#include "GfxCamera.h"
+#include "GfxModel.h"
+#include "GfxShader.h"
+#include "GfxTimer.h"
+
+#include <vector>
+
+namespace gfx
+{
+
+////
+// Strand LOD. Fibers are shuffled at load, so a 
+// LOD is a prefix of the fibers. The remaining 
+// strands are widened to keep the coverage of 
+// the full groom.
+////
+
+class HairLodSettings {
+public:
+	// Projected size(px) at which all fibers are drawn.
+	float full_detail_size = 512.f;
+	float min_fiber_ratio = .05f;
+	float max_width_scale = 8.f;
+};
+
+class HairLod {
+public:
+	int num_fibers;
+	float width_scale;
+};
+
+HairLod select_hair_lod(
+	const Model& hair, 
+	const Camera& camera, 
+	calc::iVec2 viewport,
+	const HairLodSettings& settings = HairLodSettings{});
+
+////
+// Strand visibility culling. Each fiber gets a 
+// bounding sphere and a cone of directions from 
+// its root, both in model space. A fiber is culled 
+// if its sphere is outside the frustum, or if the 
+// whole strand lies behind its root as seen from 
+// the eye, i.e. hidden by the head.
+////
+
+class HairCullStats {
+public:
+	int num_tested;
+	int num_drawn;
+	int num_frustum_culled;
+	int num_backface_culled;
+};
+
+class HairCuller {
+public:
+
+	explicit HairCuller(const Model& hair);
+
+	// Recompute the spheres and cones after the fibers moved,
+	// e.g. by Model::update_vertices.
+	void update(const Model& hair);
+
+	// Cull the first num_fibers fibers and compact the visible ones 
+	// into draw commands. pad widens the bounding spheres.
+	const std::vector<DrawElementsIndirectCommand>& cull(
+		const Model& hair, 
+		const Camera& camera, 
+		int num_fibers, 
+		float pad = 0.f);
+
+	const HairCullStats& stats() const { return stats_; }
+
+private:
+
+	// Bounding spheres, for calc::visible_mask.
+	std::vector<calc::Vec3> centers_;
+	std::vector<float> radius_;
+	// SoA, so the per-fiber tests vectorize.
+	std::vector<float> root_x_, root_y_, root_z_;
+	std::vector<float> axis_x_, axis_y_, axis_z_, cutoff_;
+
+	// Bit f % 8 of byte f / 8 set if fiber f is in the frustum.
+	std::vector<unsigned char> frustum_mask_;
+	std::vector<unsigned char> visibility_;
+	std::vector<DrawElementsIndirectCommand> commands_;
+	HairCullStats stats_{};
+};
+
+////
+// Deep opacity maps for hair self-shadowing.
+// Hair is rendered from the light twice: first 
+// the distance to the nearest strand, then the 
+// opacity accumulated into slices starting at 
+// that distance. The frustum and slices are fit 
+// to the hair bounds.
+////
+
+class DeepOpacityMapSettings {
+public:
+	// At most 16, in groups of four per render target.
+	int num_slices = 8;
+	int resolution = 1024;
+	// Depth covered by all slices, relative to the hair diameter.
+	float depth_range = .5f;
+	// Opacity of a single strand fragment.
+	float strand_opacity = .1f;
+};
+
+class DeepOpacityMap : public Shader {
+public:
+
+	DeepOpacityMap() {}
+
+	void init(const DeepOpacityMapSettings& settings);
+
+	void render(Model& hair, const calc::Vec3& light_pos, int num_fibers);
+
+	// Bind maps to texture units 1 and 2, and set lookup uniforms.
+	void bind(GLuint program);
+
+	const GpuTimer& depth_timer() const { return depth_timer_; }
+	const GpuTimer& opacity_timer() const { return opacity_timer_; }
+
+	void destroy();
+
+private:
+
+	DeepOpacityMapSettings settings_;
+	int num_slice_groups_ = 0;
+	calc::Mat4 light_transform_;
+	float layer_depth_ = 1.f;
+
+	GLuint depth_program_ = 0, opacity_program_ = 0;
+	GLuint depth_fbo_ = 0, depth_ = 0;
+	GLuint opacity_fbo_ = 0, opacity_ = 0;
+
+	GpuTimer depth_timer_, opacity_timer_;
+};
+
+////
+// Compute shader strand rasterizer. Segments are
+// binned into 16x16 pixel tiles, then each tile
+// is rasterized by one workgroup, with segments
+// staged in shared memory and analytic coverage
+// of the strand cross section. Fragments are 
+// blended order independently and composited 
+// over the color target.
+////
+
+class StrandRasterSettings {
+public:
+	// Capacity of the tile lists, segments past it are dropped.
+	int max_tile_entries = 1 << 22;
+};
+
+class StrandShading {
+public:
+	calc::Vec3 light_pos;
+	calc::Vec3 color;
+	float width;
+	float alpha;
+};
+
+class StrandRasterizer : public Shader {
+public:
+
+	StrandRasterizer() {}
+
+	void init(const Model& hair, const StrandRasterSettings& settings = StrandRasterSettings{});
+
+	// Upload the segments again after the fibers moved. The
+	// fibers and their vertex counts must not change.
+	void update(const Model& hair);
+
+	// Composite the first num_fibers fibers over color, an RGBA8 
+	// texture, depth testing against depth, a depth texture.
+	void render(
+		const Model& hair, 
+		const Camera& camera, 
+		int num_fibers, 
+		const StrandShading& shading,
+		GLuint color, 
+		GLuint depth, 
+		calc::iVec2 size);
+
+	const GpuTimer& bin_timer() const { return bin_timer_; }
+	const GpuTimer& raster_timer() const { return raster_timer_; }
+
+	void destroy();
+
+private:
+
+	static constexpr int tile_size_ = 16;
+
+	StrandRasterSettings settings_;
+	// Segments of the first f fibers.
+	std::vector<int> fiber_segments_;
+	calc::iVec2 size_{ 0, 0 };
+	calc::iVec2 num_tiles_{ 0, 0 };
+
+	GLuint bin_program_ = 0, scan_program_ = 0;
+	GLuint fill_program_ = 0, raster_program_ = 0;
+	GLuint segments_ = 0, projected_ = 0;
+	GLuint tile_counts_ = 0, tile_offsets_ = 0, tile_cursors_ = 0;
+	GLuint tile_entries_ = 0;
+
+	GpuTimer bin_timer_, raster_timer_;
+};
+
+}
+
+#endif
@@ -0,0 +1,295 @@
+#include "GfxMarschner.h"
+
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "calc.h"
+#include "utility.h"
+
+namespace gfx
+{
+
+float marschner_gaussian(float width, float x)
+{
+	return std::exp(-.5f * x * x / (width * width)) /
+		(width * std::sqrt(2.f * calc::pi));
+}
+
+// Fresnel reflectance at incidence angle gamma, with eta_perp and
+// eta_par for the two polarizations. Marschner et al. 2003, B.3.
+float marschner_fresnel(float eta_perp, float eta_par, float gamma)
+{
+	float cos_i = std::cos(gamma), sin_i = std::sin(gamma);
+
+	float sin_t = sin_i / eta_perp;
+	if (sin_t >= 1.f)
+		return 1.f;
+	float cos_t = std::sqrt(1.f - sin_t * sin_t);
+	float rs = (cos_i - eta_perp * cos_t) / (cos_i + eta_perp * cos_t);
+
+	sin_t = sin_i / eta_par;
+	if (sin_t >= 1.f)
+		return 1.f;
+	cos_t = std::sqrt(1.f - sin_t * sin_t);
+	float rp = (eta_par * cos_i - cos_t) / (eta_par * cos_i + cos_t);
+
+	return .5f * (rs * rs + rp * rp);
+}
+
+// Real roots of a*x^3 + b*x + d = 0 in [-pi/2, pi/2].
+int marschner_roots(float a, float b, float d, float roots[3])
+{
+	int count = 0;
+	auto add = [&](float x) {
+		if (std::abs(x) <= .5f * calc::pi)
+			roots[count++] = x;
+	};
+
+	if (std::abs(a) < 1e-6f) {
+		add(-d / b);
+		return count;
+	}
+
+	// Depressed cubic x^3 + p*x + q = 0.
+	float p = b / a, q = d / a;
+	float delta = .25f * q * q + p * p * p / 27.f;
+	if (delta > 0.f) {
+		float s = std::sqrt(delta);
+		add(std::cbrt(-.5f * q + s) + std::cbrt(-.5f * q - s));
+		return count;
+	}
+
+	float r = 2.f * std::sqrt(-p / 3.f);
+	float phi = std::acos(calc::clamp(
+		1.5f * q / p * std::sqrt(-3.f / p), -1.f, 1.f)) / 3.f;
+	for (int k = 0; k < 3; ++k)
+		add(r * std::cos(phi - 2.f * calc::pi * k / 3.f));
+	return count;
+}
+
+// Azimuthal scattering N_p(phi) for one color channel.
+float marschner_azimuthal(
+	int p, float phi, float eta_perp, float eta_par, float absorption)
+{
+	////
+	// Exit azimuth as a cubic in the incident offset
+	// gamma_i: phi(p, gamma_i) = a*gamma_i^3 + b*gamma_i
+	// + p*pi. Sum over all gamma_i that exit at phi,
+	// for every turn of phi.
+	////
+
+	float c = std::asin(1.f / eta_perp);
+	float a = -8.f * p * c / (calc::pi * calc::pi * calc::pi);
+	float b = 6.f * p * c / calc::pi - 2.f;
+
+	float sum = 0.f;
+	for (int k = -2; k <= 2; ++k) {
+		float roots[3];
+		int num_roots = marschner_roots(
+			a, b, p * calc::pi - phi - 2.f * calc::pi * k, roots);
+
+		for (int r = 0; r < num_roots; ++r) {
+			float gamma_i = roots[r];
+			float f = marschner_fresnel(eta_perp, eta_par, gamma_i);
+
+			float attenuation = f;
+			if (p > 0) {
+				float gamma_t = std::asin(std::sin(gamma_i) / eta_perp);
+				float transmit = std::exp(
+					-2.f * absorption * (1.f + std::cos(2.f * gamma_t)));
+				float internal = marschner_fresnel(
+					1.f / eta_perp, 1.f / eta_par, gamma_t);
+				attenuation = (1.f - f) * (1.f - f) *
+					std::pow(internal, p - 1.f) * std::pow(transmit, p);
+			}
+
+			// |2 dphi/dh|^-1, with caustics clamped.
+			float dphi_dgamma = b + 3.f * a * gamma_i * gamma_i;
+			float spread = std::abs(std::cos(gamma_i) / (2.f * dphi_dgamma));
+			sum += attenuation * std::min(spread, 2.f);
+		}
+	}
+	return sum;
+}
+
+std::size_t marschner_key(const MarschnerParams& params, int resolution)
+{
+	std::size_t seed = 0x3a25c4e7d1ceb00c;
+	seed = calc::hash_combine(seed, params.eta);
+	seed = calc::hash_combine(seed, calc::hash(params.absorption));
+	seed = calc::hash_combine(seed, params.shift);
+	seed = calc::hash_combine(seed, params.width);
+	seed = calc::hash_combine(seed, resolution);
+	return seed;
+}
+
+MarschnerLut MarschnerLut::bake(const MarschnerParams& params, int resolution)
+{
+	MarschnerLut lut{};
+	lut.resolution_ = resolution;
+	lut.key_ = marschner_key(params, resolution);
+	std::size_t num_floats = 4 * static_cast<std::size_t>(resolution) * resolution;
+	lut.m_.resize(num_floats);
+	lut.n0_.resize(num_floats);
+	lut.n1_.resize(num_floats);
+
+	auto texel = [resolution](int i) { return (i + .5f) / resolution; };
+
+	// Longitudinal terms.
+	float shifts[3] = { params.shift, -.5f * params.shift, -1.5f * params.shift };
+	float widths[3] = { params.width, .5f * params.width, 2.f * params.width };
+	util::parallel_for(0, resolution, 8, [&](int lo, int hi) {
+		for (int y = lo; y < hi; ++y) {
+			float theta_r = std::asin(2.f * texel(y) - 1.f);
+			for (int x = 0; x < resolution; ++x) {
+				float theta_i = std::asin(2.f * texel(x) - 1.f);
+				float theta_h = .5f * (theta_i + theta_r);
+				float theta_d = .5f * (theta_r - theta_i);
+				auto* m = &lut.m_[4 * (y * resolution + x)];
+				for (int p = 0; p < 3; ++p)
+					m[p] = marschner_gaussian(widths[p], theta_h - shifts[p]);
+				m[3] = std::cos(theta_d);
+			}
+		}
+	});
+
+	// Azimuthal terms.
+	util::parallel_for(0, resolution, 8, [&](int lo, int hi) {
+		for (int y = lo; y < hi; ++y) {
+			float cos_d = texel(y);
+			float sin_d = std::sqrt(1.f - cos_d * cos_d);
+			float eta2 = params.eta * params.eta;
+			float eta_perp = std::sqrt(eta2 - sin_d * sin_d) / cos_d;
+			float eta_par = eta2 * cos_d / std::sqrt(eta2 - sin_d * sin_d);
+
+			// Absorption along the refracted path.
+			float sin_t = sin_d / params.eta;
+			float cos_t = std::sqrt(1.f - sin_t * sin_t);
+			float inv_cos2_d = 1.f / std::max(cos_d * cos_d, 1e-2f);
+
+			for (int x = 0; x < resolution; ++x) {
+				float phi = std::acos(2.f * texel(x) - 1.f);
+				auto* n0 = &lut.n0_[4 * (y * resolution + x)];
+				auto* n1 = &lut.n1_[4 * (y * resolution + x)];
+
+				n0[0] = marschner_azimuthal(0, phi, eta_perp, eta_par, 0.f);
+				for (int c = 0; c < 3; ++c) {
+					float absorption = params.absorption[c] / cos_t;
+					n0[c + 1] = marschner_azimuthal(1, phi, eta_perp, eta_par, absorption);
+					n1[c] = marschner_azimuthal(2, phi, eta_perp, eta_par, absorption);
+				}
+				n1[3] = 0.f;
+				for (int c = 0; c < 4; ++c) {
+					n0[c] *= inv_cos2_d;
+					n1[c] *= inv_cos2_d;
+				}
+			}
+		}
+	});
+
+	return lut;
+}
+
+MarschnerLut MarschnerLut::load_or_bake(
+	const std::string& path,
+	const MarschnerParams& params,
+	int resolution)
+{
+	MarschnerLut lut{};
+	if (lut.load(path) && lut.key_ == marschner_key(params, resolution))
+		return lut;
+
+	lut = bake(params, resolution);
+	if (!lut.save(path))
+		util::log_warning(UTIL_FMT("Failed to cache hair shading tables {}.\n"), path);
+	return lut;
+}
+
+bool MarschnerLut::save(const std::string& path) const
+{
+	std::ofstream fp(path, std::ios::binary);
+	if (!fp)
+		return false;
+
+	uint64_t key = key_;
+	fp.write("GFX_MLUT", 8);
+	fp.write(reinterpret_cast<const char*>(&key), sizeof(key));
+	fp.write(reinterpret_cast<const char*>(&resolution_), sizeof(resolution_));
+	for (const auto* table : { &m_, &n0_, &n1_ })
+		fp.write(reinterpret_cast<const char*>(table->data()),
+			table->size() * sizeof(float));
+	return static_cast<bool>(fp);
+}
+
+bool MarschnerLut::load(const std::string& path)
+{
+	std::ifstream fp(path, std::ios::binary);
+	if (!fp)
+		return false;
+
+	char header[9];
+	fp.read(header, 8);
+	header[8] = '\0';
+	if (!fp || strcmp(header, "GFX_MLUT") != 0)
+		return false;
+
+	uint64_t key;
+	fp.read(reinterpret_cast<char*>(&key), sizeof(key));
+	fp.read(reinterpret_cast<char*>(&resolution_), sizeof(resolution_));
+	if (!fp || resolution_ <= 0)
+		return false;
+	key_ = static_cast<std::size_t>(key);
+
+	std::size_t num_floats = 4 * static_cast<std::size_t>(resolution_) * resolution_;
+	for (auto* table : { &m_, &n0_, &n1_ }) {
+		table->resize(num_floats);
+		fp.read(reinterpret_cast<char*>(table->data()),
+			num_floats * sizeof(float));
+	}
+	return static_cast<bool>(fp);
+}
+
+GLuint create_lut_texture(int resolution, const std::vector<float>& texels)
+{
+	GLuint tex;
+	glGenTextures(1, &tex);
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, resolution, resolution);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, resolution, resolution,
+		GL_RGBA, GL_FLOAT, texels.data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	return tex;
+}
+
+void MarschnerLut::upload()
+{
+	m_tex_ = create_lut_texture(resolution_, m_);
+	n0_tex_ = create_lut_texture(resolution_, n0_);
+	n1_tex_ = create_lut_texture(resolution_, n1_);
+}
+
+void MarschnerLut::bind() const
+{
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, m_tex_);
+	glActiveTexture(GL_TEXTURE4);
+	glBindTexture(GL_TEXTURE_2D, n0_tex_);
+	glActiveTexture(GL_TEXTURE5);
+	glBindTexture(GL_TEXTURE_2D, n1_tex_);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void MarschnerLut::destroy()
+{
+	glDeleteTextures(1, &m_tex_);
+	glDeleteTextures(1, &n0_tex_);
+	glDeleteTextures(1, &n1_tex_);
+	m_tex_ = n0_tex_ = n1_tex_ = 0;
+}
+
+}
@@ -0,0 +1,71 @@
+#ifndef GFX_MARSCHNER_H
+#define GFX_MARSCHNER_H
+
+#include <vector>
+#include <string>
+#include "calc.h"
+
+#ifndef _ANDROID_
+#include "glad/glad.h"
+#endif
+
+namespace gfx
+{
+
+////
+// Marschner hair scattering, baked into lookup
+// tables as in GPU Gems 2, chapter 23.
+//
+// M: indexed by (sin(theta_i), sin(theta_r)),
+//    holds M_R, M_TT, M_TRT and cos(theta_d).
+// N: indexed by (cos(phi), cos(theta_d)), holds
+//    N_R, N_TT (rgb) in N0 and N_TRT (rgb) in N1,
+//    divided by cos^2(theta_d).
+////
+
+class MarschnerParams {
+public:
+	float eta = 1.55f;
+	// Absorption per unit fiber radius.
+	calc::Vec3 absorption{ .432f, .612f, .98f };
+	// Longitudinal shift and width of R, in radians.
+	float shift = -.122f;
+	float width = .131f;
+};
+
+class MarschnerLut {
+public:
+
+	MarschnerLut() {}
+
+	static MarschnerLut bake(const MarschnerParams& params, int resolution);
+
+	// Load the tables from path if they were baked with the same
+	// settings, otherwise bake and write them.
+	static MarschnerLut load_or_bake(
+		const std::string& path,
+		const MarschnerParams& params,
+		int resolution);
+
+	bool save(const std::string& path) const;
+	bool load(const std::string& path);
+
+	// Create textures, and bind them to units 3, 4 and 5.
+	void upload();
+	void bind() const;
+	void destroy();
+
+	int resolution() const { return resolution_; }
+
+private:
+	int resolution_ = 0;
+	std::size_t key_ = 0;
+	// RGBA, row major, resolution^2 texels each.
+	std::vector<float> m_, n0_, n1_;
+
+	GLuint m_tex_ = 0, n0_tex_ = 0, n1_tex_ = 0;
+};
+
+}
+
+#endif
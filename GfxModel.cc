@@ -3,6 +3,10 @@
 #include <unordered_map>
 #include <functional>
 #include <cassert>
+#include <cstring>
+#include <cstdint>
+#include <istream>
+#include <streambuf>
 
 #include "calc.h"
 #include "utility.h"
@@ -44,6 +48,13 @@ void create_element_array_buffer(GLuint& buffer,
         indices.data(), GL_STATIC_DRAW);
 }
 
+// Byte offset of index istart in the element array buffer.
+const GLvoid* index_offset(int istart)
+{
+    return reinterpret_cast<const GLvoid*>(
+        static_cast<std::uintptr_t>(istart) * sizeof(unsigned));
+}
+
 Mesh::Mesh(const Model& model)
 {
     glGenVertexArrays(1, &vao_);
@@ -64,6 +75,18 @@ Mesh::Mesh(const Model& model)
         create_element_array_buffer(ebo_, model.indices_);
 }
 
+void Mesh::update(const Model& model)
+{
+    assert(model.acode_ == vertex_attrib::PosTan);
+    glBindBuffer(GL_ARRAY_BUFFER, pos_);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, 
+        model.positions_.size() * sizeof(calc::Vec3), model.positions_.data());
+    glBindBuffer(GL_ARRAY_BUFFER, tan_);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, 
+        model.tangents_.size() * sizeof(calc::Vec3), model.tangents_.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
 Mesh::~Mesh()
 {
     glDeleteVertexArrays(1, &vao_);
@@ -82,41 +105,67 @@ public:
 	std::vector<tinyobj::material_t> materials;
 };
 
-void fit_model_placement(float* positions, int size, 
+void fit_model_placement(std::vector<calc::Vec3>& positions, 
     calc::Box3D placement)
 {
-    calc::Box3D geom{};
-    for (int v = 0; v < size/3; ++v) {
-        calc::Vec3 pos;
-        std::copy_n(&positions[3*v], 3, 
-            calc::begin(pos));
-        geom.update(pos);
-    }
-    auto center = placement.center();
-    auto scale_ = placement.size() / geom.size();
+    if (positions.empty())
+        return;
+
+    calc::Vec3 inf, sup;
+    calc::min_max(positions.data(), positions.size(), inf, sup);
+    auto geom_center = (inf+sup)*.5f;
+    auto scale_ = placement.size() / (sup-inf);
     auto scale = *std::min_element(
         calc::begin(scale_), calc::end(scale_));
-    for (int v = 0; v < size/3; ++v) {
-        calc::Vec3 pos;
-        std::copy_n(&positions[3*v], 3, 
-            calc::begin(pos));
-        pos = (pos-geom.center())*scale + center;
-        std::copy_n(calc::begin(pos), 3,
-        &positions[3*v]);
+
+    // pos = (pos-geom_center)*scale + center
+    calc::Mat4 fit{};
+    for (int i = 0; i < 3; ++i) {
+        fit[i][i] = scale;
+        fit[3][i] = placement.center()[i] - scale*geom_center[i];
     }
+    fit[3][3] = 1.f;
+    calc::point_transform(fit, positions.data(), positions.data(), positions.size());
 }
 
+// Read-only stream over memory, tinyobj reads it a char at a time.
+class ViewStreambuf : public std::streambuf {
+public:
+    explicit ViewStreambuf(std::string_view view)
+    {
+        char* begin = const_cast<char*>(view.data());
+        setg(begin, begin, begin + view.size());
+    }
+};
+
 TinyobjModel load_tinyobj_model(const std::string& objfile, 
-    const std::string& mtldir,
-    calc::Box3D placement = {{0,0,0},{-1,-1,-1}})
+    const std::string& mtldir)
 {
     TinyobjModel model;
     std::string warn;
     std::string err;
 
+    ////
+    // Parse from a map of the file, with no copy, where
+    // tinyobj would read it through an ifstream. The
+    // materials are still read by tinyobj, from mtldir.
+    ////
+    util::MappedFile file(objfile, util::MappedFile::Sequential);
+    if (!file.is_open()) {
+        std::cerr << "Cannot open file [" << objfile << "]" << std::endl;
+        exit(1);
+    }
+    ViewStreambuf buffer(file.view());
+    std::istream stream(&buffer);
+
+    std::string basedir = mtldir;
+    if (!basedir.empty() && basedir.back() != '/' && basedir.back() != '\\')
+        basedir += '/';
+    tinyobj::MaterialFileReader material_reader(basedir);
+
     bool ret = tinyobj::LoadObj(
         &model.attrib, &model.shapes, &model.materials, 
-        &warn, &err, objfile.c_str(), mtldir.c_str(), true);
+        &warn, &err, &stream, &material_reader, true);
 
     if (!warn.empty()) {
         std::cout << warn << std::endl;
@@ -130,11 +179,6 @@ TinyobjModel load_tinyobj_model(const std::string& objfile,
         exit(1);
     }
 
-    if (placement.size().x > 0) {
-        fit_model_placement(model.attrib.vertices.data(), 
-            model.attrib.vertices.size(),placement);
-    }
-
 	return model;
 }
 
@@ -205,10 +249,11 @@ ModelVertex get_ModelVertex(AttribCode acode,
 
 Model Model::load_from_obj_file(const std::string& objfile, 
     AttribCode acode,
-	calc::Box3D placement)
+	calc::Box3D placement,
+	bool spatial_sort)
 {
 	auto mtldir = util::get_file_base_dir(objfile);
-    auto obj = load_tinyobj_model(objfile, mtldir, placement);
+    auto obj = load_tinyobj_model(objfile, mtldir);
 
     Model model{};
     model.acode_ = acode;
@@ -248,7 +293,8 @@ Model Model::load_from_obj_file(const std::string& objfile,
 
 		auto& mesh = obj.shapes[s].mesh;
 
-		if (!mesh.material_ids.empty()) {
+		// -1 if the shape has no material.
+		if (!mesh.material_ids.empty() && mesh.material_ids[0] >= 0) {
 			auto material_id = mesh.material_ids[0];
 
 			for (auto id: mesh.material_ids)
@@ -320,34 +366,97 @@ Model Model::load_from_obj_file(const std::string& objfile,
     last_part.vcount = vcount - last_part.vstart;
     last_part.icount = icount - last_part.istart;
 
+    if (placement.size().x > 0)
+        fit_model_placement(model.positions_, placement);
+
+    if (spatial_sort)
+        for (int p = 0; p < static_cast<int>(model.parts_.size()); ++p)
+            model.sort_part_spatially(p);
+
     model.bounds_ = calc::box_from_points(model.positions_);
 
     return model;
 }
 
+void Model::sort_part_spatially(int part_idx)
+{
+    const auto& part = parts_[part_idx];
+
+    // Vertices, by position.
+    std::vector<calc::Vec3> part_positions(
+        positions_.begin() + part.vstart, 
+        positions_.begin() + part.vstart + part.vcount);
+    auto order = util::morton_order(part_positions);
+
+    std::vector<unsigned> new_index(part.vcount);
+    for (int v = 0; v < part.vcount; ++v)
+        new_index[order[v]] = part.vstart + v;
+
+    auto permute = [&](auto& attribs) {
+        if (attribs.empty())
+            return;
+        std::vector<typename std::decay<decltype(attribs)>::type::value_type> 
+            sorted(part.vcount);
+        for (int v = 0; v < part.vcount; ++v)
+            sorted[v] = attribs[part.vstart + order[v]];
+        std::copy(sorted.begin(), sorted.end(), attribs.begin() + part.vstart);
+    };
+    permute(positions_);
+    permute(normals_);
+    permute(uvs_);
+    permute(tangents_);
+    permute(bitangents_);
+
+    // Triangles, by centroid.
+    int num_tris = part.icount / 3;
+    std::vector<unsigned> tris(part.icount);
+    std::vector<calc::Vec3> centroids(num_tris);
+    for (int i = 0; i < part.icount; ++i)
+        tris[i] = new_index[indices_[part.istart + i] - part.vstart];
+    for (int t = 0; t < num_tris; ++t)
+        centroids[t] = (positions_[tris[3*t]] + 
+            positions_[tris[3*t+1]] + positions_[tris[3*t+2]]) / 3.f;
+
+    auto tri_order = util::morton_order(centroids);
+    for (int t = 0; t < num_tris; ++t)
+        std::copy_n(&tris[3*tri_order[t]], 3, &indices_[part.istart + 3*t]);
+}
+
+// Copies count values off the front of bytes, exits if it is too short.
+template<typename T>
+void view_read(std::string_view& bytes, T* vals, std::size_t count)
+{
+	if (bytes.size() / sizeof(T) < count) {
+		std::cerr << "Wrong input.\n";
+		exit(1);
+	}
+	std::memcpy(vals, bytes.data(), count * sizeof(T));
+	bytes.remove_prefix(count * sizeof(T));
+}
+
 template<typename T>
-T ifstream_read(std::ifstream& fp)
+T view_read(std::string_view& bytes)
 {
 	T val;
-	fp.read(reinterpret_cast<char*>(&val), sizeof(val));
+	view_read(bytes, &val, 1);
 	return val;
 }
 
 Model Model::load_from_ind_file(
     const std::string& inputfile, 
     AttribCode acode,
-	calc::Box3D placement)
+	calc::Box3D placement,
+	bool spatial_sort)
 {
-    std::ifstream fp(inputfile, std::ios::binary);
-    char header[9];
-    fp.read(header, 8);
-    header[8] = '\0';
-    if (strcmp(header, "IND_HAIR") != 0) {
+    util::MappedFile file(inputfile, util::MappedFile::Sequential);
+    auto bytes = file.view();
+    if (bytes.substr(0, 8) != "IND_HAIR") {
         std::cerr << "Wrong input.\n";
         exit(1);
     }
-    auto num_fibers = ifstream_read<unsigned>(fp);
-    auto num_verts = ifstream_read<unsigned>(fp);
+    bytes.remove_prefix(8);
+    auto num_fibers = view_read<unsigned>(bytes);
+    auto num_verts = view_read<unsigned>(bytes);
 
 	//util::print("#hair fibers = {}\n", num_fibers);
 
@@ -355,75 +464,117 @@ Model Model::load_from_ind_file(
     model.acode_ = acode;
     model.model_type_ = ModelType::Hair;    
 
-    // Currently, our hair model has one part,
-    // with primitive restart number seperating 
-    // the fibers.
-    model.positions_.reserve(num_verts);
-    model.indices_.reserve(num_fibers-1 + num_verts);
+    ////
+    // Fibers are read in file order, then shuffled 
+    // with a fixed seed, so that any prefix of the 
+    // fibers is a uniform subset of the groom. A 
+    // LOD is then just a smaller draw count.
+    ////
+
+    std::vector<calc::Vec3> file_positions;
+    std::vector<Fiber> file_fibers;
+    file_positions.reserve(num_verts);
+    file_fibers.reserve(num_fibers);
 
-    auto vcnt = 0;
-    for (int p = 0; p < num_fibers; ++p) {
-        auto num_pverts = ifstream_read<unsigned>(fp);
+    for (unsigned p = 0; p < num_fibers; ++p) {
+        auto num_pverts = view_read<unsigned>(bytes);
 
         if (num_pverts == 0)
             continue;
         if (num_pverts == 1) {
-            ifstream_read<calc::Vec3>(fp);
+            view_read<calc::Vec3>(bytes);
             continue;
         }
 
-        for (int pv = 0; pv < num_pverts; ++pv) {
-            auto position = ifstream_read<calc::Vec3>(fp);
-            model.positions_.push_back(position);
-            model.indices_.push_back(vcnt + pv);
+        Fiber fiber{};
+        fiber.vstart = file_positions.size();
+        fiber.vcount = num_pverts;
+        file_positions.resize(fiber.vstart + num_pverts);
+        view_read(bytes, &file_positions[fiber.vstart], num_pverts);
+        file_fibers.push_back(fiber);
+    }
+
+    calc::PCG rng{0x9e3779b97f4a7c15ULL};
+    for (int f = static_cast<int>(file_fibers.size()) - 1; f > 0; --f)
+        std::swap(file_fibers[f], file_fibers[rng() % (f + 1)]);
+
+    if (spatial_sort) {
+        int num = static_cast<int>(file_fibers.size());
+        int block = std::max(1, (num + lod_blocks - 1) / lod_blocks);
+        for (int lo = 0; lo < num; lo += block) {
+            int hi = std::min(num, lo + block);
+            std::vector<calc::Vec3> roots;
+            for (int f = lo; f < hi; ++f)
+                roots.push_back(file_positions[file_fibers[f].vstart]);
+            auto order = util::morton_order(roots);
+            std::vector<Fiber> sorted;
+            for (int k : order)
+                sorted.push_back(file_fibers[lo + k]);
+            std::copy(sorted.begin(), sorted.end(), file_fibers.begin() + lo);
         }
+    }
+
+    // Currently, our hair model has one part,
+    // with primitive restart number seperating 
+    // the fibers.
+    model.positions_.reserve(file_positions.size());
+    model.indices_.reserve(file_fibers.size() + file_positions.size());
+    model.fibers_.reserve(file_fibers.size());
 
-        if (p != num_fibers - 1)
+    for (const auto& file_fiber : file_fibers) {
+        if (!model.fibers_.empty())
             model.indices_.push_back(Model::primitive_restart_number_);
 
-        vcnt += num_pverts;
-    }
+        Fiber fiber{};
+        fiber.vstart = model.positions_.size();
+        fiber.vcount = file_fiber.vcount;
+        fiber.istart = model.indices_.size();
+        fiber.icount = file_fiber.vcount;
 
-	assert(model.positions_.size() == num_verts);
-    assert(model.indices_.size() == num_fibers-1+num_verts);
+        for (int pv = 0; pv < fiber.vcount; ++pv) {
+            model.positions_.push_back(
+                file_positions[file_fiber.vstart + pv]);
+            model.indices_.push_back(fiber.vstart + pv);
+        }
+        model.fibers_.push_back(fiber);
+    }
 
     model.parts_.resize(1);
     model.parts_[0].vstart = 0;
-    model.parts_[0].vcount = num_verts;
+    model.parts_[0].vcount = model.positions_.size();
     model.parts_[0].istart = 0;
-    model.parts_[0].icount = num_fibers-1+num_verts;
+    model.parts_[0].icount = model.indices_.size();
 
     if (placement.size().x > 0) {
-        fit_model_placement((float*)model.positions_.data(), 
-            model.positions_.size()*3, placement);
+        fit_model_placement(model.positions_, placement);
     }
 
     model.bounds_ = calc::box_from_points(model.positions_);
 
-    if (acode&vertex_attrib::Tan == 0)
+    if ((acode & vertex_attrib::Tan) == 0)
         return model;
 
-    model.tangents_.resize(num_verts);
-    for (int p = 0; p < model.parts_.size(); ++p) {
-        auto start = model.parts_[p].vstart;
-        auto pvcnt = model.parts_[p].vcount;
+    // Forward edge directions of all vertices, in bulk.
+    int num_positions = model.positions_.size();
+    std::vector<calc::Vec3> forward(num_positions);
+    for (int v = 0; v+1 < num_positions; ++v)
+        forward[v] = model.positions_[v+1]-model.positions_[v];
+    calc::fast::normalize(forward.data(), forward.data(), num_positions-1);
 
-        model.tangents_[start] = calc::normalize(
-            model.positions_[start+1]-model.positions_[start]);
+    model.tangents_.resize(num_positions);
+    for (const auto& fiber : model.fibers_) {
+        auto start = fiber.vstart;
+        auto pvcnt = fiber.vcount;
+
+        model.tangents_[start] = forward[start];
 
         for (int v = 1; v < pvcnt-1; ++v) {
-            auto forward_tangent = calc::normalize(
-                model.positions_[start+v+1]-model.positions_[start+v]);
             model.tangents_[start+v] = calc::normalize(
-                model.tangents_[start+v-1]+forward_tangent);
+                model.tangents_[start+v-1]+forward[start+v]);
         }
 
-        model.tangents_[start+pvcnt-1] = calc::normalize(
-            model.positions_[start+pvcnt-1] - 
-            model.positions_[start+pvcnt-2]);
-
+        model.tangents_[start+pvcnt-1] = forward[start+pvcnt-2];
     }
-    assert(model.tangents_.size() == num_verts);
 
     return model;
 }
@@ -436,6 +587,16 @@ void Model::init_mesh()
         mesh_ = std::make_unique<Mesh>(*this);
 }
 
+static constexpr calc::Vec3 unit_cube_corners[]{
+    { 1, 1, 1},
+    { 1, 1,-1},
+    { 1,-1, 1},
+    { 1,-1,-1},
+    {-1, 1, 1},
+    {-1, 1,-1},
+    {-1,-1, 1},
+    {-1,-1,-1}};
+
 calc::Mat4 Model::local_transform() const
 {
     return model_matrix_;
@@ -445,20 +606,13 @@ void Model::local_transform(calc::Mat4 matrix)
 {
     model_matrix_ = matrix;
 
-    std::vector<calc::Vec3> corners{
-        { 1, 1, 1},
-        { 1, 1,-1},
-        { 1,-1, 1},
-        { 1,-1,-1},
-        {-1, 1, 1},
-        {-1, 1,-1},
-        {-1,-1, 1},
-        {-1,-1,-1}};
-
-    for (auto& corner : corners) {
+    std::vector<calc::Vec3> corners(
+        std::begin(unit_cube_corners), std::end(unit_cube_corners));
+
+    for (auto& corner : corners)
         corner = corner*bounds_.size()*.5f + bounds_.center();
-        corner = calc::point_transform(model_matrix_, corner);
-    }
+    calc::point_transform(model_matrix_, 
+        corners.data(), corners.data(), corners.size());
 
     bounds_ = calc::box_from_points(corners);
 }
@@ -516,6 +670,44 @@ int Model::num_parts() const
     return parts_.size();
 }
 
+int Model::num_fibers() const
+{
+    return fibers_.size();
+}
+
+const Model::Fiber& Model::fiber(int fiber_idx) const
+{
+    return fibers_[fiber_idx];
+}
+
+const std::vector<calc::Vec3>& Model::positions() const
+{
+    return positions_;
+}
+
+const std::vector<calc::Vec3>& Model::tangents() const
+{
+    return tangents_;
+}
+
+const std::vector<unsigned>& Model::indices() const
+{
+    return indices_;
+}
+
+void Model::update_vertices(
+    const std::vector<calc::Vec3>& positions,
+    const std::vector<calc::Vec3>& tangents)
+{
+    assert(model_type_ == ModelType::Hair);
+    assert(positions.size() == positions_.size());
+    assert(tangents.size() == tangents_.size());
+    positions_ = positions;
+    tangents_ = tangents;
+    if (mesh_)
+        mesh_->update(*this);
+}
+
 const Material& Model::material(int part_idx) const
 {
     return parts_[part_idx].material;
@@ -528,17 +720,43 @@ void Model::draw(int part_idx) const
     switch (model_type_) {
 	case ModelType::TriangleMesh:
         glDrawElements(GL_TRIANGLES, parts_[part_idx].icount, 
-            GL_UNSIGNED_INT, (GLvoid*)parts_[part_idx].istart);
+            GL_UNSIGNED_INT, index_offset(parts_[part_idx].istart));
         break;
     case ModelType::Hair:
         glDrawElements(GL_LINE_STRIP, parts_[part_idx].icount, 
-            GL_UNSIGNED_INT, (GLvoid*)parts_[part_idx].istart);
+            GL_UNSIGNED_INT, index_offset(parts_[part_idx].istart));
         break;
     default:
         break;
     }
 }
 
+void Model::draw(int part_idx, int num_fibers) const
+{
+    assert(model_type_ == ModelType::Hair);
+
+    num_fibers = std::min(num_fibers, static_cast<int>(fibers_.size()));
+    if (num_fibers <= 0)
+        return;
+
+    const auto& last_fiber = fibers_[num_fibers-1];
+    auto icount = last_fiber.istart + last_fiber.icount - \
+        parts_[part_idx].istart;
+    glDrawElements(GL_LINE_STRIP, icount, 
+        GL_UNSIGNED_INT, index_offset(parts_[part_idx].istart));
+}
+
+void Model::multi_draw_indirect(int num_commands) const
+{
+    if (num_commands <= 0)
+        return;
+
+    GLenum mode = model_type_ == ModelType::Hair ? 
+        GL_LINE_STRIP : GL_TRIANGLES;
+    glMultiDrawElementsIndirect(mode, GL_UNSIGNED_INT, 
+        nullptr, num_commands, sizeof(DrawElementsIndirectCommand));
+}
+
 calc::Box3D Model::bounds() const 
 {
     return bounds_;
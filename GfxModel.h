@@ -4,6 +4,7 @@
 
 #include <fstream>
 #include <vector>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include "calc.h"
@@ -43,6 +44,8 @@ public:
 	Mesh(const Model& model);
 	~Mesh();
 	GLuint vao() const { return vao_; }
+	// Re-upload positions and tangents of a PosTan model.
+	void update(const Model& model);
 
 private:
 	GLuint vao_ = 0;
@@ -77,9 +80,28 @@ public:
 
 enum class ModelType {TriangleMesh, Hair};
 
+// Layout of glMultiDrawElementsIndirect commands.
+class DrawElementsIndirectCommand {
+public:
+	GLuint count;
+	GLuint instance_count;
+	GLuint first_index;
+	GLuint base_vertex;
+	GLuint base_instance;
+};
+
 class Model {
 public:
 
+	// Vertex and index range of a hair fiber, in draw order.
+	class Fiber {
+	public:
+		int vstart;
+		int vcount;
+		int istart;
+		int icount;
+	};
+
 	ModelType model_type() const;
 
 	calc::Mat4 local_transform() const;
@@ -91,18 +113,42 @@ public:
 
 	int num_verts() const;
 	int num_parts() const;
+	int num_fibers() const;
+	const Fiber& fiber(int fiber_idx) const;
+	const std::vector<calc::Vec3>& positions() const;
+	const std::vector<calc::Vec3>& tangents() const;
+	const std::vector<unsigned>& indices() const;
+	// Hair only: replace the vertices, e.g. after the head moved.
+	// Bounds are left as loaded.
+	void update_vertices(
+		const std::vector<calc::Vec3>& positions,
+		const std::vector<calc::Vec3>& tangents);
 	const Material& material(int part_idx) const;
 	void draw(int part_idx) const;
+	// Hair only: draw the first num_fibers fibers of a part. Fibers are 
+	// shuffled at load, so any prefix is a uniform subset of the groom.
+	void draw(int part_idx, int num_fibers) const;
+	// Draw commands read from the bound GL_DRAW_INDIRECT_BUFFER.
+	void multi_draw_indirect(int num_commands) const;
 
 	calc::Box3D bounds() const;
 
+	// spatial_sort: store the vertices of each part, and 
+	// its triangles, in Morton order of their positions.
 	static Model load_from_obj_file(const std::string& inputfile, 
 		AttribCode acode = vertex_attrib::PosNormUV,
-		calc::Box3D placement = {{0,0,0},{-1,-1,-1}});
+		calc::Box3D placement = {{0,0,0},{-1,-1,-1}},
+		bool spatial_sort = false);
 
+	// spatial_sort: after shuffling, sort fibers in Morton order
+	// of their roots within each of lod_blocks blocks, so prefixes
+	// stay uniform at the granularity of a block.
 	static Model load_from_ind_file(const std::string& inputfile, 
 		AttribCode acode = vertex_attrib::PosTan,
-		calc::Box3D placement = {{0,0,0},{-1,-1,-1}});
+		calc::Box3D placement = {{0,0,0},{-1,-1,-1}},
+		bool spatial_sort = false);
+
+	static constexpr int lod_blocks = 64;
 	
 private:
 
@@ -110,6 +156,8 @@ private:
 
 	friend Mesh;
 
+	void sort_part_spatially(int part_idx);
+
 	std::vector<calc::Vec3> positions_;
 	std::vector<calc::Vec3> normals_;
 	std::vector<calc::Vec2> uvs_;
@@ -128,6 +176,8 @@ private:
 
 	std::vector<Part> parts_;
 
+	std::vector<Fiber> fibers_;
+
 	AttribCode acode_ = 0;
 	static constexpr GLuint primitive_restart_number_ = \
 		std::numeric_limits<GLuint>::max();
@@ -0,0 +1,273 @@
+#include "GfxRootBinding.h"
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cassert>
+#include <iostream>
+
+#include "calc.h"
+#include "utility.h"
+#include "GfxSdf.h"
+
+namespace gfx
+{
+
+void TriangleGrid::build(const Model& mesh, float cells_per_triangle)
+{
+	positions_ = mesh.positions();
+	indices_ = mesh.indices();
+	int num_tris = indices_.size() / 3;
+
+	////
+	// Cubic cells, about cells_per_triangle * #triangles
+	// of them over the mesh bounds.
+	////
+
+	auto bounds = calc::box_from_points(positions_);
+	auto extent = bounds.size();
+	float longest = std::max(extent.x, std::max(extent.y, extent.z));
+	float volume = 1.f;
+	for (int i = 0; i < 3; ++i)
+		volume *= std::max(extent[i], 1e-3f * longest);
+	cell_size_ = std::cbrt(volume / std::max(1.f, cells_per_triangle * num_tris));
+	cell_size_ = std::max(cell_size_, 1e-6f);
+	for (int i = 0; i < 3; ++i) {
+		size_[i] = std::max(1, static_cast<int>(std::ceil(extent[i] / cell_size_)));
+		origin_[i] = bounds.center()[i] - .5f * size_[i] * cell_size_;
+	}
+
+	auto to_cell = [this](float v, int axis) {
+		int c = static_cast<int>(std::floor((v - origin_[axis]) / cell_size_));
+		return std::min(size_[axis] - 1, std::max(0, c));
+	};
+
+	// Counting sort of (cell, triangle) pairs.
+	auto for_each_cell = [&](int t, auto&& f) {
+		const auto& a = positions_[indices_[3 * t]];
+		const auto& b = positions_[indices_[3 * t + 1]];
+		const auto& c = positions_[indices_[3 * t + 2]];
+		auto inf = calc::minimum(a, calc::minimum(b, c));
+		auto sup = calc::maximum(a, calc::maximum(b, c));
+		calc::iVec3 lo, hi;
+		for (int i = 0; i < 3; ++i) {
+			lo[i] = to_cell(inf[i], i);
+			hi[i] = to_cell(sup[i], i);
+		}
+		for (int z = lo.z; z <= hi.z; ++z)
+		for (int y = lo.y; y <= hi.y; ++y)
+		for (int x = lo.x; x <= hi.x; ++x)
+			f(cell_index(x, y, z));
+	};
+
+	int num_cells = size_.x * size_.y * size_.z;
+	cell_start_.assign(num_cells + 1, 0);
+	for (int t = 0; t < num_tris; ++t)
+		for_each_cell(t, [this](int c) { ++cell_start_[c + 1]; });
+	for (int c = 0; c < num_cells; ++c)
+		cell_start_[c + 1] += cell_start_[c];
+
+	cell_tris_.resize(cell_start_[num_cells]);
+	std::vector<int> cursor(cell_start_.begin(), cell_start_.end() - 1);
+	for (int t = 0; t < num_tris; ++t)
+		for_each_cell(t, [&](int c) { cell_tris_[cursor[c]++] = t; });
+}
+
+bool TriangleGrid::closest(const calc::Vec3& p, Hit& hit) const
+{
+	if (cell_tris_.empty())
+		return false;
+
+	calc::iVec3 center;
+	for (int i = 0; i < 3; ++i) {
+		int c = static_cast<int>(std::floor((p[i] - origin_[i]) / cell_size_));
+		center[i] = std::min(size_[i] - 1, std::max(0, c));
+	}
+
+	hit.triangle = -1;
+	hit.distance = std::numeric_limits<float>::max();
+	int max_ring = std::max(size_.x, std::max(size_.y, size_.z));
+
+	for (int ring = 0; ring <= max_ring; ++ring) {
+		////
+		// Cells at Chebyshev distance ring from the center
+		// cell are at least (ring-1)*cell_size_ away from p,
+		// also for p off the grid, as center is clamped.
+		////
+		if (hit.distance <= (ring - 1) * cell_size_)
+			break;
+
+		calc::iVec3 lo, hi;
+		for (int i = 0; i < 3; ++i) {
+			lo[i] = std::max(0, center[i] - ring);
+			hi[i] = std::min(size_[i] - 1, center[i] + ring);
+		}
+
+		for (int z = lo.z; z <= hi.z; ++z)
+		for (int y = lo.y; y <= hi.y; ++y)
+		for (int x = lo.x; x <= hi.x; ++x) {
+			bool on_ring = std::abs(x - center.x) == ring ||
+				std::abs(y - center.y) == ring ||
+				std::abs(z - center.z) == ring;
+			if (!on_ring)
+				continue;
+
+			// Skip cells no closer than the closest hit so far.
+			calc::Vec3 cell_inf = origin_ + cell_size_ * calc::Vec3{
+				static_cast<float>(x), static_cast<float>(y), static_cast<float>(z) };
+			calc::Vec3 gap = calc::maximum(calc::Vec3{},
+				calc::maximum(cell_inf - p, p - cell_inf - cell_size_));
+			if (calc::dot(gap, gap) >= hit.distance * hit.distance)
+				continue;
+
+			int c = cell_index(x, y, z);
+			for (int k = cell_start_[c]; k < cell_start_[c + 1]; ++k) {
+				int t = cell_tris_[k];
+				const auto& a = positions_[indices_[3 * t]];
+				const auto& b = positions_[indices_[3 * t + 1]];
+				const auto& v = positions_[indices_[3 * t + 2]];
+				int feature;
+				auto q = closest_point_on_triangle(p, a, b, v, feature);
+				float d = calc::length(p - q);
+				if (d < hit.distance) {
+					hit.triangle = t;
+					hit.point = q;
+					hit.distance = d;
+				}
+			}
+		}
+	}
+
+	////
+	// Barycentrics of the closest point, in double, as
+	// the Gram determinant cancels on slivers. On a
+	// degenerate triangle the point is on an edge, and
+	// is weighted between the ends of the closest one.
+	////
+	const auto& a = positions_[indices_[3 * hit.triangle]];
+	const auto& b = positions_[indices_[3 * hit.triangle + 1]];
+	const auto& c = positions_[indices_[3 * hit.triangle + 2]];
+	auto ddot = [](const calc::Vec3& x, const calc::Vec3& y) {
+		return double(x.x) * y.x + double(x.y) * y.y + double(x.z) * y.z;
+	};
+	auto v0 = b - a, v1 = c - a, v2 = hit.point - a;
+	double d00 = ddot(v0, v0), d01 = ddot(v0, v1), d11 = ddot(v1, v1);
+	double d20 = ddot(v2, v0), d21 = ddot(v2, v1);
+	double denom = d00 * d11 - d01 * d01;
+	if (denom <= 1e-12 * d00 * d11 || denom <= 0.) {
+		float best = std::numeric_limits<float>::max();
+		const calc::Vec3* corners[3] = { &a, &b, &c };
+		for (int e = 0; e < 3; ++e) {
+			const auto& p0 = *corners[e];
+			const auto& p1 = *corners[(e + 1) % 3];
+			double len2 = ddot(p1 - p0, p1 - p0);
+			float t = len2 > 0. ? static_cast<float>(
+				std::clamp(ddot(hit.point - p0, p1 - p0) / len2, 0., 1.)) : 0.f;
+			float d = calc::length(hit.point - (p0 + t * (p1 - p0)));
+			if (d < best) {
+				best = d;
+				hit.bary = calc::Vec3{};
+				hit.bary[e] = 1.f - t;
+				hit.bary[(e + 1) % 3] = t;
+			}
+		}
+	}
+	else {
+		auto v = static_cast<float>((d11 * d20 - d01 * d21) / denom);
+		auto w = static_cast<float>((d00 * d21 - d01 * d20) / denom);
+		hit.bary = calc::Vec3{ 1.f - v - w, v, w };
+	}
+	return true;
+}
+
+calc::Mat3 triangle_frame(
+	const calc::Vec3& a,
+	const calc::Vec3& b,
+	const calc::Vec3& c)
+{
+	auto n = calc::cross(b - a, c - a);
+	float len = calc::length(n);
+	n = len > 1e-20f ? n / len : calc::Vec3{ 0.f, 0.f, 1.f };
+
+	auto t = b - a;
+	t = t - calc::dot(t, n) * n;
+	len = calc::length(t);
+	t = len > 1e-20f ? t / len : calc::Vec3{ 1.f, 0.f, 0.f };
+
+	calc::Mat3 frame;
+	frame[0] = t;
+	frame[1] = calc::cross(n, t);
+	frame[2] = n;
+	return frame;
+}
+
+void HairRootBinding::bind(
+	const Model& hair, const Model& head, const TriangleGrid& grid,
+	util::Scheduler& scheduler)
+{
+	const auto& positions = hair.positions();
+	const auto& tangents = hair.tangents();
+	const auto& head_positions = head.positions();
+	head_indices_ = head.indices();
+
+	int num_fibers = hair.num_fibers();
+	roots_.resize(num_fibers);
+	fibers_.resize(num_fibers);
+	local_positions_.resize(positions.size());
+	local_tangents_.resize(tangents.size());
+
+	// Fibers are independent, and each writes only its own vertices.
+	util::parallel_for(scheduler, 0, num_fibers, 256, [&](int lo, int hi) {
+		for (int f = lo; f < hi; ++f) {
+			const auto& fiber = hair.fiber(f);
+			fibers_[f] = fiber;
+
+			TriangleGrid::Hit hit;
+			if (!grid.closest(positions[fiber.vstart], hit)) {
+				std::cerr << "Hair root binding to an empty mesh.\n";
+				exit(1);
+			}
+			roots_[f] = Root{ hit.triangle, hit.bary };
+
+			const auto& a = head_positions[head_indices_[3 * hit.triangle]];
+			const auto& b = head_positions[head_indices_[3 * hit.triangle + 1]];
+			const auto& c = head_positions[head_indices_[3 * hit.triangle + 2]];
+			auto to_local = calc::transpose(triangle_frame(a, b, c));
+
+			for (int v = fiber.vstart; v < fiber.vstart + fiber.vcount; ++v) {
+				local_positions_[v] = calc::dot(to_local, positions[v] - hit.point);
+				if (!tangents.empty())
+					local_tangents_[v] = calc::dot(to_local, tangents[v]);
+			}
+		}
+	});
+}
+
+void HairRootBinding::evaluate(
+	const std::vector<calc::Vec3>& head_positions,
+	std::vector<calc::Vec3>& positions,
+	std::vector<calc::Vec3>& tangents) const
+{
+	positions.resize(local_positions_.size());
+	tangents.resize(local_tangents_.size());
+
+	util::parallel_for(0, roots_.size(), 256, [&](int lo, int hi) {
+		for (int f = lo; f < hi; ++f) {
+			const auto& root = roots_[f];
+			const auto& a = head_positions[head_indices_[3 * root.triangle]];
+			const auto& b = head_positions[head_indices_[3 * root.triangle + 1]];
+			const auto& c = head_positions[head_indices_[3 * root.triangle + 2]];
+			auto origin = root.bary.x * a + root.bary.y * b + root.bary.z * c;
+			auto frame = triangle_frame(a, b, c);
+
+			const auto& fiber = fibers_[f];
+			for (int v = fiber.vstart; v < fiber.vstart + fiber.vcount; ++v) {
+				positions[v] = origin + calc::dot(frame, local_positions_[v]);
+				if (!tangents.empty())
+					tangents[v] = calc::dot(frame, local_tangents_[v]);
+			}
+		}
+	});
+}
+
+}
@@ -0,0 +1,114 @@
+#ifndef GFX_ROOT_BINDING_H
+#define GFX_ROOT_BINDING_H
+
+#include <vector>
+#include "calc.h"
+#include "GfxModel.h"
+#include "utility.h"
+
+namespace gfx
+{
+
+////
+// Uniform grid over the triangles of a mesh, for
+// closest point queries. Each triangle is listed
+// in every cell its bounding box overlaps. Queries
+// visit rings of cells around the query point
+// until no closer triangle can be found.
+////
+
+class TriangleGrid {
+public:
+
+	class Hit {
+	public:
+		int triangle;       // Index of the triangle's first index / 3.
+		calc::Vec3 point;   // Closest point on the triangle.
+		calc::Vec3 bary;    // Barycentric coordinates of point.
+		float distance;
+	};
+
+	TriangleGrid() {}
+
+	// cells_per_triangle: target #cells over #triangles.
+	void build(const Model& mesh, float cells_per_triangle = 1.f);
+
+	// Closest triangle to p. False if the mesh has no triangles.
+	bool closest(const calc::Vec3& p, Hit& hit) const;
+
+	calc::iVec3 size() const { return size_; }
+
+private:
+
+	int cell_index(int x, int y, int z) const
+	{
+		return (z * size_.y + y) * size_.x + x;
+	}
+
+	calc::iVec3 size_{};
+	calc::Vec3 origin_{};
+	float cell_size_ = 0.f;
+
+	std::vector<calc::Vec3> positions_;
+	std::vector<unsigned> indices_;
+	// Triangles of cell c are cell_tris_[cell_start_[c], cell_start_[c+1]).
+	std::vector<int> cell_start_;
+	std::vector<int> cell_tris_;
+};
+
+////
+// Binding of hair fibers to the triangles of a
+// head mesh. Each root is bound to its closest
+// triangle, and the fiber is stored in the frame
+// of that triangle: origin at the root's closest
+// point, x along the first edge, z along the face
+// normal. Re-evaluating the bindings against moved
+// or skinned head vertices moves each fiber
+// rigidly with its triangle.
+////
+
+class HairRootBinding {
+public:
+
+	class Root {
+	public:
+		int triangle;
+		calc::Vec3 bary;
+	};
+
+	HairRootBinding() {}
+
+	// Fibers are bound in parallel on scheduler.
+	void bind(const Model& hair, const Model& head, const TriangleGrid& grid,
+		util::Scheduler& scheduler = util::scheduler());
+
+	// Hair vertices for the head vertices head_positions, which must
+	// have the topology of the bound head.
+	void evaluate(
+		const std::vector<calc::Vec3>& head_positions,
+		std::vector<calc::Vec3>& positions,
+		std::vector<calc::Vec3>& tangents) const;
+
+	int num_roots() const { return roots_.size(); }
+	const Root& root(int fiber_idx) const { return roots_[fiber_idx]; }
+
+private:
+
+	std::vector<Root> roots_;
+	std::vector<unsigned> head_indices_;
+	// Per fiber vertex range, as in the hair model.
+	std::vector<Model::Fiber> fibers_;
+	// Hair vertices in the frame of their fiber's triangle.
+	std::vector<calc::Vec3> local_positions_;
+	std::vector<calc::Vec3> local_tangents_;
+};
+
+// Orthonormal frame of triangle abc, as the columns of a matrix.
+calc::Mat3 triangle_frame(
+	const calc::Vec3& a,
+	const calc::Vec3& b,
+	const calc::Vec3& c);
+
+}
+
+#endif
@@ -0,0 +1,448 @@
+#include "GfxSdf.h"
+
+#include <fstream>
+#include <unordered_map>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstring>
+#include <cassert>
+#include <numeric>
+
+#include "calc.h"
+#include "utility.h"
+
+namespace gfx
+{
+
+// Real-Time Collision Detection, 5.1.5.
+calc::Vec3 closest_point_on_triangle(
+	const calc::Vec3& p,
+	const calc::Vec3& a,
+	const calc::Vec3& b,
+	const calc::Vec3& c,
+	int& feature)
+{
+	auto ab = b - a, ac = c - a, ap = p - a;
+	float d1 = calc::dot(ab, ap), d2 = calc::dot(ac, ap);
+	if (d1 <= 0.f && d2 <= 0.f) {
+		feature = Vertex0;
+		return a;
+	}
+
+	auto bp = p - b;
+	float d3 = calc::dot(ab, bp), d4 = calc::dot(ac, bp);
+	if (d3 >= 0.f && d4 <= d3) {
+		feature = Vertex1;
+		return b;
+	}
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f) {
+		feature = Edge01;
+		return a + ab * (d1 / (d1 - d3));
+	}
+
+	auto cp = p - c;
+	float d5 = calc::dot(ab, cp), d6 = calc::dot(ac, cp);
+	if (d6 >= 0.f && d5 <= d6) {
+		feature = Vertex2;
+		return c;
+	}
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f) {
+		feature = Edge20;
+		return a + ac * (d2 / (d2 - d6));
+	}
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.f && (d4 - d3) >= 0.f && (d5 - d6) >= 0.f) {
+		feature = Edge12;
+		return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+	}
+
+	feature = Face;
+	float denom = 1.f / (va + vb + vc);
+	return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+class Vec3Hasher {
+public:
+	std::size_t operator()(const calc::Vec3& v) const { return calc::hash(v); }
+};
+
+std::size_t distance_field_key(
+	const Model& mesh, int resolution, int band_cells)
+{
+	std::size_t seed = 0x5df0c0ffee15dead;
+	for (const auto& p : mesh.positions())
+		seed = calc::hash_combine(seed, calc::hash(p));
+	for (auto i : mesh.indices())
+		seed = calc::hash_combine(seed, i);
+	seed = calc::hash_combine(seed, resolution);
+	seed = calc::hash_combine(seed, band_cells);
+	return seed;
+}
+
+////
+// Samples outside the band take the sign of their
+// region of the grid. Regions connected to the
+// padded border are outside, which also holds for
+// open meshes whose holes are wider than the band.
+// Regions enclosed by the band take the majority
+// sign of the band samples around them.
+////
+
+void fill_outside_band(
+	std::vector<float>& samples, const calc::iVec3& size, float band)
+{
+	const float unset = std::numeric_limits<float>::infinity();
+	const std::size_t stride[3] = { 1, static_cast<std::size_t>(size.x),
+		static_cast<std::size_t>(size.x) * size.y };
+
+	std::vector<unsigned char> visited(samples.size(), 0);
+	std::vector<std::size_t> region;
+	for (std::size_t seed = 0; seed < samples.size(); ++seed) {
+		if (samples[seed] != unset || visited[seed])
+			continue;
+
+		// Breadth first over the unset samples, 6-connected.
+		bool border = false;
+		int votes = 0;
+		region.clear();
+		region.push_back(seed);
+		visited[seed] = 1;
+		for (std::size_t head = 0; head < region.size(); ++head) {
+			std::size_t idx = region[head];
+			calc::iVec3 g{
+				static_cast<int>(idx % stride[1]),
+				static_cast<int>(idx / stride[1] % size.y),
+				static_cast<int>(idx / stride[2]) };
+			for (int i = 0; i < 3; ++i) {
+				for (int step : { -1, 1 }) {
+					if (g[i] + step < 0 || g[i] + step >= size[i]) {
+						border = true;
+						continue;
+					}
+					std::size_t next = step < 0 ? idx - stride[i] : idx + stride[i];
+					if (samples[next] != unset)
+						votes += samples[next] < 0.f ? -1 : 1;
+					else if (!visited[next]) {
+						visited[next] = 1;
+						region.push_back(next);
+					}
+				}
+			}
+		}
+
+		float value = border || votes >= 0 ? band : -band;
+		for (auto idx : region)
+			samples[idx] = value;
+	}
+}
+
+DistanceField DistanceField::bake(
+	const Model& mesh,
+	int resolution,
+	int band_cells)
+{
+	assert(mesh.model_type() == ModelType::TriangleMesh);
+
+	////
+	// The loader splits vertices by normal and uv,
+	// so weld them by position to get the mesh
+	// connectivity the pseudo-normals need.
+	////
+
+	std::unordered_map<calc::Vec3, int, Vec3Hasher> welding;
+	std::vector<calc::Vec3> verts;
+	std::vector<calc::iVec3> tris;
+	const auto& indices = mesh.indices();
+	int num_indices = indices.size();
+	for (int i = 0; i + 2 < num_indices; i += 3) {
+		calc::iVec3 tri;
+		for (int k = 0; k < 3; ++k) {
+			const auto& p = mesh.positions()[indices[i + k]];
+			auto found = welding.find(p);
+			if (found == welding.end()) {
+				found = welding.insert({ p, static_cast<int>(verts.size()) }).first;
+				verts.push_back(p);
+			}
+			tri[k] = found->second;
+		}
+		if (tri.x != tri.y && tri.y != tri.z && tri.z != tri.x)
+			tris.push_back(tri);
+	}
+
+	// Angle-weighted vertex normals and edge normals.
+	// Generating Signed Distance Fields From Triangle Meshes,
+	// Baerentzen and Aanaes.
+	std::vector<calc::Vec3> face_normals(tris.size());
+	std::vector<calc::Vec3> vert_normals(verts.size(), calc::Vec3{});
+	std::unordered_map<uint64_t, calc::Vec3> edge_normal_sums;
+	auto edge_key = [](int i, int j) {
+		return (static_cast<uint64_t>(std::min(i, j)) << 32) |
+			static_cast<uint64_t>(std::max(i, j));
+	};
+
+	int num_tris = tris.size();
+	for (int t = 0; t < num_tris; ++t) {
+		const auto& tri = tris[t];
+		auto n = calc::cross(verts[tri.y] - verts[tri.x], verts[tri.z] - verts[tri.x]);
+		float len = calc::length(n);
+		n = len > 0.f ? n / len : calc::Vec3{};
+		face_normals[t] = n;
+		for (int k = 0; k < 3; ++k) {
+			auto e0 = verts[tri[(k + 1) % 3]] - verts[tri[k]];
+			auto e1 = verts[tri[(k + 2) % 3]] - verts[tri[k]];
+			float l0 = calc::length(e0), l1 = calc::length(e1);
+			if (l0 > 0.f && l1 > 0.f) {
+				float angle = std::acos(calc::clamp(
+					calc::dot(e0, e1) / (l0 * l1), -1.f, 1.f));
+				vert_normals[tri[k]] += angle * n;
+			}
+			edge_normal_sums[edge_key(tri[k], tri[(k + 1) % 3])] += n;
+		}
+	}
+
+	// Per triangle, normals of edges 01, 12, 20.
+	std::vector<calc::Mat3> edge_normals(num_tris);
+	for (int t = 0; t < num_tris; ++t)
+		for (int k = 0; k < 3; ++k)
+			edge_normals[t][k] = edge_normal_sums[
+				edge_key(tris[t][k], tris[t][(k + 1) % 3])];
+
+	////
+	// Grid over the mesh bounds, padded by the band.
+	////
+
+	DistanceField sdf{};
+	auto bounds = calc::box_from_points(verts);
+	auto extent = bounds.size();
+	float longest = std::max(extent.x, std::max(extent.y, extent.z));
+	sdf.cell_size_ = longest / std::max(1, resolution - 1);
+	sdf.band_ = band_cells * sdf.cell_size_;
+	int pad = band_cells + 1;
+	for (int i = 0; i < 3; ++i) {
+		sdf.size_[i] = static_cast<int>(std::ceil(extent[i] / sdf.cell_size_)) + 1 + 2 * pad;
+		sdf.origin_[i] = bounds.center()[i] - .5f * (sdf.size_[i] - 1) * sdf.cell_size_;
+	}
+	sdf.key_ = distance_field_key(mesh, resolution, band_cells);
+
+	auto& size = sdf.size_;
+	float cell = sdf.cell_size_;
+	float band = sdf.band_;
+	const float unset = std::numeric_limits<float>::infinity();
+	sdf.samples_.assign(
+		static_cast<std::size_t>(size.x) * size.y * size.z, unset);
+
+	auto to_cell = [&](float v, int axis) {
+		return static_cast<int>(std::floor((v - sdf.origin_[axis]) / cell));
+	};
+
+	////
+	// Slabs of z are independent, so each thread owns
+	// the samples of its slabs. Triangles are binned
+	// once by the slabs their padded bounds overlap.
+	////
+
+	constexpr int slab_cells = 2;
+	int num_slabs = (size.z + slab_cells - 1) / slab_cells;
+	std::vector<calc::iVec3> tri_lo(num_tris), tri_hi(num_tris);
+	std::vector<int> slab_start(num_slabs + 1, 0);
+	for (int t = 0; t < num_tris; ++t) {
+		const auto& a = verts[tris[t].x];
+		const auto& b = verts[tris[t].y];
+		const auto& c = verts[tris[t].z];
+		auto inf = calc::minimum(a, calc::minimum(b, c));
+		auto sup = calc::maximum(a, calc::maximum(b, c));
+		for (int i = 0; i < 3; ++i) {
+			tri_lo[t][i] = std::max(0, to_cell(inf[i] - band, i));
+			tri_hi[t][i] = std::min(size[i] - 1, to_cell(sup[i] + band, i) + 1);
+		}
+		for (int slab = tri_lo[t].z / slab_cells; slab <= tri_hi[t].z / slab_cells; ++slab)
+			++slab_start[slab + 1];
+	}
+	std::partial_sum(slab_start.begin(), slab_start.end(), slab_start.begin());
+	// Triangles of slab s are slab_tris[slab_start[s], slab_start[s+1]).
+	std::vector<int> slab_tris(slab_start.back());
+	std::vector<int> slab_cursor(slab_start.begin(), slab_start.end() - 1);
+	for (int t = 0; t < num_tris; ++t)
+		for (int slab = tri_lo[t].z / slab_cells; slab <= tri_hi[t].z / slab_cells; ++slab)
+			slab_tris[slab_cursor[slab]++] = t;
+
+	util::parallel_for(0, num_slabs, 1, [&](int slab_lo, int slab_hi) {
+		for (int slab = slab_lo; slab < slab_hi; ++slab)
+		for (int k = slab_start[slab]; k < slab_start[slab + 1]; ++k) {
+			int t = slab_tris[k];
+			const auto& a = verts[tris[t].x];
+			const auto& b = verts[tris[t].y];
+			const auto& c = verts[tris[t].z];
+
+			auto lo = tri_lo[t], hi = tri_hi[t];
+			lo.z = std::max(lo.z, slab * slab_cells);
+			hi.z = std::min(hi.z, slab * slab_cells + slab_cells - 1);
+
+			for (int z = lo.z; z <= hi.z; ++z)
+			for (int y = lo.y; y <= hi.y; ++y)
+			for (int x = lo.x; x <= hi.x; ++x) {
+				calc::Vec3 p{
+					sdf.origin_.x + x * cell,
+					sdf.origin_.y + y * cell,
+					sdf.origin_.z + z * cell };
+				auto& sample = sdf.samples_[(
+					static_cast<std::size_t>(z) * size.y + y) * size.x + x];
+				// The plane is no farther than the triangle.
+				float plane = std::abs(calc::dot(p - a, face_normals[t]));
+				if (plane > band || plane >= std::abs(sample))
+					continue;
+
+				int feature;
+				auto q = closest_point_on_triangle(p, a, b, c, feature);
+				auto d = calc::length(p - q);
+				if (d > band || d >= std::abs(sample))
+					continue;
+
+				calc::Vec3 n;
+				switch (feature) {
+				case Vertex0: n = vert_normals[tris[t].x]; break;
+				case Vertex1: n = vert_normals[tris[t].y]; break;
+				case Vertex2: n = vert_normals[tris[t].z]; break;
+				case Edge01: n = edge_normals[t][0]; break;
+				case Edge12: n = edge_normals[t][1]; break;
+				case Edge20: n = edge_normals[t][2]; break;
+				default: n = face_normals[t]; break;
+				}
+				sample = calc::dot(p - q, n) < 0.f ? -d : d;
+			}
+		}
+	});
+
+	fill_outside_band(sdf.samples_, size, band);
+
+	return sdf;
+}
+
+DistanceField DistanceField::load_or_bake(
+	const Model& mesh,
+	const std::string& meshfile,
+	int resolution,
+	int band_cells)
+{
+	auto path = meshfile + ".sdf";
+
+	DistanceField sdf{};
+	if (sdf.load(path) &&
+			sdf.key_ == distance_field_key(mesh, resolution, band_cells))
+		return sdf;
+
+	sdf = bake(mesh, resolution, band_cells);
+	if (!sdf.save(path))
+		util::log_warning(UTIL_FMT("Failed to cache distance field {}.\n"), path);
+	return sdf;
+}
+
+template<typename T>
+void ofstream_write(std::ofstream& fp, const T& val)
+{
+	fp.write(reinterpret_cast<const char*>(&val), sizeof(val));
+}
+
+bool DistanceField::save(const std::string& path) const
+{
+	std::ofstream fp(path, std::ios::binary);
+	if (!fp)
+		return false;
+
+	fp.write("GFX_SDF1", 8);
+	ofstream_write(fp, static_cast<uint64_t>(key_));
+	ofstream_write(fp, size_);
+	ofstream_write(fp, origin_);
+	ofstream_write(fp, cell_size_);
+	ofstream_write(fp, band_);
+	fp.write(reinterpret_cast<const char*>(samples_.data()),
+		samples_.size() * sizeof(float));
+	return static_cast<bool>(fp);
+}
+
+bool DistanceField::load(const std::string& path)
+{
+	std::ifstream fp(path, std::ios::binary);
+	if (!fp)
+		return false;
+
+	char header[9];
+	fp.read(header, 8);
+	header[8] = '\0';
+	if (!fp || strcmp(header, "GFX_SDF1") != 0)
+		return false;
+
+	uint64_t key;
+	fp.read(reinterpret_cast<char*>(&key), sizeof(key));
+	fp.read(reinterpret_cast<char*>(&size_), sizeof(size_));
+	fp.read(reinterpret_cast<char*>(&origin_), sizeof(origin_));
+	fp.read(reinterpret_cast<char*>(&cell_size_), sizeof(cell_size_));
+	fp.read(reinterpret_cast<char*>(&band_), sizeof(band_));
+	if (!fp || size_.x <= 0 || size_.y <= 0 || size_.z <= 0)
+		return false;
+
+	// The samples must fill the rest of the file exactly.
+	auto header_end = fp.tellg();
+	fp.seekg(0, std::ios::end);
+	auto num_bytes = static_cast<uint64_t>(fp.tellg() - header_end);
+	fp.seekg(header_end);
+	uint64_t num_samples = num_bytes / sizeof(float);
+	uint64_t num_xy = static_cast<uint64_t>(size_.x) * size_.y;
+	if (num_bytes % sizeof(float) != 0 || num_samples % num_xy != 0 ||
+			num_samples / num_xy != static_cast<uint64_t>(size_.z))
+		return false;
+	key_ = static_cast<std::size_t>(key);
+
+	samples_.resize(static_cast<std::size_t>(num_samples));
+	fp.read(reinterpret_cast<char*>(samples_.data()),
+		samples_.size() * sizeof(float));
+	return static_cast<bool>(fp);
+}
+
+float DistanceField::distance(const calc::Vec3& p) const
+{
+	if (samples_.empty())
+		return std::numeric_limits<float>::max();
+
+	// Continuous grid coordinates, clamped to the grid.
+	auto g = (p - origin_) / cell_size_;
+	calc::Vec3 gmax{
+		static_cast<float>(size_.x - 1),
+		static_cast<float>(size_.y - 1),
+		static_cast<float>(size_.z - 1) };
+	auto gc = calc::minimum(calc::maximum(g, calc::Vec3{}), gmax);
+	float outside = calc::length(g - gc) * cell_size_;
+
+	int x = std::min(static_cast<int>(gc.x), size_.x - 2);
+	int y = std::min(static_cast<int>(gc.y), size_.y - 2);
+	int z = std::min(static_cast<int>(gc.z), size_.z - 2);
+	float fx = gc.x - x, fy = gc.y - y, fz = gc.z - z;
+
+	float c00 = calc::lerp(sample(x, y, z), sample(x + 1, y, z), fx);
+	float c10 = calc::lerp(sample(x, y + 1, z), sample(x + 1, y + 1, z), fx);
+	float c01 = calc::lerp(sample(x, y, z + 1), sample(x + 1, y, z + 1), fx);
+	float c11 = calc::lerp(sample(x, y + 1, z + 1), sample(x + 1, y + 1, z + 1), fx);
+	float d = calc::lerp(calc::lerp(c00, c10, fy), calc::lerp(c01, c11, fy), fz);
+
+	return d + outside;
+}
+
+calc::Vec3 DistanceField::gradient(const calc::Vec3& p) const
+{
+	float h = .5f * cell_size_;
+	calc::Vec3 grad;
+	for (int i = 0; i < 3; ++i) {
+		calc::Vec3 dp{};
+		dp[i] = h;
+		grad[i] = (distance(p + dp) - distance(p - dp)) / (2.f * h);
+	}
+	return grad;
+}
+
+}
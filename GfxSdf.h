@@ -0,0 +1,86 @@
+#ifndef GFX_SDF_H
+#define GFX_SDF_H
+
+#include <vector>
+#include <string>
+#include "calc.h"
+#include "GfxModel.h"
+
+namespace gfx
+{
+
+enum TriangleFeature {
+	Face = 0,
+	Vertex0, Vertex1, Vertex2,
+	Edge01, Edge12, Edge20
+};
+
+// Closest point on triangle abc to p, and the feature it lies on.
+calc::Vec3 closest_point_on_triangle(
+	const calc::Vec3& p,
+	const calc::Vec3& a,
+	const calc::Vec3& b,
+	const calc::Vec3& c,
+	int& feature);
+
+////
+// Signed distance field of a triangle mesh, on a
+// regular grid in model space. Distances are exact
+// within a narrow band around the surface, with
+// the sign taken from angle-weighted pseudo-normals.
+// Outside the band, samples are clamped to +-band,
+// outside if connected to the grid border, which
+// keeps open meshes outside. Negative is inside.
+////
+
+class DistanceField {
+public:
+
+	DistanceField() {}
+
+	// resolution: #samples along the longest side of the mesh bounds.
+	// band_cells: width of the exact band, in cells.
+	static DistanceField bake(
+		const Model& mesh,
+		int resolution,
+		int band_cells = 3);
+
+	// Load `meshfile`.sdf if it was baked from the same mesh and
+	// settings, otherwise bake and write it.
+	static DistanceField load_or_bake(
+		const Model& mesh,
+		const std::string& meshfile,
+		int resolution,
+		int band_cells = 3);
+
+	bool save(const std::string& path) const;
+	bool load(const std::string& path);
+
+	// Trilinear lookup. Points off the grid get the distance at the
+	// nearest grid point plus the distance to it.
+	float distance(const calc::Vec3& p) const;
+	calc::Vec3 gradient(const calc::Vec3& p) const;
+
+	calc::iVec3 size() const { return size_; }
+	calc::Vec3 origin() const { return origin_; }
+	float cell_size() const { return cell_size_; }
+	float band() const { return band_; }
+
+private:
+
+	float sample(int x, int y, int z) const
+	{
+		return samples_[(z * size_.y + y) * size_.x + x];
+	}
+
+	calc::iVec3 size_{};
+	calc::Vec3 origin_{};
+	float cell_size_ = 0.f;
+	float band_ = 0.f;
+	std::size_t key_ = 0;
+	std::vector<float> samples_;
+};
+
+}
+
+#endif
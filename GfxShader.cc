@@ -27,13 +27,14 @@ bool operator==(const TexInfo& lhs, const TexInfo& rhs)
 }
 
 GLuint create_texture_from_memory(
-    const std::string& img, 
+    std::string_view img, 
     const TexInfo& info)
 {
 	int w, h, c;
 	stbi_set_flip_vertically_on_load(true);
 	unsigned char* data = stbi_load_from_memory(
-		(unsigned char*)img.data(), img.size(), &w, &h, &c, 0);
+		(const unsigned char*)img.data(), static_cast<int>(img.size()), 
+		&w, &h, &c, 0);
 	
 	if (data == nullptr) {
 		std::cerr << "Failed to load image.\n";
@@ -81,9 +82,13 @@ GLuint TextureLoader::load(const TexInfo& info)
 	auto img_found = rawimgs_.find(info.path);
 
 	if (img_found == rawimgs_.end()) {
-		auto img = util::read_file(info.path);
-		rawimgs_.insert({info.path, img});
-		auto tex = create_texture_from_memory(img, info);
+		util::MappedFile img(info.path, util::MappedFile::Sequential);
+		if (!img.is_open()) {
+			std::cerr << "Failed to open " << info.path << ".\n";
+			exit(1);
+		}
+		auto tex = create_texture_from_memory(img.view(), info);
+		rawimgs_.insert({info.path, std::move(img)});
 		texs_.insert({info, tex});
 		return tex;
 	}
@@ -133,6 +138,12 @@ void UniformSetter::template set(GLuint program, const std::string& name, const
     glUniform4f(get_uniform(program, name), value.x, value.y, value.z, value.w);
 }
 
+template <>
+void UniformSetter::template set(GLuint program, const std::string& name, const calc::Mat3& value)
+{
+    glUniformMatrix3fv(get_uniform(program, name), 1, GL_FALSE, calc::begin(value));
+}
+
 template <>
 void UniformSetter::template set(GLuint program, const std::string& name, const calc::Mat4& value)
 {
@@ -229,16 +240,16 @@ std::string prettify_shader_log(const std::string & log, const std::string & sha
 				count = shader.size() - off;
 			else
 				count = line_begin_locations[lino + 1] - off;
-			util::print(ss, "----------\n");
+			util::print(ss, UTIL_FMT("----------\n"));
 			while (count > 0 && shader[off + count - 1] == '\n')
 				count--;
-			util::print(ss, "{}\n", shader.substr(off, count));
+			util::print(ss, UTIL_FMT("{}\n"), shader.substr(off, count));
 
 			int skip = 0;
 			while (skip + idx < log.size() && log[idx + skip] != '\n')
 				++skip;
-			util::print(ss, "{}\n", log.substr(log_line_begin, idx - log_line_begin + skip));
-			util::print(ss, "----------\n");
+			util::print(ss, UTIL_FMT("{}\n"), log.substr(log_line_begin, idx - log_line_begin + skip));
+			util::print(ss, UTIL_FMT("----------\n"));
 			state = 0;
 		}
 		break;
@@ -283,16 +294,17 @@ GLuint create_shader(GLenum type, std::string code)
 
 		glGetShaderiv(shader_handle, GL_INFO_LOG_LENGTH, &log_len);
 		if (log_len <= 0)
-			util::print(std::cerr, "{}: no log found", shader_type_name);
+			util::log_error(UTIL_FMT("{}: no log found"), shader_type_name);
 		else {
-			auto log = std::unique_ptr<char>(new char[log_len]);
-			glGetShaderInfoLog(shader_handle, log_len, &log_len, log.get());
-			util::print(std::cerr, "======={} compile log=======\n", shader_type_name);
-			auto pretty_log = prettify_shader_log(std::string(log.get(), log_len), code);
-			util::print(std::cerr, "{}\n", pretty_log);
-			util::print(std::cerr, "-------\n");
+			std::string log(log_len, '\0');
+			glGetShaderInfoLog(shader_handle, log_len, &log_len, &log[0]);
+			log.resize(log_len);
+			util::log_error(UTIL_FMT("======={} compile log=======\n"), shader_type_name);
+			auto pretty_log = prettify_shader_log(log, code);
+			util::log_error(UTIL_FMT("{}\n"), pretty_log);
+			util::log_error(UTIL_FMT("-------\n"));
 		}
-		util::print(std::cerr, "{} compile error.\n", shader_type_name);
+		util::log_error(UTIL_FMT("{} compile error.\n"), shader_type_name);
         exit(1);
 	}
 	return shader_handle;
@@ -306,13 +318,14 @@ void link_shader(GLuint program)
 	if (!success) {
 		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &log_len);
 		if (log_len <= 0)
-			util::print(std::cerr, "No log found\n");
+			util::log_error(UTIL_FMT("No log found\n"));
 		else {
-			auto log = std::unique_ptr<char>(new char[log_len]);
-			glGetProgramInfoLog(program, log_len, nullptr, log.get());
-			util::print(std::cerr, "Program compile log: {}", log.get());
+			std::string log(log_len, '\0');
+			glGetProgramInfoLog(program, log_len, &log_len, &log[0]);
+			log.resize(log_len);
+			util::log_error(UTIL_FMT("Program compile log: {}"), log);
 		}
-		util::print(std::cerr, "Program compile error");
+		util::log_error(UTIL_FMT("Program compile error"));
         exit(1);
 	}
 }
@@ -377,13 +390,21 @@ GLuint create_glsl_program(
 {
 	std::string vertex_shader, geometry_shader, fragment_shader, compute_shader;
     auto shader_include_dir = util::get_file_base_dir(filepath);
-	auto glsl = std::istringstream(util::read_file(filepath));
-	std::string line;
+	util::MappedFile file(filepath);
+	if (!file.is_open()) {
+		std::cerr << "Failed to open " << filepath << ".\n";
+		exit(1);
+	}
 
 	std::string* stage = nullptr;
 
-	while (std::getline(glsl, line)) {
-		if (line.find("#include") != std::string::npos && stage != nullptr) {
+	auto glsl = file.view();
+	while (!glsl.empty()) {
+		auto eol = glsl.find('\n');
+		auto line = glsl.substr(0, eol);
+		glsl.remove_prefix(eol == std::string_view::npos ? glsl.size() : eol + 1);
+
+		if (line.find("#include") != std::string_view::npos && stage != nullptr) {
 			int i = 0, j = 0;
 			while (i < line.size() && line[i++] != '\"')
 				;
@@ -391,31 +412,40 @@ GLuint create_glsl_program(
 			while (++j < line.size() && line[j] != '\"')
 				;
 
-			auto symbol = line.substr(i, j - i);
-			if (symbols.count(symbol))
-				* stage += symbols.at(symbol);
-			else
-				*stage += util::read_file(shader_include_dir + line.substr(i, j - i));
+			auto symbol = std::string(line.substr(i, j - i));
+			if (symbols.count(symbol)) {
+				*stage += symbols.at(symbol);
+			}
+			else {
+				util::MappedFile include(shader_include_dir + symbol);
+				if (!include.is_open()) {
+					std::cerr << "Failed to open " << shader_include_dir + symbol << ".\n";
+					exit(1);
+				}
+				*stage += include.view();
+			}
 			*stage += "\n";
 		}
-		else if (line.find("#stage vertex") != std::string::npos) {
+		else if (line.find("#stage vertex") != std::string_view::npos) {
 			stage = &vertex_shader;
 		}
-		else if (line.find("#stage geometry") != std::string::npos) {
+		else if (line.find("#stage geometry") != std::string_view::npos) {
 			stage = &geometry_shader;
 		}
-		else if (line.find("#stage fragment") != std::string::npos) {
+		else if (line.find("#stage fragment") != std::string_view::npos) {
 			stage = &fragment_shader;
 		}
-		else if (line.find("#stage compute") != std::string::npos) {
+		else if (line.find("#stage compute") != std::string_view::npos) {
 			stage = &compute_shader;
 		}
-		else if (line.find("#endstage") != std::string::npos) {
+		else if (line.find("#endstage") != std::string_view::npos) {
 			stage = nullptr;
 		}
 		else {
-			if (stage != nullptr)
-				* stage += line + "\n";
+			if (stage != nullptr) {
+				*stage += line;
+				*stage += '\n';
+			}
 		}
 
 	}
@@ -7,6 +7,7 @@
 #endif
 
 #include "GfxModel.h" 
+#include "utility.h"
 
 namespace gfx
 {
@@ -31,7 +32,6 @@ template <>
 struct std::hash<gfx::TexInfo> {
     std::size_t operator()(const gfx::TexInfo& vert) const
     {
-		auto unsigned_hasher = std::hash<unsigned>();
         std::size_t seed = 0xdeadbeefc01dbeaf;
         seed = calc::hash_combine(seed, vert.path);
         seed = calc::hash_combine(seed, vert.mag_filter);
@@ -56,7 +56,8 @@ private:
 
 	std::vector<std::string> fmts_{".tga", ".png", ".jpg", ".bmp"};
 	std::unordered_map<TexInfo, GLuint> texs_;
-	std::unordered_map<std::string, std::string> rawimgs_;
+	// Encoded images, mapped rather than copied.
+	std::unordered_map<std::string, util::MappedFile> rawimgs_;
 };
 
 }
@@ -80,6 +81,7 @@ private:
 template <> void UniformSetter::template set(GLuint, const std::string&, const calc::Vec2&);
 template <> void UniformSetter::template set(GLuint, const std::string&, const calc::Vec3&);
 template <> void UniformSetter::template set(GLuint, const std::string&, const calc::Vec4&);
+template <> void UniformSetter::template set(GLuint, const std::string&, const calc::Mat3&);
 template <> void UniformSetter::template set(GLuint, const std::string&, const calc::Mat4&);
 template <> void UniformSetter::template set(GLuint, const std::string&, const GLint&);
 template <> void UniformSetter::template set(GLuint, const std::string&, const GLfloat&);
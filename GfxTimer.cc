@@ -0,0 +1,40 @@
+#include "GfxTimer.h"
+
+namespace gfx
+{
+
+void GpuTimer::begin()
+{
+	if (queries_[0] == 0)
+		glGenQueries(num_queries_, queries_);
+
+	auto query = queries_[frame_ % num_queries_];
+	if (frame_ >= num_queries_) {
+		GLint available = 0;
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint64 elapsed_ns = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed_ns);
+			elapsed_ms_ = elapsed_ns * 1e-6f;
+		}
+	}
+
+	glBeginQuery(GL_TIME_ELAPSED, query);
+}
+
+void GpuTimer::end()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	frame_++;
+}
+
+void GpuTimer::destroy()
+{
+	if (queries_[0] != 0)
+		glDeleteQueries(num_queries_, queries_);
+	for (auto& query : queries_)
+		query = 0;
+	frame_ = 0;
+}
+
+}
@@ -0,0 +1,39 @@
+#ifndef GFX_TIMER_H
+#define GFX_TIMER_H
+
+#ifndef _ANDROID_
+#include "glad/glad.h"
+#endif
+
+namespace gfx
+{
+
+////
+// GPU time of a pass, from GL_TIME_ELAPSED queries.
+// Queries are recycled a few frames later, so that 
+// reading a result never stalls the pipeline.
+////
+
+class GpuTimer {
+public:
+
+	GpuTimer() {}
+
+	void begin();
+	void end();
+
+	// Latest available result, in milliseconds.
+	float elapsed_ms() const { return elapsed_ms_; }
+
+	void destroy();
+
+private:
+	static constexpr int num_queries_ = 4;
+	GLuint queries_[num_queries_] = {};
+	int frame_ = 0;
+	float elapsed_ms_ = 0.f;
+};
+
+}
+
+#endif
@@ -0,0 +1,335 @@
+#stage vertex
+#include "version"
+
+layout(location=0) in vec3 vs_Position;
+layout(location=1) in vec3 vs_Tangent;
+
+out vec3 gs_Position;
+out vec3 gs_Tangent;
+
+uniform mat4 g_LocalTransform;
+
+void main()
+{
+    gs_Position = (g_LocalTransform*vec4(vs_Position, 1.)).xyz;
+    gs_Tangent = mat3(g_LocalTransform)*vs_Tangent;
+}
+
+#endstage
+
+#stage geometry
+#include "version"
+
+layout(lines) in;
+layout(triangle_strip, max_vertices=4) out;
+
+in vec3 gs_Position[];
+in vec3 gs_Tangent[];
+
+out vec3 fs_Position;
+out vec3 fs_Tangent;
+
+uniform mat4 g_WorldTransform;
+uniform vec3 g_Eye;
+uniform float g_HairWidth;
+
+void main()
+{
+    // Expand the segment into a ribbon facing the eye.
+    for (int i = 0; i < 2; ++i) {
+        vec3 T = normalize(gs_Tangent[i]);
+        vec3 V = g_Eye-gs_Position[i];
+        vec3 side = cross(T, V);
+        float len = length(side);
+        side = len > 1e-6 ? side/len : vec3(0.);
+        for (int s = -1; s <= 1; s += 2) {
+            fs_Position = gs_Position[i] + .5*s*g_HairWidth*side;
+            fs_Tangent = T;
+            gl_Position = g_WorldTransform*vec4(fs_Position, 1.);
+            EmitVertex();
+        }
+    }
+    EndPrimitive();
+}
+
+#endstage
+
+#stage fragment
+#include "version"
+#include "shading"
+#include "output"
+
+in vec3 fs_Position;
+in vec3 fs_Tangent;
+
+uniform vec3 g_Eye, g_PointLightPos;
+uniform vec3 g_HairColor;
+uniform float g_HairAlpha;
+
+#ifdef OIT_OUTPUT
+
+// Weighted blended order-independent transparency,
+// McGuire and Bavoil 2013, eq. 10.
+layout(location=0) out vec4 out_Accum;
+layout(location=1) out float out_Reveal;
+
+void write_color(vec3 color, float alpha)
+{
+    float z = 1.-gl_FragCoord.z;
+    float w = clamp(alpha*max(1e-2, 3e3*z*z*z), 1e-2, 3e3);
+    out_Accum = vec4(color*alpha, alpha)*w;
+    out_Reveal = alpha;
+}
+
+#else
+
+out vec4 out_Color;
+
+void write_color(vec3 color, float alpha)
+{
+    out_Color = vec4(color, 1);
+}
+
+#endif
+
+// Deep opacity maps, see hair_deep_opacity.glsl.
+uniform int g_DomEnabled;
+uniform int g_DomNumSlices;
+uniform float g_DomLayerDepth;
+uniform mat4 g_LightTransform;
+layout(binding=1) uniform sampler2D g_DomDepth;
+layout(binding=2) uniform sampler2DArray g_DomOpacity;
+
+float dom_slice(vec2 uv, int j)
+{
+    if (j < 0)
+        return 0.;
+    return texture(g_DomOpacity, vec3(uv, j/4))[j%4];
+}
+
+// Fraction of light reaching pos through the hair.
+float hair_transmittance(vec3 pos)
+{
+    if (g_DomEnabled == 0)
+        return 1.;
+
+    vec4 clip = g_LightTransform*vec4(pos, 1.);
+    vec2 uv = clip.xy/clip.w*.5+.5;
+    float z0 = texture(g_DomDepth, uv).r;
+    float k = (distance(pos, g_PointLightPos)-z0)/g_DomLayerDepth;
+    // Slice j ends at k = j+1, so the last slice is reached just
+    // below k = g_DomNumSlices.
+    k = clamp(k, 0., float(g_DomNumSlices)-1e-3);
+
+    // Opacity is known at slice ends, interpolate in between.
+    int j = int(k);
+    float opacity = mix(dom_slice(uv, j-1), dom_slice(uv, j), fract(k));
+    return exp(-opacity);
+}
+
+#ifdef MARSCHNER_LUT
+
+// Marschner tables, see GfxMarschner.h.
+layout(binding=3) uniform sampler2D g_MarschnerM;
+layout(binding=4) uniform sampler2D g_MarschnerN0;
+layout(binding=5) uniform sampler2D g_MarschnerN1;
+
+void main()
+{
+    vec3 T = normalize(fs_Tangent);
+    vec3 L = normalize(g_PointLightPos-fs_Position);
+    vec3 V = normalize(g_Eye-fs_Position);
+
+    float sin_i = dot(T, L);
+    float sin_r = dot(T, V);
+    vec3 Lp = L-sin_i*T;
+    vec3 Vp = V-sin_r*T;
+    float cos_phi = dot(Lp, Vp)*inversesqrt(max(dot(Lp, Lp)*dot(Vp, Vp), 1e-8));
+
+    vec4 M = texture(g_MarschnerM, vec2(sin_i, sin_r)*.5+.5);
+    vec2 uv_n = vec2(cos_phi*.5+.5, M.a);
+    vec4 N0 = texture(g_MarschnerN0, uv_n);
+    vec3 N1 = texture(g_MarschnerN1, uv_n).rgb;
+    vec3 scattering = M.r*N0.r + M.g*N0.gba + M.b*N1;
+
+    float cos_i = sqrt(max(0., 1.-sin_i*sin_i));
+    float transmittance = hair_transmittance(fs_Position);
+
+    vec3 lighting = vec3(.2)*g_HairColor;
+    lighting += transmittance*cos_i*scattering;
+    write_color(lighting, g_HairAlpha);
+}
+
+#elif defined(MARSCHNER_ANALYTIC)
+
+// The model of GfxMarschner.cc, evaluated per fragment
+// instead of baked, with the roots shared by channels.
+uniform float g_MarschnerEta;
+uniform vec3 g_MarschnerAbsorption;
+uniform float g_MarschnerShift, g_MarschnerWidth;
+
+const float PI = 3.14159265;
+
+float marschner_gaussian(float width, float x)
+{
+    return exp(-.5*x*x/(width*width))/(width*sqrt(2.*PI));
+}
+
+float marschner_fresnel(float eta_perp, float eta_par, float gamma)
+{
+    float cos_i = cos(gamma), sin_i = sin(gamma);
+
+    float sin_t = sin_i/eta_perp;
+    if (sin_t >= 1.)
+        return 1.;
+    float cos_t = sqrt(1.-sin_t*sin_t);
+    float rs = (cos_i-eta_perp*cos_t)/(cos_i+eta_perp*cos_t);
+
+    sin_t = sin_i/eta_par;
+    if (sin_t >= 1.)
+        return 1.;
+    cos_t = sqrt(1.-sin_t*sin_t);
+    float rp = (eta_par*cos_i-cos_t)/(eta_par*cos_i+cos_t);
+
+    return .5*(rs*rs+rp*rp);
+}
+
+// Real roots of a*x^3 + b*x + d = 0 in [-pi/2, pi/2].
+int marschner_roots(float a, float b, float d, out float roots[3])
+{
+    float x[3];
+    int num_x = 1;
+    if (abs(a) < 1e-6) {
+        x[0] = -d/b;
+    }
+    else {
+        float p = b/a, q = d/a;
+        float delta = .25*q*q + p*p*p/27.;
+        if (delta > 0.) {
+            float s = sqrt(delta);
+            float u = -.5*q+s, v = -.5*q-s;
+            x[0] = sign(u)*pow(abs(u), 1./3.) + sign(v)*pow(abs(v), 1./3.);
+        }
+        else {
+            float r = 2.*sqrt(-p/3.);
+            float phi = acos(clamp(1.5*q/p*sqrt(-3./p), -1., 1.))/3.;
+            for (int k = 0; k < 3; ++k)
+                x[k] = r*cos(phi-2.*PI*k/3.);
+            num_x = 3;
+        }
+    }
+
+    int count = 0;
+    for (int k = 0; k < num_x; ++k)
+        if (abs(x[k]) <= .5*PI)
+            roots[count++] = x[k];
+    return count;
+}
+
+vec3 marschner_azimuthal(
+    int p, float phi, float eta_perp, float eta_par, vec3 absorption)
+{
+    float c = asin(1./eta_perp);
+    float a = -8.*p*c/(PI*PI*PI);
+    float b = 6.*p*c/PI-2.;
+
+    vec3 sum = vec3(0.);
+    for (int k = -2; k <= 2; ++k) {
+        float roots[3];
+        int num_roots = marschner_roots(a, b, p*PI-phi-2.*PI*k, roots);
+
+        for (int r = 0; r < num_roots; ++r) {
+            float gamma_i = roots[r];
+            float f = marschner_fresnel(eta_perp, eta_par, gamma_i);
+
+            vec3 attenuation = vec3(f);
+            if (p > 0) {
+                float gamma_t = asin(sin(gamma_i)/eta_perp);
+                vec3 transmit = exp(-2.*absorption*(1.+cos(2.*gamma_t)));
+                float internal = marschner_fresnel(
+                    1./eta_perp, 1./eta_par, gamma_t);
+                attenuation = (1.-f)*(1.-f)*
+                    pow(internal, p-1.)*pow(transmit, vec3(p));
+            }
+
+            float dphi_dgamma = b+3.*a*gamma_i*gamma_i;
+            float spread = abs(cos(gamma_i)/(2.*dphi_dgamma));
+            sum += attenuation*min(spread, 2.);
+        }
+    }
+    return sum;
+}
+
+void main()
+{
+    vec3 T = normalize(fs_Tangent);
+    vec3 L = normalize(g_PointLightPos-fs_Position);
+    vec3 V = normalize(g_Eye-fs_Position);
+
+    float sin_i = clamp(dot(T, L), -1., 1.);
+    float sin_r = clamp(dot(T, V), -1., 1.);
+    vec3 Lp = L-sin_i*T;
+    vec3 Vp = V-sin_r*T;
+    float cos_phi = dot(Lp, Vp)*inversesqrt(max(dot(Lp, Lp)*dot(Vp, Vp), 1e-8));
+
+    float theta_i = asin(sin_i), theta_r = asin(sin_r);
+    float theta_h = .5*(theta_i+theta_r);
+    float theta_d = .5*(theta_r-theta_i);
+    float shift = g_MarschnerShift, width = g_MarschnerWidth;
+    vec3 M = vec3(
+        marschner_gaussian(width, theta_h-shift),
+        marschner_gaussian(.5*width, theta_h+.5*shift),
+        marschner_gaussian(2.*width, theta_h+1.5*shift));
+
+    // Bravais indices and absorption at theta_d, see MarschnerLut::bake.
+    float cos_d = max(cos(theta_d), 1e-3);
+    float sin_d = sqrt(1.-cos_d*cos_d);
+    float eta2 = g_MarschnerEta*g_MarschnerEta;
+    float eta_perp = sqrt(eta2-sin_d*sin_d)/cos_d;
+    float eta_par = eta2*cos_d/sqrt(eta2-sin_d*sin_d);
+    float sin_t = sin_d/g_MarschnerEta;
+    vec3 absorption = g_MarschnerAbsorption/sqrt(1.-sin_t*sin_t);
+
+    float phi = acos(clamp(cos_phi, -1., 1.));
+    vec3 scattering =
+        M.x*marschner_azimuthal(0, phi, eta_perp, eta_par, vec3(0.)) +
+        M.y*marschner_azimuthal(1, phi, eta_perp, eta_par, absorption) +
+        M.z*marschner_azimuthal(2, phi, eta_perp, eta_par, absorption);
+    scattering /= max(cos_d*cos_d, 1e-2);
+
+    float cos_i = sqrt(max(0., 1.-sin_i*sin_i));
+    float transmittance = hair_transmittance(fs_Position);
+
+    vec3 lighting = vec3(.2)*g_HairColor;
+    lighting += transmittance*cos_i*scattering;
+    write_color(lighting, g_HairAlpha);
+}
+
+#else
+
+void main()
+{
+    // Kajiya-Kay.
+    vec3 T = normalize(fs_Tangent);
+    vec3 L = normalize(g_PointLightPos-fs_Position);
+    vec3 V = normalize(g_Eye-fs_Position);
+
+    float cosTL = dot(T, L);
+    float sinTL = sqrt(max(0., 1.-cosTL*cosTL));
+    float cosTV = dot(T, V);
+    float sinTV = sqrt(max(0., 1.-cosTV*cosTV));
+
+    float diffuse = sinTL;
+    float specular = pow(max(0., cosTL*cosTV+sinTL*sinTV), 80.);
+
+    float transmittance = hair_transmittance(fs_Position);
+
+    vec3 lighting = vec3(.2)*g_HairColor;
+    lighting += transmittance*.6*diffuse*g_HairColor;
+    lighting += transmittance*.3*specular*vec3(1.);
+    write_color(lighting, g_HairAlpha);
+}
+
+#endif
+
+#endstage
@@ -0,0 +1,60 @@
+#stage vertex
+#include "version"
+
+layout(location=0) in vec3 vs_Position;
+
+out vec3 fs_Position;
+
+uniform mat4 g_LocalTransform, g_LightTransform;
+
+void main()
+{
+    fs_Position = (g_LocalTransform*vec4(vs_Position, 1.)).xyz;
+    gl_Position = g_LightTransform*vec4(fs_Position, 1.);
+}
+
+#endstage
+
+#stage fragment
+#include "version"
+#include "pass"
+
+in vec3 fs_Position;
+
+uniform vec3 g_LightPos;
+
+#ifdef DEPTH_PASS
+
+// Distance from the light to the nearest hair, with GL_MIN blending.
+layout(location=0) out float out_Depth;
+
+void main()
+{
+    out_Depth = distance(fs_Position, g_LightPos);
+}
+
+#else
+
+// Slice j accumulates the opacity of fragments in front of its end,
+// four slices per attachment, with additive blending.
+layout(location=0) out vec4 out_Opacity[NUM_SLICE_GROUPS];
+
+layout(binding=0) uniform sampler2D g_DomDepth;
+uniform float g_DomLayerDepth;
+uniform float g_HairOpacity;
+
+void main()
+{
+    float z0 = texelFetch(g_DomDepth, ivec2(gl_FragCoord.xy), 0).r;
+    float k = (distance(fs_Position, g_LightPos)-z0)/g_DomLayerDepth;
+    k = min(k, 4.*NUM_SLICE_GROUPS-1.);
+
+    for (int i = 0; i < NUM_SLICE_GROUPS; ++i) {
+        vec4 slice_end = vec4(4*i+1, 4*i+2, 4*i+3, 4*i+4);
+        out_Opacity[i] = g_HairOpacity*vec4(greaterThan(slice_end, vec4(k)));
+    }
+}
+
+#endif
+
+#endstage
@@ -0,0 +1,242 @@
+#stage compute
+#include "version"
+#include "pass"
+
+////
+// Software strand rasterizer, see GfxHair.h.
+// BIN_PASS projects segments and counts them per
+// tile, SCAN_PASS turns counts into offsets,
+// FILL_PASS writes tile lists, and RASTER_PASS
+// composites each tile in one workgroup.
+////
+
+#define TILE_SIZE 16
+#define BATCH_SIZE (TILE_SIZE*TILE_SIZE)
+
+// Model space endpoints, two per segment.
+layout(std430, binding=0) readonly buffer Segments { vec4 g_Segments[]; };
+// Screen space endpoints (px, window depth, half width in px),
+// then the shaded color, three per segment.
+layout(std430, binding=1) buffer Projected { vec4 g_Projected[]; };
+layout(std430, binding=2) buffer TileCounts { uint g_TileCount[]; };
+layout(std430, binding=3) buffer TileOffsets { uint g_TileOffset[]; };
+layout(std430, binding=4) buffer TileCursors { uint g_TileCursor[]; };
+layout(std430, binding=5) buffer TileEntries { uint g_TileEntry[]; };
+
+uniform int g_NumSegments;
+uniform int g_NumTilesX, g_NumTilesY;
+uniform int g_MaxTileEntries;
+uniform vec2 g_Viewport;
+
+// Tiles touched by the bounding box of a projected segment, empty
+// if the segment is culled.
+ivec4 tile_rect(vec4 a, vec4 b)
+{
+    float pad = max(a.w, b.w)+.5;
+    vec2 inf = min(a.xy, b.xy)-pad;
+    vec2 sup = max(a.xy, b.xy)+pad;
+    if (a.w < 0. || any(greaterThan(inf, g_Viewport)) || any(lessThan(sup, vec2(0.))))
+        return ivec4(0, 0, -1, -1);
+
+    ivec2 tiles = ivec2(g_NumTilesX, g_NumTilesY);
+    ivec2 lo = clamp(ivec2(inf)/TILE_SIZE, ivec2(0), tiles-1);
+    ivec2 hi = clamp(ivec2(sup)/TILE_SIZE, ivec2(0), tiles-1);
+    return ivec4(lo, hi);
+}
+
+#ifdef BIN_PASS
+
+layout(local_size_x=256) in;
+
+uniform mat4 g_LocalTransform, g_WorldTransform;
+uniform vec3 g_Eye, g_PointLightPos;
+uniform vec3 g_HairColor;
+uniform float g_HairWidth;
+// Pixels per unit length at unit distance.
+uniform float g_PixelScale;
+
+vec4 project(vec3 pos)
+{
+    vec4 clip = g_WorldTransform*vec4(pos, 1.);
+    vec3 ndc = clip.xyz/clip.w;
+    return vec4((ndc.xy*.5+.5)*g_Viewport, ndc.z*.5+.5,
+        .5*g_HairWidth*g_PixelScale/clip.w);
+}
+
+// Kajiya-Kay, once per segment.
+vec3 shade(vec3 pos, vec3 T)
+{
+    vec3 L = normalize(g_PointLightPos-pos);
+    vec3 V = normalize(g_Eye-pos);
+
+    float cosTL = dot(T, L);
+    float sinTL = sqrt(max(0., 1.-cosTL*cosTL));
+    float cosTV = dot(T, V);
+    float sinTV = sqrt(max(0., 1.-cosTV*cosTV));
+    float specular = pow(max(0., cosTL*cosTV+sinTL*sinTV), 80.);
+
+    return (.2+.6*sinTL)*g_HairColor+.3*specular*vec3(1.);
+}
+
+void main()
+{
+    uint s = gl_GlobalInvocationID.x;
+    if (s >= uint(g_NumSegments))
+        return;
+
+    vec3 p0 = (g_LocalTransform*vec4(g_Segments[2*s].xyz, 1.)).xyz;
+    vec3 p1 = (g_LocalTransform*vec4(g_Segments[2*s+1].xyz, 1.)).xyz;
+
+    // Segments crossing the eye plane are dropped.
+    vec4 c0 = g_WorldTransform*vec4(p0, 1.);
+    vec4 c1 = g_WorldTransform*vec4(p1, 1.);
+    if (min(c0.w, c1.w) <= 1e-4) {
+        g_Projected[3*s] = vec4(-1.);
+        return;
+    }
+
+    vec4 a = project(p0), b = project(p1);
+    g_Projected[3*s] = a;
+    g_Projected[3*s+1] = b;
+    g_Projected[3*s+2] = vec4(shade(.5*(p0+p1), normalize(p1-p0)), 1.);
+
+    ivec4 rect = tile_rect(a, b);
+    for (int y = rect.y; y <= rect.w; ++y)
+        for (int x = rect.x; x <= rect.z; ++x)
+            atomicAdd(g_TileCount[y*g_NumTilesX+x], 1u);
+}
+
+#endif
+
+#ifdef SCAN_PASS
+
+// One workgroup, each invocation owns a run of tiles.
+layout(local_size_x=1024) in;
+
+shared uint s_Sum[1024];
+
+void main()
+{
+    uint i = gl_LocalInvocationID.x;
+    uint num_tiles = uint(g_NumTilesX*g_NumTilesY);
+    uint run = (num_tiles+1023u)/1024u;
+    uint begin = min(i*run, num_tiles);
+    uint end = min(begin+run, num_tiles);
+
+    uint sum = 0u;
+    for (uint t = begin; t < end; ++t)
+        sum += g_TileCount[t];
+    s_Sum[i] = sum;
+    barrier();
+
+    // Inclusive scan of the run sums.
+    for (uint d = 1u; d < 1024u; d <<= 1) {
+        uint v = i >= d ? s_Sum[i-d] : 0u;
+        barrier();
+        s_Sum[i] += v;
+        barrier();
+    }
+
+    uint offset = s_Sum[i]-sum;
+    for (uint t = begin; t < end; ++t) {
+        g_TileOffset[t] = offset;
+        g_TileCursor[t] = offset;
+        offset += g_TileCount[t];
+    }
+}
+
+#endif
+
+#ifdef FILL_PASS
+
+layout(local_size_x=256) in;
+
+void main()
+{
+    uint s = gl_GlobalInvocationID.x;
+    if (s >= uint(g_NumSegments))
+        return;
+
+    ivec4 rect = tile_rect(g_Projected[3*s], g_Projected[3*s+1]);
+    for (int y = rect.y; y <= rect.w; ++y) {
+        for (int x = rect.x; x <= rect.z; ++x) {
+            uint entry = atomicAdd(g_TileCursor[y*g_NumTilesX+x], 1u);
+            // Overflowing entries are dropped.
+            if (entry < uint(g_MaxTileEntries))
+                g_TileEntry[entry] = s;
+        }
+    }
+}
+
+#endif
+
+#ifdef RASTER_PASS
+
+layout(local_size_x=TILE_SIZE, local_size_y=TILE_SIZE) in;
+
+layout(rgba8, binding=0) uniform image2D g_Color;
+layout(binding=0) uniform sampler2D g_Depth;
+
+uniform float g_HairAlpha;
+
+shared vec4 s_A[BATCH_SIZE], s_B[BATCH_SIZE], s_Color[BATCH_SIZE];
+
+void main()
+{
+    uint tile = gl_WorkGroupID.y*uint(g_NumTilesX)+gl_WorkGroupID.x;
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    bool inside = all(lessThan(vec2(pixel), g_Viewport));
+    float scene_depth = inside ? texelFetch(g_Depth, pixel, 0).r : 0.;
+    vec2 center = vec2(pixel)+.5;
+
+    uint begin = g_TileOffset[tile];
+    uint end = min(begin+g_TileCount[tile], uint(g_MaxTileEntries));
+    uint lane = gl_LocalInvocationIndex;
+
+    // Weighted blended OIT, as in hair.glsl, kept in registers.
+    vec4 accum = vec4(0.);
+    float reveal = 1.;
+
+    for (uint base = begin; base < end; base += BATCH_SIZE) {
+        barrier();
+        if (base+lane < end) {
+            uint s = g_TileEntry[base+lane];
+            s_A[lane] = g_Projected[3*s];
+            s_B[lane] = g_Projected[3*s+1];
+            s_Color[lane] = g_Projected[3*s+2];
+        }
+        barrier();
+
+        uint count = min(uint(BATCH_SIZE), end-base);
+        for (uint k = 0u; k < count; ++k) {
+            vec4 a = s_A[k], b = s_B[k];
+            vec2 ab = b.xy-a.xy;
+            float t = clamp(dot(center-a.xy, ab)/max(dot(ab, ab), 1e-8), 0., 1.);
+            float d = distance(center, a.xy+t*ab);
+            float z = mix(a.z, b.z, t);
+
+            // Overlap of the strand cross section with the pixel.
+            float hw = mix(a.w, b.w, t);
+            float coverage = max(0., min(hw, d+.5)-max(-hw, d-.5));
+            if (coverage <= 0. || z >= scene_depth || z < 0.)
+                continue;
+
+            float alpha = coverage*g_HairAlpha;
+            float x = 1.-z;
+            float w = clamp(alpha*max(1e-2, 3e3*x*x*x), 1e-2, 3e3);
+            accum += vec4(s_Color[k].rgb*alpha, alpha)*w;
+            reveal *= 1.-alpha;
+        }
+    }
+
+    if (!inside || reveal >= 1.)
+        return;
+
+    vec4 dst = imageLoad(g_Color, pixel);
+    vec3 color = accum.rgb/max(accum.a, 1e-5);
+    imageStore(g_Color, pixel, vec4(mix(color, dst.rgb, reveal), dst.a));
+}
+
+#endif
+
+#endstage
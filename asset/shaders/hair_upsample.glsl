@@ -0,0 +1,64 @@
+#stage vertex
+#include "version"
+
+void main()
+{
+    // Fullscreen triangle.
+    vec2 pos = vec2((gl_VertexID<<1)&2, gl_VertexID&2);
+    gl_Position = vec4(pos*2.-1., 0., 1.);
+}
+
+#endstage
+
+#stage fragment
+#include "version"
+
+out vec4 out_Color;
+
+layout(binding=0) uniform sampler2D g_HalfColor;
+layout(binding=1) uniform sampler2D g_HalfDepth;
+layout(binding=2) uniform sampler2D g_Depth;
+
+uniform mat4 g_InvWorldTransform;
+
+// Clip space w of the point at uv and depth z.
+float linear_depth(vec2 uv, float z)
+{
+    vec4 w_row = vec4(g_InvWorldTransform[0][3], g_InvWorldTransform[1][3], 
+        g_InvWorldTransform[2][3], g_InvWorldTransform[3][3]);
+    return 1./dot(w_row, vec4(vec3(uv, z)*2.-1., 1.));
+}
+
+void main()
+{
+    vec2 uv = gl_FragCoord.xy/vec2(textureSize(g_Depth, 0));
+    float depth = linear_depth(uv, texelFetch(g_Depth, ivec2(gl_FragCoord.xy), 0).r);
+
+    // Bilinear footprint in the half resolution target.
+    ivec2 half_size = textureSize(g_HalfColor, 0);
+    vec2 pos = uv*vec2(half_size)-.5;
+    ivec2 base = ivec2(floor(pos));
+    vec2 f = pos-vec2(base);
+
+    vec4 color = vec4(0.);
+    float weight = 0.;
+    for (int i = 0; i < 4; ++i) {
+        ivec2 offset = ivec2(i&1, i>>1);
+        ivec2 tap = clamp(base+offset, ivec2(0), half_size-1);
+        vec2 tap_uv = (vec2(tap)+.5)/vec2(half_size);
+        float tap_depth = linear_depth(tap_uv, texelFetch(g_HalfDepth, tap, 0).r);
+
+        // Taps from another surface than this pixel barely contribute.
+        vec2 b = mix(1.-f, f, vec2(offset));
+        float w = b.x*b.y/(1e-3+abs(tap_depth-depth)/depth);
+        color += w*texelFetch(g_HalfColor, tap, 0);
+        weight += w;
+    }
+
+    if (color.a <= 0.)
+        discard;
+    // Blended with GL_ONE, GL_ONE_MINUS_SRC_ALPHA.
+    out_Color = color/weight;
+}
+
+#endstage
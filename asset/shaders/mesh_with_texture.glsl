@@ -10,12 +10,14 @@ out vec3 fs_Normal;
 out vec2 fs_Texcoord;
 
 uniform mat4 g_LocalTransform, g_WorldTransform;
+// Inverse transpose of g_LocalTransform's upper 3x3.
+uniform mat3 g_NormalTransform;
 
 void main()
 {
     fs_Position = (g_LocalTransform*vec4(vs_Position, 1.)).xyz;
     gl_Position = g_WorldTransform*vec4(fs_Position, 1.);
-    fs_Normal = mat3(transpose(inverse(g_LocalTransform)))*vs_Normal;
+    fs_Normal = g_NormalTransform*vs_Normal;
     fs_Texcoord = vs_Texcoord;
 }
 
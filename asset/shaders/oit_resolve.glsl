@@ -0,0 +1,33 @@
+#stage vertex
+#include "version"
+
+void main()
+{
+    // Fullscreen triangle.
+    vec2 pos = vec2((gl_VertexID<<1)&2, gl_VertexID&2);
+    gl_Position = vec4(pos*2.-1., 0., 1.);
+}
+
+#endstage
+
+#stage fragment
+#include "version"
+
+out vec4 out_Color;
+
+layout(binding=0) uniform sampler2D g_Accum;
+layout(binding=1) uniform sampler2D g_Reveal;
+
+void main()
+{
+    ivec2 coord = ivec2(gl_FragCoord.xy);
+    float reveal = texelFetch(g_Reveal, coord, 0).r;
+    if (reveal >= 1.)
+        discard;
+
+    vec4 accum = texelFetch(g_Accum, coord, 0);
+    // Blended with GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA.
+    out_Color = vec4(accum.rgb/max(accum.a, 1e-5), reveal);
+}
+
+#endstage
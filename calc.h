@@ -3,12 +3,62 @@
 
 
 #include <cmath>
+#include <limits>
 #include <numeric>
 #include <algorithm>
 #include <functional>
 #include <vector>
 #include <cstring>
 #include <string>
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <type_traits>
+
+////
+// SIMD backend for Mat4. Defining CALC_NO_SIMD
+// keeps the portable scalar code everywhere.
+////
+
+#if !defined(CALC_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define CALC_SIMD_SSE
+#include <xmmintrin.h>
+#elif !defined(CALC_NO_SIMD) && (defined(__ARM_NEON) || defined(_M_ARM64))
+#define CALC_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(CALC_SIMD_SSE) || defined(CALC_SIMD_NEON)
+#define CALC_SIMD
+#endif
+
+// Eight lanes for the batched kernels, scalar otherwise.
+#if !defined(CALC_NO_SIMD) && defined(__AVX2__)
+#define CALC_SIMD_AVX2
+#include <immintrin.h>
+#endif
+
+// Every AVX2 CPU has F16C, GCC and Clang still need -mf16c.
+#if defined(CALC_SIMD_AVX2) && (defined(__F16C__) || defined(_MSC_VER))
+#define CALC_SIMD_F16C
+#endif
+
+////
+// Most of calc is constexpr. During constant evaluation,
+// SIMD, pointer casts and <cmath> are swapped for plain
+// code, and runtime code is unchanged. Without the
+// builtin, calc is runtime only, see CALC_CONSTEXPR.
+////
+
+#if (defined(__GNUC__) && __GNUC__ >= 9) || \
+	(defined(__clang__) && __clang_major__ >= 9) || \
+	(defined(_MSC_VER) && _MSC_VER >= 1925)
+#define CALC_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#define CALC_CONSTEXPR
+#else
+#define CALC_CONSTANT_EVALUATED() false
+#endif
 
 namespace calc
 {
@@ -20,6 +70,68 @@ namespace calc
 constexpr float pi = 3.1415926535897932384626f;
 constexpr float eps = 16 * std::numeric_limits<float>::epsilon();
 
+////
+// <cmath> functions usable in constant expressions.
+////
+
+constexpr float sqrt(float x)
+{
+	if (!CALC_CONSTANT_EVALUATED())
+		return std::sqrt(x);
+	if (!(x > 0.))
+		return x == 0. ? 0.f : std::numeric_limits<float>::quiet_NaN();
+	if (x == std::numeric_limits<float>::infinity())
+		return x;
+	// Newton's method from above.
+	double r = x > 1. ? x : 1., prev = 0.;
+	while (r != prev) {
+		prev = r;
+		r = .5 * (r + x / r);
+		if (r > prev)
+			break;
+	}
+	return static_cast<float>(prev);
+}
+
+constexpr float sin(float x)
+{
+	if (!CALC_CONSTANT_EVALUATED())
+		return std::sin(x);
+	// Taylor series about the nearest multiple of 2 pi.
+	constexpr double two_pi = 6.283185307179586476925;
+	double k = static_cast<double>(static_cast<long long>(x / two_pi));
+	double r = x - k * two_pi;
+	r = r > two_pi / 2 ? r - two_pi : (r < -two_pi / 2 ? r + two_pi : r);
+	double term = r, sum = r;
+	for (int n = 1; n < 16; ++n) {
+		term *= -r * r / ((2 * n) * (2 * n + 1));
+		sum += term;
+	}
+	return static_cast<float>(sum);
+}
+
+constexpr float cos(float x)
+{
+	if (!CALC_CONSTANT_EVALUATED())
+		return std::cos(x);
+	return sin(x + pi / 2);
+}
+
+constexpr float tan(float x)
+{
+	if (!CALC_CONSTANT_EVALUATED())
+		return std::tan(x);
+	return sin(x) / cos(x);
+}
+
+template<typename T>
+constexpr void swap(T& a, T& b)
+{
+	T tmp = a;
+	a = b;
+	b = tmp;
+}
+
 ////
 // Mat class.
 ////
@@ -48,8 +160,14 @@ public:
 	ValType x;
 	ValType y;
 
-	const ValType& operator[](const int i) const { return (&x)[i]; }
-	ValType& operator[](const int i) { return (&x)[i]; }
+	constexpr const ValType& operator[](const int i) const
+	{
+		return CALC_CONSTANT_EVALUATED() ? (i == 0 ? x : y) : (&x)[i];
+	}
+	constexpr ValType& operator[](const int i)
+	{
+		return CALC_CONSTANT_EVALUATED() ? (i == 0 ? x : y) : (&x)[i];
+	}
 };
 
 using Vec2 = Mat<float, 2, 1>;
@@ -67,8 +185,14 @@ public:
 	ValType y;
 	ValType z;
 
-	const ValType& operator[](const int i) const { return (&x)[i]; }
-	ValType& operator[](const int i) { return (&x)[i]; }
+	constexpr const ValType& operator[](const int i) const
+	{
+		return CALC_CONSTANT_EVALUATED() ? (i == 0 ? x : (i == 1 ? y : z)) : (&x)[i];
+	}
+	constexpr ValType& operator[](const int i)
+	{
+		return CALC_CONSTANT_EVALUATED() ? (i == 0 ? x : (i == 1 ? y : z)) : (&x)[i];
+	}
 };
 
 using Vec3 = Mat<float, 3, 1>;
@@ -87,8 +211,14 @@ public:
 	ValType z;
 	ValType w;
 
-	const ValType& operator[](const int i) const { return (&x)[i]; }
-	ValType& operator[](const int i) { return (&x)[i]; }
+	constexpr const ValType& operator[](const int i) const
+	{
+		return CALC_CONSTANT_EVALUATED() ? (i == 0 ? x : (i == 1 ? y : (i == 2 ? z : w))) : (&x)[i];
+	}
+	constexpr ValType& operator[](const int i)
+	{
+		return CALC_CONSTANT_EVALUATED() ? (i == 0 ? x : (i == 1 ? y : (i == 2 ? z : w))) : (&x)[i];
+	}
 };
 
 using Vec4 = Mat<float, 4, 1>;
@@ -105,12 +235,18 @@ public:
 	Mat<ValType, 2, 1> col_vec_0;
 	Mat<ValType, 2, 1> col_vec_1;
 
-	const auto& operator[](const int i) const { return (&col_vec_0)[i]; }
-	auto& operator[](const int i) { return (&col_vec_0)[i]; }
+	constexpr const auto& operator[](const int i) const
+	{
+		return CALC_CONSTANT_EVALUATED() ? (i == 0 ? col_vec_0 : col_vec_1) : (&col_vec_0)[i];
+	}
+	constexpr auto& operator[](const int i)
+	{
+		return CALC_CONSTANT_EVALUATED() ? (i == 0 ? col_vec_0 : col_vec_1) : (&col_vec_0)[i];
+	}
 
-	auto& T()
+	constexpr auto& T()
 	{
-		std::swap((*this)[0][1], (*this)[1][0]);
+		calc::swap((*this)[0][1], (*this)[1][0]);
 		return *this;
 	}
 };
@@ -130,14 +266,20 @@ public:
 	Mat<ValType, 3, 1> col_vec_1;
 	Mat<ValType, 3, 1> col_vec_2;
 
-	const auto& operator[](const int i) const { return (&col_vec_0)[i]; }
-	auto& operator[](const int i) { return (&col_vec_0)[i]; }
+	constexpr const auto& operator[](const int i) const
+	{
+		return CALC_CONSTANT_EVALUATED() ? (i == 0 ? col_vec_0 : (i == 1 ? col_vec_1 : col_vec_2)) : (&col_vec_0)[i];
+	}
+	constexpr auto& operator[](const int i)
+	{
+		return CALC_CONSTANT_EVALUATED() ? (i == 0 ? col_vec_0 : (i == 1 ? col_vec_1 : col_vec_2)) : (&col_vec_0)[i];
+	}
 
-	auto& T()
+	constexpr auto& T()
 	{
-		std::swap((*this)[0][1], (*this)[1][0]);
-		std::swap((*this)[0][2], (*this)[2][0]);
-		std::swap((*this)[1][2], (*this)[2][1]);
+		calc::swap((*this)[0][1], (*this)[1][0]);
+		calc::swap((*this)[0][2], (*this)[2][0]);
+		calc::swap((*this)[1][2], (*this)[2][1]);
 		return *this;
 	}
 };
@@ -158,17 +300,23 @@ public:
 	Mat<ValType, 4, 1> col_vec_2;
 	Mat<ValType, 4, 1> col_vec_3;
 
-	const auto& operator[](const int i) const { return (&col_vec_0)[i]; }
-	auto& operator[](const int i) { return (&col_vec_0)[i]; }
+	constexpr const auto& operator[](const int i) const
+	{
+		return CALC_CONSTANT_EVALUATED() ? (i == 0 ? col_vec_0 : (i == 1 ? col_vec_1 : (i == 2 ? col_vec_2 : col_vec_3))) : (&col_vec_0)[i];
+	}
+	constexpr auto& operator[](const int i)
+	{
+		return CALC_CONSTANT_EVALUATED() ? (i == 0 ? col_vec_0 : (i == 1 ? col_vec_1 : (i == 2 ? col_vec_2 : col_vec_3))) : (&col_vec_0)[i];
+	}
 
-	auto& T()
+	constexpr auto& T()
 	{
-		std::swap((*this)[0][1], (*this)[1][0]);
-		std::swap((*this)[0][2], (*this)[2][0]);
-		std::swap((*this)[0][3], (*this)[3][0]);
-		std::swap((*this)[1][2], (*this)[2][1]);
-		std::swap((*this)[1][3], (*this)[3][1]);
-		std::swap((*this)[2][3], (*this)[3][2]);
+		calc::swap((*this)[0][1], (*this)[1][0]);
+		calc::swap((*this)[0][2], (*this)[2][0]);
+		calc::swap((*this)[0][3], (*this)[3][0]);
+		calc::swap((*this)[1][2], (*this)[2][1]);
+		calc::swap((*this)[1][3], (*this)[3][1]);
+		calc::swap((*this)[2][3], (*this)[3][2]);
 		return *this;
 	}
 };
@@ -221,92 +369,134 @@ const ValType* end(const Mat<ValType, NumRows, NumCols>& a)
 	return begin(a) + NumRows * NumCols;
 }
 
+////
+// element: i-th value of a in column major order,
+// as begin(a)[i], also in constant expressions.
+////
+
+template<typename ValType, int NumRows, int NumCols>
+constexpr typename std::enable_if<NumCols == 1, ValType&>::type
+	element(Mat<ValType, NumRows, NumCols>& a, int i)
+{
+	return a[i];
+}
+
+template<typename ValType, int NumRows, int NumCols>
+constexpr typename std::enable_if<NumCols != 1, ValType&>::type
+	element(Mat<ValType, NumRows, NumCols>& a, int i)
+{
+	return CALC_CONSTANT_EVALUATED() ? a[i / NumRows][i % NumRows] : begin(a)[i];
+}
+
+template<typename ValType, int NumRows, int NumCols>
+constexpr typename std::enable_if<NumCols == 1, const ValType&>::type
+	element(const Mat<ValType, NumRows, NumCols>& a, int i)
+{
+	return a[i];
+}
+
+template<typename ValType, int NumRows, int NumCols>
+constexpr typename std::enable_if<NumCols != 1, const ValType&>::type
+	element(const Mat<ValType, NumRows, NumCols>& a, int i)
+{
+	return CALC_CONSTANT_EVALUATED() ? a[i / NumRows][i % NumRows] : begin(a)[i];
+}
+
+// Indexable view of the values of a, see element.
+template<typename MatType>
+class Elements {
+public:
+	const MatType& a;
+	constexpr auto operator[](int i) const { return element(a, i); }
+};
+
+template<typename MatType>
+constexpr Elements<MatType> elements(const MatType& a)
+{
+	return Elements<MatType>{ a };
+}
+
 ////
 // Element-wise operations.
 ////
 
 #define ElementwiseOpsForMat(Op) \
 template<typename ValType1, typename ValType2, int NumRows, int NumCols> \
-auto operator##Op##=( \
+constexpr auto operator Op##=( \
 	Mat<ValType1, NumRows, NumCols>& lhs, \
 	const Mat<ValType2, NumRows, NumCols>& rhs) \
 { \
 for (int i = 0; i < NumRows * NumCols; ++i) \
-	* (begin(lhs) + i) Op##= *(begin(rhs) + i); \
+	element(lhs, i) Op##= element(rhs, i); \
 return lhs; \
 } \
 \
 template<typename ValType, typename ScalarType, int NumRows, int NumCols> \
-typename std::enable_if< \
+constexpr typename std::enable_if< \
 	std::is_same<float, ScalarType>::value \
 	|| std::is_same<int, ScalarType>::value, \
 	Mat<ValType, NumRows, NumCols>>::type \
-operator##Op##=(Mat<ValType, NumRows, NumCols> & lhs, const ScalarType & rhs) \
+operator Op##=(Mat<ValType, NumRows, NumCols> & lhs, const ScalarType & rhs) \
 { \
 for (int i = 0; i < NumRows * NumCols; ++i) \
-	* (begin(lhs) + i) Op##= rhs; \
+	element(lhs, i) Op##= rhs; \
 return lhs; \
 } \
 \
 template<typename ValType1, typename ValType2, int NumRows, int NumCols> \
-auto operator##Op( \
+constexpr auto operator Op( \
 	const Mat<ValType1, NumRows, NumCols> & lhs, \
 	const Mat<ValType2, NumRows, NumCols> & rhs) \
 { \
 Mat<decltype(ValType1() + ValType2()), NumRows, NumCols> tmp{}; \
 for (int i = 0; i < NumRows * NumCols; ++i) \
-	* (begin(tmp) + i) = *(begin(lhs) + i) Op *(begin(rhs) + i); \
+	element(tmp, i) = element(lhs, i) Op element(rhs, i); \
 return tmp; \
 } \
 \
 template<typename ValType, typename ScalarType, int NumRows, int NumCols> \
-typename std::enable_if< \
+constexpr typename std::enable_if< \
 	std::is_same<float, ScalarType>::value \
 	|| std::is_same<int, ScalarType>::value, \
 	Mat<decltype(ValType() + ScalarType()), NumRows, NumCols>>::type \
-operator##Op( \
+operator Op( \
 const Mat<ValType, NumRows, NumCols> & lhs, \
 const ScalarType & rhs) \
 { \
 Mat<decltype(ValType() + ScalarType()), NumRows, NumCols> tmp{}; \
 for (int i = 0; i < NumRows * NumCols; ++i) \
-	* (begin(tmp) + i) = *(begin(lhs) + i) Op rhs; \
+	element(tmp, i) = element(lhs, i) Op rhs; \
 return tmp; \
 } \
 \
 template<typename ValType, typename ScalarType, int NumRows, int NumCols> \
-typename std::enable_if< \
+constexpr typename std::enable_if< \
 	std::is_same<float, ScalarType>::value \
 	|| std::is_same<int, ScalarType>::value, \
 	Mat<decltype(ValType() * ScalarType()), NumRows, NumCols>>::type \
-operator##Op( \
+operator Op( \
 const ScalarType & lhs, \
 const Mat<ValType, NumRows, NumCols> & rhs) \
 { \
 Mat<decltype(ValType() + ScalarType()), NumRows, NumCols> tmp{}; \
 for (int i = 0; i < NumRows * NumCols; ++i) \
-	* (begin(tmp) + i) = lhs Op * (begin(rhs) + i); \
+	element(tmp, i) = lhs Op element(rhs, i); \
 return tmp; \
 }
 
 template<typename ValType1, typename ValType2, int NumRows, int NumCols>
-bool operator==(
+constexpr bool operator==(
 	const Mat<ValType1, NumRows, NumCols>& lhs,
 	const Mat<ValType2, NumRows, NumCols>& rhs)
 {
-	auto lhs_iter = begin(lhs);
-	auto rhs_iter = begin(rhs);
-	while (lhs_iter != end(lhs)) {
-		if (*lhs_iter != *rhs_iter)
+	for (int i = 0; i < NumRows * NumCols; ++i)
+		if (element(lhs, i) != element(rhs, i))
 			return false;
-		lhs_iter++;
-		rhs_iter++;
-	}
 	return true;
 }
 
 template<typename ValType1, typename ValType2, int NumRows, int NumCols>
-bool operator!=(
+constexpr bool operator!=(
 	const Mat<ValType1, NumRows, NumCols>& lhs,
 	const Mat<ValType2, NumRows, NumCols>& rhs)
 {
@@ -323,91 +513,447 @@ ElementwiseOpsForMat(/);
 ////
 
 template<int NumRows, int NumCols>
-auto operator%=(
+constexpr auto operator%=(
     Mat<int, NumRows, NumCols>& lhs, const Mat<int, NumRows, NumCols>& rhs)
 {
     for (int i = 0; i < NumRows * NumCols; ++i)
-        * (begin(lhs) + i) %= *(begin(rhs) + i);
+        element(lhs, i) %= element(rhs, i);
     return lhs;
 }
 
 template<int NumRows, int NumCols>
-auto operator%=(Mat<int, NumRows, NumCols> & lhs, int rhs)
+constexpr auto operator%=(Mat<int, NumRows, NumCols> & lhs, int rhs)
 {
     for (int i = 0; i < NumRows * NumCols; ++i)
-        * (begin(lhs) + i) %= rhs;
+        element(lhs, i) %= rhs;
     return lhs;
 }
 
 template<int NumRows, int NumCols>
-auto operator%(
+constexpr auto operator%(
     Mat<int, NumRows, NumCols> lhs, const Mat<int, NumRows, NumCols>& rhs)
 {
     return lhs %= rhs;
 }
 
 template<int NumRows, int NumCols>
-auto operator%(Mat<int, NumRows, NumCols> lhs, int rhs)
+constexpr auto operator%(Mat<int, NumRows, NumCols> lhs, int rhs)
 {
     return lhs %= rhs;
 }
 
 template<int NumRows, int NumCols>
-auto operator%(int lhs, const Mat<int, NumRows, NumCols> & rhs)
+constexpr auto operator%(int lhs, const Mat<int, NumRows, NumCols> & rhs)
 {
     Mat<int, NumRows, NumCols> tmp{};
     for (int i = 0; i < NumRows * NumCols; ++i)
-        * (begin(tmp) + i) = lhs % *(begin(rhs) + i);
+        element(tmp, i) = lhs % element(rhs, i);
     return tmp;
 }
 
 ////
 
 template<typename ValType, int NumCols, int NumRows>
-auto abs(Mat<ValType, NumCols, NumRows> a)
+constexpr auto abs(Mat<ValType, NumCols, NumRows> a)
 {
-	for (auto* p = begin(a); p != end(a); ++p)
-		*p = std::abs(*p);
+	for (int i = 0; i < NumCols * NumRows; ++i)
+		element(a, i) = element(a, i) < 0 ? -element(a, i) : element(a, i);
 	return a;
 }
 
 template<typename ValType, int NumCols, int NumRows>
-auto operator-(Mat<ValType, NumCols, NumRows> a)
+constexpr auto operator-(Mat<ValType, NumCols, NumRows> a)
 {
-	for (auto* p = begin(a); p != end(a); ++p)
-		*p = -*p;
+	for (int i = 0; i < NumCols * NumRows; ++i)
+		element(a, i) = -element(a, i);
 	return a;
 }
 
+////
+// Expression templates, opt in with lazy(m): chains
+// of element-wise operations on lazy operands are
+// evaluated in one loop when converted to a Mat,
+// without Mat temporaries in between, e.g.
+//   Vec3 p = (lazy(p0) - c) * s + center;
+// Operands are held by reference, so an expression
+// must be converted within the full expression that
+// builds it. Mat operands alone keep the eager
+// operators above.
+////
+
+namespace expr
+{
+
+template<typename Derived, typename ValType, int NumRows, int NumCols>
+class Expr {
+public:
+	using value_type = ValType;
+	constexpr static int num_rows = NumRows;
+	constexpr static int num_cols = NumCols;
+
+	constexpr ValType at(int i) const
+	{
+		return static_cast<const Derived&>(*this).at(i);
+	}
+
+	template<typename T>
+	constexpr operator Mat<T, NumRows, NumCols>() const
+	{
+		Mat<T, NumRows, NumCols> m{};
+		for (int i = 0; i < NumRows * NumCols; ++i)
+			element(m, i) = static_cast<T>(at(i));
+		return m;
+	}
+};
+
+template<typename T>
+struct is_Expr {
+	template<typename D, typename V, int R, int C>
+	static std::true_type test(const Expr<D, V, R, C>*);
+	static std::false_type test(...);
+	static constexpr bool value = decltype(test(std::declval<T*>()))::value;
+};
+
+template<typename MatType>
+class Leaf : public Expr<Leaf<MatType>, 
+	typename MatType::value_type, MatType::num_rows, MatType::num_cols> {
+public:
+	constexpr explicit Leaf(const MatType& m) : m_{ m } {}
+	constexpr auto at(int i) const { return element(m_, i); }
+private:
+	const MatType& m_;
+};
+
+template<typename ValType, int NumRows, int NumCols>
+class Scalar : public Expr<Scalar<ValType, NumRows, NumCols>, 
+	ValType, NumRows, NumCols> {
+public:
+	constexpr explicit Scalar(ValType s) : s_{ s } {}
+	constexpr ValType at(int) const { return s_; }
+private:
+	ValType s_;
+};
+
+struct Add { template<typename A, typename B> static constexpr auto apply(A a, B b) { return a + b; } };
+struct Sub { template<typename A, typename B> static constexpr auto apply(A a, B b) { return a - b; } };
+struct Mul { template<typename A, typename B> static constexpr auto apply(A a, B b) { return a * b; } };
+struct Div { template<typename A, typename B> static constexpr auto apply(A a, B b) { return a / b; } };
+
+template<typename Op, typename L, typename R>
+class Binary : public Expr<Binary<Op, L, R>,
+	decltype(Op::apply(typename L::value_type(), typename R::value_type())),
+	L::num_rows, L::num_cols> {
+public:
+	static_assert(L::num_rows == R::num_rows && L::num_cols == R::num_cols,
+		"mat size not equal.");
+
+	constexpr Binary(const L& l, const R& r) : l_{ l }, r_{ r } {}
+	constexpr auto at(int i) const { return Op::apply(l_.at(i), r_.at(i)); }
+private:
+	L l_;
+	R r_;
+};
+
+template<typename E>
+class Negate : public Expr<Negate<E>, 
+	typename E::value_type, E::num_rows, E::num_cols> {
+public:
+	constexpr explicit Negate(const E& e) : e_{ e } {}
+	constexpr auto at(int i) const { return -e_.at(i); }
+private:
+	E e_;
+};
+
+// Expression node of an operand, by value.
+template<typename E>
+constexpr const E& node(const Expr<E, typename E::value_type, E::num_rows, E::num_cols>& e)
+{
+	return static_cast<const E&>(e);
+}
+
+template<typename ValType, int NumRows, int NumCols>
+constexpr auto node(const Mat<ValType, NumRows, NumCols>& m)
+{
+	return Leaf<Mat<ValType, NumRows, NumCols>>{ m };
+}
+
+template<typename T>
+using Node = typename std::decay<decltype(node(std::declval<const T&>()))>::type;
+
+// Lazy operands, at least one of them an expression.
+template<typename L, typename R>
+using enable_if_lazy = typename std::enable_if<
+	(is_Expr<L>::value && (is_Expr<R>::value || is_Mat<R>::value)) ||
+	(is_Mat<L>::value && is_Expr<R>::value), int>::type;
+
+template<typename E, typename ScalarType>
+using enable_if_scalar = typename std::enable_if<is_Expr<E>::value && (
+	std::is_same<float, ScalarType>::value || 
+	std::is_same<int, ScalarType>::value), int>::type;
+
+#define ExpressionOpsForMat(Op, OpName) \
+template<typename L, typename R, enable_if_lazy<L, R> = 0> \
+constexpr auto operator Op(const L& lhs, const R& rhs) \
+{ \
+	return Binary<OpName, Node<L>, Node<R>>{ node(lhs), node(rhs) }; \
+} \
+\
+template<typename E, typename ScalarType, enable_if_scalar<E, ScalarType> = 0> \
+constexpr auto operator Op(const E& lhs, const ScalarType& rhs) \
+{ \
+	using S = Scalar<ScalarType, E::num_rows, E::num_cols>; \
+	return Binary<OpName, E, S>{ lhs, S{ rhs } }; \
+} \
+\
+template<typename E, typename ScalarType, enable_if_scalar<E, ScalarType> = 0> \
+constexpr auto operator Op(const ScalarType& lhs, const E& rhs) \
+{ \
+	using S = Scalar<ScalarType, E::num_rows, E::num_cols>; \
+	return Binary<OpName, S, E>{ S{ lhs }, rhs }; \
+} \
+\
+template<typename ValType, int NumRows, int NumCols, typename E, \
+	typename = typename std::enable_if<is_Expr<E>::value>::type> \
+constexpr auto& operator Op##=(Mat<ValType, NumRows, NumCols>& lhs, const E& rhs) \
+{ \
+	for (int i = 0; i < NumRows * NumCols; ++i) \
+		element(lhs, i) Op##= rhs.at(i); \
+	return lhs; \
+}
+
+ExpressionOpsForMat(+, Add);
+ExpressionOpsForMat(-, Sub);
+ExpressionOpsForMat(*, Mul);
+ExpressionOpsForMat(/, Div);
+
+#undef ExpressionOpsForMat
+
+template<typename E, typename = typename std::enable_if<is_Expr<E>::value>::type>
+constexpr auto operator-(const E& e)
+{
+	return Negate<E>{ e };
+}
+
+}
+
+template<typename ValType, int NumRows, int NumCols>
+constexpr auto lazy(const Mat<ValType, NumRows, NumCols>& m)
+{
+	return expr::Leaf<Mat<ValType, NumRows, NumCols>>{ m };
+}
+
+// Mat of an expression, for auto variables.
+template<typename E, typename = typename std::enable_if<expr::is_Expr<E>::value>::type>
+constexpr auto eval(const E& e)
+{
+	return static_cast<Mat<typename E::value_type, E::num_rows, E::num_cols>>(e);
+}
+
+#ifdef CALC_SIMD
+
+////
+// Four float lanes, over SSE or NEON. Mat4 kernels 
+// are written once against these operations.
+////
+
+namespace simd
+{
+
+#if defined(CALC_SIMD_SSE)
+
+using f32x4 = __m128;
+
+inline f32x4 load(const float* p) { return _mm_loadu_ps(p); }
+inline void store(float* p, f32x4 v) { _mm_storeu_ps(p, v); }
+inline f32x4 splat(float s) { return _mm_set1_ps(s); }
+inline f32x4 set(float x, float y, float z, float w) { return _mm_setr_ps(x, y, z, w); }
+inline f32x4 add(f32x4 a, f32x4 b) { return _mm_add_ps(a, b); }
+inline f32x4 sub(f32x4 a, f32x4 b) { return _mm_sub_ps(a, b); }
+inline f32x4 mul(f32x4 a, f32x4 b) { return _mm_mul_ps(a, b); }
+inline float lane0(f32x4 v) { return _mm_cvtss_f32(v); }
+
+// (a[i], a[j], b[k], b[l])
+template<int i, int j, int k, int l>
+inline f32x4 shuffle(f32x4 a, f32x4 b)
+{
+	return _mm_shuffle_ps(a, b, _MM_SHUFFLE(l, k, j, i));
+}
+
+inline void transpose(f32x4& r0, f32x4& r1, f32x4& r2, f32x4& r3)
+{
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+}
+
+#elif defined(CALC_SIMD_NEON)
+
+using f32x4 = float32x4_t;
+
+inline f32x4 load(const float* p) { return vld1q_f32(p); }
+inline void store(float* p, f32x4 v) { vst1q_f32(p, v); }
+inline f32x4 splat(float s) { return vdupq_n_f32(s); }
+inline f32x4 set(float x, float y, float z, float w)
+{
+	float v[4] = { x, y, z, w };
+	return vld1q_f32(v);
+}
+inline f32x4 add(f32x4 a, f32x4 b) { return vaddq_f32(a, b); }
+inline f32x4 sub(f32x4 a, f32x4 b) { return vsubq_f32(a, b); }
+inline f32x4 mul(f32x4 a, f32x4 b) { return vmulq_f32(a, b); }
+inline float lane0(f32x4 v) { return vgetq_lane_f32(v, 0); }
+
+template<int i, int j, int k, int l>
+inline f32x4 shuffle(f32x4 a, f32x4 b)
+{
+	f32x4 r = vdupq_n_f32(vgetq_lane_f32(a, i));
+	r = vsetq_lane_f32(vgetq_lane_f32(a, j), r, 1);
+	r = vsetq_lane_f32(vgetq_lane_f32(b, k), r, 2);
+	return vsetq_lane_f32(vgetq_lane_f32(b, l), r, 3);
+}
+
+inline void transpose(f32x4& r0, f32x4& r1, f32x4& r2, f32x4& r3)
+{
+	float32x4x2_t t01 = vtrnq_f32(r0, r1);
+	float32x4x2_t t23 = vtrnq_f32(r2, r3);
+	r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+	r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+	r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+	r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+
+#endif
+
+template<int i, int j, int k, int l>
+inline f32x4 permute(f32x4 a) { return shuffle<i, j, k, l>(a, a); }
+
+inline f32x4 madd(f32x4 a, f32x4 b, f32x4 c) { return add(mul(a, b), c); }
+
+// Linear combination of the columns of a by v.
+inline f32x4 mat4_transform(const float* a, const float* v)
+{
+	f32x4 r = mul(load(a), splat(v[0]));
+	r = madd(load(a + 4), splat(v[1]), r);
+	r = madd(load(a + 8), splat(v[2]), r);
+	return madd(load(a + 12), splat(v[3]), r);
+}
+
+inline void mat4_mul(const float* a, const float* b, float* out)
+{
+	for (int j = 0; j < 4; ++j)
+		store(out + 4 * j, mat4_transform(a, b + 4 * j));
+}
+
+inline void mat4_transpose(const float* a, float* out)
+{
+	f32x4 r0 = load(a), r1 = load(a + 4), r2 = load(a + 8), r3 = load(a + 12);
+	transpose(r0, r1, r2, r3);
+	store(out, r0);
+	store(out + 4, r1);
+	store(out + 8, r2);
+	store(out + 12, r3);
+}
+
+inline void mat4_inv(const float* a, float* out)
+{
+	////
+	// Cofactors from the 2x2 minors of the first two
+	// and last two columns, Laplace expansion. The
+	// columns are read as the rows of the transpose,
+	// whose inverse has our columns as its rows.
+	////
+
+	f32x4 r0 = load(a), r1 = load(a + 4), r2 = load(a + 8), r3 = load(a + 12);
+
+	// s0..s3, s4 s5 s4 s5 of rows 0, 1 and c0..c3, c4 c5 c4 c5 of rows 2, 3.
+	f32x4 s = sub(
+		mul(permute<0, 0, 0, 1>(r0), permute<1, 2, 3, 2>(r1)),
+		mul(permute<0, 0, 0, 1>(r1), permute<1, 2, 3, 2>(r0)));
+	f32x4 s45 = sub(
+		mul(permute<1, 2, 1, 2>(r0), permute<3, 3, 3, 3>(r1)),
+		mul(permute<1, 2, 1, 2>(r1), permute<3, 3, 3, 3>(r0)));
+	f32x4 c = sub(
+		mul(permute<0, 0, 0, 1>(r2), permute<1, 2, 3, 2>(r3)),
+		mul(permute<0, 0, 0, 1>(r3), permute<1, 2, 3, 2>(r2)));
+	f32x4 c45 = sub(
+		mul(permute<1, 2, 1, 2>(r2), permute<3, 3, 3, 3>(r3)),
+		mul(permute<1, 2, 1, 2>(r3), permute<3, 3, 3, 3>(r2)));
+
+	// (c_k, c_k, s_k, s_k)
+	f32x4 k0 = shuffle<0, 0, 0, 0>(c, s);
+	f32x4 k1 = shuffle<1, 1, 1, 1>(c, s);
+	f32x4 k2 = shuffle<2, 2, 2, 2>(c, s);
+	f32x4 k3 = shuffle<3, 3, 3, 3>(c, s);
+	f32x4 k4 = shuffle<0, 0, 0, 0>(c45, s45);
+	f32x4 k5 = shuffle<1, 1, 1, 1>(c45, s45);
+
+	// Columns of the transpose, lanes swapped in pairs.
+	f32x4 t0 = r0, t1 = r1, t2 = r2, t3 = r3;
+	transpose(t0, t1, t2, t3);
+	t0 = permute<1, 0, 3, 2>(t0);
+	t1 = permute<1, 0, 3, 2>(t1);
+	t2 = permute<1, 0, 3, 2>(t2);
+	t3 = permute<1, 0, 3, 2>(t3);
+
+	f32x4 sign = set(1.f, -1.f, 1.f, -1.f);
+	f32x4 b0 = mul(sign, add(sub(mul(t1, k5), mul(t2, k4)), mul(t3, k3)));
+	f32x4 b1 = mul(sign, sub(sub(mul(t2, k2), mul(t0, k5)), mul(t3, k1)));
+	f32x4 b2 = mul(sign, add(sub(mul(t0, k4), mul(t1, k2)), mul(t3, k0)));
+	f32x4 b3 = mul(sign, sub(sub(mul(t1, k1), mul(t0, k3)), mul(t2, k0)));
+
+	// Expansion along the first row of the transpose.
+	f32x4 first = add(
+		add(mul(splat(a[0]), b0), mul(splat(a[1]), b1)),
+		add(mul(splat(a[2]), b2), mul(splat(a[3]), b3)));
+	f32x4 inv_det = splat(1.f / lane0(first));
+
+	store(out, mul(b0, inv_det));
+	store(out + 4, mul(b1, inv_det));
+	store(out + 8, mul(b2, inv_det));
+	store(out + 12, mul(b3, inv_det));
+}
+}
+
+#endif
+
 ////
 // Matrix operations.
 ////
 
 template<typename ValType, int NumRows>
-typename std::enable_if<
+constexpr typename std::enable_if<
 	(NumRows>1), Mat<ValType, NumRows, NumRows>>::type
 transpose(Mat<ValType, NumRows, NumRows> m)
 {
 	return m.T();
 }
 
-inline auto det(const Mat<float, 2, 2> &m)
+#ifdef CALC_SIMD
+constexpr Mat4 transpose(const Mat4& m)
+{
+	Mat4 result{};
+	if (CALC_CONSTANT_EVALUATED())
+		return result = m, result.T();
+	simd::mat4_transpose(begin(m), begin(result));
+	return result;
+}
+#endif
+
+constexpr auto det(const Mat<float, 2, 2> &m)
 {
-	const auto* p = begin(m);
+	const auto p = elements(m);
 	return p[0] * p[3] - p[1] * p[2];
 }
 
-inline auto det(const Mat<float, 3, 3> &m)
+constexpr auto det(const Mat<float, 3, 3> &m)
 {
-	const auto* p = begin(m);
+	const auto p = elements(m);
 	return p[0] * (p[4] * p[8] - p[5] * p[7])
 		- p[3] * (p[1] * p[8] - p[2] * p[7])
 		+ p[6] * (p[1] * p[5] - p[2] * p[4]);
 }
 
-inline auto det(const Mat<float, 4, 4> &m)
+constexpr auto det(const Mat<float, 4, 4> &m)
 {
-	const auto* p = begin(m);
+	const auto p = elements(m);
 	return p[10] * p[13] * p[3] * p[4] + p[0] * p[10] * p[15] * p[5]
 		- p[10] * p[12] * p[3] * p[5] + p[11] * (-p[13] * p[2] * p[4]
 		- p[0] * p[14] * p[5] + p[12] * p[2] * p[5] + p[0] * p[13] * p[6])
@@ -421,18 +967,18 @@ inline auto det(const Mat<float, 4, 4> &m)
 		+ p[0] * p[14] * p[7] * p[9] - p[12] * p[2] * p[7] * p[9];
 }
 
-inline auto inv(const Mat<float, 2, 2>& m)
+constexpr auto inv(const Mat<float, 2, 2>& m)
 {
-	const auto* p = begin(m);
+	const auto p = elements(m);
 	return Mat<float, 2, 2>{
 		{p[3], -p[1]},
 		{ -p[2], p[0] }
-	} /= det(m);
+	} / det(m);
 }
 
-inline auto inv(const Mat<float, 3, 3>& m)
+constexpr auto inv(const Mat<float, 3, 3>& m)
 {
-	const auto *p = begin(m);
+	const auto p = elements(m);
 	return Mat<float, 3, 3>{
 	{
 		-p[5] * p[7] + p[4] * p[8],
@@ -449,12 +995,19 @@ inline auto inv(const Mat<float, 3, 3>& m)
 		p[1] * p[6] - p[0] * p[7],
 		-p[1] * p[3] + p[0] * p[4]
 	}
-	} /= det(m);
+	} / det(m);
 }
 
-inline auto inv(const Mat<float, 4, 4>& m)
+constexpr auto inv(const Mat<float, 4, 4>& m)
 {
-	const auto* p = begin(m);
+#ifdef CALC_SIMD
+	if (!CALC_CONSTANT_EVALUATED()) {
+		Mat<float, 4, 4> result{};
+		simd::mat4_inv(begin(m), begin(result));
+		return result;
+	}
+#endif
+	const auto p = elements(m);
 	return Mat<float, 4, 4>{
 	{
 		-p[11] * p[14] * p[5] + p[10] * p[15] * p[5] + p[11] * p[13] * p[6]
@@ -496,21 +1049,21 @@ inline auto inv(const Mat<float, 4, 4>& m)
 		-p[1] * p[10] * p[4] + p[0] * p[10] * p[5] - p[2] * p[5] * p[8]
 		+ p[1] * p[6] * p[8] + p[2] * p[4] * p[9] - p[0] * p[6] * p[9]
 	}
-	} /= det(m);
+	} / det(m);
 }
 
 template<typename ValType, int NumCols, int NumRows>
-ValType value_sum(const Mat<ValType, NumCols, NumRows>& a)
+constexpr ValType value_sum(const Mat<ValType, NumCols, NumRows>& a)
 {
 	ValType sum{ 0 };
-	for (const auto* p = begin(a); p != end(a); ++p)
-		sum += *p;
+	for (int i = 0; i < NumCols * NumRows; ++i)
+		sum += element(a, i);
 	return sum;
 }
 
 // Inner-product of two vecters.
 template<int NumRows, int NumCols>
-typename std::enable_if<NumCols == 1, float>::type
+constexpr typename std::enable_if<NumCols == 1, float>::type
 dot(const Mat<float, NumRows, NumCols>& p,
 	const Mat<float, NumRows, NumCols>& q)
 {
@@ -520,7 +1073,7 @@ dot(const Mat<float, NumRows, NumCols>& p,
 
 // Inner-product of matrix A, with vector v (Av).
 template<int MatSize, int NumCols>
-typename std::enable_if<
+constexpr typename std::enable_if<
 	MatSize != 1 && NumCols == 1, Mat<float, MatSize, 1>>::type
 dot(const Mat<float, MatSize, MatSize>& A,
 	const Mat<float, MatSize, NumCols>& v)
@@ -533,7 +1086,7 @@ dot(const Mat<float, MatSize, MatSize>& A,
 
 // Inner-product of two matrices, A and B.
 template<int MatSize>
-typename std::enable_if<
+constexpr typename std::enable_if<
 	MatSize != 1, Mat<float, MatSize, MatSize>>::type
 dot(const Mat<float, MatSize, MatSize>& A,
 	const Mat<float, MatSize, MatSize>& B)
@@ -544,19 +1097,45 @@ dot(const Mat<float, MatSize, MatSize>& A,
 	return result;
 }
 
+#ifdef CALC_SIMD
+constexpr Vec4 dot(const Mat4& A, const Vec4& v)
+{
+	Vec4 result{};
+	if (CALC_CONSTANT_EVALUATED()) {
+		for (int i = 0; i < 4; ++i)
+			result += A[i] * v[i];
+		return result;
+	}
+	simd::store(begin(result), simd::mat4_transform(begin(A), begin(v)));
+	return result;
+}
+
+constexpr Mat4 dot(const Mat4& A, const Mat4& B)
+{
+	Mat4 result{};
+	if (CALC_CONSTANT_EVALUATED()) {
+		for (int i = 0; i < 4; ++i)
+			result[i] = dot(A, B[i]);
+		return result;
+	}
+	simd::mat4_mul(begin(A), begin(B), begin(result));
+	return result;
+}
+#endif
+
 template<int NumRows>
-auto length(const Mat<float,NumRows, 1>& v)
+constexpr auto length(const Mat<float,NumRows, 1>& v)
 {
-	return std::sqrtf(dot(v,v));
+	return calc::sqrt(dot(v,v));
 }
 
 template<int NumRows>
-auto normalize(const Mat<float, NumRows, 1>& v)
+constexpr auto normalize(const Mat<float, NumRows, 1>& v)
 {
 	return v / length(v);
 }
 
-inline Vec3 cross(const Vec3& p, const Vec3& q)
+constexpr Vec3 cross(const Vec3& p, const Vec3& q)
 {
 	return Vec3{
 		p.y * q.z - q.y * p.z,
@@ -576,37 +1155,37 @@ public:
 	float y;
 	float z;
 
-	Quat()
+	constexpr Quat()
 		: w{1}, x{ 0 }, y{ 0 }, z{ 0 }
 	{}
 
-	Quat(float w, float x, float y, float z)
+	constexpr Quat(float w, float x, float y, float z)
 		: w{ w }, x{ x }, y{ y }, z{ z }
 	{}
 
-	Quat(float w, const Vec3& v)
+	constexpr Quat(float w, const Vec3& v)
 		: w{ w }, x{ v.x }, y{ v.y }, z{ v.z }
 	{}
 
-	float real() const { return w; }
-	void real(float w) { this->w = w; }
-	Vec3 imag() const { return Vec3{ x, y, z }; }
-	void imag(const Vec3& v) { x = v.x; y = v.y; z = v.z; }
+	constexpr float real() const { return w; }
+	constexpr void real(float w) { this->w = w; }
+	constexpr Vec3 imag() const { return Vec3{ x, y, z }; }
+	constexpr void imag(const Vec3& v) { x = v.x; y = v.y; z = v.z; }
 
 	// Input axis should be a unit vector.
-	static Quat angle_axis(float angle, Vec3 axis)
+	static constexpr Quat angle_axis(float angle, Vec3 axis)
 	{
-		return Quat{ cos(angle * .5f),
-			axis * std::sinf(angle * .5f)};
+		return Quat{ calc::cos(angle * .5f),
+			axis * calc::sin(angle * .5f)};
 	}
 };
 
-inline float dot(const Quat& p, const Quat& q)
+constexpr float dot(const Quat& p, const Quat& q)
 {
 	return p.x*q.x + p.y*q.y + p.z*q.z + p.w*q.w;
 }
 
-inline Quat& operator+=(Quat lhs, const Quat& rhs)
+constexpr Quat& operator+=(Quat& lhs, const Quat& rhs)
 {
 	lhs.x += rhs.x;
 	lhs.y += rhs.y;
@@ -615,12 +1194,12 @@ inline Quat& operator+=(Quat lhs, const Quat& rhs)
 	return lhs;
 }
 
-inline Quat operator+(Quat lhs, const Quat& rhs)
+constexpr Quat operator+(Quat lhs, const Quat& rhs)
 {
 	return lhs += rhs;
 }
 
-inline Quat& operator-=(Quat lhs, const Quat& rhs)
+constexpr Quat& operator-=(Quat& lhs, const Quat& rhs)
 {
 	lhs.x -= rhs.x;
 	lhs.y -= rhs.y;
@@ -629,22 +1208,22 @@ inline Quat& operator-=(Quat lhs, const Quat& rhs)
 	return lhs;
 }
 
-inline Quat operator-(Quat lhs, const Quat& rhs)
+constexpr Quat operator-(Quat lhs, const Quat& rhs)
 {
 	return lhs -= rhs;
 }
 
-inline Quat operator*(const Quat& p, float s)
+constexpr Quat operator*(const Quat& p, float s)
 {
 	return Quat{p.w*s,p.x*s,p.y*s,p.z*s};
 }
 
-inline Quat operator*(float s, const Quat& p)
+constexpr Quat operator*(float s, const Quat& p)
 {
 	return p*s;
 }
 
-inline Quat& operator*=(Quat & lhs, const Quat & rhs)
+constexpr Quat& operator*=(Quat & lhs, const Quat & rhs)
 {
 	const Quat lhs_{ lhs };
 	lhs.w = lhs_.w * rhs.w - lhs_.x * rhs.x - lhs_.y * rhs.y - lhs_.z * rhs.z;
@@ -654,12 +1233,12 @@ inline Quat& operator*=(Quat & lhs, const Quat & rhs)
 	return lhs;
 }
 
-inline Quat operator*(Quat lhs, const Quat & rhs)
+constexpr Quat operator*(Quat lhs, const Quat & rhs)
 {
 	return lhs *= rhs;
 }
 
-inline Quat& operator/=(Quat& p, float s)
+constexpr Quat& operator/=(Quat& p, float s)
 {
 	p.x /= s;
 	p.y /= s;
@@ -668,18 +1247,18 @@ inline Quat& operator/=(Quat& p, float s)
 	return p;
 }
 
-inline Quat operator/(const Quat& p, float s)
+constexpr Quat operator/(const Quat& p, float s)
 {
 	Quat result{ p };
-	return result /= s;;
+	return result /= s;
 }
 
-inline Quat operator/(float w, const Quat& p)
+constexpr Quat operator/(float w, const Quat& p)
 {
 	return Quat{w/p.x,w/p.y,w/p.z,w/p.w};
 }
 
-inline Quat & operator/=(Quat & lhs, const Quat & rhs)
+constexpr Quat & operator/=(Quat & lhs, const Quat & rhs)
 {
 	const Quat lhs_{ lhs };
 
@@ -693,41 +1272,42 @@ inline Quat & operator/=(Quat & lhs, const Quat & rhs)
 	return lhs;
 }
 
-inline Quat operator/(Quat lhs, const Quat & rhs)
+constexpr Quat operator/(Quat lhs, const Quat & rhs)
 {
 	return lhs /= rhs;
 }
 
-inline Quat conj(const Quat& q)
+constexpr Quat conj(const Quat& q)
 {
 	return Quat{q.w, -q.x,-q.y,-q.z};
 }
 
-inline Quat inv(const Quat& q)
+constexpr Quat inv(const Quat& q)
 {
 	return conj(q) / dot(q,q);
 }
 
-inline float length(const Quat& q)
+constexpr float length(const Quat& q)
 {
-	return std::sqrtf(dot(q,q));
+	return calc::sqrt(dot(q,q));
 }
 
-inline Quat normalize(Quat q)
+constexpr Quat normalize(Quat q)
 {
 	return q / length(q);
 }
 
 // Input Quat should be a unit Quaternion.
-inline Vec3 rotate(const Quat& q, const Vec3& v)
+constexpr Vec3 rotate(const Quat& q, const Vec3& v)
 {
-	return 2.f*dot(q.imag(), v) * q.imag()
-		+ (q.w*q.w - dot(q.imag(), q.imag())) * v
-		+ 2.f*q.w * cross(q.imag(), v);
+	const Vec3 u = q.imag(), u_cross_v = cross(u, v);
+	return 2.f*dot(u, v) * lazy(u)
+		+ (q.w*q.w - dot(u, u)) * lazy(v)
+		+ 2.f*q.w * lazy(u_cross_v);
 }
 
 // Input q should be normalized first.
-inline Mat3 Quat2Mat3(const Quat& q)
+constexpr Mat3 Quat2Mat3(const Quat& q)
 {
 	float xx = q.x*q.x, yy = q.y*q.y, zz = q.z*q.z, xz = q.x*q.z, \
 		xy = q.x*q.y, yz = q.y*q.z, wx = q.w*q.x, wy = q.w*q.y, wz = q.w*q.z;
@@ -798,7 +1378,7 @@ private:
 ////
 
 template<typename MatType, typename ScalarType>
-typename std::enable_if<
+constexpr typename std::enable_if<
 	is_Mat<MatType>::value, MatType>::type
 diag(const ScalarType& v)
 {
@@ -806,12 +1386,12 @@ diag(const ScalarType& v)
 	static_assert(
 		MatType::num_rows == MatType::num_cols, "mat size not equal.");
 	for (int d = 0; d < MatType::num_cols; ++d)
-		m[d][d] = static_cast<MatType::value_type>(v);
+		m[d][d] = static_cast<typename MatType::value_type>(v);
 	return m;
 }
 
 template<typename MatType1, typename MatType2>
-typename std::enable_if<
+constexpr typename std::enable_if<
 	is_Mat<MatType1>::value && 
 	is_Mat<MatType2>::value, MatType1>::type
 cast(const MatType2& src)
@@ -822,56 +1402,54 @@ cast(const MatType2& src)
 	
 	for (int col = 0; col < min_cols; ++col)
 		for (int row = 0; row < min_rows; ++row) {
-			begin(dest)[row+col*MatType1::num_rows] = \
-				begin(src)[row+col*MatType2::num_rows];
+			element(dest, row+col*MatType1::num_rows) = \
+				element(src, row+col*MatType2::num_rows);
 		}
 
 	return dest;
 }
 
-inline float to_radian(const float degree)
+constexpr float to_radian(const float degree)
 {
 	return degree * pi / 180.f;
 }
 
 template<typename T>
-inline T lerp(T v0, T v1, float t)
+constexpr T lerp(T v0, T v1, float t)
 {
 	return v0+(v1-v0)*t;
 }
 
-inline float clamp(float s, float min, float max)
+template<typename ValType, int NumRows, int NumCols>
+constexpr Mat<ValType, NumRows, NumCols> lerp(
+	const Mat<ValType, NumRows, NumCols>& v0, 
+	const Mat<ValType, NumRows, NumCols>& v1, float t)
+{
+	return lazy(v0)+(lazy(v1)-v0)*t;
+}
+
+constexpr float clamp(float s, float min, float max)
 {
 	return s>max?max:(s<min?min:s);
 }
 
 template<typename ValType, int NumRows, int NumCols>
-auto minimum(
+constexpr auto minimum(
 	Mat<ValType, NumRows, NumCols> lhs,
 	const Mat<ValType, NumRows, NumCols>& rhs)
 {
-	auto lhs_iter = begin(lhs);
-	auto rhs_iter = begin(rhs);
-	while (lhs_iter!=end(lhs)) {
-		*lhs_iter = std::min(*lhs_iter,*rhs_iter);
-		lhs_iter++;
-		rhs_iter++;
-	}
+	for (int i = 0; i < NumRows * NumCols; ++i)
+		element(lhs, i) = std::min(element(lhs, i), element(rhs, i));
 	return lhs;
 }
 
 template<typename ValType, int NumRows, int NumCols>
-auto maximum(
+constexpr auto maximum(
 	Mat<ValType, NumRows, NumCols> lhs,
 	const Mat<ValType, NumRows, NumCols>& rhs)
 {
-	auto lhs_iter = begin(lhs);
-	auto rhs_iter = begin(rhs);
-	while (lhs_iter!=end(lhs)) {
-		*lhs_iter = std::max(*lhs_iter,*rhs_iter);
-		lhs_iter++;
-		rhs_iter++;
-	}
+	for (int i = 0; i < NumRows * NumCols; ++i)
+		element(lhs, i) = std::max(element(lhs, i), element(rhs, i));
 	return lhs;
 }
 
@@ -893,7 +1471,7 @@ bool compare(
 	return true;
 }
 
-inline Vec3 unproject(
+constexpr Vec3 unproject(
 	const Vec3& winpos, 
 	const Mat4& view, 
 	const Mat4& proj, 
@@ -910,17 +1488,17 @@ inline Vec3 unproject(
 	return cast<Vec3>(obj);
 }
 
-inline Mat2 rotation_transform(float angle)
+constexpr Mat2 rotation_transform(float angle)
 {
 	return Mat2{
-		{std::cosf(angle), std::sinf(angle)}, 
-		{-std::sinf(angle), std::cosf(angle)}};
+		{calc::cos(angle), calc::sin(angle)}, 
+		{-calc::sin(angle), calc::cos(angle)}};
 }
 
 // Input axis should be a unit vector.
-inline Mat3 rotation_transform(float angle, Vec3 axis)
+constexpr Mat3 rotation_transform(float angle, Vec3 axis)
 {
-	float cosw = std::cosf(angle), sin_w = std::sinf(angle);
+	float cosw = calc::cos(angle), sin_w = calc::sin(angle);
 	float _1cosw = 1-cosw;
 	float x = axis.x, y = axis.y, z = axis.z;
 	float zz = z*z, xx = x*x, yy = y*y, yz = y*z, xz = x*z, xy = x*y;
@@ -935,7 +1513,7 @@ inline Mat3 rotation_transform(float angle, Vec3 axis)
 }
 
 template<int NumRows>
-typename std::enable_if<
+constexpr typename std::enable_if<
 	NumRows==2||NumRows==3, Mat<float, NumRows+1,NumRows+1>>::type
 affine_transform(
 	const Mat<float, NumRows, NumRows>& basis,
@@ -952,14 +1530,14 @@ affine_transform(
 }
 
 // Solve for coordinates under new basis and origin.
-inline Mat4 view_transform(
+constexpr Mat4 view_transform(
 	Mat3 view_base, const Vec3& view_point)
 {
 	view_base.T();
 	return affine_transform(view_base, dot(view_base, -view_point));
 }
 
-inline Mat4 lookat(const Vec3 eye, const Vec3 spot, const Vec3 up)
+constexpr Mat4 lookat(const Vec3 eye, const Vec3 spot, const Vec3 up)
 {
 	const Vec3 forward_ = normalize(spot - eye);
 	const Vec3 s = normalize(cross(forward_, up));
@@ -968,10 +1546,10 @@ inline Mat4 lookat(const Vec3 eye, const Vec3 spot, const Vec3 up)
 	 return view_transform(Mat3{s,up_,-forward_}, eye);
 }
 
-inline Mat4 projective_transform(
+constexpr Mat4 projective_transform(
 	float fovy, float aspect, float znear, float zfar)
 {
-	float tan_half_fovy = std::tanf(fovy / 2.f);
+	float tan_half_fovy = calc::tan(fovy / 2.f);
 	float tan_half_fovx = aspect * tan_half_fovy;
 
 	Mat4 tmp{};
@@ -983,7 +1561,7 @@ inline Mat4 projective_transform(
 	return tmp;
 }
 
-inline Mat4 orthographic_transform(
+constexpr Mat4 orthographic_transform(
 	float left, float right, float bottom, float top, 
 	float near_plane, float far_plane)
 {
@@ -998,7 +1576,7 @@ inline Mat4 orthographic_transform(
 	return tmp;
 }
 
-inline Vec3 point_transform(
+constexpr Vec3 point_transform(
     const calc::Mat4& transform, const Vec3 point)
 {
     auto point_ = cast<Vec4>(point);
@@ -1008,46 +1586,156 @@ inline Vec3 point_transform(
     return cast<Vec3>(point_);
 }
 
+constexpr Vec3 vector_transform(
+    const calc::Mat4& transform, const Vec3 vector)
+{
+    auto vector_ = cast<Vec4>(vector);
+    vector_.w = 0.f;
+    return cast<Vec3>(dot(transform, vector_));
+}
+
 ////
-// Ray tracing.
+// Affine transform of 3D space, a 3x4 matrix of a
+// linear part and a translation. Inverse and normal
+// matrix only involve the 3x3 part, the full Mat4
+// inverse is left to projective transforms.
 ////
 
-class Ray {
+class Affine3 {
 public:
-	Vec3 o;
-	Vec3 d;
+	Mat3 linear;
+	Vec3 translation;
 
-	// hit point: o+s*d.
-	mutable float s;
-};
+	constexpr Affine3()
+		: linear{ diag<Mat3>(1.f) }, translation{}
+	{}
 
-template<typename VecType>
-class Box;
+	constexpr Affine3(const Mat3& linear, const Vec3& translation)
+		: linear{ linear }, translation{ translation }
+	{}
 
-template <typename VecType>
-Box<VecType> box_from_points(const std::vector<VecType>& points);
+	// m should be affine, its last row is ignored.
+	constexpr explicit Affine3(const Mat4& m)
+		: linear{ cast<Mat3>(m) }, translation{ cast<Vec3>(m[3]) }
+	{}
 
-template<typename VecType>
-class Box {
-public:
+	constexpr Mat4 mat4() const { return affine_transform(linear, translation); }
+};
 
-	Box() 
-		: sup_{-1}, inf_{1}
-	{}
+constexpr Vec3 vector_transform(const Affine3& a, const Vec3& v)
+{
+	const auto& m = a.linear;
+	return Vec3{
+		m[0][0] * v.x + m[1][0] * v.y + m[2][0] * v.z,
+		m[0][1] * v.x + m[1][1] * v.y + m[2][1] * v.z,
+		m[0][2] * v.x + m[1][2] * v.y + m[2][2] * v.z };
+}
+
+constexpr Vec3 point_transform(const Affine3& a, const Vec3& point)
+{
+	auto v = vector_transform(a, point);
+	return Vec3{ 
+		v.x + a.translation.x, v.y + a.translation.y, v.z + a.translation.z };
+}
+
+// a after b.
+constexpr Affine3 dot(const Affine3& a, const Affine3& b)
+{
+	return Affine3{ 
+		Mat3{ 
+			vector_transform(a, b.linear[0]), 
+			vector_transform(a, b.linear[1]), 
+			vector_transform(a, b.linear[2]) },
+		point_transform(a, b.translation) };
+}
+
+////
+// The rows of inv(m) are the cross products of pairs
+// of columns of m, over det(m). normal_matrix is the
+// transpose, so these are its columns.
+////
+
+constexpr Mat3 normal_matrix(const Mat3& m)
+{
+	auto c0 = cross(m[1], m[2]), c1 = cross(m[2], m[0]), c2 = cross(m[0], m[1]);
+	float inv_det = 1.f / (m[0].x * c0.x + m[0].y * c0.y + m[0].z * c0.z);
+	return Mat3{ 
+		{ c0.x * inv_det, c0.y * inv_det, c0.z * inv_det },
+		{ c1.x * inv_det, c1.y * inv_det, c1.z * inv_det },
+		{ c2.x * inv_det, c2.y * inv_det, c2.z * inv_det } };
+}
+
+// Inverse with the translation applied to the linear part's inverse.
+constexpr Affine3 inv_with(const Mat3& linear, const Vec3& translation)
+{
+	Affine3 a{ linear, Vec3{} };
+	auto t = vector_transform(a, translation);
+	a.translation = Vec3{ -t.x, -t.y, -t.z };
+	return a;
+}
+
+constexpr Affine3 inv(const Affine3& a)
+{
+	return inv_with(normal_matrix(a.linear).T(), a.translation);
+}
+
+// Inverse of rotation and translation only.
+constexpr Affine3 rigid_inv(const Affine3& a)
+{
+	auto linear = a.linear;
+	return inv_with(linear.T(), a.translation);
+}
+
+// Transform of normals, inverse transpose of the linear part.
+constexpr Mat3 normal_matrix(const Affine3& a)
+{
+	return normal_matrix(a.linear);
+}
+
+////
+// Ray tracing.
+////
+
+class Ray {
+public:
+	Vec3 o;
+	Vec3 d;
 
-	Box(VecType center, VecType size)
+	// hit point: o+s*d.
+	mutable float s = 0.f;
+};
+
+template<typename VecType>
+class Box;
+
+template <typename VecType>
+Box<VecType> box_from_points(const std::vector<VecType>& points);
+
+template<typename VecType>
+class Box {
+public:
+
+	constexpr Box() 
+		: sup_{}, inf_{}
+	{
+		sup_.x = -1;
+		inf_.x = 1;
+	}
+
+	constexpr Box(VecType center, VecType size)
 		: sup_{center+.5f*size}, inf_{center-.5f*size}
 	{}
 
-	VecType sup() { return sup_; }
-	VecType inf() { return inf_; }
+	constexpr VecType sup() const { return sup_; }
+	constexpr VecType inf() const { return inf_; }
+	constexpr bool empty() const { return sup_.x < inf_.x; }
 
-	VecType center() const {return (sup_+inf_)*.5f;}
-	VecType size() const {return sup_-inf_;}
+	constexpr VecType center() const {return (sup_+inf_)*.5f;}
+	constexpr VecType size() const {return sup_-inf_;}
 
 	void update(VecType point)
 	{
-		if (sup_.x < inf_.x) {
+		if (empty()) {
 			*this = box_from_points(std::vector<VecType>{point});
 			return;
 		}
@@ -1100,17 +1788,17 @@ using Box3D = Box<Vec3>;
 // }
 
 template<typename VecType>
-auto box_union(
+constexpr auto box_union(
 	const Box<VecType>& box1, 
 	const Box<VecType>& box2)
 {
-	if (box1.size() == VecType{})
+	if (box1.empty())
 		return box2;
-	if (box2.size() == VecType{})
+	if (box2.empty())
 		return box1;
-	auto inf = minimum(box1.minimum(),box2.minimum());
-	auto sup = maximum(box1.maximum(),box2.maximum());
-	return Box<VecType>::from_points({inf, sup});
+	auto inf = minimum(box1.inf(),box2.inf());
+	auto sup = maximum(box1.sup(),box2.sup());
+	return Box<VecType>{(inf+sup)*.5f, sup-inf};
 }
 
 class Sphere {
@@ -1119,32 +1807,1580 @@ public:
 	float r;
 };
 
-inline bool hit(const Sphere &sphere, const Ray &ray)
+////
+// Ray hit distances. The first hit at s >= eps,
+// in units of ray.d, or infinity on a miss. See
+// Rayx8 for eight at a time.
+////
+
+// ray.d must be a unit vector.
+inline float hit_distance(const Sphere &sphere, const Ray &ray)
 {
+	constexpr float miss = std::numeric_limits<float>::infinity();
 	auto b = 2.f*dot(ray.o - sphere.o, ray.d);
 	auto c = dot(ray.o - sphere.o, ray.o - sphere.o) - \
 		sphere.r * sphere.r;
 	auto delta = b * b - 4 * c;
 	if (delta <= eps)
-		return false;
+		return miss;
 
-	delta = std::sqrtf(delta);
+	delta = std::sqrt(delta);
 	auto t1 = std::min(.5f*(-b - delta), .5f*(-b + delta));
 	auto t2 = std::max(.5f*(-b - delta), .5f*(-b + delta));
 
 	if (t2 < eps)
+		return miss;
+	return t1 >= eps ? t1 : t2;
+}
+
+inline bool hit(const Sphere &sphere, const Ray &ray)
+{
+	float s = hit_distance(sphere, ray);
+	if (s == std::numeric_limits<float>::infinity())
 		return false;
 
-	if (t1 >= eps)
-		ray.s = t1;
-	else
-		ray.s = t2;
+	ray.s = s;
+	return true;
+}
+
+// Slab test. The entry distance, 0 from inside, or infinity
+// on a miss or past s_max.
+inline float hit_distance(const Box3D &box, const Ray &ray,
+	float s_max = std::numeric_limits<float>::infinity())
+{
+	auto inf = box.inf(), sup = box.sup();
+	float s_near = 0.f, s_far = s_max;
+	for (int i = 0; i < 3; ++i) {
+		float inv_d = 1.f / ray.d[i];
+		float s0 = (inf[i] - ray.o[i]) * inv_d;
+		float s1 = (sup[i] - ray.o[i]) * inv_d;
+		s_near = std::max(s_near, std::min(s0, s1));
+		s_far = std::min(s_far, std::max(s0, s1));
+	}
+	return s_near <= s_far ? s_near : std::numeric_limits<float>::infinity();
+}
+
+// Triangle v0 + (e1, e2), Moller and Trumbore. u and v are
+// the weights of v0+e1 and v0+e2 at the hit.
+inline float hit_distance(const Vec3 &v0, const Vec3 &e1, const Vec3 &e2,
+	const Ray &ray, float &u, float &v)
+{
+	constexpr float miss = std::numeric_limits<float>::infinity();
+	auto p = cross(ray.d, e2);
+	float det = dot(e1, p);
+	if (std::abs(det) < 1e-20f)
+		return miss;
+	float inv_det = 1.f / det;
+
+	auto t = ray.o - v0;
+	u = dot(t, p) * inv_det;
+	if (u < 0.f || u > 1.f)
+		return miss;
+	auto q = cross(t, e1);
+	v = dot(ray.d, q) * inv_det;
+	if (v < 0.f || u + v > 1.f)
+		return miss;
+	float s = dot(e2, q) * inv_det;
+	return s >= eps ? s : miss;
+}
+
+////
+// Batched kernels over arrays of vectors. Eight
+// vectors at a time are transposed to SoA, i.e.
+// Vec3x8 and Vec4x8, with the remainder done one
+// vector at a time. Output may alias input.
+////
+
+namespace simd
+{
+
+#if defined(CALC_SIMD_AVX2)
+
+using f32x8 = __m256;
+
+inline f32x8 load8(const float* p) { return _mm256_loadu_ps(p); }
+inline void store8(float* p, f32x8 v) { _mm256_storeu_ps(p, v); }
+inline f32x8 splat8(float s) { return _mm256_set1_ps(s); }
+inline f32x8 add(f32x8 a, f32x8 b) { return _mm256_add_ps(a, b); }
+inline f32x8 sub(f32x8 a, f32x8 b) { return _mm256_sub_ps(a, b); }
+inline f32x8 mul(f32x8 a, f32x8 b) { return _mm256_mul_ps(a, b); }
+inline f32x8 div(f32x8 a, f32x8 b) { return _mm256_div_ps(a, b); }
+inline f32x8 min(f32x8 a, f32x8 b) { return _mm256_min_ps(a, b); }
+inline f32x8 max(f32x8 a, f32x8 b) { return _mm256_max_ps(a, b); }
+inline f32x8 sqrt(f32x8 a) { return _mm256_sqrt_ps(a); }
+// About 12 bits.
+inline f32x8 rsqrt_estimate(f32x8 a) { return _mm256_rsqrt_ps(a); }
+inline f32x8 abs(f32x8 a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a); }
+inline f32x8 floor(f32x8 a) { return _mm256_floor_ps(a); }
+// Magnitude of a, sign of b.
+inline f32x8 copysign(f32x8 a, f32x8 b)
+{
+	auto sign = _mm256_set1_ps(-0.f);
+	return _mm256_or_ps(_mm256_andnot_ps(sign, a), _mm256_and_ps(sign, b));
+}
+// Per lane a < b ? x : y.
+inline f32x8 select_less(f32x8 a, f32x8 b, f32x8 x, f32x8 y)
+{
+	return _mm256_blendv_ps(y, x, _mm256_cmp_ps(a, b, _CMP_LT_OQ));
+}
+// Bit i set if a[i] < b[i].
+inline int less_mask(f32x8 a, f32x8 b)
+{
+	return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LT_OQ));
+}
+
+// Writes first + i for each bit i set in bits < 256, in order, and
+// returns how many. Eight ints are stored, out must have room.
+inline int append_lanes(int* out, int first, int bits)
+{
+	// Set lanes of each byte of bits, packed in bytes.
+	static const auto table = [] {
+		std::array<unsigned long long, 256> t{};
+		for (int b = 0; b < 256; ++b)
+			for (int i = 0, n = 0; i < 8; ++i)
+				if (b >> i & 1)
+					t[b] |= static_cast<unsigned long long>(i) << 8 * n++;
+		return t;
+	}();
+	auto lanes = _mm256_cvtepu8_epi32(_mm_cvtsi64_si128(table[bits]));
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(out), 
+		_mm256_add_epi32(lanes, _mm256_set1_epi32(first)));
+	return static_cast<int>(std::bitset<8>(bits).count());
+}
+
+////
+// Integer lanes. Loads widen eight integers to
+// int32, stores narrow lanes that are in range
+// of the stored type.
+////
+
+using i32x8 = __m256i;
+
+// Nearest, ties to even.
+inline i32x8 round_to_int(f32x8 a) { return _mm256_cvtps_epi32(a); }
+inline f32x8 to_float(i32x8 a) { return _mm256_cvtepi32_ps(a); }
+
+inline i32x8 load8(const std::int8_t* p)
+{
+	return _mm256_cvtepi8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+}
+
+inline i32x8 load8(const std::uint8_t* p)
+{
+	return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+}
+
+inline i32x8 load8(const std::int16_t* p)
+{
+	return _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+}
+
+inline i32x8 load8(const std::uint16_t* p)
+{
+	return _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+}
+
+inline __m128i pack16(i32x8 a)
+{
+	return _mm_packs_epi32(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+}
+
+inline void store8(std::int8_t* p, i32x8 a)
+{
+	auto w = pack16(a);
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packs_epi16(w, w));
+}
+
+inline void store8(std::uint8_t* p, i32x8 a)
+{
+	auto w = pack16(a);
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packus_epi16(w, w));
+}
+
+inline void store8(std::int16_t* p, i32x8 a)
+{
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(p), pack16(a));
+}
+
+inline void store8(std::uint16_t* p, i32x8 a)
+{
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(p), 
+		_mm_packus_epi32(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1)));
+}
+
+// Eight pairs (a[i], b[i]) of int16, interleaved.
+inline void store8_pairs(std::int16_t* p, i32x8 a, i32x8 b)
+{
+	auto pairs = _mm256_or_si256(_mm256_and_si256(a, _mm256_set1_epi32(0xffff)), 
+		_mm256_slli_epi32(b, 16));
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(p), pairs);
+}
+
+inline void load8_pairs(const std::int16_t* p, i32x8& a, i32x8& b)
+{
+	auto pairs = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+	a = _mm256_srai_epi32(_mm256_slli_epi32(pairs, 16), 16);
+	b = _mm256_srai_epi32(pairs, 16);
+}
+
+#else
+
+class f32x8 {
+public:
+	float v[8];
+};
+
+#define CALC_F32X8_LANES(expr) \
+	f32x8 r; for (int i = 0; i < 8; ++i) r.v[i] = expr; return r;
+
+inline f32x8 load8(const float* p) { CALC_F32X8_LANES(p[i]) }
+inline void store8(float* p, f32x8 v) { std::copy_n(v.v, 8, p); }
+inline f32x8 splat8(float s) { CALC_F32X8_LANES(s) }
+inline f32x8 add(f32x8 a, f32x8 b) { CALC_F32X8_LANES(a.v[i] + b.v[i]) }
+inline f32x8 sub(f32x8 a, f32x8 b) { CALC_F32X8_LANES(a.v[i] - b.v[i]) }
+inline f32x8 mul(f32x8 a, f32x8 b) { CALC_F32X8_LANES(a.v[i] * b.v[i]) }
+inline f32x8 div(f32x8 a, f32x8 b) { CALC_F32X8_LANES(a.v[i] / b.v[i]) }
+inline f32x8 min(f32x8 a, f32x8 b) { CALC_F32X8_LANES(std::min(a.v[i], b.v[i])) }
+inline f32x8 max(f32x8 a, f32x8 b) { CALC_F32X8_LANES(std::max(a.v[i], b.v[i])) }
+inline f32x8 sqrt(f32x8 a) { CALC_F32X8_LANES(std::sqrt(a.v[i])) }
+inline f32x8 rsqrt_estimate(f32x8 a) { CALC_F32X8_LANES(1.f / std::sqrt(a.v[i])) }
+inline f32x8 abs(f32x8 a) { CALC_F32X8_LANES(std::abs(a.v[i])) }
+inline f32x8 floor(f32x8 a) { CALC_F32X8_LANES(std::floor(a.v[i])) }
+inline f32x8 copysign(f32x8 a, f32x8 b) { CALC_F32X8_LANES(std::copysign(a.v[i], b.v[i])) }
+inline f32x8 select_less(f32x8 a, f32x8 b, f32x8 x, f32x8 y)
+{
+	CALC_F32X8_LANES(a.v[i] < b.v[i] ? x.v[i] : y.v[i])
+}
+inline int less_mask(f32x8 a, f32x8 b)
+{
+	int bits = 0;
+	for (int i = 0; i < 8; ++i)
+		bits |= (a.v[i] < b.v[i]) << i;
+	return bits;
+}
+
+inline int append_lanes(int* out, int first, int bits)
+{
+	int n = 0;
+	for (int i = 0; i < 8; ++i) {
+		out[n] = first + i;
+		n += bits >> i & 1;
+	}
+	return n;
+}
+
+#undef CALC_F32X8_LANES
+
+#endif
+
+inline f32x8 madd(f32x8 a, f32x8 b, f32x8 c) { return add(mul(a, b), c); }
+
+// Whether array kernels go eight at a time. Scalar lanes only
+// pay off for the min/max reduction.
+#if defined(CALC_SIMD_AVX2)
+constexpr bool batched = true;
+#else
+constexpr bool batched = false;
+#endif
+
+inline float reduce_min(f32x8 a)
+{
+	float v[8];
+	store8(v, a);
+	return *std::min_element(v, v + 8);
+}
+
+inline float reduce_max(f32x8 a)
+{
+	float v[8];
+	store8(v, a);
+	return *std::max_element(v, v + 8);
+}
+
+}
+
+class Vec3x8 {
+public:
+	simd::f32x8 x, y, z;
+};
+
+class Vec4x8 {
+public:
+	simd::f32x8 x, y, z, w;
+};
+
+static_assert(sizeof(Vec3) == 3 * sizeof(float), "Vec3 must be packed.");
+static_assert(sizeof(Vec4) == 4 * sizeof(float), "Vec4 must be packed.");
+
+inline Vec3x8 load_x8(const Vec3* p)
+{
+	const float* f = begin(*p);
+#if defined(CALC_SIMD_AVX2)
+	// Rows of two groups of four vectors: x0y0z0x1 y1z1x2y2 z2x3y3z3.
+	__m256 m03 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(f)), _mm_loadu_ps(f + 12), 1);
+	__m256 m14 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(f + 4)), _mm_loadu_ps(f + 16), 1);
+	__m256 m25 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(f + 8)), _mm_loadu_ps(f + 20), 1);
+	__m256 xy = _mm256_shuffle_ps(m14, m25, _MM_SHUFFLE(2, 1, 3, 2));
+	__m256 yz = _mm256_shuffle_ps(m03, m14, _MM_SHUFFLE(1, 0, 2, 1));
+	return Vec3x8{
+		_mm256_shuffle_ps(m03, xy, _MM_SHUFFLE(2, 0, 3, 0)),
+		_mm256_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0)),
+		_mm256_shuffle_ps(yz, m25, _MM_SHUFFLE(3, 0, 3, 1)) };
+#else
+	Vec3x8 r;
+	for (int i = 0; i < 8; ++i) {
+		r.x.v[i] = f[3 * i];
+		r.y.v[i] = f[3 * i + 1];
+		r.z.v[i] = f[3 * i + 2];
+	}
+	return r;
+#endif
+}
+
+inline void store_x8(Vec3* p, const Vec3x8& v)
+{
+	float* f = begin(*p);
+#if defined(CALC_SIMD_AVX2)
+	__m256 xy = _mm256_shuffle_ps(v.x, v.y, _MM_SHUFFLE(2, 0, 2, 0));
+	__m256 yz = _mm256_shuffle_ps(v.y, v.z, _MM_SHUFFLE(3, 1, 3, 1));
+	__m256 zx = _mm256_shuffle_ps(v.z, v.x, _MM_SHUFFLE(3, 1, 2, 0));
+	__m256 m03 = _mm256_shuffle_ps(xy, zx, _MM_SHUFFLE(2, 0, 2, 0));
+	__m256 m14 = _mm256_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0));
+	__m256 m25 = _mm256_shuffle_ps(zx, yz, _MM_SHUFFLE(3, 1, 3, 1));
+	_mm_storeu_ps(f, _mm256_castps256_ps128(m03));
+	_mm_storeu_ps(f + 4, _mm256_castps256_ps128(m14));
+	_mm_storeu_ps(f + 8, _mm256_castps256_ps128(m25));
+	_mm_storeu_ps(f + 12, _mm256_extractf128_ps(m03, 1));
+	_mm_storeu_ps(f + 16, _mm256_extractf128_ps(m14, 1));
+	_mm_storeu_ps(f + 20, _mm256_extractf128_ps(m25, 1));
+#else
+	for (int i = 0; i < 8; ++i) {
+		f[3 * i] = v.x.v[i];
+		f[3 * i + 1] = v.y.v[i];
+		f[3 * i + 2] = v.z.v[i];
+	}
+#endif
+}
+
+// From separate coordinate arrays, with no transpose.
+inline Vec3x8 load_x8(const float* x, const float* y, const float* z)
+{
+	return Vec3x8{ simd::load8(x), simd::load8(y), simd::load8(z) };
+}
+
+inline Vec4x8 load_x8(const Vec4* p)
+{
+	const float* f = begin(*p);
+#if defined(CALC_SIMD_AVX2)
+	// Vectors i and i+4 share a row, transposed per 128 bit half.
+	auto row = [f](int i) {
+		return _mm256_insertf128_ps(
+			_mm256_castps128_ps256(_mm_loadu_ps(f + 4 * i)), _mm_loadu_ps(f + 4 * i + 16), 1);
+	};
+	__m256 r0 = row(0), r1 = row(1), r2 = row(2), r3 = row(3);
+	__m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpackhi_ps(r0, r1);
+	__m256 t2 = _mm256_unpacklo_ps(r2, r3), t3 = _mm256_unpackhi_ps(r2, r3);
+	return Vec4x8{
+		_mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0)),
+		_mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2)),
+		_mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0)),
+		_mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2)) };
+#else
+	Vec4x8 r;
+	for (int i = 0; i < 8; ++i) {
+		r.x.v[i] = f[4 * i];
+		r.y.v[i] = f[4 * i + 1];
+		r.z.v[i] = f[4 * i + 2];
+		r.w.v[i] = f[4 * i + 3];
+	}
+	return r;
+#endif
+}
+
+inline void store_x8(Vec4* p, const Vec4x8& v)
+{
+	float* f = begin(*p);
+#if defined(CALC_SIMD_AVX2)
+	__m256 t0 = _mm256_unpacklo_ps(v.x, v.y), t1 = _mm256_unpackhi_ps(v.x, v.y);
+	__m256 t2 = _mm256_unpacklo_ps(v.z, v.w), t3 = _mm256_unpackhi_ps(v.z, v.w);
+	__m256 r[4] = {
+		_mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0)),
+		_mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2)),
+		_mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0)),
+		_mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2)) };
+	for (int i = 0; i < 4; ++i) {
+		_mm_storeu_ps(f + 4 * i, _mm256_castps256_ps128(r[i]));
+		_mm_storeu_ps(f + 4 * i + 16, _mm256_extractf128_ps(r[i], 1));
+	}
+#else
+	for (int i = 0; i < 8; ++i) {
+		f[4 * i] = v.x.v[i];
+		f[4 * i + 1] = v.y.v[i];
+		f[4 * i + 2] = v.z.v[i];
+		f[4 * i + 3] = v.w.v[i];
+	}
+#endif
+}
+
+// Row r of m applied to (x, y, z, w).
+inline simd::f32x8 row_dot(const Mat4& m, int r,
+	simd::f32x8 x, simd::f32x8 y, simd::f32x8 z, simd::f32x8 w)
+{
+	using namespace simd;
+	return madd(splat8(m[0][r]), x, madd(splat8(m[1][r]), y,
+		madd(splat8(m[2][r]), z, mul(splat8(m[3][r]), w))));
+}
+
+inline Vec4x8 dot(const Mat4& m, const Vec4x8& v)
+{
+	return Vec4x8{
+		row_dot(m, 0, v.x, v.y, v.z, v.w),
+		row_dot(m, 1, v.x, v.y, v.z, v.w),
+		row_dot(m, 2, v.x, v.y, v.z, v.w),
+		row_dot(m, 3, v.x, v.y, v.z, v.w) };
+}
+
+inline Vec3x8 point_transform(const Mat4& m, const Vec3x8& p)
+{
+	using namespace simd;
+	auto one = splat8(1.f);
+	auto w = row_dot(m, 3, p.x, p.y, p.z, one);
+	return Vec3x8{
+		div(row_dot(m, 0, p.x, p.y, p.z, one), w),
+		div(row_dot(m, 1, p.x, p.y, p.z, one), w),
+		div(row_dot(m, 2, p.x, p.y, p.z, one), w) };
+}
+
+inline simd::f32x8 dot(const Vec3x8& a, const Vec3x8& b)
+{
+	using namespace simd;
+	return madd(a.x, b.x, madd(a.y, b.y, mul(a.z, b.z)));
+}
+
+inline Vec3x8 cross(const Vec3x8& p, const Vec3x8& q)
+{
+	using namespace simd;
+	return Vec3x8{
+		sub(mul(p.y, q.z), mul(q.y, p.z)),
+		sub(mul(p.z, q.x), mul(q.z, p.x)),
+		sub(mul(p.x, q.y), mul(q.x, p.y)) };
+}
+
+inline Vec3x8 normalize(const Vec3x8& v)
+{
+	using namespace simd;
+	auto len = sqrt(dot(v, v));
+	return Vec3x8{ div(v.x, len), div(v.y, len), div(v.z, len) };
+}
+
+inline Vec3x8 lerp(const Vec3x8& v0, const Vec3x8& v1, float t)
+{
+	using namespace simd;
+	auto t_ = splat8(t);
+	return Vec3x8{
+		madd(sub(v1.x, v0.x), t_, v0.x),
+		madd(sub(v1.y, v0.y), t_, v0.y),
+		madd(sub(v1.z, v0.z), t_, v0.z) };
+}
+
+inline void point_transform(
+	const Mat4& m, const Vec3* points, Vec3* out, int count)
+{
+	int i = 0;
+	for (; simd::batched && i + 8 <= count; i += 8)
+		store_x8(out + i, point_transform(m, load_x8(points + i)));
+	for (; i < count; ++i)
+		out[i] = point_transform(m, points[i]);
+}
+
+inline void dot(const Mat4& m, const Vec4* v, Vec4* out, int count)
+{
+	int i = 0;
+	for (; simd::batched && i + 8 <= count; i += 8)
+		store_x8(out + i, dot(m, load_x8(v + i)));
+	for (; i < count; ++i)
+		out[i] = dot(m, v[i]);
+}
+
+inline void normalize(const Vec3* v, Vec3* out, int count)
+{
+	int i = 0;
+	for (; simd::batched && i + 8 <= count; i += 8)
+		store_x8(out + i, normalize(load_x8(v + i)));
+	for (; i < count; ++i)
+		out[i] = normalize(v[i]);
+}
+
+inline void cross(const Vec3* p, const Vec3* q, Vec3* out, int count)
+{
+	int i = 0;
+	for (; simd::batched && i + 8 <= count; i += 8)
+		store_x8(out + i, cross(load_x8(p + i), load_x8(q + i)));
+	for (; i < count; ++i)
+		out[i] = cross(p[i], q[i]);
+}
+
+inline void dot(const Vec3* p, const Vec3* q, float* out, int count)
+{
+	int i = 0;
+	for (; simd::batched && i + 8 <= count; i += 8)
+		simd::store8(out + i, dot(load_x8(p + i), load_x8(q + i)));
+	for (; i < count; ++i)
+		out[i] = dot(p[i], q[i]);
+}
+
+inline void lerp(
+	const Vec3* v0, const Vec3* v1, float t, Vec3* out, int count)
+{
+	int i = 0;
+	for (; simd::batched && i + 8 <= count; i += 8)
+		store_x8(out + i, lerp(load_x8(v0 + i), load_x8(v1 + i), t));
+	for (; i < count; ++i)
+		out[i] = lerp(v0[i], v1[i], t);
+}
+
+// Componentwise extremes of count > 0 points.
+inline void min_max(const Vec3* points, int count, Vec3& inf, Vec3& sup)
+{
+	inf = sup = points[0];
+	int i = 0;
+	if (count >= 8) {
+		auto lo = load_x8(points), hi = lo;
+		for (i = 8; i + 8 <= count; i += 8) {
+			auto p = load_x8(points + i);
+			lo = Vec3x8{ simd::min(lo.x, p.x), simd::min(lo.y, p.y), simd::min(lo.z, p.z) };
+			hi = Vec3x8{ simd::max(hi.x, p.x), simd::max(hi.y, p.y), simd::max(hi.z, p.z) };
+		}
+		inf = Vec3{ simd::reduce_min(lo.x), simd::reduce_min(lo.y), simd::reduce_min(lo.z) };
+		sup = Vec3{ simd::reduce_max(hi.x), simd::reduce_max(hi.y), simd::reduce_max(hi.z) };
+	}
+	for (; i < count; ++i) {
+		inf = minimum(inf, points[i]);
+		sup = maximum(sup, points[i]);
+	}
+}
+
+inline Box3D box_from_points(const std::vector<Vec3>& points)
+{
+	if (points.size() == 0)
+		return Box3D{};
+
+	Vec3 inf, sup;
+	min_max(points.data(), points.size(), inf, sup);
+	return Box3D{ (inf + sup) * .5f, sup - inf };
+}
+
+////
+// Approximations to <cmath> functions, for bulk
+// kernels that trade a few ulps for throughput.
+// Each has an f32x8 form, which the array forms
+// use eight at a time as the batched kernels do.
+// Max errors are over the whole float input range,
+// unless noted otherwise.
+////
+
+namespace fast
+{
+
+// 1/sqrt(x), x > 0. Relative error below 3e-7 with SSE,
+// 5e-6 otherwise.
+inline float rsqrt(float x)
+{
+#if defined(CALC_SIMD_SSE)
+	float r = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+	return r * (1.5f - .5f * x * r * r);
+#else
+	// Initial guess from the exponent bits, then Newton.
+	unsigned bits = 0;
+	std::memcpy(&bits, &x, sizeof(bits));
+	bits = 0x5f375a86u - (bits >> 1);
+	float r = 0.f;
+	std::memcpy(&r, &bits, sizeof(r));
+	r = r * (1.5f - .5f * x * r * r);
+	return r * (1.5f - .5f * x * r * r);
+#endif
+}
+
+inline simd::f32x8 rsqrt(simd::f32x8 x)
+{
+	using namespace simd;
+	auto r = rsqrt_estimate(x);
+	return mul(r, sub(splat8(1.5f), mul(mul(splat8(.5f), x), mul(r, r))));
+}
+
+// Relative error below 3e-7 with SSE or AVX2, 5e-6 otherwise.
+inline Vec3 normalize(const Vec3& v)
+{
+	return v * rsqrt(dot(v, v));
+}
+
+inline Vec3x8 normalize(const Vec3x8& v)
+{
+	auto r = rsqrt(dot(v, v));
+	return Vec3x8{ simd::mul(v.x, r), simd::mul(v.y, r), simd::mul(v.z, r) };
+}
+
+inline void normalize(const Vec3* v, Vec3* out, int count)
+{
+	int i = 0;
+	for (; simd::batched && i + 8 <= count; i += 8)
+		store_x8(out + i, fast::normalize(load_x8(v + i)));
+	for (; i < count; ++i)
+		out[i] = fast::normalize(v[i]);
+}
+
+// x in [-1, 1]. Absolute error below 5e-7 rad,
+// Abramowitz and Stegun 4.4.46.
+inline float acos(float x)
+{
+	float a = std::abs(x);
+	float p = -.0012624911f;
+	p = p * a + .0066700901f;
+	p = p * a - .0170881256f;
+	p = p * a + .0308918810f;
+	p = p * a - .0501743046f;
+	p = p * a + .0889789874f;
+	p = p * a - .2145988016f;
+	p = p * a + 1.5707963050f;
+	float r = std::sqrt(1.f - a) * p;
+	return x < 0.f ? pi - r : r;
+}
+
+// Absolute error below 3e-6 rad, atan2(0, 0) is 0.
+inline float atan2(float y, float x)
+{
+	float ax = std::abs(x), ay = std::abs(y);
+	float hi = std::max(ax, ay), lo = std::min(ax, ay);
+	float t = lo / std::max(hi, std::numeric_limits<float>::min());
+	float t2 = t * t;
+	float p = -.01172120f;
+	p = p * t2 + .05265332f;
+	p = p * t2 - .11643287f;
+	p = p * t2 + .19354346f;
+	p = p * t2 - .33262347f;
+	p = p * t2 + .99997726f;
+	float r = p * t;
+	r = ay > ax ? .5f * pi - r : r;
+	r = x < 0.f ? pi - r : r;
+	return y < 0.f ? -r : r;
+}
+
+////
+// sin and cos of x, sharing the reduction to
+// [-pi/4, pi/4]. Absolute error below 2e-7 for
+// |x| < 1e4, larger beyond as the reduction
+// loses bits, |x| < 2^30.
+////
+
+inline void sincos(float x, float& s, float& c)
+{
+	float t = x * (2.f / pi);
+	float k = static_cast<float>(static_cast<int>(t + (t < 0.f ? -.5f : .5f)));
+	// pi/2 in three parts, Cody-Waite.
+	float r = x - k * 1.5703125f;
+	r = r - k * 4.83751297e-4f;
+	r = r - k * 7.54978995e-8f;
+	float r2 = r * r;
+
+	float sin_r = -1.9515295891e-4f;
+	sin_r = sin_r * r2 + 8.3321608736e-3f;
+	sin_r = sin_r * r2 - 1.6666654611e-1f;
+	sin_r = sin_r * r2 * r + r;
+
+	float cos_r = 2.443315711809948e-5f;
+	cos_r = cos_r * r2 - 1.388731625493765e-3f;
+	cos_r = cos_r * r2 + 4.166664568298827e-2f;
+	cos_r = cos_r * r2 * r2 - .5f * r2 + 1.f;
+
+	// Quadrant k mod 4 rotates (cos_r, sin_r).
+	int q = static_cast<int>(k) & 3;
+	s = (q & 1) ? cos_r : sin_r;
+	c = (q & 1) ? sin_r : cos_r;
+	s = (q & 2) ? -s : s;
+	c = ((q + 1) & 2) ? -c : c;
+}
+
+inline simd::f32x8 acos(simd::f32x8 x)
+{
+	using namespace simd;
+	auto a = abs(x);
+	auto p = splat8(-.0012624911f);
+	p = madd(p, a, splat8(.0066700901f));
+	p = madd(p, a, splat8(-.0170881256f));
+	p = madd(p, a, splat8(.0308918810f));
+	p = madd(p, a, splat8(-.0501743046f));
+	p = madd(p, a, splat8(.0889789874f));
+	p = madd(p, a, splat8(-.2145988016f));
+	p = madd(p, a, splat8(1.5707963050f));
+	auto r = mul(sqrt(max(sub(splat8(1.f), a), splat8(0.f))), p);
+	return select_less(x, splat8(0.f), sub(splat8(pi), r), r);
+}
+
+inline simd::f32x8 atan2(simd::f32x8 y, simd::f32x8 x)
+{
+	using namespace simd;
+	auto ax = abs(x), ay = abs(y);
+	auto hi = max(ax, ay), lo = min(ax, ay);
+	auto t = div(lo, max(hi, splat8(std::numeric_limits<float>::min())));
+	auto t2 = mul(t, t);
+	auto p = splat8(-.01172120f);
+	p = madd(p, t2, splat8(.05265332f));
+	p = madd(p, t2, splat8(-.11643287f));
+	p = madd(p, t2, splat8(.19354346f));
+	p = madd(p, t2, splat8(-.33262347f));
+	p = madd(p, t2, splat8(.99997726f));
+	auto r = mul(p, t);
+	r = select_less(ax, ay, sub(splat8(.5f * pi), r), r);
+	r = select_less(x, splat8(0.f), sub(splat8(pi), r), r);
+	return select_less(y, splat8(0.f), sub(splat8(0.f), r), r);
+}
+
+inline void sincos(simd::f32x8 x, simd::f32x8& s, simd::f32x8& c)
+{
+	using namespace simd;
+	auto k = floor(madd(x, splat8(2.f / pi), splat8(.5f)));
+	auto r = sub(x, mul(k, splat8(1.5703125f)));
+	r = sub(r, mul(k, splat8(4.83751297e-4f)));
+	r = sub(r, mul(k, splat8(7.54978995e-8f)));
+	auto r2 = mul(r, r);
+
+	auto sin_r = splat8(-1.9515295891e-4f);
+	sin_r = madd(sin_r, r2, splat8(8.3321608736e-3f));
+	sin_r = madd(sin_r, r2, splat8(-1.6666654611e-1f));
+	sin_r = madd(mul(sin_r, r2), r, r);
+
+	auto cos_r = splat8(2.443315711809948e-5f);
+	cos_r = madd(cos_r, r2, splat8(-1.388731625493765e-3f));
+	cos_r = madd(cos_r, r2, splat8(4.166664568298827e-2f));
+	cos_r = madd(mul(cos_r, r2), r2, sub(splat8(1.f), mul(splat8(.5f), r2)));
+
+	// Quadrant k mod 4 in [0, 4), as in the scalar version.
+	auto q = sub(k, mul(splat8(4.f), floor(mul(k, splat8(.25f)))));
+	auto odd = sub(q, mul(splat8(2.f), floor(mul(q, splat8(.5f)))));
+	s = select_less(odd, splat8(.5f), sin_r, cos_r);
+	c = select_less(odd, splat8(.5f), cos_r, sin_r);
+	s = select_less(q, splat8(1.5f), s, sub(splat8(0.f), s));
+	c = select_less(abs(sub(q, splat8(1.5f))), splat8(1.f), sub(splat8(0.f), c), c);
+}
+
+inline void acos(const float* x, float* out, int count)
+{
+	int i = 0;
+	for (; simd::batched && i + 8 <= count; i += 8)
+		simd::store8(out + i, fast::acos(simd::load8(x + i)));
+	for (; i < count; ++i)
+		out[i] = fast::acos(x[i]);
+}
+
+inline void atan2(const float* y, const float* x, float* out, int count)
+{
+	int i = 0;
+	for (; simd::batched && i + 8 <= count; i += 8)
+		simd::store8(out + i, fast::atan2(simd::load8(y + i), simd::load8(x + i)));
+	for (; i < count; ++i)
+		out[i] = fast::atan2(y[i], x[i]);
+}
+
+inline void sincos(const float* x, float* s, float* c, int count)
+{
+	int i = 0;
+	for (; simd::batched && i + 8 <= count; i += 8) {
+		simd::f32x8 s8, c8;
+		fast::sincos(simd::load8(x + i), s8, c8);
+		simd::store8(s + i, s8);
+		simd::store8(c + i, c8);
+	}
+	for (; i < count; ++i)
+		fast::sincos(x[i], s[i], c[i]);
+}
+
+}
+
+////
+// Eight rays at a time, in the lanes of Vec3x8.
+// The kernels take eight primitives too, so eight
+// rays are tested against one primitive with the
+// primitive splat to all lanes, and one ray
+// against eight primitives with the ray splat.
+// Distances are as for the scalar hit_distance.
+////
+
+class Rayx8 {
+public:
+	Vec3x8 o;
+	Vec3x8 d;
+	Vec3x8 inv_d;  // 1/d, for slab tests.
+};
+
+inline Vec3x8 splat_x8(const Vec3& v)
+{
+	return Vec3x8{ simd::splat8(v.x), simd::splat8(v.y), simd::splat8(v.z) };
+}
+
+inline Rayx8 rays_x8(const Vec3x8& o, const Vec3x8& d)
+{
+	using namespace simd;
+	auto one = splat8(1.f);
+	return Rayx8{ o, d, Vec3x8{ div(one, d.x), div(one, d.y), div(one, d.z) } };
+}
+
+inline Rayx8 splat_x8(const Ray& ray)
+{
+	return rays_x8(splat_x8(ray.o), splat_x8(ray.d));
+}
+
+inline Rayx8 load_x8(const Ray* rays)
+{
+	Vec3 o[8], d[8];
+	for (int i = 0; i < 8; ++i) {
+		o[i] = rays[i].o;
+		d[i] = rays[i].d;
+	}
+	return rays_x8(load_x8(o), load_x8(d));
+}
+
+// Spheres of centers o and radii r. Ray directions must be unit vectors.
+inline simd::f32x8 hit_distance(const Vec3x8& o, simd::f32x8 r, const Rayx8& rays)
+{
+	using namespace simd;
+	auto miss = splat8(std::numeric_limits<float>::infinity());
+	auto e = splat8(eps);
+	Vec3x8 oc{ sub(rays.o.x, o.x), sub(rays.o.y, o.y), sub(rays.o.z, o.z) };
+	auto b = mul(splat8(2.f), dot(oc, rays.d));
+	auto c = sub(dot(oc, oc), mul(r, r));
+	auto delta = sub(mul(b, b), mul(splat8(4.f), c));
+
+	auto root = sqrt(max(delta, splat8(0.f)));
+	auto t1 = mul(splat8(.5f), sub(sub(splat8(0.f), b), root));
+	auto t2 = mul(splat8(.5f), add(sub(splat8(0.f), b), root));
+	auto s = select_less(t1, e, t2, t1);
+	s = select_less(t2, e, miss, s);
+	return select_less(e, delta, s, miss);
+}
+
+inline simd::f32x8 hit_distance(const Sphere& sphere, const Rayx8& rays)
+{
+	return hit_distance(splat_x8(sphere.o), simd::splat8(sphere.r), rays);
+}
+
+// Boxes [inf, sup].
+inline simd::f32x8 hit_distance(const Vec3x8& inf, const Vec3x8& sup,
+	const Rayx8& rays, simd::f32x8 s_max)
+{
+	using namespace simd;
+	auto s_near = splat8(0.f), s_far = s_max;
+	auto slab = [&](f32x8 lo, f32x8 hi, f32x8 o, f32x8 inv_d) {
+		auto s0 = mul(sub(lo, o), inv_d);
+		auto s1 = mul(sub(hi, o), inv_d);
+		s_near = max(s_near, min(s0, s1));
+		s_far = min(s_far, max(s0, s1));
+	};
+	slab(inf.x, sup.x, rays.o.x, rays.inv_d.x);
+	slab(inf.y, sup.y, rays.o.y, rays.inv_d.y);
+	slab(inf.z, sup.z, rays.o.z, rays.inv_d.z);
+	return select_less(s_far, s_near, splat8(std::numeric_limits<float>::infinity()), s_near);
+}
+
+inline simd::f32x8 hit_distance(const Box3D& box, const Rayx8& rays,
+	simd::f32x8 s_max = simd::splat8(std::numeric_limits<float>::infinity()))
+{
+	return hit_distance(splat_x8(box.inf()), splat_x8(box.sup()), rays, s_max);
+}
+
+// Triangles v0 + (e1, e2).
+inline simd::f32x8 hit_distance(const Vec3x8& v0, const Vec3x8& e1, const Vec3x8& e2,
+	const Rayx8& rays, simd::f32x8& u, simd::f32x8& v)
+{
+	using namespace simd;
+	auto p = cross(rays.d, e2);
+	auto det = dot(e1, p);
+	auto inv_det = div(splat8(1.f), det);
+
+	Vec3x8 t{ sub(rays.o.x, v0.x), sub(rays.o.y, v0.y), sub(rays.o.z, v0.z) };
+	u = mul(dot(t, p), inv_det);
+	auto q = cross(t, e1);
+	v = mul(dot(rays.d, q), inv_det);
+	auto s = mul(dot(e2, q), inv_det);
+
+	auto zero = splat8(0.f), one = splat8(1.f);
+	auto miss = splat8(std::numeric_limits<float>::infinity());
+	s = select_less(abs(det), splat8(1e-20f), miss, s);
+	s = select_less(u, zero, miss, s);
+	s = select_less(one, u, miss, s);
+	s = select_less(v, zero, miss, s);
+	s = select_less(one, add(u, v), miss, s);
+	return select_less(s, splat8(eps), miss, s);
+}
+
+////
+// View frustum, the clip volume -w <= x, y, z <= w
+// of a transform, as six planes in the space the
+// transform maps from (Gribb and Hartmann). Plane
+// normals point inwards and are unit length, so
+// a plane's value at (p, 1) is the signed distance
+// of p. The tests keep an object unless it is
+// wholly behind one plane. That never culls a
+// visible object, but may keep one just off an
+// edge or a corner of the frustum.
+////
+
+class Frustum {
+public:
+	// Left, right, bottom, top, near, far.
+	Vec4 planes[6];
+
+	constexpr Frustum()
+		: planes{}
+	{}
+
+	// E.g. the projection after the view transform, for world space planes.
+	constexpr explicit Frustum(const Mat4& m)
+		: planes{}
+	{
+		for (int p = 0; p < 6; ++p) {
+			int axis = p / 2;
+			float sign = p % 2 ? -1.f : 1.f;
+			Vec4 plane{};
+			for (int col = 0; col < 4; ++col)
+				plane[col] = m[col][3] + sign * m[col][axis];
+			planes[p] = plane / length(cast<Vec3>(plane));
+		}
+	}
+};
+
+constexpr float plane_distance(const Vec4& plane, const Vec3& p)
+{
+	return plane.x * p.x + plane.y * p.y + plane.z * p.z + plane.w;
+}
+
+// Planes moved out by pad, so spheres are tested as if pad larger.
+constexpr Frustum expand(const Frustum& f, float pad)
+{
+	Frustum g = f;
+	for (auto& plane : g.planes)
+		plane.w += pad;
+	return g;
+}
+
+constexpr bool visible(const Frustum& f, const Sphere& sphere)
+{
+	float closest = plane_distance(f.planes[0], sphere.o);
+	for (int p = 1; p < 6; ++p)
+		closest = std::min(closest, plane_distance(f.planes[p], sphere.o));
+	return closest + sphere.r >= 0.f;
+}
+
+// Box [inf, sup], by its corner furthest along each plane's normal.
+constexpr bool visible(const Frustum& f, const Vec3& inf, const Vec3& sup)
+{
+	float closest = std::numeric_limits<float>::infinity();
+	for (const auto& plane : f.planes) {
+		float d = plane.x * (plane.x < 0.f ? inf.x : sup.x) +
+			plane.y * (plane.y < 0.f ? inf.y : sup.y) +
+			plane.z * (plane.z < 0.f ? inf.z : sup.z) + plane.w;
+		closest = std::min(closest, d);
+	}
+	return closest >= 0.f;
+}
+
+constexpr bool visible(const Frustum& f, const Box3D& box)
+{
+	return !box.empty() && visible(f, box.inf(), box.sup());
+}
+
+////
+// Bulk frustum tests, eight objects at a time. The
+// mask forms set bit i % 8 of mask[i / 8] for each
+// kept object i, and write (count + 7) / 8 bytes.
+// The index forms write the kept indices in order
+// and return their number, indices must have room
+// for count of them.
+//
+// Box tests take the corner of each box furthest
+// along a plane's normal, so Frustumx8 splits the
+// normals by sign into weights of sup and of inf.
+////
+
+class Frustumx8 {
+public:
+	Vec4x8 planes[6];
+	Vec3x8 sup_weights[6];  // max(n, 0).
+	Vec3x8 inf_weights[6];  // min(n, 0).
+};
+
+inline Frustumx8 splat_x8(const Frustum& f)
+{
+	using namespace simd;
+	Frustumx8 g;
+	for (int p = 0; p < 6; ++p) {
+		const auto& plane = f.planes[p];
+		g.planes[p] = Vec4x8{ 
+			splat8(plane.x), splat8(plane.y), splat8(plane.z), splat8(plane.w) };
+		g.sup_weights[p] = Vec3x8{ splat8(std::max(plane.x, 0.f)), 
+			splat8(std::max(plane.y, 0.f)), splat8(std::max(plane.z, 0.f)) };
+		g.inf_weights[p] = Vec3x8{ splat8(std::min(plane.x, 0.f)), 
+			splat8(std::min(plane.y, 0.f)), splat8(std::min(plane.z, 0.f)) };
+	}
+	return g;
+}
+
+inline simd::f32x8 plane_distance(const Vec4x8& plane, const Vec3x8& p)
+{
+	using namespace simd;
+	return madd(plane.x, p.x, madd(plane.y, p.y, madd(plane.z, p.z, plane.w)));
+}
+
+// Bit i set if sphere i of centers c and radii r is kept.
+inline int visible_mask(const Frustumx8& f, const Vec3x8& c, simd::f32x8 r)
+{
+	using namespace simd;
+	auto d = [&](int p) { return plane_distance(f.planes[p], c); };
+	auto closest = min(min(min(d(0), d(1)), min(d(2), d(3))), min(d(4), d(5)));
+	return ~less_mask(add(closest, r), splat8(0.f)) & 0xff;
+}
+
+// Bit i set if box i of [inf, sup] is kept. Boxes must not be empty.
+inline int visible_mask(const Frustumx8& f, const Vec3x8& inf, const Vec3x8& sup)
+{
+	using namespace simd;
+	auto furthest = [&](int p) {
+		const auto& s = f.sup_weights[p];
+		const auto& i = f.inf_weights[p];
+		auto d = madd(s.x, sup.x, madd(s.y, sup.y, madd(s.z, sup.z, f.planes[p].w)));
+		return add(d, madd(i.x, inf.x, madd(i.y, inf.y, mul(i.z, inf.z))));
+	};
+	auto closest = min(min(min(furthest(0), furthest(1)), 
+		min(furthest(2), furthest(3))), min(furthest(4), furthest(5)));
+	return ~less_mask(closest, splat8(0.f)) & 0xff;
+}
+
+namespace simd
+{
+
+////
+// Mask and index forms of a test, from the bits
+// group(i) of objects i to i+7, and one(i) for
+// object i alone. Groups go in pairs, so both
+// share the loads of the test's constants.
+////
+
+template<typename Group, typename One>
+inline void mask_of(int count, unsigned char* mask, Group group, One one)
+{
+	int i = 0;
+	for (; batched && i + 16 <= count; i += 16) {
+		int lo = group(i), hi = group(i + 8);
+		mask[i / 8] = static_cast<unsigned char>(lo);
+		mask[i / 8 + 1] = static_cast<unsigned char>(hi);
+	}
+	for (; batched && i + 8 <= count; i += 8)
+		mask[i / 8] = static_cast<unsigned char>(group(i));
+	for (; i < count; i += 8) {
+		int bits = 0;
+		for (int j = 0; j < 8 && i + j < count; ++j)
+			bits |= one(i + j) << j;
+		mask[i / 8] = static_cast<unsigned char>(bits);
+	}
+}
+
+// Indices are stored unconditionally and kept by advancing the
+// count, with no branch on the test. Fewer than i are kept before
+// object i, so the eight stores of append_lanes stay in bounds.
+template<typename Group, typename One>
+inline int indices_of(int count, int* indices, Group group, One one)
+{
+	int n = 0, i = 0;
+	for (; batched && i + 16 <= count; i += 16) {
+		int lo = group(i), hi = group(i + 8);
+		n += append_lanes(indices + n, i, lo);
+		n += append_lanes(indices + n, i + 8, hi);
+	}
+	for (; batched && i + 8 <= count; i += 8)
+		n += append_lanes(indices + n, i, group(i));
+	for (; i < count; ++i) {
+		indices[n] = i;
+		n += one(i);
+	}
+	return n;
+}
+
+}
+
+inline void visible_mask(const Frustum& f, 
+	const Vec3* centers, const float* radii, int count, unsigned char* mask)
+{
+	auto f8 = splat_x8(f);
+	simd::mask_of(count, mask,
+		[&](int i) { return visible_mask(f8, load_x8(centers + i), simd::load8(radii + i)); },
+		[&](int i) { return static_cast<int>(visible(f, Sphere{ centers[i], radii[i] })); });
+}
+
+inline int visible_indices(const Frustum& f, 
+	const Vec3* centers, const float* radii, int count, int* indices)
+{
+	auto f8 = splat_x8(f);
+	return simd::indices_of(count, indices,
+		[&](int i) { return visible_mask(f8, load_x8(centers + i), simd::load8(radii + i)); },
+		[&](int i) { return static_cast<int>(visible(f, Sphere{ centers[i], radii[i] })); });
+}
+
+// Boxes [inf[i], sup[i]], not empty.
+inline void visible_mask(const Frustum& f, 
+	const Vec3* inf, const Vec3* sup, int count, unsigned char* mask)
+{
+	auto f8 = splat_x8(f);
+	simd::mask_of(count, mask,
+		[&](int i) { return visible_mask(f8, load_x8(inf + i), load_x8(sup + i)); },
+		[&](int i) { return static_cast<int>(visible(f, inf[i], sup[i])); });
+}
+
+inline int visible_indices(const Frustum& f, 
+	const Vec3* inf, const Vec3* sup, int count, int* indices)
+{
+	auto f8 = splat_x8(f);
+	return simd::indices_of(count, indices,
+		[&](int i) { return visible_mask(f8, load_x8(inf + i), load_x8(sup + i)); },
+		[&](int i) { return static_cast<int>(visible(f, inf[i], sup[i])); });
+}
+
+////
+// Boxes as separate coordinate arrays, inf_x[i] and
+// so on, the layout to pick for many boxes. Which
+// corner is furthest along a plane's normal depends
+// only on the signs of the normal, so it is picked
+// once per call, as arrays. Each plane then takes
+// three multiply-adds per box, as for a sphere.
+////
+
+class FrustumCorners {
+public:
+	// Coordinate arrays of the furthest corner, per plane.
+	const float* x[6];
+	const float* y[6];
+	const float* z[6];
+};
+
+inline FrustumCorners furthest_corners(const Frustum& f,
+	const float* inf_x, const float* inf_y, const float* inf_z,
+	const float* sup_x, const float* sup_y, const float* sup_z)
+{
+	FrustumCorners c;
+	for (int p = 0; p < 6; ++p) {
+		c.x[p] = f.planes[p].x < 0.f ? inf_x : sup_x;
+		c.y[p] = f.planes[p].y < 0.f ? inf_y : sup_y;
+		c.z[p] = f.planes[p].z < 0.f ? inf_z : sup_z;
+	}
+	return c;
+}
+
+// Bit j set if box i + j is kept.
+inline int visible_mask(const Frustumx8& f, const FrustumCorners& c, int i)
+{
+	using namespace simd;
+	auto d = [&](int p) {
+		return plane_distance(f.planes[p], load_x8(c.x[p] + i, c.y[p] + i, c.z[p] + i));
+	};
+	auto closest = min(min(min(d(0), d(1)), min(d(2), d(3))), min(d(4), d(5)));
+	return ~less_mask(closest, splat8(0.f)) & 0xff;
+}
+
+inline void visible_mask(const Frustum& f,
+	const float* inf_x, const float* inf_y, const float* inf_z,
+	const float* sup_x, const float* sup_y, const float* sup_z,
+	int count, unsigned char* mask)
+{
+	auto f8 = splat_x8(f);
+	auto c = furthest_corners(f, inf_x, inf_y, inf_z, sup_x, sup_y, sup_z);
+	simd::mask_of(count, mask,
+		[&](int i) { return visible_mask(f8, c, i); },
+		[&](int i) { return static_cast<int>(visible(f, Vec3{ inf_x[i], inf_y[i], inf_z[i] },
+			Vec3{ sup_x[i], sup_y[i], sup_z[i] })); });
+}
+
+inline int visible_indices(const Frustum& f,
+	const float* inf_x, const float* inf_y, const float* inf_z,
+	const float* sup_x, const float* sup_y, const float* sup_z,
+	int count, int* indices)
+{
+	auto f8 = splat_x8(f);
+	auto c = furthest_corners(f, inf_x, inf_y, inf_z, sup_x, sup_y, sup_z);
+	return simd::indices_of(count, indices,
+		[&](int i) { return visible_mask(f8, c, i); },
+		[&](int i) { return static_cast<int>(visible(f, Vec3{ inf_x[i], inf_y[i], inf_z[i] },
+			Vec3{ sup_x[i], sup_y[i], sup_z[i] })); });
+}
+
+////
+// Half floats, IEEE binary16 in a uint16_t. The
+// scalar conversions match F16C bit for bit: they
+// round to nearest even, keep infinities, and
+// quiet NaNs, keeping what fits of the payload,
+// see https://gist.github.com/rygorous/2156668.
+////
+
+inline std::uint16_t float_to_half(float x)
+{
+	std::uint32_t f;
+	std::memcpy(&f, &x, sizeof(f));
+	std::uint32_t sign = f >> 16 & 0x8000;
+	f &= 0x7fffffff;
+
+	std::uint32_t h;
+	if (f >= 0x47800000) {
+		// Past the largest half, or infinity and NaN.
+		h = f > 0x7f800000 ? 0x7e00 | (f >> 13 & 0x3ff) : 0x7c00;
+	}
+	else if (f < 0x38800000) {
+		// Subnormal, rounded by the float add.
+		const std::uint32_t magic_bits = 126u << 23;
+		float magic, y;
+		std::memcpy(&magic, &magic_bits, sizeof(magic));
+		std::memcpy(&y, &f, sizeof(y));
+		y += magic;
+		std::memcpy(&h, &y, sizeof(h));
+		h -= magic_bits;
+	}
+	else {
+		// Rebias, and add just under half an ulp plus the odd bit.
+		f += 0xc8000fff + (f >> 13 & 1);
+		h = f >> 13;
+	}
+	return static_cast<std::uint16_t>(sign | h);
+}
+
+inline float half_to_float(std::uint16_t h)
+{
+	std::uint32_t f = (h & 0x7fffu) << 13;
+	std::uint32_t exponent = f & 0x0f800000;
+	f += 112u << 23;
+	if (exponent == 0x0f800000) {
+		// Infinity, or NaN, quieted as by F16C.
+		f += 112u << 23;
+		if (f & 0x007fffff)
+			f |= 0x00400000;
+	}
+	else if (exponent == 0) {
+		// Subnormal, renormalized by the float subtract.
+		const std::uint32_t magic_bits = 113u << 23;
+		float magic, y;
+		f += 1u << 23;
+		std::memcpy(&magic, &magic_bits, sizeof(magic));
+		std::memcpy(&y, &f, sizeof(y));
+		y -= magic;
+		std::memcpy(&f, &y, sizeof(f));
+	}
+	f |= static_cast<std::uint32_t>(h & 0x8000) << 16;
+	float x;
+	std::memcpy(&x, &f, sizeof(x));
+	return x;
+}
+
+inline void float_to_half(const float* x, std::uint16_t* out, int count)
+{
+	int i = 0;
+#if defined(CALC_SIMD_F16C)
+	for (; i + 8 <= count; i += 8)
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+			_mm256_cvtps_ph(_mm256_loadu_ps(x + i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+	for (; i < count; ++i)
+		out[i] = float_to_half(x[i]);
+}
 
+inline void half_to_float(const std::uint16_t* h, float* out, int count)
+{
+	int i = 0;
+#if defined(CALC_SIMD_F16C)
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_ps(out + i, 
+			_mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(h + i))));
+#endif
+	for (; i < count; ++i)
+		out[i] = half_to_float(h[i]);
+}
+
+////
+// Normalized integers. A signed IntType is snorm,
+// [-1, 1] to [-max, max], with the lowest integer
+// also decoding to -1. An unsigned one is unorm,
+// [0, 1] to [0, max]. Out of range values clamp,
+// NaN goes to the lower end, and rounding is to
+// nearest even, so dequantize then quantize is
+// exact.
+////
+
+template<typename IntType>
+constexpr float norm_scale()
+{
+	return static_cast<float>(std::numeric_limits<IntType>::max());
+}
+
+template<typename IntType>
+constexpr float norm_min()
+{
+	return std::is_signed<IntType>::value ? -1.f : 0.f;
+}
+
+template<typename IntType>
+inline IntType quantize(float x)
+{
+	// As the SIMD max and min, for the same NaN handling.
+	x = x > norm_min<IntType>() ? x : norm_min<IntType>();
+	x = x < 1.f ? x : 1.f;
+	return static_cast<IntType>(std::nearbyint(x * norm_scale<IntType>()));
+}
+
+template<typename IntType>
+inline float dequantize(IntType q)
+{
+	float x = q / norm_scale<IntType>();
+	return x > -1.f ? x : -1.f;
+}
+
+template<typename IntType>
+inline void quantize(const float* x, IntType* out, int count)
+{
+	int i = 0;
+#if defined(CALC_SIMD_AVX2)
+	using namespace simd;
+	auto lo = splat8(norm_min<IntType>()), hi = splat8(1.f);
+	auto scale = splat8(norm_scale<IntType>());
+	for (; i + 8 <= count; i += 8)
+		store8(out + i, round_to_int(mul(min(max(load8(x + i), lo), hi), scale)));
+#endif
+	for (; i < count; ++i)
+		out[i] = quantize<IntType>(x[i]);
+}
+
+template<typename IntType>
+inline void dequantize(const IntType* q, float* out, int count)
+{
+	int i = 0;
+#if defined(CALC_SIMD_AVX2)
+	using namespace simd;
+	auto lo = splat8(-1.f), scale = splat8(norm_scale<IntType>());
+	for (; i + 8 <= count; i += 8)
+		store8(out + i, max(div(to_float(load8(q + i)), scale), lo));
+#endif
+	for (; i < count; ++i)
+		out[i] = dequantize(q[i]);
+}
+
+////
+// Octahedral normals, Cigolle et al. 2014. A unit
+// vector is projected on the octahedron |x| + |y|
+// + |z| = 1, whose lower half is folded out over
+// the upper one, and flattened to [-1, 1]^2. The
+// array forms pack each normal as two snorm16, to
+// within 4e-3 degrees.
+////
+
+inline Vec2 oct_encode(const Vec3& n)
+{
+	float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	float x = n.x / l1, y = n.y / l1;
+	if (n.z < 0.f)
+		return Vec2{ std::copysign(1.f - std::abs(y), x), 
+			std::copysign(1.f - std::abs(x), y) };
+	return Vec2{ x, y };
+}
+
+inline Vec3 oct_decode(const Vec2& e)
+{
+	float z = 1.f - std::abs(e.x) - std::abs(e.y);
+	float t = std::max(-z, 0.f);
+	float x = e.x - std::copysign(t, e.x), y = e.y - std::copysign(t, e.y);
+	float len = std::sqrt(x * x + y * y + z * z);
+	return Vec3{ x / len, y / len, z / len };
+}
+
+inline void oct_encode(const Vec3x8& n, simd::f32x8& u, simd::f32x8& v)
+{
+	using namespace simd;
+	auto l1 = add(add(abs(n.x), abs(n.y)), abs(n.z));
+	auto x = div(n.x, l1), y = div(n.y, l1);
+	auto one = splat8(1.f), zero = splat8(0.f);
+	u = select_less(n.z, zero, copysign(sub(one, abs(y)), x), x);
+	v = select_less(n.z, zero, copysign(sub(one, abs(x)), y), y);
+}
+
+inline Vec3x8 oct_decode(simd::f32x8 u, simd::f32x8 v)
+{
+	using namespace simd;
+	auto z = sub(splat8(1.f), add(abs(u), abs(v)));
+	auto t = max(sub(splat8(0.f), z), splat8(0.f));
+	return normalize(Vec3x8{ sub(u, copysign(t, u)), sub(v, copysign(t, v)), z });
+}
+
+// out[2i] and out[2i+1] are the snorm16 coordinates of normals[i].
+inline void oct_encode(const Vec3* normals, std::int16_t* out, int count)
+{
+	int i = 0;
+#if defined(CALC_SIMD_AVX2)
+	using namespace simd;
+	auto lo = splat8(-1.f), hi = splat8(1.f);
+	auto scale = splat8(norm_scale<std::int16_t>());
+	auto snorm = [&](f32x8 x) { return round_to_int(mul(min(max(x, lo), hi), scale)); };
+	for (; i + 8 <= count; i += 8) {
+		f32x8 u, v;
+		oct_encode(load_x8(normals + i), u, v);
+		store8_pairs(out + 2 * i, snorm(u), snorm(v));
+	}
+#endif
+	for (; i < count; ++i) {
+		auto e = oct_encode(normals[i]);
+		out[2 * i] = quantize<std::int16_t>(e.x);
+		out[2 * i + 1] = quantize<std::int16_t>(e.y);
+	}
+}
+
+inline void oct_decode(const std::int16_t* in, Vec3* normals, int count)
+{
+	int i = 0;
+#if defined(CALC_SIMD_AVX2)
+	using namespace simd;
+	auto lo = splat8(-1.f), scale = splat8(norm_scale<std::int16_t>());
+	for (; i + 8 <= count; i += 8) {
+		i32x8 u, v;
+		load8_pairs(in + 2 * i, u, v);
+		store_x8(normals + i, oct_decode(
+			max(div(to_float(u), scale), lo), max(div(to_float(v), scale), lo)));
+	}
+#endif
+	for (; i < count; ++i)
+		normals[i] = oct_decode(Vec2{ 
+			dequantize(in[2 * i]), dequantize(in[2 * i + 1]) });
+}
+
+////
+// Morton codes.
+////
+
+// Spread the low 10 bits of v to every third bit.
+inline unsigned expand_bits_10(unsigned v)
+{
+	v &= 0x3ff;
+	v = (v | (v << 16)) & 0x030000ff;
+	v = (v | (v << 8)) & 0x0300f00f;
+	v = (v | (v << 4)) & 0x030c30c3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+
+// 30 bit Morton code of p, quantized to 1024 steps per axis of bounds.
+inline unsigned morton_code(const Vec3& p, Box3D bounds)
+{
+	auto inf = bounds.inf();
+	auto size = bounds.size();
+	unsigned code = 0;
+	for (int i = 0; i < 3; ++i) {
+		float t = size[i] > 0.f ? (p[i] - inf[i]) / size[i] : 0.f;
+		auto q = static_cast<unsigned>(std::min(std::max(t * 1024.f, 0.f), 1023.f));
+		code |= expand_bits_10(q) << (2 - i);
+	}
+	return code;
+}
+
+
+////
+// Compile-time checks.
+////
+
+#ifdef CALC_CONSTEXPR
+
+namespace test
+{
+
+constexpr bool near(float a, float b, float tol = 1e-5f)
+{
+	return a - b <= tol && b - a <= tol;
+}
+
+template<typename MatType>
+constexpr bool near(const MatType& a, const MatType& b, float tol = 1e-5f)
+{
+	for (int i = 0; i < MatType::num_rows * MatType::num_cols; ++i)
+		if (!near(element(a, i), element(b, i), tol))
+			return false;
 	return true;
 }
 
+constexpr Vec3 x_axis{ 1, 0, 0 }, y_axis{ 0, 1, 0 }, z_axis{ 0, 0, 1 };
+
+static_assert(Vec3{ 1, 2, 3 } + Vec3{ 1, 1, 1 } == Vec3{ 2, 3, 4 }, "");
+static_assert(2.f * Vec2{ 1, 2 } - Vec2{ 1, 1 } == Vec2{ 1, 3 }, "");
+static_assert(iVec3{ 5, 6, 7 } % 4 == iVec3{ 1, 2, 3 }, "");
+static_assert(abs(-Vec3{ 1, -2, 3 }) == Vec3{ 1, 2, 3 }, "");
+static_assert(dot(Vec3{ 1, 2, 3 }, Vec3{ 4, 5, 6 }) == 32.f, "");
+static_assert(cross(x_axis, y_axis) == z_axis, "");
+static_assert(minimum(Vec3{ 1, 5, 3 }, Vec3{ 2, 4, 3 }) == Vec3{ 1, 4, 3 }, "");
+static_assert(cast<Vec3>(Vec4{ 1, 2, 3, 4 }) == Vec3{ 1, 2, 3 }, "");
+static_assert(lerp(Vec2{ 0, 2 }, Vec2{ 2, 4 }, .5f) == Vec2{ 1, 3 }, "");
+static_assert(eval((lazy(Vec3{ 1, 2, 3 }) - Vec3{ 1, 1, 1 }) * 2.f + z_axis) == Vec3{ 0, 2, 5 }, "");
+static_assert(eval(-lazy(iVec2{ 1, 2 }) / 1) == iVec2{ -1, -2 }, "");
+
+static_assert(sqrt(4.f) == 2.f && near(sqrt(2.f) * sqrt(2.f), 2.f), "");
+static_assert(near(sin(pi / 6), .5f) && near(cos(-pi / 3), .5f), "");
+static_assert(near(tan(pi / 4), 1.f) && near(sin(100.f), -.50636564f), "");
+static_assert(near(length(Vec3{ 3, 4, 12 }), 13.f), "");
+static_assert(near(normalize(Vec2{ 3, 4 }), Vec2{ .6f, .8f }), "");
+
+constexpr Mat3 m3{ { 2, 0, 1 }, { 1, 3, 0 }, { 0, 1, 4 } };
+static_assert(det(m3) == 25.f, "");
+static_assert(near(dot(m3, inv(m3)), diag<Mat3>(1.f)), "");
+static_assert(transpose(m3)[0] == Vec3{ 2, 1, 0 }, "");
+static_assert(near(dot(inv(Mat2{ { 1, 2 }, { 3, 4 } }), Vec2{ 1, 2 }), Vec2{ 1, 0 }), "");
+
+constexpr Mat4 m4 = affine_transform(m3, Vec3{ 1, 2, 3 });
+static_assert(near(dot(m4, inv(m4)), diag<Mat4>(1.f)), "");
+static_assert(transpose(m4)[3] == Vec4{ 0, 0, 0, 1 }, "");
+static_assert(point_transform(m4, Vec3{}) == Vec3{ 1, 2, 3 }, "");
+static_assert(vector_transform(m4, x_axis) == Vec3{ 2, 0, 1 }, "");
+static_assert(det(m4) == 25.f, "");
+
+constexpr Affine3 a4{ m4 };
+static_assert(a4.mat4() == m4, "");
+static_assert(near(dot(a4, inv(a4)).mat4(), diag<Mat4>(1.f)), "");
+static_assert(near(inv(a4).mat4(), inv(m4)), "");
+static_assert(point_transform(dot(a4, a4), x_axis) == point_transform(dot(m4, m4), x_axis), "");
+static_assert(near(rigid_inv(Affine3{ rotation_transform(pi / 2, z_axis), x_axis }).mat4(),
+	inv(affine_transform(rotation_transform(pi / 2, z_axis), x_axis))), "");
+// Normals stay orthogonal to transformed tangents.
+static_assert(near(dot(dot(normal_matrix(a4), z_axis), vector_transform(a4, x_axis)), 0.f), "");
+static_assert(near(dot(dot(normal_matrix(a4), z_axis), vector_transform(a4, y_axis)), 0.f), "");
+
+static_assert(point_transform(
+	lookat(Vec3{ 0, 0, 1 }, Vec3{}, y_axis), Vec3{}) == Vec3{ 0, 0, -1 }, "");
+static_assert(near(projective_transform(pi / 2, 2.f, 1.f, 3.f),
+	Mat4{ { .5f, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, -2, -1 }, { 0, 0, -3, 0 } }), "");
+static_assert(orthographic_transform(-1, 1, -1, 1, 1, -1) == diag<Mat4>(1.f), "");
+
+static_assert(near(rotate(Quat::angle_axis(pi / 2, z_axis), x_axis), y_axis), "");
+static_assert(near(Quat2Mat3(Quat::angle_axis(pi / 2, z_axis)),
+	rotation_transform(pi / 2, z_axis)), "");
+static_assert(near(dot(rotation_transform(pi / 2), Vec2{ 1, 0 }), Vec2{ 0, 1 }), "");
+
+static_assert(Box3D{ Vec3{ 1, 1, 1 }, Vec3{ 2, 2, 2 } }.size() == Vec3{ 2, 2, 2 }, "");
+static_assert(box_union(Box3D{ Vec3{ 0, 0, 0 }, Vec3{ 2, 2, 2 } },
+	Box3D{ Vec3{ 2, 0, 0 }, Vec3{ 2, 2, 2 } }).size() == Vec3{ 4, 2, 2 }, "");
+static_assert(box_union(Box3D{}, Box3D{ Vec3{ 1, 1, 1 }, Vec3{} }).center() == Vec3{ 1, 1, 1 }, "");
+
+// Frustum of a 90 degree fov from z = -1 to -3, its near right top corner
+// (1, 1, -1), far right top corner (3, 3, -3).
+constexpr Frustum f4{ projective_transform(pi / 2, 1.f, 1.f, 3.f) };
+static_assert(near(plane_distance(f4.planes[4], Vec3{ 0, 0, -2 }), 1.f), "");
+static_assert(near(plane_distance(f4.planes[5], Vec3{ 0, 0, -2 }), 1.f), "");
+static_assert(near(plane_distance(f4.planes[1], Vec3{ 2, 0, -2 }), 0.f), "");
+static_assert(visible(f4, Sphere{ Vec3{ 3, 3, -3 }, 1e-3f }), "");
+static_assert(!visible(f4, Sphere{ Vec3{ 0, 0, -3.1f }, .05f }), "");
+static_assert(visible(f4, Box3D{ Vec3{ 1.5f, 1.5f, -.5f }, Vec3{ 1, 1, 1 } }), "");
+static_assert(!visible(f4, Box3D{ Vec3{ 0, 0, -.5f }, Vec3{ 1, 1, .9f } }), "");
+static_assert(visible(expand(f4, .2f), Sphere{ Vec3{ 0, 0, -3.1f }, .05f }), "");
 
 }
 
+#endif
+
+}
 
 #endif
@@ -0,0 +1,80 @@
+#include "GfxBvh.h"
+#include "utility.h"
+#include "check.h"
+#include "scenes.h"
+
+#include <filesystem>
+
+////
+// SegmentBvh build, refit and query throughput
+// on procedural grooms. Usage: bvh_segment_bench
+// [num_fibers], default 10k fibers of 32 vertices.
+////
+
+using namespace calc;
+
+int main(int argc, char** argv)
+{
+	const int num_fibers = argc > 1 ? std::atoi(argv[1]) : 10000;
+	const auto path = (std::filesystem::temp_directory_path() / "bvh_segment_bench.ind").string();
+	scenes::write_groom(path, num_fibers, 32);
+	auto hair = gfx::Model::load_from_ind_file(path);
+	std::filesystem::remove(path);
+
+	const float radius = .002f;
+	gfx::SegmentBvh bvh;
+	const double build_ms = check::best_ms(5, [&]() { bvh.build(hair, radius); });
+
+	// Rays from a ring around the head towards it, and spheres along the hair.
+	PCG rng(7);
+	auto uniform = [&]() { return rng() / 4294967295.f * 2 - 1; };
+	std::vector<Ray> rays(100000);
+	for (auto& ray : rays) {
+		Vec3 o = 3.f * normalize(Vec3{ uniform(), .5f * uniform(), uniform() });
+		Vec3 target = .8f * Vec3{ uniform(), uniform(), uniform() };
+		ray = Ray{ o, normalize(target - o) };
+	}
+	std::vector<Sphere> spheres(100000);
+	for (auto& sphere : spheres)
+		sphere = Sphere{ hair.positions()[rng() % hair.num_verts()], .02f };
+
+	int num_hits = 0;
+	const double ray_ms = check::best_ms(3, [&]() {
+		num_hits = 0;
+		gfx::SegmentBvh::Hit hit{};
+		for (const auto& ray : rays)
+			num_hits += bvh.intersect(ray, hit);
+	});
+	std::size_t num_overlaps = 0;
+	const double overlap_ms = check::best_ms(3, [&]() {
+		num_overlaps = 0;
+		std::vector<int> segments;
+		for (const auto& sphere : spheres) {
+			segments.clear();
+			bvh.overlap(sphere, segments);
+			num_overlaps += segments.size();
+		}
+	});
+
+	// Refit to a swaying groom, roots fixed, after the queries
+	// as it loosens the boxes.
+	std::vector<Vec3> moved = hair.positions();
+	for (int f = 0; f < hair.num_fibers(); ++f) {
+		const auto& fiber = hair.fiber(f);
+		for (int v = 1; v < fiber.vcount; ++v)
+			moved[fiber.vstart + v].x += .002f * v;
+	}
+	const double refit_ms = check::best_ms(5, [&]() { bvh.refit(moved); });
+
+	const double num_segments = bvh.num_segments();
+	std::printf("%d fibers, %d segments, %d nodes, %d threads\n",
+		hair.num_fibers(), bvh.num_segments(), bvh.num_nodes(),
+		util::scheduler().num_threads());
+	std::printf("build  %7.2f ms  %6.2f Msegments/s\n", build_ms, num_segments / build_ms * 1e-3);
+	std::printf("refit  %7.2f ms  %6.2f Msegments/s\n", refit_ms, num_segments / refit_ms * 1e-3);
+	std::printf("ray    %7.2f ms  %6.2f Mrays/s, %d%% hit\n", ray_ms,
+		rays.size() / ray_ms * 1e-3, static_cast<int>(100. * num_hits / rays.size()));
+	std::printf("sphere %7.2f ms  %6.2f Mqueries/s, %.1f segments each\n", overlap_ms,
+		spheres.size() / overlap_ms * 1e-3, double(num_overlaps) / spheres.size());
+	return 0;
+}
@@ -0,0 +1,86 @@
+#include "GfxBvh.h"
+#include "utility.h"
+#include "check.h"
+#include "scenes.h"
+
+////
+// TriangleBvh build and query throughput on the
+// procedural head. Usage: bvh_triangle_bench [n],
+// n rings by n sectors, default 400, i.e. 320k
+// triangles, about a scanned head mesh.
+////
+
+using namespace calc;
+
+int main(int argc, char** argv)
+{
+	const int n = argc > 1 ? std::atoi(argv[1]) : 400;
+	std::vector<Vec3> positions;
+	std::vector<unsigned> indices;
+	scenes::bumpy_sphere(n, positions, indices);
+
+	gfx::TriangleBvh bvh;
+	const double build_ms = check::best_ms(5, [&]() { bvh.build(positions, indices); });
+
+	////
+	// Primary rays from a ring around the head, shadow
+	// rays from just off its surface towards a light,
+	// and small boxes along the surface.
+	////
+
+	PCG rng(7);
+	auto uniform = [&]() { return rng() / 4294967295.f * 2 - 1; };
+	std::vector<Ray> rays(200000), shadow_rays(rays.size());
+	for (auto& ray : rays) {
+		Vec3 o = 3.f * normalize(Vec3{ uniform(), .5f * uniform(), uniform() });
+		Vec3 target = 1.1f * Vec3{ uniform(), uniform(), uniform() };
+		ray = Ray{ o, normalize(target - o) };
+	}
+	const Vec3 light{ 4, 4, 4 };
+	std::vector<float> shadow_dist(rays.size());
+	for (std::size_t r = 0; r < shadow_rays.size(); ++r) {
+		Vec3 p = 1.07f * positions[rng() % positions.size()];
+		shadow_rays[r] = Ray{ p, normalize(light - p) };
+		shadow_dist[r] = length(light - p);
+	}
+	std::vector<Box3D> boxes(100000);
+	for (auto& box : boxes)
+		box = Box3D{ positions[rng() % positions.size()], Vec3{ .02f, .02f, .02f } };
+
+	int num_hits = 0;
+	const double ray_ms = check::best_ms(3, [&]() {
+		num_hits = 0;
+		gfx::TriangleBvh::Hit hit{};
+		for (const auto& ray : rays)
+			num_hits += bvh.intersect(ray, hit);
+	});
+	int num_occluded = 0;
+	const double shadow_ms = check::best_ms(3, [&]() {
+		num_occluded = 0;
+		for (std::size_t r = 0; r < shadow_rays.size(); ++r)
+			num_occluded += bvh.occluded(shadow_rays[r], shadow_dist[r]);
+	});
+	std::size_t num_overlaps = 0;
+	const double overlap_ms = check::best_ms(3, [&]() {
+		num_overlaps = 0;
+		std::vector<int> triangles;
+		for (const auto& box : boxes) {
+			triangles.clear();
+			bvh.overlap(box, triangles);
+			num_overlaps += triangles.size();
+		}
+	});
+
+	const double num_tris = bvh.num_triangles();
+	std::printf("%d triangles, %d nodes, %d threads\n",
+		bvh.num_triangles(), bvh.num_nodes(), util::scheduler().num_threads());
+	std::printf("build  %7.2f ms  %6.2f Mtriangles/s\n", build_ms, num_tris / build_ms * 1e-3);
+	std::printf("ray    %7.2f ms  %6.2f Mrays/s, %d%% hit\n", ray_ms,
+		rays.size() / ray_ms * 1e-3, static_cast<int>(100. * num_hits / rays.size()));
+	std::printf("shadow %7.2f ms  %6.2f Mrays/s, %d%% occluded\n", shadow_ms,
+		shadow_rays.size() / shadow_ms * 1e-3,
+		static_cast<int>(100. * num_occluded / shadow_rays.size()));
+	std::printf("box    %7.2f ms  %6.2f Mqueries/s, %.1f triangles each\n", overlap_ms,
+		boxes.size() / overlap_ms * 1e-3, double(num_overlaps) / boxes.size());
+	return 0;
+}
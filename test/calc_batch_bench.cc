@@ -0,0 +1,90 @@
+#include "calc.h"
+#include "check.h"
+
+#include <cstdlib>
+#include <vector>
+
+////
+// Batched Vec3 kernels of calc against the scalar
+// loops they replace: point_transform, normalize
+// and min_max, at 1M, 10M and 100M points, from
+// cache to memory bound. Usage: calc_batch_bench
+// [max_millions], default 100; the largest size
+// takes 2.4 GB. Built with the configured options
+// and with AVX2 forced on.
+////
+
+using namespace calc;
+
+int main(int argc, char** argv)
+{
+	if (check::cpu_lacks_build_isa())
+		return check::skipped;
+
+	const int max_millions = argc > 1 ? std::max(1, std::atoi(argv[1])) : 100;
+	PCG rng(37);
+	auto uniform = [&]() { return rng() / 4294967295.f * 2 - 1; };
+	const Mat4 m = dot(projective_transform(pi / 3, 1.5f, .1f, 100.f),
+		lookat(Vec3{ 1, 2, 3 }, Vec3{}, Vec3{ 0, 1, 0 }));
+
+#if defined(CALC_SIMD_AVX2)
+	std::printf("AVX2\n");
+#else
+	std::printf("no AVX2\n");
+#endif
+	std::printf("points     kernel           scalar ms  batched ms  Mpoints/ms     x\n");
+	for (int millions : { 1, 10, 100 }) {
+		if (millions > max_millions)
+			break;
+		const int count = millions * 1000000;
+		std::vector<Vec3> points(count), out(count);
+		for (auto& p : points)
+			p = Vec3{ uniform(), uniform(), uniform() };
+		const int reps = millions < 10 ? 20 : millions < 100 ? 5 : 2;
+
+		auto report = [&](const char* name, auto scalar, auto batched) {
+			const double scalar_ms = check::best_ms(reps, scalar);
+			const double batched_ms = check::best_ms(reps, batched);
+			std::printf("%4dM      %-15s %10.2f %11.2f %11.2f %5.2f\n", millions, name,
+				scalar_ms, batched_ms, count / batched_ms * 1e-6, scalar_ms / batched_ms);
+		};
+
+		report("point_transform",
+			[&]() {
+				for (int i = 0; i < count; ++i)
+					out[i] = point_transform(m, points[i]);
+				check::keep(out.back());
+			},
+			[&]() {
+				point_transform(m, points.data(), out.data(), count);
+				check::keep(out.back());
+			});
+		report("normalize",
+			[&]() {
+				for (int i = 0; i < count; ++i)
+					out[i] = normalize(points[i]);
+				check::keep(out.back());
+			},
+			[&]() {
+				normalize(points.data(), out.data(), count);
+				check::keep(out.back());
+			});
+		report("min_max",
+			[&]() {
+				Vec3 inf = points[0], sup = points[0];
+				for (int i = 1; i < count; ++i) {
+					inf = minimum(inf, points[i]);
+					sup = maximum(sup, points[i]);
+				}
+				check::keep(inf);
+				check::keep(sup);
+			},
+			[&]() {
+				Vec3 inf, sup;
+				min_max(points.data(), count, inf, sup);
+				check::keep(inf);
+				check::keep(sup);
+			});
+	}
+	return 0;
+}
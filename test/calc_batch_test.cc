@@ -0,0 +1,115 @@
+#include "calc.h"
+#include "check.h"
+
+#include <vector>
+
+////
+// Batched array kernels of calc against their
+// per-vector forms, for every remainder of eight,
+// in place and out of place. Built with the
+// configured options and with AVX2 forced on.
+////
+
+using namespace calc;
+
+namespace
+{
+
+bool near(float a, float b)
+{
+	return std::abs(a - b) <= 1e-5f * (1.f + std::abs(b));
+}
+
+bool near(const Vec3& a, const Vec3& b)
+{
+	return near(a.x, b.x) && near(a.y, b.y) && near(a.z, b.z);
+}
+
+bool near(const Vec4& a, const Vec4& b)
+{
+	return near(a.x, b.x) && near(a.y, b.y) && near(a.z, b.z) && near(a.w, b.w);
+}
+
+}
+
+int main()
+{
+	if (check::cpu_lacks_build_isa())
+		return check::skipped;
+
+	PCG rng(11);
+	auto uniform = [&]() { return rng() / 4294967295.f * 20 - 10; };
+	auto vec3 = [&]() { return Vec3{ uniform(), uniform(), uniform() }; };
+	auto vec4 = [&]() { return Vec4{ uniform(), uniform(), uniform(), uniform() }; };
+
+	// Projective, with w kept away from zero so the division
+	// does not amplify rounding differences.
+	Mat4 m{};
+	for (int r = 0; r < 4; ++r)
+		for (int c = 0; c < 4; ++c)
+			m[c][r] = r < 3 ? uniform() : .002f * uniform();
+	m[3][3] = 1.f;
+
+	for (int count = 0; count <= 41; ++count) {
+		std::vector<Vec3> p(count), q(count), out(count);
+		std::vector<Vec4> v(count), out4(count);
+		std::vector<float> out1(count);
+		for (int i = 0; i < count; ++i) {
+			p[i] = vec3();
+			q[i] = vec3();
+			v[i] = vec4();
+		}
+
+		point_transform(m, p.data(), out.data(), count);
+		for (int i = 0; i < count; ++i)
+			CHECK(near(out[i], point_transform(m, p[i])));
+
+		dot(m, v.data(), out4.data(), count);
+		for (int i = 0; i < count; ++i)
+			CHECK(near(out4[i], dot(m, v[i])));
+
+		normalize(p.data(), out.data(), count);
+		for (int i = 0; i < count; ++i)
+			CHECK(near(out[i], normalize(p[i])));
+
+		cross(p.data(), q.data(), out.data(), count);
+		for (int i = 0; i < count; ++i)
+			CHECK(near(out[i], cross(p[i], q[i])));
+
+		dot(p.data(), q.data(), out1.data(), count);
+		for (int i = 0; i < count; ++i)
+			CHECK(near(out1[i], dot(p[i], q[i])));
+
+		lerp(p.data(), q.data(), .3f, out.data(), count);
+		for (int i = 0; i < count; ++i)
+			CHECK(near(out[i], lerp(p[i], q[i], .3f)));
+
+		// Output aliasing input.
+		out = p;
+		point_transform(m, out.data(), out.data(), count);
+		for (int i = 0; i < count; ++i)
+			CHECK(near(out[i], point_transform(m, p[i])));
+		out = p;
+		normalize(out.data(), out.data(), count);
+		for (int i = 0; i < count; ++i)
+			CHECK(near(out[i], normalize(p[i])));
+		out = p;
+		cross(out.data(), q.data(), out.data(), count);
+		for (int i = 0; i < count; ++i)
+			CHECK(near(out[i], cross(p[i], q[i])));
+
+		// Extremes are exact, wherever they are.
+		if (count > 0) {
+			Vec3 inf, sup, inf_ref = p[0], sup_ref = p[0];
+			for (const auto& point : p) {
+				inf_ref = minimum(inf_ref, point);
+				sup_ref = maximum(sup_ref, point);
+			}
+			min_max(p.data(), count, inf, sup);
+			CHECK(inf == inf_ref);
+			CHECK(sup == sup_ref);
+		}
+	}
+
+	return check::result();
+}
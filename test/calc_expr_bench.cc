@@ -0,0 +1,111 @@
+#include "calc.h"
+#include "check.h"
+
+#include <vector>
+
+////
+// Expression templates of calc against the eager
+// operators, on the expressions that use them:
+// rotate by a Quat, lerp of Vec3 and Mat4, and
+// the fit of fit_model_placement, over 1M values.
+// The eager forms are those before lazy().
+////
+
+using namespace calc;
+
+namespace
+{
+
+Vec3 rotate_eager(const Quat& q, const Vec3& v)
+{
+	const Vec3 u = q.imag(), u_cross_v = cross(u, v);
+	return 2.f*dot(u, v) * u
+		+ (q.w*q.w - dot(u, u)) * v
+		+ 2.f*q.w * u_cross_v;
+}
+
+template<typename MatType>
+MatType lerp_eager(const MatType& v0, const MatType& v1, float t)
+{
+	return v0+(v1-v0)*t;
+}
+
+}
+
+int main()
+{
+	PCG rng(41);
+	auto uniform = [&]() { return rng() / 4294967295.f * 2 - 1; };
+	auto vec3 = [&]() { return Vec3{ uniform(), uniform(), uniform() }; };
+
+	const int count = 1 << 20;
+	std::vector<Vec3> a(count), b(count), out(count);
+	for (int i = 0; i < count; ++i) {
+		a[i] = vec3();
+		b[i] = vec3();
+	}
+	std::vector<Mat4> m0(count / 16), m1(m0.size()), m_out(m0.size());
+	for (std::size_t i = 0; i < m0.size(); ++i)
+		for (int e = 0; e < 16; ++e) {
+			element(m0[i], e) = uniform();
+			element(m1[i], e) = uniform();
+		}
+	const Quat q = normalize(Quat{ .3f, .5f, -.2f, .8f });
+	const Vec3 geom_center{ .1f, -.2f, .3f }, center{ 0.f, 1.f, 0.f };
+	const float scale = 1.7f;
+
+	std::printf("%d Vec3, %d Mat4\n", count, static_cast<int>(m0.size()));
+	std::printf("expression       eager ms   lazy ms      x\n");
+	auto report = [&](const char* name, auto eager, auto lazy) {
+		const double eager_ms = check::best_ms(20, eager);
+		const double lazy_ms = check::best_ms(20, lazy);
+		std::printf("%-15s %9.3f %9.3f  %5.2f\n", name, eager_ms, lazy_ms, eager_ms / lazy_ms);
+	};
+
+	report("rotate",
+		[&]() {
+			for (int i = 0; i < count; ++i)
+				out[i] = rotate_eager(q, a[i]);
+			check::keep(out.back());
+		},
+		[&]() {
+			for (int i = 0; i < count; ++i)
+				out[i] = rotate(q, a[i]);
+			check::keep(out.back());
+		});
+	report("lerp Vec3",
+		[&]() {
+			for (int i = 0; i < count; ++i)
+				out[i] = lerp_eager(a[i], b[i], .3f);
+			check::keep(out.back());
+		},
+		[&]() {
+			for (int i = 0; i < count; ++i)
+				out[i] = lerp(a[i], b[i], .3f);
+			check::keep(out.back());
+		});
+	report("lerp Mat4",
+		[&]() {
+			for (std::size_t i = 0; i < m0.size(); ++i)
+				m_out[i] = lerp_eager(m0[i], m1[i], .3f);
+			check::keep(m_out.back());
+		},
+		[&]() {
+			for (std::size_t i = 0; i < m0.size(); ++i)
+				m_out[i] = lerp(m0[i], m1[i], .3f);
+			check::keep(m_out.back());
+		});
+	// (pos-geom_center)*scale + center, of fit_model_placement.
+	report("fit",
+		[&]() {
+			for (int i = 0; i < count; ++i)
+				out[i] = (a[i] - geom_center)*scale + center;
+			check::keep(out.back());
+		},
+		[&]() {
+			for (int i = 0; i < count; ++i)
+				out[i] = (lazy(a[i]) - geom_center)*scale + center;
+			check::keep(out.back());
+		});
+	return 0;
+}
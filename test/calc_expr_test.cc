@@ -0,0 +1,98 @@
+#include "calc.h"
+#include "check.h"
+
+#include <type_traits>
+
+////
+// Expression templates of calc, opted into with
+// lazy(m), against the eager element-wise ops and
+// per-element references.
+////
+
+using namespace calc;
+
+namespace
+{
+
+template<typename MatType>
+bool near(const MatType& a, const MatType& b)
+{
+	for (int i = 0; i < MatType::num_rows * MatType::num_cols; ++i) {
+		float x = element(a, i), y = element(b, i);
+		if (std::abs(x - y) > 1e-6f * (1.f + std::abs(y)))
+			return false;
+	}
+	return true;
+}
+
+}
+
+// Expressions convert to the Mat of their operands.
+static_assert(std::is_same<decltype(eval(lazy(Vec3{}) + Vec3{})), Vec3>::value, "");
+static_assert(std::is_same<decltype(eval(lazy(iVec3{}) * 2)), iVec3>::value, "");
+static_assert(std::is_same<decltype(eval(-lazy(Mat4{}))), Mat4>::value, "");
+// Without lazy(), the eager operators are unchanged.
+static_assert(std::is_same<decltype(Vec3{} + Vec3{}), Vec3>::value, "");
+
+int main()
+{
+	PCG rng(5);
+	auto uniform = [&]() { return rng() / 4294967295.f * 4 - 2; };
+	auto vec3 = [&]() { return Vec3{ uniform(), uniform(), uniform() }; };
+
+	for (int n = 0; n < 1000; ++n) {
+		const Vec3 a = vec3(), b = vec3(), c = vec3();
+		const float s = uniform(), t = .5f * uniform() + 1.5f;
+
+		// Chains, scalars on either side.
+		CHECK(near<Vec3>((lazy(a) - b) * s + c, (a - b) * s + c));
+		CHECK(near<Vec3>(s * lazy(a) + b * t, s * a + b * t));
+		CHECK(near<Vec3>(lazy(a) * b - c / t, a * b - c / t));
+		CHECK(near<Vec3>(-(lazy(a) + b), -(a + b)));
+		CHECK(near<Vec3>(lazy(a) + lazy(b) + lazy(c), a + b + c));
+
+		// Scalar over an expression, which has no eager form.
+		const Vec3 quotient{ t / (b.x * b.x + 1.f),
+			t / (b.y * b.y + 1.f), t / (b.z * b.z + 1.f) };
+		CHECK(near<Vec3>(t / (lazy(b) * b + 1.f), quotient));
+
+		// Compound assignment.
+		Vec3 m = a;
+		m += lazy(b) * s;
+		CHECK(near<Vec3>(m, a + b * s));
+		m = a;
+		m -= lazy(b) - c;
+		CHECK(near<Vec3>(m, a - (b - c)));
+		m = a;
+		m *= lazy(b) + c;
+		CHECK(near<Vec3>(m, a * (b + c)));
+		m = a;
+		m /= lazy(b) * b + 1.f;
+		CHECK(near<Vec3>(m, a / (b * b + 1.f)));
+
+		// The result may alias an operand, as elements are independent.
+		m = a;
+		m = (lazy(m) - b) * s + m;
+		CHECK(near<Vec3>(m, (a - b) * s + a));
+
+		// Callers that use the lazy form.
+		CHECK(near<Vec3>(lerp(a, b, s), a + (b - a) * s));
+		const Quat q = normalize(Quat{ uniform(), uniform(), uniform(), uniform() });
+		const Quat r = q * Quat{ 0.f, a } * conj(q);
+		CHECK(near<Vec3>(rotate(q, a), r.imag()));
+	}
+
+	// Integers stay exact.
+	const iVec3 i{ 3, -4, 5 }, j{ 7, 2, -1 };
+	CHECK((eval((lazy(i) - j) * 3 + 1) == iVec3{ -11, -17, 19 }));
+
+	// Matrices are element-wise too.
+	Mat4 A{}, B{};
+	for (int e = 0; e < 16; ++e) {
+		element(A, e) = uniform();
+		element(B, e) = uniform();
+	}
+	CHECK(near<Mat4>(lazy(A) * 2.f - B, A * 2.f - B));
+
+	return check::result();
+}
@@ -0,0 +1,152 @@
+#include "calc.h"
+#include "check.h"
+
+#include <vector>
+
+////
+// calc::fast against <cmath> in double, within the
+// max errors documented in calc.h, for the scalar
+// and the array forms. Built with the configured
+// options and with AVX2 forced on.
+////
+
+using namespace calc;
+
+namespace
+{
+
+class MaxError {
+public:
+	double value = 0.;
+	float at = 0.f;
+
+	void update(double error, float x)
+	{
+		if (error > value) {
+			value = error;
+			at = x;
+		}
+	}
+};
+
+// Scalar and array forms of f over x, error of each against ref.
+template<typename Scalar, typename Array, typename Ref>
+MaxError sweep(const std::vector<float>& x, Scalar scalar, Array array, Ref error)
+{
+	MaxError max_error{};
+	std::vector<float> out(x.size());
+	array(x.data(), out.data(), static_cast<int>(x.size()));
+	for (std::size_t i = 0; i < x.size(); ++i) {
+		max_error.update(error(x[i], scalar(x[i])), x[i]);
+		max_error.update(error(x[i], out[i]), x[i]);
+	}
+	return max_error;
+}
+
+}
+
+int main()
+{
+	if (check::cpu_lacks_build_isa())
+		return check::skipped;
+
+	PCG rng(3);
+	auto uniform = [&]() { return rng() / 4294967295.f; };
+
+	// rsqrt and normalize, relative, over all binades.
+	{
+#if defined(CALC_SIMD_SSE)
+		const double bound = 3e-7;
+#else
+		const double bound = 5e-6;
+#endif
+		MaxError rsqrt_error{};
+		for (int e = -120; e <= 120; ++e)
+			for (int n = 0; n < 2000; ++n) {
+				float x = std::ldexp(1.f + uniform(), e);
+				double ref = 1. / std::sqrt(double(x));
+				rsqrt_error.update(std::abs(fast::rsqrt(x) - ref) / ref, x);
+			}
+		std::printf("rsqrt     max relative error %.2e at %g\n", rsqrt_error.value, rsqrt_error.at);
+		CHECK(rsqrt_error.value < bound);
+
+		std::vector<Vec3> v(100003), out(v.size());
+		for (auto& p : v)
+			p = Vec3{ uniform() - .5f, uniform() - .5f, uniform() - .5f } * std::ldexp(1.f, rng() % 40 - 20);
+		fast::normalize(v.data(), out.data(), static_cast<int>(v.size()));
+		MaxError normalize_error{};
+		for (std::size_t i = 0; i < v.size(); ++i) {
+			double len = std::sqrt(double(v[i].x) * v[i].x + double(v[i].y) * v[i].y + double(v[i].z) * v[i].z);
+			for (int c = 0; c < 3; ++c) {
+				normalize_error.update(std::abs(out[i][c] - v[i][c] / len), v[i][c]);
+				normalize_error.update(std::abs(fast::normalize(v[i])[c] - v[i][c] / len), v[i][c]);
+			}
+		}
+		std::printf("normalize max error %.2e\n", normalize_error.value);
+		CHECK(normalize_error.value < bound);
+	}
+
+	// acos, absolute, on a dense grid of [-1, 1].
+	{
+		std::vector<float> x;
+		for (int i = 0; i <= 2000000; ++i)
+			x.push_back(-1.f + i / 1000000.f);
+		x.push_back(1.f);
+		auto acos_error = sweep(x,
+			[](float x) { return fast::acos(x); },
+			[](const float* x, float* out, int count) { fast::acos(x, out, count); },
+			[](float x, float r) { return std::abs(r - std::acos(double(x))); });
+		std::printf("acos      max error %.2e at %g\n", acos_error.value, acos_error.at);
+		CHECK(acos_error.value < 5e-7);
+	}
+
+	// atan2, absolute, around the circle at many magnitudes, and on the axes.
+	{
+		std::vector<float> y, x;
+		for (int i = 0; i < 400000; ++i) {
+			float angle = 2.f * pi * uniform();
+			float r = std::ldexp(1.f, rng() % 200 - 100);
+			y.push_back(r * std::sin(angle));
+			x.push_back(r * std::cos(angle));
+		}
+		for (float a : { 1.f, -1.f, 3e-30f, -3e30f }) {
+			y.insert(y.end(), { a, 0.f, a, a });
+			x.insert(x.end(), { 0.f, a, a, -a });
+		}
+		std::vector<float> out(x.size());
+		fast::atan2(y.data(), x.data(), out.data(), static_cast<int>(x.size()));
+		MaxError atan2_error{};
+		for (std::size_t i = 0; i < x.size(); ++i) {
+			double ref = std::atan2(double(y[i]), double(x[i]));
+			atan2_error.update(std::abs(out[i] - ref), y[i]);
+			atan2_error.update(std::abs(fast::atan2(y[i], x[i]) - ref), y[i]);
+		}
+		std::printf("atan2     max error %.2e\n", atan2_error.value);
+		CHECK(atan2_error.value < 3e-6);
+		CHECK(fast::atan2(0.f, 0.f) == 0.f);
+	}
+
+	// sincos, absolute, for |x| < 1e4, and near multiples of pi/4.
+	{
+		std::vector<float> x;
+		for (int i = 0; i < 1000000; ++i)
+			x.push_back((2.f * uniform() - 1.f) * 1e4f);
+		for (int k = -400; k <= 400; ++k)
+			for (float d : { -1e-4f, 0.f, 1e-4f })
+				x.push_back(k * .25f * pi + d);
+		std::vector<float> s(x.size()), c(x.size());
+		fast::sincos(x.data(), s.data(), c.data(), static_cast<int>(x.size()));
+		MaxError sincos_error{};
+		for (std::size_t i = 0; i < x.size(); ++i) {
+			float s1, c1;
+			fast::sincos(x[i], s1, c1);
+			double sr = std::sin(double(x[i])), cr = std::cos(double(x[i]));
+			sincos_error.update(std::max(std::abs(s[i] - sr), std::abs(c[i] - cr)), x[i]);
+			sincos_error.update(std::max(std::abs(s1 - sr), std::abs(c1 - cr)), x[i]);
+		}
+		std::printf("sincos    max error %.2e at %g\n", sincos_error.value, sincos_error.at);
+		CHECK(sincos_error.value < 2e-7);
+	}
+
+	return check::result();
+}
@@ -0,0 +1,205 @@
+#include "calc.h"
+#include "check.h"
+
+#include <vector>
+
+////
+// Frustum culling of calc: objects on and around the
+// corners of a view frustum, the scalar tests against
+// the bulk mask and index forms, and the Vec3 box
+// arrays against the coordinate arrays. Built with
+// the configured options and with AVX2 forced on.
+////
+
+using namespace calc;
+
+namespace
+{
+
+constexpr float fovy = pi / 3, aspect = 1.5f, znear = .1f, zfar = 100.f;
+
+// Objects, tested one at a time and in bulk, in every form.
+class Objects {
+public:
+	std::vector<Vec3> centers;
+	std::vector<float> radii;
+	std::vector<Vec3> inf, sup;
+
+	void add(const Vec3& center, float r)
+	{
+		centers.push_back(center);
+		radii.push_back(r);
+		inf.push_back(center - Vec3{ r, r, r });
+		sup.push_back(center + Vec3{ r, r, r });
+	}
+
+	int size() const { return static_cast<int>(centers.size()); }
+
+	// Kept by the scalar sphere and box tests, which every bulk
+	// form must agree with.
+	class Kept {
+	public:
+		std::vector<bool> spheres, boxes;
+
+		bool both(int i) const { return spheres[i] && boxes[i]; }
+		bool neither(int i) const { return !spheres[i] && !boxes[i]; }
+	};
+
+	Kept visible(const Frustum& f) const
+	{
+		const int count = size();
+		std::vector<bool> spheres(count), boxes(count);
+		for (int i = 0; i < count; ++i) {
+			spheres[i] = calc::visible(f, Sphere{ centers[i], radii[i] });
+			boxes[i] = calc::visible(f, inf[i], sup[i]);
+		}
+
+		std::vector<float> inf_x(count), inf_y(count), inf_z(count);
+		std::vector<float> sup_x(count), sup_y(count), sup_z(count);
+		for (int i = 0; i < count; ++i) {
+			inf_x[i] = inf[i].x, inf_y[i] = inf[i].y, inf_z[i] = inf[i].z;
+			sup_x[i] = sup[i].x, sup_y[i] = sup[i].y, sup_z[i] = sup[i].z;
+		}
+		std::vector<unsigned char> mask((centers.size() + 7) / 8);
+		std::vector<int> indices(centers.size());
+		auto check_mask = [&](const std::vector<bool>& expected) {
+			for (int i = 0; i < count; ++i)
+				CHECK((mask[i / 8] >> i % 8 & 1) == expected[i]);
+		};
+		auto check_indices = [&](int n, const std::vector<bool>& expected) {
+			int k = 0;
+			for (int i = 0; i < count; ++i)
+				if (expected[i])
+					CHECK(k < n && indices[k++] == i);
+			CHECK(k == n);
+		};
+
+		visible_mask(f, centers.data(), radii.data(), count, mask.data());
+		check_mask(spheres);
+		check_indices(visible_indices(f, centers.data(), radii.data(), count, indices.data()), spheres);
+
+		visible_mask(f, inf.data(), sup.data(), count, mask.data());
+		check_mask(boxes);
+		check_indices(visible_indices(f, inf.data(), sup.data(), count, indices.data()), boxes);
+
+		visible_mask(f, inf_x.data(), inf_y.data(), inf_z.data(),
+			sup_x.data(), sup_y.data(), sup_z.data(), count, mask.data());
+		check_mask(boxes);
+		check_indices(visible_indices(f, inf_x.data(), inf_y.data(), inf_z.data(),
+			sup_x.data(), sup_y.data(), sup_z.data(), count, indices.data()), boxes);
+		return Kept{ spheres, boxes };
+	}
+};
+
+}
+
+int main()
+{
+	if (check::cpu_lacks_build_isa())
+		return check::skipped;
+
+	PCG rng(19);
+	auto uniform = [&]() { return rng() / 4294967295.f * 2 - 1; };
+
+	const Mat4 view = lookat(Vec3{ 1, 2, 3 }, Vec3{ 0, .5f, 0 }, Vec3{ 0, 1, 0 });
+	const Mat4 to_world = inv(view);
+	const Frustum f{ dot(projective_transform(fovy, aspect, znear, zfar), view) };
+	const float ty = std::tan(fovy / 2), tx = aspect * ty;
+
+	// A view space point in world space.
+	auto world = [&](float x, float y, float z) { return point_transform(to_world, Vec3{ x, y, z }); };
+
+	////
+	// At each corner, objects on it are kept, and objects
+	// just off it, outside all three of its planes, or
+	// only the near or far one, are culled.
+	////
+
+	for (float d : { znear, zfar }) {
+		const float r = 1e-3f * d, out = d == znear ? 1.f : -1.f;
+		for (float sx : { -1.f, 1.f })
+			for (float sy : { -1.f, 1.f }) {
+				const Vec3 corner{ sx * tx * d, sy * ty * d, -d };
+				Objects objects;
+				objects.add(world(corner.x, corner.y, corner.z), r);
+				objects.add(world(corner.x, corner.y, corner.z), 10.f * d);
+				objects.add(world(1.1f * corner.x, 1.1f * corner.y, corner.z + out * .1f * d), r);
+				objects.add(world(corner.x, corner.y, corner.z + out * .1f * d), r);
+				auto kept = objects.visible(f);
+				CHECK(kept.both(0));
+				CHECK(kept.both(1));
+				CHECK(kept.neither(2));
+				CHECK(kept.neither(3));
+			}
+	}
+
+	////
+	// Off a side edge by a, along the bisector of its two
+	// planes, objects are behind each plane by only about
+	// .82 a. A sphere of radius between the two is outside
+	// the frustum, yet the tests keep it, as documented.
+	// One of radius below .82 a is culled.
+	////
+
+	for (float sx : { -1.f, 1.f })
+		for (float sy : { -1.f, 1.f }) {
+			const float d = 10.f, a = .01f;
+			const Vec3 n_x = normalize(Vec3{ -sx, 0.f, -tx }), n_y = normalize(Vec3{ 0.f, -sy, -ty });
+			const Vec3 p = Vec3{ sx * tx * d, sy * ty * d, -d } - a * normalize(n_x + n_y);
+			const float behind = -std::min(dot(n_x, p), dot(n_y, p));
+			CHECK(behind > .8f * a && behind < .85f * a);
+			Objects objects;
+			objects.add(world(p.x, p.y, p.z), .9f * a);
+			objects.add(world(p.x, p.y, p.z), .75f * a);
+			auto kept = objects.visible(f);
+			CHECK(kept.both(0));
+			CHECK(kept.spheres[1] == false);
+		}
+
+	// Behind the camera, and around all of it.
+	{
+		Objects objects;
+		objects.add(world(0.f, 0.f, 1.f), .5f);
+		objects.add(world(0.f, 0.f, -50.f), 500.f);
+		auto kept = objects.visible(f);
+		CHECK(kept.neither(0));
+		CHECK(kept.both(1));
+	}
+
+	// Inside points are never culled, by any form, at any count.
+	for (int count : { 0, 1, 7, 8, 9, 15, 16, 17, 41, 1003 }) {
+		Objects objects;
+		for (int i = 0; i < count; ++i) {
+			float d = 1.01f * znear + .98f * (zfar - znear) * (.5f * uniform() + .5f);
+			objects.add(world(.999f * uniform() * tx * d, .999f * uniform() * ty * d, -d), 0.f);
+		}
+		auto kept = objects.visible(f);
+		for (int i = 0; i < count; ++i)
+			CHECK(kept.both(i));
+	}
+
+	// Random objects, in and out, agree between all forms.
+	for (int count : { 13, 64, 1003 }) {
+		Objects objects;
+		for (int i = 0; i < count; ++i) {
+			float d = 2.f * zfar * uniform();
+			objects.add(world(2.f * uniform() * tx * d, 2.f * uniform() * ty * d, -d),
+				std::abs(uniform()) * std::abs(d) * .1f);
+		}
+		auto kept = objects.visible(f);
+		int num_kept = 0;
+		for (int i = 0; i < count; ++i)
+			num_kept += kept.spheres[i];
+		CHECK(num_kept > 0 && num_kept < count);
+	}
+
+	// Moving the planes out by pad keeps spheres pad larger.
+	{
+		Objects near_miss;
+		near_miss.add(world(0.f, 0.f, -.5f * znear), .1f * znear);
+		CHECK(near_miss.visible(f).neither(0));
+		CHECK(near_miss.visible(expand(f, .5f * znear)).both(0));
+	}
+
+	return check::result();
+}
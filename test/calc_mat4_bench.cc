@@ -0,0 +1,86 @@
+#include "calc.h"
+#include "check.h"
+
+#include <random>
+
+////
+// Mat4 multiply, inverse and transform throughput,
+// and the Affine3 inverse, normal matrix and compose
+// against their Mat4 forms. Built twice,
+// calc_mat4_bench_scalar with CALC_NO_SIMD.
+////
+
+using namespace calc;
+
+int main()
+{
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> uniform(-2, 2);
+	std::vector<Mat4> ms(1024);
+	for (auto& m : ms)
+		for (int j = 0; j < 4; ++j)
+			for (int i = 0; i < 4; ++i)
+				m[j][i] = uniform(rng) + (i == j ? 3.f : 0.f);
+
+	constexpr int n = 1 << 20;
+	constexpr int mask = 1023;
+	Mat4 acc{};
+	Vec4 vacc{};
+
+	const double inv_ms = check::best_ms(5, [&]() {
+		for (int k = 0; k < n; ++k)
+			acc += inv(ms[k & mask]);
+	});
+	const double mul_ms = check::best_ms(5, [&]() {
+		for (int k = 0; k < n; ++k)
+			acc += dot(ms[k & mask], ms[(k + 1) & mask]);
+	});
+	const double xform_ms = check::best_ms(5, [&]() {
+		for (int k = 0; k < n; ++k)
+			vacc += dot(ms[k & mask], ms[(k + 7) & mask][0]);
+	});
+
+	// Affine parts of the same matrices.
+	std::vector<Affine3> as(ms.size());
+	for (std::size_t i = 0; i < ms.size(); ++i)
+		as[i] = Affine3{ ms[i] };
+	Mat3 nacc{};
+	Vec3 tacc{};
+	auto keep_affine = [&](const Affine3& a) {
+		nacc += a.linear;
+		tacc += a.translation;
+	};
+
+	const double affine_inv_ms = check::best_ms(5, [&]() {
+		for (int k = 0; k < n; ++k)
+			keep_affine(inv(as[k & mask]));
+	});
+	const double normal_ms = check::best_ms(5, [&]() {
+		for (int k = 0; k < n; ++k)
+			nacc += normal_matrix(as[k & mask]);
+	});
+	// As from a Mat4, the transpose of the inverse's 3x3 part.
+	const double normal4_ms = check::best_ms(5, [&]() {
+		for (int k = 0; k < n; ++k)
+			nacc += cast<Mat3>(inv(ms[k & mask])).T();
+	});
+	const double compose_ms = check::best_ms(5, [&]() {
+		for (int k = 0; k < n; ++k)
+			keep_affine(dot(as[k & mask], as[(k + 1) & mask]));
+	});
+	check::keep(acc);
+	check::keep(vacc);
+	check::keep(nacc);
+	check::keep(tacc);
+
+#ifdef CALC_SIMD
+	const char* backend = "simd";
+#else
+	const char* backend = "scalar";
+#endif
+	std::printf("mat4 %s: inv %.2f ns, mul %.2f ns, transform %.2f ns\n", backend,
+		inv_ms * 1e6 / n, mul_ms * 1e6 / n, xform_ms * 1e6 / n);
+	std::printf("affine3 %s: inv %.2f ns, normal_matrix %.2f ns (from mat4 %.2f ns), compose %.2f ns\n",
+		backend, affine_inv_ms * 1e6 / n, normal_ms * 1e6 / n, normal4_ms * 1e6 / n, compose_ms * 1e6 / n);
+	return 0;
+}
@@ -0,0 +1,139 @@
+#include "calc.h"
+#include "check.h"
+
+#include <random>
+
+////
+// Mat4 multiply, inverse, transpose and transform
+// against a double precision reference. With
+// CALC_SIMD these run through calc::simd.
+////
+
+using namespace calc;
+
+namespace
+{
+
+using Mat4d = std::array<std::array<double, 4>, 4>;
+
+// Column major like calc, m[column][row].
+Mat4d to_double(const Mat4& m)
+{
+	Mat4d d{};
+	for (int j = 0; j < 4; ++j)
+		for (int i = 0; i < 4; ++i)
+			d[j][i] = m[j][i];
+	return d;
+}
+
+Mat4d mul(const Mat4d& a, const Mat4d& b)
+{
+	Mat4d c{};
+	for (int j = 0; j < 4; ++j)
+		for (int i = 0; i < 4; ++i)
+			for (int k = 0; k < 4; ++k)
+				c[j][i] += a[k][i] * b[j][k];
+	return c;
+}
+
+// Gauss-Jordan with partial pivoting.
+Mat4d inverse(Mat4d a)
+{
+	Mat4d r{};
+	for (int d = 0; d < 4; ++d)
+		r[d][d] = 1;
+	for (int col = 0; col < 4; ++col) {
+		int pivot = col;
+		for (int row = col + 1; row < 4; ++row)
+			if (std::abs(a[col][row]) > std::abs(a[col][pivot]))
+				pivot = row;
+		for (int j = 0; j < 4; ++j) {
+			std::swap(a[j][col], a[j][pivot]);
+			std::swap(r[j][col], r[j][pivot]);
+		}
+		const double s = 1 / a[col][col];
+		for (int j = 0; j < 4; ++j) {
+			a[j][col] *= s;
+			r[j][col] *= s;
+		}
+		for (int row = 0; row < 4; ++row) {
+			if (row == col)
+				continue;
+			const double f = a[col][row];
+			for (int j = 0; j < 4; ++j) {
+				a[j][row] -= f * a[j][col];
+				r[j][row] -= f * r[j][col];
+			}
+		}
+	}
+	return r;
+}
+
+// Infinity norm, the largest absolute row sum.
+double norm(const Mat4d& m)
+{
+	double n = 0;
+	for (int i = 0; i < 4; ++i)
+		n = std::max(n, std::abs(m[0][i]) + std::abs(m[1][i])
+			+ std::abs(m[2][i]) + std::abs(m[3][i]));
+	return n;
+}
+
+// Largest element difference, relative to the largest reference element.
+double rel_error(const Mat4& m, const Mat4d& ref)
+{
+	double err = 0, scale = 0;
+	for (int j = 0; j < 4; ++j)
+		for (int i = 0; i < 4; ++i) {
+			err = std::max(err, std::abs(m[j][i] - ref[j][i]));
+			scale = std::max(scale, std::abs(ref[j][i]));
+		}
+	return err / scale;
+}
+
+}
+
+int main()
+{
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> uniform(-2, 2);
+	auto random_mat4 = [&]() {
+		Mat4 m;
+		for (int j = 0; j < 4; ++j)
+			for (int i = 0; i < 4; ++i)
+				m[j][i] = uniform(rng) + (i == j ? 3.f : 0.f);
+		return m;
+	};
+
+	for (int n = 0; n < 1000; ++n) {
+		const Mat4 a = random_mat4(), b = random_mat4();
+		const Mat4d ad = to_double(a), bd = to_double(b);
+
+		CHECK(rel_error(dot(a, b), mul(ad, bd)) < 1e-6);
+		// Inverse error grows with the condition number.
+		const Mat4d ref_inv = inverse(ad);
+		CHECK(rel_error(inv(a), ref_inv) < 1e-6 * norm(ad) * norm(ref_inv));
+
+		const Mat4 t = transpose(a);
+		for (int j = 0; j < 4; ++j)
+			for (int i = 0; i < 4; ++i)
+				CHECK(t[j][i] == a[i][j]);
+
+		const Vec4 v{ uniform(rng), uniform(rng), uniform(rng), uniform(rng) };
+		const Vec4 av = dot(a, v);
+		for (int i = 0; i < 4; ++i) {
+			double ref = 0;
+			for (int k = 0; k < 4; ++k)
+				ref += ad[k][i] * v[k];
+			CHECK(std::abs(av[i] - ref) < 1e-5);
+		}
+	}
+
+	// Rigid transforms invert exactly enough to round trip points.
+	const Mat4 rigid = affine_transform(
+		rotation_transform(.7f, normalize(Vec3{ 1, 2, 3 })), Vec3{ 4, -5, 6 });
+	const Vec3 p{ .3f, -1.2f, 2.5f };
+	CHECK(length(point_transform(inv(rigid), point_transform(rigid, p)) - p) < 1e-5f);
+
+	return check::result();
+}
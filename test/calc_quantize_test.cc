@@ -0,0 +1,199 @@
+#include "calc.h"
+#include "check.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+////
+// Half floats, normalized integers and octahedral
+// normals of calc: the scalar conversions against
+// references, and the array forms against the
+// scalar ones, bit for bit, for every remainder of
+// eight. Built with the configured options and with
+// AVX2 and F16C forced on.
+////
+
+using namespace calc;
+
+namespace
+{
+
+std::uint32_t bits(float x)
+{
+	std::uint32_t b;
+	std::memcpy(&b, &x, sizeof(b));
+	return b;
+}
+
+float from_bits(std::uint32_t b)
+{
+	float x;
+	std::memcpy(&x, &b, sizeof(x));
+	return x;
+}
+
+// Nearest half to x, ties to even, from the value of every half.
+std::uint16_t nearest_half(float x, const std::vector<double>& values)
+{
+	if (std::isnan(x))
+		return static_cast<std::uint16_t>(0x7e00 | (bits(x) >> 16 & 0x8000) | (bits(x) >> 13 & 0x3ff));
+	std::uint16_t sign = std::signbit(x) ? 0x8000 : 0;
+	double a = std::abs(double(x));
+	// Past the largest half by half an ulp or more is infinity.
+	if (a >= 65520.)
+		return sign | 0x7c00;
+	auto h = static_cast<std::uint16_t>(std::upper_bound(values.begin(), values.end(), a) - values.begin() - 1);
+	if (h < 0x7bff) {
+		double below = a - values[h], above = values[h + 1] - a;
+		if (above < below || (above == below && h % 2))
+			++h;
+	}
+	return sign | h;
+}
+
+}
+
+int main()
+{
+	if (check::cpu_lacks_build_isa())
+		return check::skipped;
+
+	PCG rng(29);
+	auto uniform = [&]() { return rng() / 4294967295.f * 2 - 1; };
+
+	////
+	// Every half to float and back. Finite ones, and
+	// infinities, round trip; NaNs come back quiet with
+	// their payload, as from F16C.
+	////
+
+	std::vector<std::uint16_t> all(1 << 16), back(all.size());
+	std::vector<float> floats(all.size());
+	for (std::size_t h = 0; h < all.size(); ++h)
+		all[h] = static_cast<std::uint16_t>(h);
+	half_to_float(all.data(), floats.data(), static_cast<int>(all.size()));
+	float_to_half(floats.data(), back.data(), static_cast<int>(all.size()));
+	std::vector<double> values(0x7c00);
+	for (std::size_t i = 0; i < all.size(); ++i) {
+		const std::uint16_t h = all[i];
+		const float x = half_to_float(h);
+		CHECK(bits(x) == bits(floats[i]));
+		const bool nan = (h & 0x7c00) == 0x7c00 && (h & 0x3ff);
+		if (nan) {
+			CHECK(std::isnan(x));
+			CHECK((bits(x) & 0x00400000) != 0);
+			CHECK(back[i] == (h | 0x200));
+		}
+		else {
+			CHECK(back[i] == h);
+			CHECK(float_to_half(x) == h);
+		}
+		if (h < 0x7c00) {
+			int exponent = h >> 10, mantissa = h & 0x3ff;
+			values[h] = exponent ? std::ldexp(1024. + mantissa, exponent - 25) : std::ldexp(double(mantissa), -24);
+			CHECK(double(x) == values[h]);
+		}
+	}
+
+	// Floats to half, round to nearest even, against the values.
+	{
+		std::vector<float> x;
+		for (int i = 0; i < 20000; ++i)
+			x.push_back(std::ldexp(uniform(), static_cast<int>(rng() % 44) - 26));
+		for (std::uint16_t h : { 0x0000, 0x0001, 0x03ff, 0x0400, 0x3c00, 0x7bff }) {
+			// Halfway between neighbours, and just off it.
+			double mid = .5 * (values[h] + values[h + 1]);
+			for (float m : { float(mid), std::nextafter(float(mid), 0.f), std::nextafter(float(mid), 1e9f) }) {
+				x.push_back(m);
+				x.push_back(-m);
+			}
+		}
+		for (float v : { 65504.f, 65519.f, 65520.f, 1e10f, 1e-10f, 0.f, -0.f,
+				std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(),
+				std::numeric_limits<float>::quiet_NaN(), from_bits(0x7f800001), from_bits(0xff812345) })
+			x.push_back(v);
+		std::vector<std::uint16_t> h(x.size());
+		float_to_half(x.data(), h.data(), static_cast<int>(x.size()));
+		for (std::size_t i = 0; i < x.size(); ++i) {
+			CHECK(float_to_half(x[i]) == nearest_half(x[i], values));
+			CHECK(h[i] == float_to_half(x[i]));
+		}
+	}
+
+	////
+	// Normalized integers: every integer dequantizes and
+	// quantizes back, clamping and NaN, and the array
+	// forms against the scalar ones.
+	////
+
+	auto check_norm = [&](auto zero) {
+		using IntType = decltype(zero);
+		const int lo = std::numeric_limits<IntType>::min(), hi = std::numeric_limits<IntType>::max();
+		for (int q = lo; q <= hi; ++q) {
+			float x = dequantize(static_cast<IntType>(q));
+			CHECK(quantize<IntType>(x) == (q == lo && lo < 0 ? lo + 1 : q));
+			CHECK(x >= -1.f && x <= 1.f);
+		}
+		CHECK(quantize<IntType>(2.f) == hi);
+		CHECK(quantize<IntType>(-2.f) == static_cast<IntType>(norm_min<IntType>() * hi));
+		CHECK(quantize<IntType>(std::numeric_limits<float>::quiet_NaN()) ==
+			static_cast<IntType>(norm_min<IntType>() * hi));
+
+		for (int count = 0; count <= 41; ++count) {
+			std::vector<float> x(count), out(count);
+			std::vector<IntType> q(count);
+			for (int i = 0; i < count; ++i)
+				x[i] = i % 13 == 5 ? std::numeric_limits<float>::quiet_NaN() : 1.2f * uniform();
+			quantize(x.data(), q.data(), count);
+			for (int i = 0; i < count; ++i)
+				CHECK(q[i] == quantize<IntType>(x[i]));
+			dequantize(q.data(), out.data(), count);
+			for (int i = 0; i < count; ++i)
+				CHECK(bits(out[i]) == bits(dequantize(q[i])));
+		}
+	};
+	check_norm(std::int8_t{});
+	check_norm(std::uint8_t{});
+	check_norm(std::int16_t{});
+	check_norm(std::uint16_t{});
+
+	////
+	// Octahedral normals, within 4e-3 degrees, on both
+	// hemispheres, the axes and the folds, and the array
+	// forms within rounding of the scalar ones.
+	////
+
+	std::vector<Vec3> normals;
+	for (int i = 0; i < 100000; ++i)
+		normals.push_back(normalize(Vec3{ uniform(), uniform(), uniform() }));
+	for (float s : { 1.f, -1.f }) {
+		normals.insert(normals.end(), { Vec3{ s, 0, 0 }, Vec3{ 0, s, 0 }, Vec3{ 0, 0, s } });
+		normals.push_back(normalize(Vec3{ s, 1, 0 }));
+		normals.push_back(normalize(Vec3{ 1, s, 1e-7f }));
+	}
+	const int count = static_cast<int>(normals.size());
+	std::vector<std::int16_t> packed(2 * count);
+	std::vector<Vec3> decoded(count);
+	oct_encode(normals.data(), packed.data(), count);
+	oct_decode(packed.data(), decoded.data(), count);
+	double max_degrees = 0.;
+	for (int i = 0; i < count; ++i) {
+		Vec2 e = oct_encode(normals[i]);
+		CHECK(std::abs(packed[2 * i] - quantize<std::int16_t>(e.x)) <= 1);
+		CHECK(std::abs(packed[2 * i + 1] - quantize<std::int16_t>(e.y)) <= 1);
+		// In double, as acos of a float dot near 1 is off by 0.02 degrees.
+		const Vec3& a = normals[i];
+		const Vec3& b = decoded[i];
+		double cx = double(a.y) * b.z - double(a.z) * b.y;
+		double cy = double(a.z) * b.x - double(a.x) * b.z;
+		double cz = double(a.x) * b.y - double(a.y) * b.x;
+		double c = double(a.x) * b.x + double(a.y) * b.y + double(a.z) * b.z;
+		max_degrees = std::max(max_degrees, std::atan2(std::sqrt(cx * cx + cy * cy + cz * cz), c) * 180. / pi);
+		CHECK(std::abs(length(decoded[i]) - 1.f) < 1e-6f);
+	}
+	std::printf("octahedral max error %.2e degrees\n", max_degrees);
+	CHECK(max_degrees < 4e-3);
+
+	return check::result();
+}
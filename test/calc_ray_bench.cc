@@ -0,0 +1,106 @@
+#include "calc.h"
+#include "check.h"
+
+#include <vector>
+
+////
+// Ray packet throughput of calc: the nearest hit of
+// each ray over all primitives, one ray at a time
+// against packets of eight rays. Built with the
+// configured options and with AVX2 forced on.
+////
+
+using namespace calc;
+
+int main()
+{
+	if (check::cpu_lacks_build_isa())
+		return check::skipped;
+
+	PCG rng(17);
+	auto uniform = [&]() { return rng() / 4294967295.f * 2 - 1; };
+	auto vec3 = [&]() { return Vec3{ uniform(), uniform(), uniform() }; };
+
+	std::vector<Ray> rays(8 * 1024);
+	for (auto& ray : rays)
+		ray = Ray{ 3.f * vec3(), normalize(vec3()) };
+	std::vector<Rayx8> packets(rays.size() / 8);
+	for (std::size_t p = 0; p < packets.size(); ++p)
+		packets[p] = load_x8(rays.data() + 8 * p);
+
+	std::vector<Sphere> spheres(256);
+	std::vector<Box3D> boxes(spheres.size());
+	std::vector<Vec3> v0(spheres.size()), e1(v0.size()), e2(v0.size());
+	for (std::size_t i = 0; i < spheres.size(); ++i) {
+		spheres[i] = Sphere{ 2.f * vec3(), .05f + .1f * std::abs(uniform()) };
+		boxes[i] = Box3D{ 2.f * vec3(), Vec3{ .2f, .2f, .2f } };
+		v0[i] = 2.f * vec3();
+		e1[i] = .3f * vec3();
+		e2[i] = .3f * vec3();
+	}
+
+	std::vector<float> nearest(rays.size());
+	const float miss = std::numeric_limits<float>::infinity();
+
+	////
+	// Primitives outer, as a leaf would hand them out, so
+	// each packet splats the primitive once.
+	////
+
+	auto scalar = [&](auto hit) {
+		return check::best_ms(5, [&]() {
+			std::fill(nearest.begin(), nearest.end(), miss);
+			for (std::size_t i = 0; i < spheres.size(); ++i)
+				for (std::size_t r = 0; r < rays.size(); ++r)
+					nearest[r] = std::min(nearest[r], hit(i, rays[r]));
+			check::keep(nearest.back());
+		});
+	};
+	auto packet = [&](auto hit) {
+		return check::best_ms(5, [&]() {
+			std::fill(nearest.begin(), nearest.end(), miss);
+			for (std::size_t i = 0; i < spheres.size(); ++i)
+				for (std::size_t p = 0; p < packets.size(); ++p) {
+					float* s = nearest.data() + 8 * p;
+					simd::store8(s, simd::min(simd::load8(s), hit(i, packets[p])));
+				}
+			check::keep(nearest.back());
+		});
+	};
+
+	const double sphere_ms = scalar([&](std::size_t i, const Ray& ray) {
+		return hit_distance(spheres[i], ray);
+	});
+	const double sphere8_ms = packet([&](std::size_t i, const Rayx8& rays) {
+		return hit_distance(spheres[i], rays);
+	});
+	const double box_ms = scalar([&](std::size_t i, const Ray& ray) {
+		return hit_distance(boxes[i], ray);
+	});
+	const double box8_ms = packet([&](std::size_t i, const Rayx8& rays) {
+		return hit_distance(boxes[i], rays);
+	});
+	const double triangle_ms = scalar([&](std::size_t i, const Ray& ray) {
+		float u, v;
+		return hit_distance(v0[i], e1[i], e2[i], ray, u, v);
+	});
+	const double triangle8_ms = packet([&](std::size_t i, const Rayx8& rays) {
+		simd::f32x8 u, v;
+		return hit_distance(splat_x8(v0[i]), splat_x8(e1[i]), splat_x8(e2[i]), rays, u, v);
+	});
+
+	const double num_tests = double(rays.size()) * spheres.size();
+	auto report = [&](const char* name, double ms, double ms8) {
+		std::printf("%-8s scalar %7.2f ms %7.1f Mtests/s   x8 %7.2f ms %7.1f Mtests/s   %.2fx\n",
+			name, ms, num_tests / ms * 1e-3, ms8, num_tests / ms8 * 1e-3, ms / ms8);
+	};
+#if defined(CALC_SIMD_AVX2)
+	std::printf("AVX2, %d rays, %d primitives\n", static_cast<int>(rays.size()), static_cast<int>(spheres.size()));
+#else
+	std::printf("scalar lanes, %d rays, %d primitives\n", static_cast<int>(rays.size()), static_cast<int>(spheres.size()));
+#endif
+	report("sphere", sphere_ms, sphere8_ms);
+	report("box", box_ms, box8_ms);
+	report("triangle", triangle_ms, triangle8_ms);
+	return 0;
+}
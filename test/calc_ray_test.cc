@@ -0,0 +1,209 @@
+#include "calc.h"
+#include "check.h"
+
+#include <array>
+#include <vector>
+
+////
+// Ray packets of calc against the scalar
+// hit_distance, lane by lane: eight rays against a
+// splat primitive, and a splat ray against eight
+// primitives. Built with the configured options and
+// with AVX2 forced on.
+////
+
+using namespace calc;
+
+namespace
+{
+
+constexpr float miss = std::numeric_limits<float>::infinity();
+
+// Hits agree to rounding, misses exactly. Rays that graze
+// the primitive may round to either side of the threshold
+// with FMA, or, for spheres, to a distance off by the
+// square root of the rounding. Those are counted, not
+// failed, and must stay rare.
+class Agreement {
+public:
+	int num_tests = 0;
+	int num_hits = 0;
+	int num_borderline = 0;
+	int num_wrong = 0;
+
+	void update(float packet, float scalar, bool grazing = false)
+	{
+		++num_tests;
+		if (packet == miss && scalar == miss)
+			return;
+		++num_hits;
+		if (packet == miss || scalar == miss ||
+			std::abs(packet - scalar) > 1e-4f * (1.f + std::abs(scalar))) {
+			if (grazing || packet == miss || scalar == miss)
+				++num_borderline;
+			else
+				++num_wrong;
+		}
+	}
+
+	void report(const char* name) const
+	{
+		std::printf("%-9s %8d tests, %3d%% hit, %d borderline, %d wrong\n", name, num_tests,
+			static_cast<int>(100. * num_hits / num_tests), num_borderline, num_wrong);
+		CHECK(num_wrong == 0);
+		CHECK(num_borderline * 10000 <= num_tests);
+		CHECK(num_hits * 100 > num_tests);
+	}
+};
+
+// Within a thousandth of the radius of tangent, in double.
+bool grazing(const Sphere& sphere, const Ray& ray)
+{
+	double oc[3], d[3], b = 0., c = 0., dd = 0.;
+	for (int i = 0; i < 3; ++i) {
+		oc[i] = double(ray.o[i]) - sphere.o[i];
+		d[i] = ray.d[i];
+		b += oc[i] * d[i];
+		c += oc[i] * oc[i];
+		dd += d[i] * d[i];
+	}
+	double distance = std::sqrt(std::max(0., c - b * b / dd));
+	return std::abs(distance - sphere.r) < 1e-3 * sphere.r;
+}
+
+std::array<float, 8> lanes(simd::f32x8 a)
+{
+	std::array<float, 8> out;
+	simd::store8(out.data(), a);
+	return out;
+}
+
+}
+
+int main()
+{
+	if (check::cpu_lacks_build_isa())
+		return check::skipped;
+
+	PCG rng(13);
+	auto uniform = [&]() { return rng() / 4294967295.f * 2 - 1; };
+	auto vec3 = [&]() { return Vec3{ uniform(), uniform(), uniform() }; };
+
+	////
+	// Rays from around the primitives towards their middle,
+	// some from inside, and one in eight along an axis, so
+	// that 1/d is infinite in two of its components.
+	////
+
+	std::vector<Ray> rays(8 * 512);
+	for (std::size_t r = 0; r < rays.size(); ++r) {
+		Vec3 o = 3.f * vec3(), d{};
+		if (r % 8 == 3)
+			d[rng() % 3] = rng() % 2 ? 1.f : -1.f;
+		else
+			d = normalize(.5f * vec3() - o);
+		rays[r] = Ray{ o, d };
+	}
+
+	std::vector<Sphere> spheres(8 * 64);
+	for (auto& sphere : spheres)
+		sphere = Sphere{ 2.f * vec3(), .2f + std::abs(uniform()) };
+
+	std::vector<Box3D> boxes(spheres.size());
+	std::vector<float> s_max(boxes.size());
+	for (std::size_t b = 0; b < boxes.size(); ++b) {
+		Vec3 size = vec3();
+		boxes[b] = Box3D{ 2.f * vec3(), Vec3{ std::abs(size.x), std::abs(size.y), std::abs(size.z) } + Vec3{ .1f, .1f, .1f } };
+		s_max[b] = b % 2 ? miss : 2.f + 4.f * std::abs(uniform());
+	}
+
+	// Degenerate ones among them, which no ray hits.
+	std::vector<Vec3> v0(spheres.size()), e1(v0.size()), e2(v0.size());
+	for (std::size_t t = 0; t < v0.size(); ++t) {
+		v0[t] = 2.f * vec3();
+		e1[t] = 2.f * vec3();
+		e2[t] = t % 16 == 5 ? -.5f * e1[t] : 2.f * vec3();
+	}
+
+	// Eight rays against one primitive.
+	Agreement sphere_rays{}, box_rays{}, triangle_rays{}, uv_rays{};
+	for (std::size_t r = 0; r < rays.size(); r += 8) {
+		const Rayx8 packet = load_x8(rays.data() + r);
+		for (std::size_t p = 0; p < spheres.size(); ++p) {
+			auto s = lanes(hit_distance(spheres[p], packet));
+			for (int i = 0; i < 8; ++i)
+				sphere_rays.update(s[i], hit_distance(spheres[p], rays[r + i]), grazing(spheres[p], rays[r + i]));
+
+			s = lanes(hit_distance(boxes[p], packet, simd::splat8(s_max[p])));
+			for (int i = 0; i < 8; ++i)
+				box_rays.update(s[i], hit_distance(boxes[p], rays[r + i], s_max[p]));
+
+			simd::f32x8 u8, v8;
+			s = lanes(hit_distance(splat_x8(v0[p]), splat_x8(e1[p]), splat_x8(e2[p]), packet, u8, v8));
+			auto u = lanes(u8), v = lanes(v8);
+			for (int i = 0; i < 8; ++i) {
+				float u1 = 0.f, v1 = 0.f;
+				float s1 = hit_distance(v0[p], e1[p], e2[p], rays[r + i], u1, v1);
+				triangle_rays.update(s[i], s1);
+				if (s[i] != miss && s1 != miss) {
+					uv_rays.update(u[i], u1);
+					uv_rays.update(v[i], v1);
+				}
+			}
+		}
+	}
+
+	// One ray against eight primitives.
+	Agreement sphere_prims{}, box_prims{}, triangle_prims{};
+	for (std::size_t p = 0; p < spheres.size(); p += 8) {
+		Vec3 o[8];
+		float radius[8];
+		Vec3 inf[8], sup[8];
+		for (int i = 0; i < 8; ++i) {
+			o[i] = spheres[p + i].o;
+			radius[i] = spheres[p + i].r;
+			inf[i] = boxes[p + i].inf();
+			sup[i] = boxes[p + i].sup();
+		}
+		const Vec3x8 o8 = load_x8(o), inf8 = load_x8(inf), sup8 = load_x8(sup);
+		const Vec3x8 v08 = load_x8(v0.data() + p), e18 = load_x8(e1.data() + p), e28 = load_x8(e2.data() + p);
+		const auto r8 = simd::load8(radius), s_max8 = simd::load8(s_max.data() + p);
+		for (const auto& ray : rays) {
+			const Rayx8 packet = splat_x8(ray);
+			auto s = lanes(hit_distance(o8, r8, packet));
+			for (int i = 0; i < 8; ++i)
+				sphere_prims.update(s[i], hit_distance(spheres[p + i], ray), grazing(spheres[p + i], ray));
+
+			s = lanes(hit_distance(inf8, sup8, packet, s_max8));
+			for (int i = 0; i < 8; ++i)
+				box_prims.update(s[i], hit_distance(boxes[p + i], ray, s_max[p + i]));
+
+			simd::f32x8 u8, v8;
+			s = lanes(hit_distance(v08, e18, e28, packet, u8, v8));
+			for (int i = 0; i < 8; ++i) {
+				float u1 = 0.f, v1 = 0.f;
+				triangle_prims.update(s[i], hit_distance(v0[p + i], e1[p + i], e2[p + i], ray, u1, v1));
+			}
+		}
+	}
+
+	sphere_rays.report("sphere x8");
+	box_rays.report("box x8");
+	triangle_rays.report("tri x8");
+	uv_rays.report("tri uv");
+	sphere_prims.report("8 spheres");
+	box_prims.report("8 boxes");
+	triangle_prims.report("8 tris");
+
+	// Exact cases: from inside a sphere the far root, from
+	// inside a box 0, behind them a miss.
+	const Sphere unit{ Vec3{ 0, 0, 0 }, 1.f };
+	const Box3D cube{ Vec3{ 0, 0, 0 }, Vec3{ 2, 2, 2 } };
+	const Ray inside{ Vec3{ 0, 0, 0 }, Vec3{ 1, 0, 0 } }, behind{ Vec3{ 2, 0, 0 }, Vec3{ 1, 0, 0 } };
+	CHECK(lanes(hit_distance(unit, splat_x8(inside)))[0] == 1.f);
+	CHECK(lanes(hit_distance(cube, splat_x8(inside)))[0] == 0.f);
+	CHECK(lanes(hit_distance(unit, splat_x8(behind)))[0] == miss);
+	CHECK(lanes(hit_distance(cube, splat_x8(behind)))[0] == miss);
+
+	return check::result();
+}
@@ -0,0 +1,94 @@
+
+#ifndef GFX_TEST_CHECK_H
+#define GFX_TEST_CHECK_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+
+////
+// Minimal test and benchmark helpers. A test is an
+// executable run by ctest, CHECK logs each failure and
+// check::result() is its exit status.
+////
+
+namespace check
+{
+
+inline int& failures()
+{
+	static int count = 0;
+	return count;
+}
+
+inline bool expect(bool cond, const char* expr, const char* file, int line)
+{
+	if (!cond) {
+		std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", file, line, expr);
+		++failures();
+	}
+	return cond;
+}
+
+// Exit status for ctest's SKIP_RETURN_CODE.
+constexpr int skipped = 77;
+
+// Whether this binary uses instructions the CPU lacks, i.e. it
+// was built for AVX2 and runs on an older CPU.
+inline bool cpu_lacks_build_isa()
+{
+	bool lacks = false;
+#if defined(__GNUC__) || defined(__clang__)
+#if defined(__AVX2__)
+	lacks = lacks || !__builtin_cpu_supports("avx2");
+#endif
+#if defined(__FMA__)
+	lacks = lacks || !__builtin_cpu_supports("fma");
+#endif
+#if defined(__F16C__)
+	lacks = lacks || !__builtin_cpu_supports("f16c");
+#endif
+#endif
+	return lacks;
+}
+
+inline int result()
+{
+	if (failures() != 0)
+		std::fprintf(stderr, "%d check(s) failed\n", failures());
+	return failures() == 0 ? 0 : 1;
+}
+
+// Best of reps runs of f, in milliseconds. One warm-up run first.
+template<typename F>
+double best_ms(int reps, F&& f)
+{
+	f();
+	double best = std::numeric_limits<double>::max();
+	for (int r = 0; r < reps; ++r) {
+		const auto start = std::chrono::steady_clock::now();
+		f();
+		const auto stop = std::chrono::steady_clock::now();
+		best = std::min(best,
+			std::chrono::duration<double, std::milli>(stop - start).count());
+	}
+	return best;
+}
+
+// Written by keep. At namespace scope, a set but never read
+// variable is not warned about.
+inline volatile char keep_sink;
+
+// Keeps a result alive without the optimizer removing its computation.
+template<typename T>
+void keep(const T& value)
+{
+	keep_sink = *reinterpret_cast<const volatile char*>(&value);
+}
+
+}
+
+#define CHECK(cond) ::check::expect(static_cast<bool>(cond), #cond, __FILE__, __LINE__)
+
+#endif
@@ -0,0 +1,72 @@
+#include "utility.h"
+#include "check.h"
+#include "old_format.h"
+
+#include <cstdlib>
+
+////
+// Cost per call of util::format against the format
+// before it, which rescanned the rest of the format
+// string per argument, as it is called: with a plain
+// string, with UTIL_FMT, and format_to into a reused
+// string, on the hair timings line of GfxDemo and on
+// a short line of two ints. Usage: format_bench
+// [calls], default 200000.
+////
+
+int main(int argc, char** argv)
+{
+	const int calls = argc > 1 ? std::max(1, std::atoi(argv[1])) : 200000;
+	calc::PCG rng(49);
+	std::vector<float> ms(calls + 4);
+	for (auto& t : ms)
+		t = rng() / 4294967295.f * 20.f;
+	std::string out;
+
+	auto report = [&](const char* name, auto f) {
+		const double total_ms = check::best_ms(5, [&]() {
+			for (int i = 0; i < calls; ++i)
+				f(i);
+			check::keep(out.size());
+		});
+		std::printf("  %-22s %8.1f ns\n", name, total_ms * 1e6 / calls);
+	};
+
+	std::printf("%d calls, best of 5\n", calls);
+	std::printf("\"hair ms: depth={:.3} ... upsample={:.3}\\n\", five floats\n");
+	report("old format", [&](int i) {
+		out = old::format("hair ms: depth={:.3} opacity={:.3} hair={:.3} resolve={:.3} upsample={:.3}\n",
+			ms[i], ms[i + 1], ms[i + 2], ms[i + 3], ms[i + 4]);
+	});
+	report("format, runtime", [&](int i) {
+		out = util::format("hair ms: depth={:.3} opacity={:.3} hair={:.3} resolve={:.3} upsample={:.3}\n",
+			ms[i], ms[i + 1], ms[i + 2], ms[i + 3], ms[i + 4]);
+	});
+	report("format, UTIL_FMT", [&](int i) {
+		out = util::format(
+			UTIL_FMT("hair ms: depth={:.3} opacity={:.3} hair={:.3} resolve={:.3} upsample={:.3}\n"),
+			ms[i], ms[i + 1], ms[i + 2], ms[i + 3], ms[i + 4]);
+	});
+	report("format_to, UTIL_FMT", [&](int i) {
+		out.clear();
+		util::format_to(out,
+			UTIL_FMT("hair ms: depth={:.3} opacity={:.3} hair={:.3} resolve={:.3} upsample={:.3}\n"),
+			ms[i], ms[i + 1], ms[i + 2], ms[i + 3], ms[i + 4]);
+	});
+
+	std::printf("\"#fibers drawn={}, culled={}\\n\", two ints\n");
+	report("old format", [&](int i) {
+		out = old::format("#fibers drawn={}, culled={}\n", i, calls - i);
+	});
+	report("format, runtime", [&](int i) {
+		out = util::format("#fibers drawn={}, culled={}\n", i, calls - i);
+	});
+	report("format, UTIL_FMT", [&](int i) {
+		out = util::format(UTIL_FMT("#fibers drawn={}, culled={}\n"), i, calls - i);
+	});
+	report("format_to, UTIL_FMT", [&](int i) {
+		out.clear();
+		util::format_to(out, UTIL_FMT("#fibers drawn={}, culled={}\n"), i, calls - i);
+	});
+	return 0;
+}
@@ -0,0 +1,178 @@
+#include "utility.h"
+#include "check.h"
+#include "old_format.h"
+
+#include <cmath>
+#include <limits>
+
+////
+// util::format, at run time, through UTIL_FMT and
+// format_to, against the format before it, on ints
+// at their limits, floats at many precisions, inf,
+// nan, -0 and denormals, bool, chars, strings,
+// escapes and calc types, and the few places they
+// are meant to differ.
+////
+
+using namespace calc;
+
+namespace
+{
+
+template<typename Str, typename ... Args>
+bool same_as_old(Str compiled, const char* fmt, const Args& ... args)
+{
+	const std::string expected = old::format(fmt, args...);
+	std::string appended = "<";
+	util::format_to(appended, compiled, args...);
+	return util::format(fmt, args...) == expected
+		&& util::format(compiled, args...) == expected
+		&& appended == "<" + expected;
+}
+
+template<typename F>
+bool throws(F&& f)
+{
+	try {
+		f();
+	}
+	catch (const std::invalid_argument&) {
+		return true;
+	}
+	return false;
+}
+
+}
+
+#define CHECK_OLD(str, ...) CHECK(same_as_old(UTIL_FMT(str), str, __VA_ARGS__))
+
+int main()
+{
+	////
+	// Integers.
+	////
+
+	CHECK_OLD("{}", 0);
+	CHECK_OLD("{} {}", std::numeric_limits<int>::min(), std::numeric_limits<int>::max());
+	CHECK_OLD("{} {}", std::numeric_limits<long long>::min(), std::numeric_limits<long long>::max());
+	CHECK_OLD("{}", std::numeric_limits<unsigned long long>::max());
+	CHECK_OLD("{},{},{}", static_cast<short>(-32768), 7u, static_cast<std::size_t>(-1));
+	// Precision is for floats only.
+	CHECK_OLD("{:.3}", 123456789);
+
+	////
+	// Floats, at the default and given precisions.
+	////
+
+	for (double value : { 0., 1., -1., .1, 1. / 3, static_cast<double>(pi), 1e-5, 123456., 1234567., 1e21, 1e-300,
+			-2.5e17, 6.02214076e23 }) {
+		CHECK_OLD("{}", value);
+		CHECK_OLD("{}", static_cast<float>(value));
+		CHECK_OLD("{:.0}", value);
+		CHECK_OLD("{:.1}", value);
+		CHECK_OLD("{:.3}", static_cast<float>(value));
+		CHECK_OLD("{:.12}", value);
+		CHECK_OLD("{:.17}", value);
+		CHECK_OLD("{:.40}", value);
+		CHECK_OLD("{:.100}", value);
+		CHECK_OLD("{:.9}", static_cast<float>(value));
+	}
+	const float inf = std::numeric_limits<float>::infinity();
+	CHECK_OLD("{} {} {:.3}", inf, -inf, static_cast<double>(inf));
+	CHECK_OLD("{}", std::numeric_limits<double>::quiet_NaN());
+	CHECK_OLD("{} {:.3} {}", -0.f, -0., 0.f);
+	CHECK_OLD("{} {}", std::numeric_limits<float>::denorm_min(), std::numeric_limits<double>::denorm_min());
+	CHECK_OLD("{:.20} {:.20}", std::numeric_limits<float>::denorm_min(), std::numeric_limits<double>::denorm_min());
+	CHECK_OLD("{} {}", std::numeric_limits<float>::max(), std::numeric_limits<double>::lowest());
+	// Digits after the leading ones are dropped, as by std::stoi.
+	CHECK_OLD("{:.3f}", pi);
+	CHECK_OLD("{x.2}", pi);
+
+	////
+	// bool, chars and strings.
+	////
+
+	CHECK_OLD("{} {}", true, false);
+	CHECK_OLD("[{}{}{}]", 'a', static_cast<signed char>('b'), static_cast<unsigned char>('c'));
+	CHECK_OLD("{}: {}", "c string", std::string("string"));
+	CHECK_OLD("{}{}", std::string_view("view"), std::string());
+	CHECK_OLD("{:.3}", "precision ignored");
+
+	////
+	// Escapes, and text around and between the arguments.
+	////
+
+	CHECK_OLD("a{{b}}{}c", 1);
+	CHECK_OLD("{{{{{}", 1);
+	CHECK_OLD("}}{}{{", 1);
+	CHECK_OLD("{}{{", 1);
+	CHECK_OLD("{} }}", 1);
+	CHECK_OLD("{} {{}}", 1);
+	CHECK_OLD("x={}, y={}, z={}\n", 1, 2.5f, "three");
+	CHECK_OLD("{}{}{}", 1, 2, 3);
+	CHECK(util::format("{{}}") == old::format("{{}}"));
+	CHECK(util::format("plain text") == "plain text");
+	CHECK(util::format(UTIL_FMT("50% {{done}}")) == old::format("50% {{done}}"));
+
+	////
+	// calc matrices and quaternions, as matrix_ostream and
+	// quat_ostream with the given precision.
+	////
+
+	const Vec3 v{ 1.f / 3, -2.f, 1e-7f };
+	const Mat3 m3 = Quat2Mat3(normalize(Quat{ .3f, .5f, -.2f, .8f }));
+	Mat4 m4 = affine_transform(m3, v);
+	CHECK_OLD("{}", v);
+	CHECK_OLD("{:.3}", v);
+	CHECK_OLD("{:.12}", m3);
+	CHECK_OLD("m={:.2}\n", m4);
+	CHECK_OLD("{}", iVec2{ -1, 7 });
+	CHECK_OLD("{} {:.2}", Quat{ .3f, .5f, -.2f, .8f }, Quat{ 1.f / 3, -0.f, inf, 1e-40f });
+
+	////
+	// Meant to differ, or to fail alike.
+	////
+
+	// Too few arguments leave the rest as is.
+	CHECK(util::format("{} and {}", 1) == "1 and {}");
+	CHECK(util::format("{} and {}", 1) == old::format("{} and {}", 1));
+	CHECK(util::format("{} {:.3} }} {", pi) == old::format("{} {:.3} }} {", pi));
+
+	// A precision that is not a number is ignored, where the old
+	// one threw from std::stoi.
+	CHECK(util::format("{:.x}", pi) == util::format("{}", pi));
+	CHECK(util::format(UTIL_FMT("{:.x}"), pi) == util::format("{}", pi));
+	CHECK(throws([] { old::format("{:.x}", pi); }));
+	// But not for anything else, which the old one never parsed.
+	CHECK_OLD("{:.x}", 12);
+
+	// }} right after {, as in {}}}, closed the old placeholder, and
+	// the braces were lost.
+	CHECK(util::format("{}}}", 1) == "1}}");
+	CHECK(old::format("{}}}", 1) == "1");
+	CHECK(util::format("{{{}}}", 1) == "{1}}");
+	CHECK(old::format("{{{}}}", 1) == "{1");
+
+	// Unmatched braces before the last argument, and too many
+	// arguments, throw for both.
+	CHECK(throws([] { util::format("} {}", 1); }));
+	CHECK(throws([] { old::format("} {}", 1); }));
+	CHECK(throws([] { util::format("{ {}", 1); }));
+	CHECK(throws([] { old::format("{ {}", 1); }));
+	CHECK(throws([] { util::format("{", 1); }));
+	CHECK(throws([] { old::format("{", 1); }));
+	CHECK(throws([] { util::format("{}", 1, 2); }));
+	CHECK(throws([] { old::format("{}", 1, 2); }));
+	CHECK(throws([] { util::format("", 1); }));
+	CHECK(throws([] { old::format("", 1); }));
+	// Without arguments nothing is parsed.
+	CHECK(util::format("{ }} {") == "{ }} {");
+
+	// print goes through the same format_to.
+	std::ostringstream ss;
+	util::print(ss, "{} and {}", 1);
+	util::print(ss, UTIL_FMT(" {:.3}}}"), pi);
+	CHECK(ss.str() == "1 and {} 3.14}}");
+
+	return check::result();
+}
@@ -0,0 +1,62 @@
+
+#ifndef GFX_TEST_GL_CONTEXT_H
+#define GFX_TEST_GL_CONTEXT_H
+
+#include <iostream>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include "glad/glad.h"
+
+////
+// OpenGL 4.5 core context without a window, through
+// EGL on a surfaceless display, so GPU benchmarks run
+// headless, on Mesa's llvmpipe on CPU-only machines.
+// Render into framebuffer objects.
+////
+
+namespace glcontext
+{
+
+inline bool create()
+{
+	auto get_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+		eglGetProcAddress("eglGetPlatformDisplayEXT"));
+	if (!get_display) {
+		std::cerr << "eglGetPlatformDisplayEXT unavailable.\n";
+		return false;
+	}
+	EGLDisplay display = get_display(
+		EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+		std::cerr << "Failed to initialize EGL.\n";
+		return false;
+	}
+	eglBindAPI(EGL_OPENGL_API);
+
+	const EGLint attribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 5,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE };
+	EGLContext context = eglCreateContext(
+		display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attribs);
+	if (context == EGL_NO_CONTEXT ||
+		!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+		std::cerr << "Failed to create an OpenGL 4.5 context.\n";
+		return false;
+	}
+	if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(eglGetProcAddress))) {
+		std::cerr << "Failed to load OpenGL.\n";
+		return false;
+	}
+	return true;
+}
+
+inline const char* renderer()
+{
+	return reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+}
+
+}
+
+#endif
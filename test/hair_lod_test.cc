@@ -0,0 +1,115 @@
+#include "GfxHair.h"
+#include "check.h"
+#include "scenes.h"
+
+#include <filesystem>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+////
+// Strand LOD of select_hair_lod: fiber counts from
+// the projected size, whose prefixes are contiguous
+// index ranges, and the width scale that keeps the
+// coverage, capped at max_width_scale.
+////
+
+using namespace calc;
+
+namespace
+{
+
+// Looking down -z at the origin from distance.
+class DistanceCamera : public gfx::Camera {
+public:
+	explicit DistanceCamera(float distance) : distance_(distance) {}
+
+	Mat4 world_transform() const override
+	{
+		return dot(projective_transform(pi / 3, 1.f, .1f, 1000.f),
+			lookat(pos(), Vec3{}, Vec3{ 0, 1, 0 }));
+	}
+
+	Vec3 pos() const override { return Vec3{ 0, 0, distance_ }; }
+
+private:
+	float distance_;
+};
+
+}
+
+int main()
+{
+	const int num_fibers = 1000;
+	const auto path = (std::filesystem::temp_directory_path() / "hair_lod_test.ind").string();
+	scenes::write_groom(path, num_fibers, 8);
+	auto hair = gfx::Model::load_from_ind_file(path);
+	std::filesystem::remove(path);
+	CHECK(hair.num_fibers() == num_fibers);
+
+	// Any prefix of the fibers is one index range, as draw(part, n) draws.
+	for (int f = 1; f < hair.num_fibers(); ++f)
+		CHECK(hair.fiber(f).istart == hair.fiber(f - 1).istart + hair.fiber(f - 1).icount + 1);
+
+	const iVec2 viewport{ 800, 800 };
+	gfx::HairLodSettings settings;
+	int prev_fibers = num_fibers;
+	for (float distance : { 2.f, 4.f, 8.f, 16.f, 32.f, 64.f, 128.f, 256.f, 1024.f }) {
+		DistanceCamera camera{ distance };
+		auto lod = gfx::select_hair_lod(hair, camera, viewport, settings);
+		const float size = gfx::projected_size(camera, hair.bounds(), viewport);
+		const float ratio = clamp(size / settings.full_detail_size, settings.min_fiber_ratio, 1.f);
+
+		CHECK(lod.num_fibers == std::min(num_fibers, static_cast<int>(std::ceil(ratio * num_fibers))));
+		CHECK(lod.num_fibers >= static_cast<int>(settings.min_fiber_ratio * num_fibers));
+		CHECK(lod.num_fibers <= prev_fibers);
+		CHECK(lod.width_scale >= 1.f);
+		CHECK(lod.width_scale <= settings.max_width_scale);
+		CHECK(lod.width_scale == std::min(settings.max_width_scale,
+			static_cast<float>(num_fibers) / lod.num_fibers));
+		prev_fibers = lod.num_fibers;
+	}
+
+	// Close up, every fiber at their width.
+	{
+		auto lod = gfx::select_hair_lod(hair, DistanceCamera{ 2.f }, viewport, settings);
+		CHECK(lod.num_fibers == num_fibers);
+		CHECK(lod.width_scale == 1.f);
+	}
+
+	// Far off, min_fiber_ratio of them, widened by 1 / ratio when uncapped.
+	{
+		gfx::HairLodSettings wide = settings;
+		wide.max_width_scale = 100.f;
+		auto lod = gfx::select_hair_lod(hair, DistanceCamera{ 1024.f }, viewport, wide);
+		CHECK(lod.num_fibers == 50);
+		CHECK(lod.width_scale == 20.f);
+	}
+
+	// Capped by default, and with a lower floor.
+	{
+		auto lod = gfx::select_hair_lod(hair, DistanceCamera{ 1024.f }, viewport, settings);
+		CHECK(lod.num_fibers == 50);
+		CHECK(lod.width_scale == settings.max_width_scale);
+
+		gfx::HairLodSettings few = settings;
+		few.min_fiber_ratio = .01f;
+		few.max_width_scale = 4.f;
+		lod = gfx::select_hair_lod(hair, DistanceCamera{ 1024.f }, viewport, few);
+		CHECK(lod.num_fibers == 10);
+		CHECK(lod.width_scale == 4.f);
+	}
+
+	// A single fiber groom is never dropped.
+	{
+		const auto one = (std::filesystem::temp_directory_path() / "hair_lod_test_one.ind").string();
+		scenes::write_groom(one, 1, 8);
+		auto single = gfx::Model::load_from_ind_file(one);
+		std::filesystem::remove(one);
+		auto lod = gfx::select_hair_lod(single, DistanceCamera{ 1024.f }, viewport, settings);
+		CHECK(lod.num_fibers == 1);
+		CHECK(lod.width_scale == 1.f);
+	}
+
+	return check::result();
+}
@@ -0,0 +1,144 @@
+#include "GfxDemo.h"
+#include "check.h"
+#include "scenes.h"
+#include "gl_context.h"
+
+#include <chrono>
+#include <filesystem>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+////
+// Per-pass timings of the hair renderer, headless,
+// on the procedural groom over the icosphere head.
+// Usage: hair_render_bench [num_fibers] [size]
+// [spatial_sort], default 10k fibers of 32 vertices
+// at 512^2, in shuffled order.
+//
+// Each pass is reported as wall time to glFinish
+// and as its GpuTimer, best of the measured frames.
+// For the strand rasterizer, hair is the binning
+// and composite the tile raster.
+////
+
+namespace
+{
+
+class PassTimes {
+public:
+	double frame_ms = 1e9;
+	float shadow_ms = 1e9f, hair_ms = 1e9f, composite_ms = 1e9f;
+};
+
+PassTimes time_hair(Renderer& renderer, gfx::Model& head, gfx::Model& hair,
+	gfx::Camera& camera, int num_frames, gfx::StrandRasterizer* raster)
+{
+	PassTimes times{};
+	for (int frame = 0; frame < num_frames; ++frame) {
+		renderer.render(head, camera);
+		glFinish();
+		auto start = std::chrono::steady_clock::now();
+		if (raster)
+			renderer.render_hair_strands(hair, camera, *raster);
+		else
+			renderer.render_hair(hair, camera);
+		glFinish();
+		std::chrono::duration<double, std::milli> elapsed =
+			std::chrono::steady_clock::now() - start;
+
+		// Timer results lag a few frames behind.
+		if (frame < 4)
+			continue;
+		const auto& shadow = renderer.hair_shadow();
+		times.frame_ms = std::min(times.frame_ms, elapsed.count());
+		times.shadow_ms = std::min(times.shadow_ms,
+			shadow.depth_timer().elapsed_ms() + shadow.opacity_timer().elapsed_ms());
+		if (raster) {
+			times.shadow_ms = 0.f;
+			times.hair_ms = std::min(times.hair_ms, raster->bin_timer().elapsed_ms());
+			times.composite_ms = std::min(times.composite_ms, raster->raster_timer().elapsed_ms());
+			continue;
+		}
+		times.hair_ms = std::min(times.hair_ms, renderer.hair_timer().elapsed_ms());
+		times.composite_ms = std::min(times.composite_ms,
+			renderer.resolve_timer().elapsed_ms() + renderer.upsample_timer().elapsed_ms());
+	}
+	return times;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	const int num_fibers = argc > 1 ? std::atoi(argv[1]) : 10000;
+	const int size = argc > 2 ? std::atoi(argv[2]) : 512;
+	const bool spatial_sort = argc > 3 && std::atoi(argv[3]) != 0;
+	const int num_frames = 12;
+
+	if (!glcontext::create())
+		return 1;
+
+	auto head = gfx::Model::load_from_obj_file(
+		gfxconfig::asset_dir + "/sphere/ico.obj", gfx::vertex_attrib::PosNormUV);
+	const auto path = (std::filesystem::temp_directory_path() / "hair_render_bench.ind").string();
+	scenes::write_groom(path, num_fibers, 32);
+	auto hair = gfx::Model::load_from_ind_file(path, gfx::vertex_attrib::PosTan,
+		calc::Box3D{ {0,0,0},{-1,-1,-1} }, spatial_sort);
+	std::filesystem::remove(path);
+
+	gfx::ArcballCamera camera{ head.bounds(), { 0,0,-1 }, { 0,1,0 },
+		calc::to_radian(60.f), 1.f };
+
+	std::printf("%s, %d fibers, %d segments, %dx%d, %s\n", glcontext::renderer(),
+		hair.num_fibers(), hair.num_verts() - hair.num_fibers(), size, size,
+		spatial_sort ? "sorted" : "shuffled");
+	std::printf("%-22s %10s %10s %10s %12s\n",
+		"", "frame ms", "shadow ms", "hair ms", "composite ms");
+
+	auto report = [&](const char* name, const RendererSettings& settings,
+		bool strand_raster = false) {
+		Renderer renderer{};
+		renderer.init(settings);
+		renderer.create_framebuffer(calc::iVec2{ size, size });
+		// Every fiber, to compare the passes at the same load.
+		renderer.hair_lod_settings().full_detail_size = 1.f;
+		gfx::StrandRasterizer raster{};
+		if (strand_raster)
+			raster.init(hair);
+		auto times = time_hair(renderer, head, hair, camera, num_frames,
+			strand_raster ? &raster : nullptr);
+		std::printf("%-22s %10.2f %10.2f %10.2f %12.2f\n", name, times.frame_ms,
+			times.shadow_ms, times.hair_ms, times.composite_ms);
+		raster.destroy();
+		renderer.destory_resource();
+	};
+
+	RendererSettings settings{};
+	settings.hair_oit = false;
+	settings.hair_half_res = false;
+
+	settings.hair_shading_lut = false;
+	settings.hair_shading_analytic = false;
+	report("kajiya-kay", settings);
+	settings.hair_shading_lut = true;
+	report("marschner lut", settings);
+	settings.hair_shading_analytic = true;
+	report("marschner analytic", settings);
+	settings.hair_shading_analytic = false;
+
+	// Composite is the upsample, or the OIT resolve.
+	settings.hair_half_res = true;
+	report("lut half res", settings);
+	settings.hair_half_res = false;
+	settings.hair_oit = true;
+	report("lut oit", settings);
+
+	// Line strips against the strand rasterizer, which blends
+	// Kajiya-Kay without shadows.
+	settings.hair_shadow = false;
+	settings.hair_shading_lut = false;
+	report("kajiya-kay oit, no dom", settings);
+	report("strand raster", settings, true);
+	return 0;
+}
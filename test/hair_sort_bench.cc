@@ -0,0 +1,79 @@
+#include "GfxHair.h"
+#include "GfxBvh.h"
+#include "GfxCamera.h"
+#include "utility.h"
+#include "check.h"
+#include "scenes.h"
+
+#include <filesystem>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+////
+// Fiber culling and SegmentBvh with and without
+// the Morton sort of load_from_ind_file, on
+// procedural grooms. Usage: hair_sort_bench
+// [num_fibers], default 10k fibers of 32 vertices.
+// hair_render_bench covers the raster side.
+////
+
+using namespace calc;
+
+int main(int argc, char** argv)
+{
+	const int num_fibers = argc > 1 ? std::atoi(argv[1]) : 10000;
+	const auto path = (std::filesystem::temp_directory_path() / "hair_sort_bench.ind").string();
+	scenes::write_groom(path, num_fibers, 32);
+
+	// Looking at the whole groom, and at one side of it.
+	Box3D side{};
+	side.update(Vec3{ .2f, .2f, -.8f });
+	side.update(Vec3{ 1.f, 1.f, 0.f });
+	gfx::ArcballCamera cameras[2] = {
+		{ Box3D{ Vec3{ 0.f, .2f, 0.f }, Vec3{ 3.2f, 2.8f, 3.2f } },
+			{ 0, 0, -1 }, { 0, 1, 0 }, to_radian(60.f), 1.f },
+		{ side, { 0, 0, -1 }, { 0, 1, 0 }, to_radian(60.f), 1.f } };
+
+	std::printf("%d fibers, %d threads\n", num_fibers, util::scheduler().num_threads());
+	std::printf("%-8s %10s %10s %16s %16s %10s %10s\n", "", "update ms", "cull ms",
+		"commands full", "commands side", "bvh ms", "ray ms");
+
+	for (bool spatial_sort : { false, true }) {
+		auto hair = gfx::Model::load_from_ind_file(
+			path, gfx::vertex_attrib::PosTan, Box3D{ {0,0,0},{-1,-1,-1} }, spatial_sort);
+
+		gfx::HairCuller culler{ hair };
+		const double update_ms = check::best_ms(5, [&]() { culler.update(hair); });
+		std::size_t num_commands[2];
+		double cull_ms = 0.;
+		for (int c = 0; c < 2; ++c) {
+			cull_ms += check::best_ms(20, [&]() {
+				num_commands[c] = culler.cull(hair, cameras[c], hair.num_fibers()).size(); });
+		}
+
+		gfx::SegmentBvh bvh;
+		const double bvh_ms = check::best_ms(5, [&]() { bvh.build(hair, .002f); });
+		PCG rng(7);
+		auto uniform = [&]() { return rng() / 4294967295.f * 2 - 1; };
+		std::vector<Ray> rays(100000);
+		for (auto& ray : rays) {
+			Vec3 o = 3.f * normalize(Vec3{ uniform(), .5f * uniform(), uniform() });
+			Vec3 target = .8f * Vec3{ uniform(), uniform(), uniform() };
+			ray = Ray{ o, normalize(target - o) };
+		}
+		const double ray_ms = check::best_ms(3, [&]() {
+			int num_hits = 0;
+			gfx::SegmentBvh::Hit hit{};
+			for (const auto& ray : rays)
+				num_hits += bvh.intersect(ray, hit);
+			check::keep(num_hits);
+		});
+
+		std::printf("%-8s %10.2f %10.2f %16zu %16zu %10.2f %10.2f\n",
+			spatial_sort ? "sorted" : "shuffled", update_ms, .5 * cull_ms,
+			num_commands[0], num_commands[1], bvh_ms, ray_ms);
+	}
+	std::filesystem::remove(path);
+	return 0;
+}
@@ -0,0 +1,104 @@
+#include "utility.h"
+#include "check.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+////
+// Latency of Logger::log as the producers see it,
+// the p50, p99 and p99.9 of single calls, with 1 to
+// 4 producers logging a line of timings each, into
+// rings of 64 and 1024 slots, paced at 20 us per
+// message and in bursts that fill the ring, to a
+// temp file. Against it, print of the same line to
+// an unbuffered stream, as to std::cerr before the
+// logger, under a mutex so lines stay whole. Usage:
+// logger_bench [messages], per producer, default
+// 20000.
+////
+
+namespace
+{
+
+// Nanoseconds per call of log(i), from num_producers threads at once.
+template<typename F>
+std::vector<double> producer_latencies(int num_producers, int num_messages, bool paced, F&& log)
+{
+	std::vector<std::vector<double>> latencies(num_producers);
+	std::vector<std::thread> producers;
+	for (int p = 0; p < num_producers; ++p)
+		producers.emplace_back([&, p]() {
+			auto& ns = latencies[p];
+			ns.reserve(num_messages);
+			auto next = std::chrono::steady_clock::now();
+			for (int i = 0; i < num_messages; ++i) {
+				if (paced) {
+					next += std::chrono::microseconds(20);
+					while (std::chrono::steady_clock::now() < next)
+						std::this_thread::yield();
+				}
+				const auto start = std::chrono::steady_clock::now();
+				log(i);
+				const auto stop = std::chrono::steady_clock::now();
+				ns.push_back(std::chrono::duration<double, std::nano>(stop - start).count());
+			}
+		});
+	for (auto& producer : producers)
+		producer.join();
+
+	std::vector<double> all;
+	for (const auto& ns : latencies)
+		all.insert(all.end(), ns.begin(), ns.end());
+	std::sort(all.begin(), all.end());
+	return all;
+}
+
+void report(const char* name, int num_producers, const std::vector<double>& ns)
+{
+	auto at = [&](double q) { return ns[std::min(ns.size() - 1, static_cast<std::size_t>(q * ns.size()))]; };
+	std::printf("%-22s %9d %9.0f %9.0f %9.0f %9.0f\n", name, num_producers,
+		at(.5), at(.99), at(.999), ns.back());
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	const int num_messages = argc > 1 ? std::max(1000, std::atoi(argv[1])) : 20000;
+	const float t[5] = { .412f, 1.73f, 3.052f, .84f, .221f };
+	const auto path = (std::filesystem::temp_directory_path() / "logger_bench.log").string();
+
+	std::printf("%d hardware threads, %d messages per producer\n",
+		util::default_num_threads(), num_messages);
+	for (bool paced : { true, false }) {
+		std::printf("%s\n%-22s %9s %9s %9s %9s %9s\n", paced ? "paced, 20 us apart, ns" : "bursts, ns",
+			"", "producers", "p50", "p99", "p99.9", "max");
+		for (int num_producers = 1; num_producers <= 4; ++num_producers) {
+			for (int num_slots : { 64, 1024 }) {
+				std::filesystem::remove(path);
+				util::Logger logger{ std::make_unique<util::FileLogSink>(path), num_slots };
+				auto ns = producer_latencies(num_producers, num_messages, paced, [&](int i) {
+					logger.log(UTIL_FMT("frame {} ms: depth={:.3} opacity={:.3} hair={:.3} resolve={:.3} upsample={:.3}\n"),
+						i, t[0], t[1], t[2], t[3], t[4]);
+				});
+				report(num_slots == 64 ? "Logger, 64 slots" : "Logger, 1024 slots", num_producers, ns);
+			}
+
+			std::ofstream stream(path, std::ios_base::trunc);
+			stream << std::unitbuf;
+			std::mutex mutex;
+			auto ns = producer_latencies(num_producers, num_messages, paced, [&](int i) {
+				std::lock_guard<std::mutex> lock(mutex);
+				util::print(stream,
+					UTIL_FMT("frame {} ms: depth={:.3} opacity={:.3} hair={:.3} resolve={:.3} upsample={:.3}\n"),
+					i, t[0], t[1], t[2], t[3], t[4]);
+			});
+			report("print under a mutex", num_producers, ns);
+		}
+	}
+	std::filesystem::remove(path);
+	return 0;
+}
@@ -0,0 +1,168 @@
+#include "utility.h"
+#include "check.h"
+
+#include <atomic>
+#include <thread>
+
+////
+// util::Logger with 4 producers on rings from 2 to
+// 1024 slots: every message arrives whole and in
+// each producer's order, messages over a quarter of
+// the ring are truncated to whole lines, flush and
+// set_sink return once the text is in the sink, and
+// the destructor writes out what is left.
+////
+
+namespace
+{
+
+const int num_producers = 4;
+
+// A MemoryLogSink whose text outlives it, as the Logger owns its sink.
+class KeptLogSink : public util::MemoryLogSink {
+public:
+	explicit KeptLogSink(std::string& kept) : kept_(kept) {}
+	~KeptLogSink() { kept_ = text(); }
+
+private:
+	std::string& kept_;
+};
+
+// Message seq of producer p, of a length that cycles through one
+// slot, exactly one and two slots, and many.
+std::string message(int p, int seq)
+{
+	static const int lengths[] = { 12, 100, util::Logger::slot_text_size,
+		util::Logger::slot_text_size + 1, 2 * util::Logger::slot_text_size, 600, 3000 };
+	const int length = lengths[(p + seq) % 7];
+	std::string text = util::format("p{}:{}|", p, seq);
+	text.resize(length - 1, static_cast<char>('a' + (p + seq) % 26));
+	return text + '\n';
+}
+
+// The message as the sink gets it from a ring of num_slots.
+std::string received(const std::string& text, int num_slots)
+{
+	const std::size_t max_size = std::max(1, num_slots / 4) * util::Logger::slot_text_size;
+	if (text.size() <= max_size)
+		return text;
+	std::string line = text.substr(0, max_size);
+	line.back() = '\n';
+	return line;
+}
+
+// Whether log holds every message of every producer, once, each
+// producer's in order.
+bool all_in_order(const std::string& log, int num_messages, int num_slots)
+{
+	std::vector<int> next(num_producers, 0);
+	std::size_t pos = 0;
+	while (pos < log.size()) {
+		const auto end = log.find('\n', pos);
+		if (end == std::string::npos)
+			return false;
+		int p = -1, seq = -1;
+		if (std::sscanf(log.c_str() + pos, "p%d:%d|", &p, &seq) != 2 || p < 0 || p >= num_producers)
+			return false;
+		if (seq != next[p]++)
+			return false;
+		if (log.compare(pos, end + 1 - pos, received(message(p, seq), num_slots)) != 0)
+			return false;
+		pos = end + 1;
+	}
+	for (int n : next)
+		if (n != num_messages)
+			return false;
+	return true;
+}
+
+template<typename F>
+void run_producers(F&& produce)
+{
+	std::vector<std::thread> producers;
+	for (int p = 0; p < num_producers; ++p)
+		producers.emplace_back([&produce, p]() { produce(p); });
+	for (auto& producer : producers)
+		producer.join();
+}
+
+}
+
+int main()
+{
+	const int num_messages = 2000;
+
+	for (int num_slots : { 2, 3, 8, 64, 1024 }) {
+		const int ring = num_slots == 3 ? 4 : num_slots;
+
+		// Left to the destructor to write out.
+		{
+			std::string kept;
+			{
+				util::Logger logger{ std::make_unique<KeptLogSink>(kept), num_slots };
+				run_producers([&](int p) {
+					for (int seq = 0; seq < num_messages; ++seq)
+						logger.push(message(p, seq));
+				});
+			}
+			CHECK(all_in_order(kept, num_messages, ring));
+		}
+
+		// Flushed by the producers as they go: each finds its
+		// messages so far in the sink.
+		{
+			auto sink = std::make_unique<util::MemoryLogSink>();
+			auto* memory = sink.get();
+			util::Logger logger{ std::move(sink), num_slots };
+			std::atomic<int> missing{ 0 };
+			run_producers([&](int p) {
+				for (int seq = 0; seq < num_messages / 4; ++seq) {
+					logger.log(UTIL_FMT("{}"), message(p, seq));
+					if (seq % 50 == 49) {
+						logger.flush();
+						if (memory->text().find(util::format("p{}:{}|", p, seq)) == std::string::npos)
+							++missing;
+					}
+				}
+			});
+			logger.flush();
+			CHECK(missing == 0);
+			CHECK(all_in_order(memory->text(), num_messages / 4, ring));
+		}
+	}
+
+	// Everything before set_sink goes to the old sink, the rest to
+	// the new one.
+	{
+		std::string first, second;
+		{
+			util::Logger logger{ std::make_unique<KeptLogSink>(first), 16 };
+			run_producers([&](int p) {
+				for (int seq = 0; seq < 100; ++seq)
+					logger.push(message(p, seq));
+			});
+			logger.set_sink(std::make_unique<KeptLogSink>(second));
+			CHECK(all_in_order(first, 100, 16));
+			run_producers([&](int p) {
+				for (int seq = 0; seq < 100; ++seq)
+					logger.push(message(p, seq));
+			});
+		}
+		CHECK(all_in_order(second, 100, 16));
+	}
+
+	// Text without a newline is written as is, truncated or not.
+	{
+		std::string kept;
+		{
+			util::Logger logger{ std::make_unique<KeptLogSink>(kept), 4 };
+			logger.push("no newline, ");
+			logger.push(std::string(1000, 'x'));
+			logger.push("");
+			logger.log(UTIL_FMT("{} {:.3}\n"), 1, 2.f / 3);
+		}
+		CHECK(kept == "no newline, " + std::string(util::Logger::slot_text_size, 'x') + "1 0.667\n");
+	}
+
+	return check::result();
+}
@@ -0,0 +1,113 @@
+#include "utility.h"
+#include "check.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+////
+// util::MappedFile against the read_file before it,
+// which sized the file with one pass of ignore()
+// and read it again into a heap buffer, copied out
+// into the string. Each row opens the file and sums
+// its bytes, from the page cache and, where POSIX,
+// after dropping its pages. Usage: mapped_file_bench
+// [mib], the size of the generated file, default 256.
+////
+
+namespace
+{
+
+// read_file as it was, but for the array delete.
+std::string read_file_old(const std::string& path)
+{
+	std::ifstream fin(path, std::ios_base::binary);
+	fin.ignore(std::numeric_limits<std::streamsize>::max());
+	auto size = fin.gcount();
+	fin.clear();
+
+	fin.seekg(0, std::ios_base::beg);
+	auto source = std::unique_ptr<char[]>(new char[size]);
+	fin.read(source.get(), size);
+
+	return std::string(source.get(), static_cast<std::string::size_type>(size));
+}
+
+std::uint64_t sum(std::string_view bytes)
+{
+	std::uint64_t total = 0;
+	for (char c : bytes)
+		total += static_cast<unsigned char>(c);
+	return total;
+}
+
+void drop_pages(const std::string& path)
+{
+#if !defined(_WIN32)
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd >= 0) {
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+#else
+	(void)path;
+#endif
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	const int mib = argc > 1 ? std::max(1, std::atoi(argv[1])) : 256;
+	const std::size_t size = static_cast<std::size_t>(mib) << 20;
+	const auto path = (std::filesystem::temp_directory_path() / "mapped_file_bench.bin").string();
+	{
+		calc::PCG rng(48);
+		std::vector<std::uint32_t> block(1 << 18);
+		std::ofstream out(path, std::ios_base::binary);
+		for (std::size_t written = 0; written < size; written += block.size() * 4) {
+			for (auto& word : block)
+				word = rng();
+			out.write(reinterpret_cast<const char*>(block.data()),
+				std::min(block.size() * 4, size - written));
+		}
+	}
+
+	const std::uint64_t expected = sum(util::read_file(path));
+	auto row = [&](const char* name, auto read) {
+		const double warm_ms = check::best_ms(3, [&]() { CHECK(read() == expected); });
+		// Dropped outside the timing.
+		double dropped_ms = std::numeric_limits<double>::max();
+		for (int r = 0; r < 3; ++r) {
+			drop_pages(path);
+			const auto start = std::chrono::steady_clock::now();
+			CHECK(read() == expected);
+			const auto stop = std::chrono::steady_clock::now();
+			dropped_ms = std::min(dropped_ms,
+				std::chrono::duration<double, std::milli>(stop - start).count());
+		}
+		std::printf("%-16s %8.1f ms %5.2f GB/s  %8.1f ms %5.2f GB/s\n", name,
+			warm_ms, size / warm_ms * 1e-6, dropped_ms, size / dropped_ms * 1e-6);
+	};
+
+	std::printf("%d MiB file\n", mib);
+	std::printf("%-16s %22s  %22s\n", "", "warm cache", "pages dropped");
+	row("old read_file", [&]() { return sum(read_file_old(path)); });
+	row("new read_file", [&]() { return sum(util::read_file(path)); });
+	row("MappedFile", [&]() { return sum(util::MappedFile(path).view()); });
+	row("+ Sequential", [&]() {
+		return sum(util::MappedFile(path, util::MappedFile::Sequential).view());
+	});
+
+	std::filesystem::remove(path);
+	return check::result();
+}
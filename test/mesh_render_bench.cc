@@ -0,0 +1,183 @@
+#include "GfxShader.h"
+#include "GfxTimer.h"
+#include "GfxConfig.h"
+#include "utility.h"
+#include "check.h"
+#include "scenes.h"
+#include "gl_context.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+////
+// The mesh pass of mesh_with_texture.glsl, headless,
+// with the normal matrix uploaded per draw against
+// the shader before it, which inverted the local
+// transform per vertex. Usage: mesh_render_bench [n]
+// [size], a bumpy sphere of 2n^2 triangles, default
+// n = 720, about a million, at size^2, default 256,
+// so the vertex stage dominates.
+////
+
+using namespace calc;
+
+namespace
+{
+
+// The shader as it was, with the per vertex inverse.
+std::string write_old_shader(const std::string& path)
+{
+	auto source = util::read_file(gfxconfig::shader_dir + "/mesh_with_texture.glsl");
+	const std::string now = "g_NormalTransform*vs_Normal";
+	const auto pos = source.find(now);
+	if (pos == std::string::npos) {
+		std::cerr << "mesh_with_texture.glsl has no g_NormalTransform.\n";
+		exit(1);
+	}
+	source.replace(pos, now.size(), "mat3(transpose(inverse(g_LocalTransform)))*vs_Normal");
+	std::ofstream(path) << source;
+	return path;
+}
+
+template<typename T>
+GLuint array_buffer(GLuint attrib, const std::vector<T>& data)
+{
+	GLuint buffer = 0;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(T), data.data(), GL_STATIC_DRAW);
+	glEnableVertexAttribArray(attrib);
+	glVertexAttribPointer(attrib, sizeof(T) / sizeof(float), GL_FLOAT, GL_FALSE, sizeof(T), nullptr);
+	return buffer;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	const int n = argc > 1 ? std::max(2, std::atoi(argv[1])) : 720;
+	const int size = argc > 2 ? std::max(1, std::atoi(argv[2])) : 256;
+	const int num_frames = 12;
+
+	if (!glcontext::create())
+		return 1;
+
+	std::vector<Vec3> positions, normals;
+	std::vector<Vec2> uvs;
+	std::vector<unsigned> indices;
+	scenes::bumpy_sphere(n, positions, indices);
+	for (const auto& p : positions) {
+		normals.push_back(normalize(p));
+		uvs.push_back(Vec2{ .5f + .5f * p.x, .5f + .5f * p.y });
+	}
+
+	GLuint vao = 0, ebo = 0;
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	GLuint buffers[3] = {
+		array_buffer(0, positions), array_buffer(1, normals), array_buffer(2, uvs) };
+	glGenBuffers(1, &ebo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned),
+		indices.data(), GL_STATIC_DRAW);
+
+	GLuint fbo = 0, renderbuffers[2] = {};
+	glGenRenderbuffers(2, renderbuffers);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, size, size);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "framebuffer incomplete.\n";
+		return 1;
+	}
+
+	GLuint texture = 0;
+	const unsigned char white[4] = { 255, 255, 255, 255 };
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+	// Rotated and scaled, so the normal matrix is not the identity.
+	Mat3 scale = diag<Mat3>(1.f);
+	scale[0][0] = 1.2f;
+	scale[1][1] = .8f;
+	const Mat4 local = affine_transform(
+		dot(Quat2Mat3(normalize(Quat{ .9f, .2f, .3f, .1f })), scale), Vec3{ .1f, 0.f, 0.f });
+	const Mat4 world = dot(projective_transform(pi / 3, 1.f, .1f, 10.f),
+		lookat(Vec3{ 0, 0, 3 }, Vec3{}, Vec3{ 0, 1, 0 }));
+
+	const auto old_path = (std::filesystem::temp_directory_path() / "mesh_render_bench.glsl").string();
+	const std::unordered_map<std::string, std::string> symbols{ {"version", "#version 450 core"} };
+	const GLuint programs[2] = {
+		gfx::create_glsl_program(symbols, write_old_shader(old_path)),
+		gfx::create_glsl_program(symbols, gfxconfig::shader_dir + "/mesh_with_texture.glsl") };
+	std::filesystem::remove(old_path);
+
+	std::printf("%s, %d vertices, %d triangles, %dx%d\n", glcontext::renderer(),
+		static_cast<int>(positions.size()), static_cast<int>(indices.size() / 3), size, size);
+	std::printf("%-30s %10s %10s\n", "", "frame ms", "gpu ms");
+
+	double frame_ms[2];
+	for (int p = 0; p < 2; ++p) {
+		gfx::UniformSetter uniforms;
+		gfx::GpuTimer timer;
+		double best_ms = 1e9;
+		float best_gpu_ms = 1e9f;
+		for (int frame = 0; frame < num_frames; ++frame) {
+			glFinish();
+			auto start = std::chrono::steady_clock::now();
+			timer.begin();
+			glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+			glViewport(0, 0, size, size);
+			glEnable(GL_DEPTH_TEST);
+			glClearColor(1, 1, 1, 1);
+			glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+			glUseProgram(programs[p]);
+			uniforms.set(programs[p], "g_DiffuseMap", 0);
+			uniforms.set(programs[p], "g_WorldTransform", world);
+			uniforms.set(programs[p], "g_Eye", Vec3{ 0, 0, 3 });
+			uniforms.set(programs[p], "g_PointLightPos", Vec3{ 2, 2, 2 });
+			uniforms.set(programs[p], "g_LocalTransform", local);
+			if (p == 1)
+				uniforms.set(programs[p], "g_NormalTransform", normal_matrix(Affine3{ local }));
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, texture);
+			glBindVertexArray(vao);
+			glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(indices.size()), GL_UNSIGNED_INT, nullptr);
+			timer.end();
+			glFinish();
+			std::chrono::duration<double, std::milli> elapsed =
+				std::chrono::steady_clock::now() - start;
+			// Timer results lag a few frames behind.
+			if (frame < 4)
+				continue;
+			best_ms = std::min(best_ms, elapsed.count());
+			best_gpu_ms = std::min(best_gpu_ms, timer.elapsed_ms());
+		}
+		frame_ms[p] = best_ms;
+		std::printf("%-30s %10.2f %10.2f\n", p == 0 ? "inverse per vertex (old)" : "normal matrix uniform (new)",
+			best_ms, best_gpu_ms);
+		timer.destroy();
+	}
+	std::printf("speedup %.2fx\n", frame_ms[0] / frame_ms[1]);
+
+	glDeleteProgram(programs[0]);
+	glDeleteProgram(programs[1]);
+	glDeleteTextures(1, &texture);
+	glDeleteFramebuffers(1, &fbo);
+	glDeleteRenderbuffers(2, renderbuffers);
+	glDeleteBuffers(3, buffers);
+	glDeleteBuffers(1, &ebo);
+	glDeleteVertexArrays(1, &vao);
+	return 0;
+}
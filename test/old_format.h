@@ -0,0 +1,118 @@
+#ifndef GFX_TEST_OLD_FORMAT_H
+#define GFX_TEST_OLD_FORMAT_H
+
+#include "utility.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+////
+// util::format as it was before it was parsed in one
+// pass, the reference of format_test and the baseline
+// of format_bench. As there, but for int casts of the
+// size compares, and util::operator<< made visible, so
+// calc matrices and quaternions print as they would
+// have, which the original failed to compile for.
+////
+
+namespace old
+{
+
+using util::operator<<;
+
+inline std::string format(const std::string& fmt)
+{
+	return fmt;
+}
+
+template<typename First, typename ... Others>
+std::string format(
+	const std::string& fmt,
+	First first,
+	Others ... others)
+{
+	const int size = static_cast<int>(fmt.size());
+
+	auto is_op_delim = [&fmt](int idx){
+		if (fmt[idx]=='{')
+			return true;
+		return false;
+	};
+
+	auto is_ed_delim = [&fmt](int idx){
+		if (fmt[idx]=='}')
+			return true;
+		return false;
+	};
+
+	auto is_delim_escape = [&fmt, size](int idx) {
+		if (idx+1>=size) return false;
+		if ((fmt[idx]=='{' && fmt[idx+1]=='{') ||
+				(fmt[idx]=='}' && fmt[idx+1]=='}'))
+			return true;
+		return false;
+	};
+
+	std::string first_part, format_part;
+	int state = 0, first_part_ed = 0;
+	for (int idx = 0; idx < size; ++idx) {
+		if (is_delim_escape(idx)) {
+			if (state == 0)
+				first_part += fmt[idx+1];
+			else if (state == 1)
+				format_part += fmt[idx+1];
+			idx++;
+		}
+		else if (is_op_delim(idx)) {
+			if (state == 0)
+				state = 1;
+			else
+				throw std::invalid_argument("Delimiter mismatch");
+		}
+		else if (is_ed_delim(idx)) {
+			if (state == 1) {
+				state = 2;
+				first_part_ed = idx+1;
+			}
+			else
+				throw std::invalid_argument("Delimiter mismatch");
+			break;
+		}
+		else {
+			if (state == 0)
+				first_part += fmt[idx];
+			else if (state == 1)
+				format_part += fmt[idx];
+		}
+	}
+	if (state != 2)
+		throw std::invalid_argument("Delimiter mismatch");
+	auto remaining_part = fmt.substr(
+		first_part_ed, fmt.size() - first_part_ed);
+	std::stringstream ss;
+
+	if (std::is_floating_point<First>::value ||
+			calc::is_Mat<First>::value ||
+			std::is_same<calc::Quat,First>::value) {
+		// Setting precision of a floating point number.
+		// Changing width of the integral part: Unsupported.
+		auto pos = format_part.find('.');
+		if (pos != std::string::npos && pos < format_part.size()-1) {
+			auto curr_prec = std::stoi(format_part.substr(pos+1));
+			auto prev_prec = ss.precision(curr_prec);
+			ss << first;
+			ss.precision(prev_prec);
+		}
+		else
+			ss << first;
+	}
+	else
+		ss << first;
+
+	return first_part + ss.str() + format(remaining_part, others...);
+}
+
+}
+
+#endif
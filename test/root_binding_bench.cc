@@ -0,0 +1,55 @@
+#include "GfxRootBinding.h"
+#include "check.h"
+#include "scenes.h"
+
+#include <filesystem>
+
+////
+// Rate of HairRootBinding::bind from 1 to N
+// scheduler threads, as scheduler_bench. Usage:
+// root_binding_bench [N] [num_fibers], N defaults
+// to the hardware threads, num_fibers to 100k, on
+// a head of about 130k triangles.
+////
+
+using namespace calc;
+
+int main(int argc, char** argv)
+{
+	const int max_threads = argc > 1 ? std::max(1, std::atoi(argv[1])) : util::default_num_threads();
+	const int num_fibers = argc > 2 ? std::max(1, std::atoi(argv[2])) : 100000;
+
+	std::vector<Vec3> positions;
+	std::vector<unsigned> indices;
+	scenes::bumpy_sphere(256, positions, indices);
+	const auto obj = (std::filesystem::temp_directory_path() / "root_binding_bench.obj").string();
+	const auto ind = (std::filesystem::temp_directory_path() / "root_binding_bench.ind").string();
+	scenes::write_obj(obj, positions, indices);
+	scenes::write_groom(ind, num_fibers, 16);
+	auto head = gfx::Model::load_from_obj_file(obj, gfx::vertex_attrib::Pos);
+	auto hair = gfx::Model::load_from_ind_file(ind);
+	std::filesystem::remove(obj);
+	std::filesystem::remove(ind);
+
+	gfx::TriangleGrid grid;
+	const double build_ms = check::best_ms(5, [&]() { grid.build(head); });
+	std::printf("%d triangles, grid %dx%dx%d built in %.2f ms, %d fibers\n",
+		static_cast<int>(head.indices().size() / 3), grid.size().x, grid.size().y, grid.size().z,
+		build_ms, hair.num_fibers());
+	std::printf("threads    bind ms   Mroots/s      x\n");
+
+	double bind_1 = 0.;
+	for (int threads = 1; threads <= max_threads; ++threads) {
+		util::Scheduler s(threads);
+		gfx::HairRootBinding binding;
+		const double bind_ms = check::best_ms(5, [&]() {
+			binding.bind(hair, head, grid, s);
+			check::keep(binding.root(0));
+		});
+		if (threads == 1)
+			bind_1 = bind_ms;
+		std::printf("%7d  %9.2f  %9.2f  %5.2f\n", threads, bind_ms,
+			hair.num_fibers() / bind_ms * 1e-3, bind_1 / bind_ms);
+	}
+	return 0;
+}
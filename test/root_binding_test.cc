@@ -0,0 +1,164 @@
+#include "GfxRootBinding.h"
+#include "GfxSdf.h"
+#include "check.h"
+#include "scenes.h"
+
+#include <filesystem>
+
+////
+// TriangleGrid::closest against a scan of every
+// triangle, for points on, near and far off the
+// grid, with degenerate triangles in the mesh, and
+// HairRootBinding round trips on any scheduler.
+////
+
+using namespace calc;
+
+namespace
+{
+
+std::string temp_path(const char* name)
+{
+	return (std::filesystem::temp_directory_path() / name).string();
+}
+
+// Distance to the closest triangle, by brute force.
+float closest_distance(const gfx::Model& mesh, const Vec3& p)
+{
+	const auto& positions = mesh.positions();
+	const auto& indices = mesh.indices();
+	float best = std::numeric_limits<float>::max();
+	for (std::size_t t = 0; t + 2 < indices.size(); t += 3) {
+		int feature;
+		auto q = gfx::closest_point_on_triangle(p, positions[indices[t]],
+			positions[indices[t + 1]], positions[indices[t + 2]], feature);
+		best = std::min(best, length(p - q));
+	}
+	return best;
+}
+
+}
+
+int main()
+{
+	PCG rng(31);
+	auto uniform = [&]() { return rng() / 4294967295.f * 2 - 1; };
+	auto vec3 = [&]() { return Vec3{ uniform(), uniform(), uniform() }; };
+
+	////
+	// The head, whose poles are fans of zero area
+	// triangles, and away from it a sliver, a triangle
+	// with collinear corners and one collapsed to a
+	// point, so most cells between them are empty.
+	////
+
+	std::vector<Vec3> positions;
+	std::vector<unsigned> indices;
+	scenes::bumpy_sphere(24, positions, indices);
+	auto add = [&](Vec3 a, Vec3 b, Vec3 c) {
+		unsigned base = static_cast<unsigned>(positions.size());
+		positions.insert(positions.end(), { a, b, c });
+		indices.insert(indices.end(), { base, base + 1, base + 2 });
+	};
+	add(Vec3{ 3, 0, 0 }, Vec3{ 3.5f, 0, 0 }, Vec3{ 3.25f, 1e-4f, 0 });
+	add(Vec3{ 0, 3, 0 }, Vec3{ 0, 3.5f, 0 }, Vec3{ 0, 4, 0 });
+	add(Vec3{ -2, -2, 2 }, Vec3{ -2, -2, 2 }, Vec3{ -2, -2, 2 });
+
+	const auto obj = temp_path("root_binding_test.obj");
+	scenes::write_obj(obj, positions, indices);
+	auto head = gfx::Model::load_from_obj_file(obj, gfx::vertex_attrib::Pos);
+	std::filesystem::remove(obj);
+
+	for (float cells_per_triangle : { .1f, 1.f, 8.f }) {
+		gfx::TriangleGrid grid;
+		grid.build(head, cells_per_triangle);
+		const Vec3 lo{ -2.f, -2.f, -1.1f }, hi{ 3.5f, 4.f, 2.f };
+
+		auto check_closest = [&](const Vec3& p) {
+			gfx::TriangleGrid::Hit hit;
+			CHECK(grid.closest(p, hit));
+			CHECK(hit.distance == closest_distance(head, p));
+			CHECK(std::abs(length(p - hit.point) - hit.distance) <= 1e-5f * (1.f + hit.distance));
+
+			const auto& head_positions = head.positions();
+			const auto& head_indices = head.indices();
+			const Vec3& a = head_positions[head_indices[3 * hit.triangle]];
+			const Vec3& b = head_positions[head_indices[3 * hit.triangle + 1]];
+			const Vec3& c = head_positions[head_indices[3 * hit.triangle + 2]];
+			// Also on slivers and degenerate triangles.
+			Vec3 q = hit.bary.x * a + hit.bary.y * b + hit.bary.z * c;
+			CHECK(length(q - hit.point) < 1e-5f);
+			CHECK(std::abs(hit.bary.x + hit.bary.y + hit.bary.z - 1.f) < 1e-5f);
+		};
+
+		// Within the bounds, and on cell corners.
+		for (int i = 0; i < 2000; ++i)
+			check_closest(lo + (hi - lo) * (.5f * vec3() + .5f));
+		for (float x : { -2.f, -1.f, 0.f, 1.f, 3.f })
+			for (float y : { -2.f, 0.f, 2.f, 4.f })
+				check_closest(Vec3{ x, y, 0.f });
+
+		// Off the grid, near it, far off it, and beyond its corners.
+		for (int i = 0; i < 500; ++i) {
+			Vec3 d = normalize(vec3());
+			check_closest(d * (4.f + 2.f * std::abs(uniform())));
+			check_closest(d * 100.f);
+		}
+		for (float s : { 1.f, -1.f }) {
+			check_closest(Vec3{ 10.f * s, 0.f, 0.f });
+			check_closest(Vec3{ 0.f, 10.f * s, 0.f });
+			check_closest(Vec3{ 0.f, 0.f, 10.f * s });
+			check_closest(Vec3{ 8.f * s, 8.f * s, 8.f * s });
+		}
+
+		// On and around the degenerate triangles.
+		for (const Vec3& p : { Vec3{ 0, 3.7f, 0 }, Vec3{ .1f, 3.7f, .1f }, Vec3{ 0, 4.2f, 0 },
+				Vec3{ -2, -2, 2 }, Vec3{ -2.1f, -1.9f, 2.2f }, Vec3{ 3.25f, .5f, 0 },
+				Vec3{ 0, 1.05f, 0 }, Vec3{ 0, -1.2f, 0 } })
+			check_closest(p);
+	}
+
+	// An empty mesh has no closest triangle.
+	{
+		gfx::TriangleGrid empty;
+		gfx::TriangleGrid::Hit hit;
+		CHECK(!empty.closest(Vec3{}, hit));
+	}
+
+	////
+	// Bound to the head it was grown on, a groom comes
+	// back where it was, and every scheduler binds the
+	// same roots.
+	////
+
+	const auto ind = temp_path("root_binding_test.ind");
+	scenes::write_groom(ind, 500, 8);
+	auto hair = gfx::Model::load_from_ind_file(ind);
+	std::filesystem::remove(ind);
+
+	gfx::TriangleGrid grid;
+	grid.build(head);
+	gfx::HairRootBinding binding;
+	binding.bind(hair, head, grid);
+	std::vector<Vec3> moved, tangents;
+	binding.evaluate(head.positions(), moved, tangents);
+	CHECK(moved.size() == hair.positions().size());
+	CHECK(tangents.size() == hair.tangents().size());
+	for (std::size_t v = 0; v < moved.size(); ++v) {
+		CHECK(length(moved[v] - hair.positions()[v]) < 1e-5f);
+		CHECK(length(tangents[v] - hair.tangents()[v]) < 1e-5f);
+	}
+
+	for (int threads : { 1, 3 }) {
+		util::Scheduler scheduler(threads);
+		gfx::HairRootBinding other;
+		other.bind(hair, head, grid, scheduler);
+		CHECK(other.num_roots() == binding.num_roots());
+		for (int f = 0; f < binding.num_roots(); ++f) {
+			CHECK(other.root(f).triangle == binding.root(f).triangle);
+			CHECK(other.root(f).bary == binding.root(f).bary);
+		}
+	}
+
+	return check::result();
+}
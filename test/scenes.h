@@ -0,0 +1,102 @@
+
+#ifndef GFX_TEST_SCENES_H
+#define GFX_TEST_SCENES_H
+
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include "calc.h"
+
+////
+// Procedural stand-ins for the head and groom
+// assets, which are not in the tree. The head
+// is a unit sphere with bumps, the groom grows
+// from its upper half and falls under gravity.
+////
+
+namespace scenes
+{
+
+// n rings by n sectors, 2n^2 triangles. n = 720 is about a million.
+inline void bumpy_sphere(int n,
+	std::vector<calc::Vec3>& positions, std::vector<unsigned>& indices)
+{
+	std::mt19937 rng(3);
+	std::uniform_real_distribution<float> noise(0, .01f);
+	positions.clear();
+	indices.clear();
+	for (int i = 0; i <= n; ++i)
+		for (int j = 0; j < n; ++j) {
+			float theta = calc::pi * i / n, phi = 2 * calc::pi * j / n;
+			float r = 1 + .05f * std::sin(7 * theta) * std::cos(5 * phi) + noise(rng);
+			positions.push_back(calc::Vec3{
+				r * std::sin(theta) * std::cos(phi),
+				r * std::cos(theta),
+				r * std::sin(theta) * std::sin(phi) });
+		}
+	for (int i = 0; i < n; ++i)
+		for (int j = 0; j < n; ++j) {
+			unsigned a = i * n + j, b = i * n + (j + 1) % n;
+			unsigned c = a + n, d = b + n;
+			indices.insert(indices.end(), { a, b, c, b, d, c });
+		}
+}
+
+// Positions and triangles as an .obj file, without normals or uvs.
+inline void write_obj(const std::string& path,
+	const std::vector<calc::Vec3>& positions, const std::vector<unsigned>& indices)
+{
+	std::ofstream out(path);
+	for (const auto& p : positions)
+		out << "v " << p.x << ' ' << p.y << ' ' << p.z << '\n';
+	for (std::size_t t = 0; t + 2 < indices.size(); t += 3)
+		out << "f " << indices[t] + 1 << ' ' << indices[t + 1] + 1
+			<< ' ' << indices[t + 2] + 1 << '\n';
+}
+
+// Fibers of verts_per_fiber vertices, 0.6 long, as an .ind file.
+inline void write_groom(const std::string& path,
+	int num_fibers, int verts_per_fiber, unsigned seed = 1)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> uniform(-1, 1);
+	const float step = .6f / (verts_per_fiber - 1);
+	const calc::Vec3 gravity{ 0, -.35f, 0 };
+
+	std::ofstream out(path, std::ios::binary);
+	auto write_u32 = [&](std::uint32_t v) {
+		out.write(reinterpret_cast<const char*>(&v), sizeof(v)); };
+	out.write("IND_HAIR", 8);
+	write_u32(num_fibers);
+	write_u32(num_fibers * verts_per_fiber);
+
+	std::vector<calc::Vec3> fiber(verts_per_fiber);
+	for (int f = 0; f < num_fibers; ++f) {
+		calc::Vec3 root;
+		do {
+			root = calc::Vec3{ uniform(rng), std::abs(uniform(rng)), uniform(rng) };
+		} while (calc::dot(root, root) > 1 || calc::dot(root, root) < .01f);
+		root = calc::normalize(root);
+
+		calc::Vec3 dir = root;
+		fiber[0] = root * 1.01f;
+		for (int v = 1; v < verts_per_fiber; ++v) {
+			calc::Vec3 jitter{ uniform(rng), uniform(rng), uniform(rng) };
+			dir = calc::normalize(dir + gravity + .2f * jitter);
+			calc::Vec3 p = fiber[v - 1] + step * dir;
+			// Slide along the head instead of entering it.
+			if (calc::length(p) < 1.01f)
+				p = calc::normalize(p) * 1.01f;
+			fiber[v] = p;
+		}
+		write_u32(verts_per_fiber);
+		out.write(reinterpret_cast<const char*>(fiber.data()),
+			fiber.size() * sizeof(calc::Vec3));
+	}
+}
+
+}
+
+#endif
@@ -0,0 +1,91 @@
+#include "utility.h"
+#include "check.h"
+
+#include <cstring>
+
+////
+// Scaling of util::Scheduler from 1 to N threads.
+// Usage: scheduler_bench [N] [pin], N defaults to
+// the hardware threads, pin pins the workers. Per
+// thread count, the time and speedup over 1 thread
+// of an even loop, of a loop whose items cost more
+// towards its end, which leaves the last chunks to
+// thieves, and of nested loops, then the cost of a
+// chunk with nothing to do.
+////
+
+using namespace calc;
+
+namespace
+{
+
+// Arithmetic of about 8 ns a step, the optimizer cannot drop.
+float work(int i, int steps)
+{
+	float x = static_cast<float>(i & 1023) * 1e-3f;
+	for (int s = 0; s < steps; ++s)
+		x = x * .999f + std::sqrt(x + 1.f) * 1e-3f;
+	return x;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	const int max_threads = argc > 1 ? std::max(1, std::atoi(argv[1])) : util::default_num_threads();
+	const bool pin = argc > 2 && std::strcmp(argv[2], "pin") == 0;
+	const int n = 1 << 14;
+	std::vector<float> out(n);
+
+	std::printf("%d hardware threads, %s\n", util::default_num_threads(), pin ? "pinned" : "not pinned");
+	std::printf("threads     even ms  x       uneven ms  x       nested ms  x     empty ns/chunk\n");
+	double even_1 = 0., uneven_1 = 0., nested_1 = 0.;
+	for (int threads = 1; threads <= max_threads; ++threads) {
+		util::Scheduler s(threads, pin);
+
+		const double even_ms = check::best_ms(5, [&]() {
+			util::parallel_for(s, 0, n, 64, [&](int lo, int hi) {
+				for (int i = lo; i < hi; ++i)
+					out[i] = work(i, 200);
+			});
+			check::keep(out[n / 2]);
+		});
+
+		// Item i costs in proportion to i, the last chunk 64 times
+		// the first, the same total as the even loop.
+		const double uneven_ms = check::best_ms(5, [&]() {
+			util::parallel_for(s, 0, n, 64, [&](int lo, int hi) {
+				for (int i = lo; i < hi; ++i)
+					out[i] = work(i, 6 + 388 * i / n);
+			});
+			check::keep(out[n / 2]);
+		});
+
+		// 64 outer items of 256 inner ones, as the BVH builds nest.
+		const double nested_ms = check::best_ms(5, [&]() {
+			util::parallel_for(s, 0, 64, 1, [&](int lo, int hi) {
+				for (int o = lo; o < hi; ++o)
+					util::parallel_for(s, o * 256, (o + 1) * 256, 32, [&](int lo, int hi) {
+						for (int i = lo; i < hi; ++i)
+							out[i] = work(i, 200);
+					});
+			});
+			check::keep(out[n / 2]);
+		});
+
+		const int num_chunks = 1 << 16;
+		const double empty_ms = check::best_ms(5, [&]() {
+			util::parallel_for(s, 0, num_chunks, 1, [&](int lo, int) { check::keep(lo); });
+		});
+
+		if (threads == 1) {
+			even_1 = even_ms;
+			uneven_1 = uneven_ms;
+			nested_1 = nested_ms;
+		}
+		std::printf("%7d  %9.2f  %4.2f  %9.2f  %4.2f  %9.2f  %4.2f  %9.1f\n", threads,
+			even_ms, even_1 / even_ms, uneven_ms, uneven_1 / uneven_ms,
+			nested_ms, nested_1 / nested_ms, empty_ms * 1e6 / num_chunks);
+	}
+	return 0;
+}
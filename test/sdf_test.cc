@@ -0,0 +1,113 @@
+#include "GfxSdf.h"
+#include "check.h"
+#include "scenes.h"
+
+#include <filesystem>
+
+////
+// DistanceField signs on closed and open meshes,
+// and rejection of malformed cache files.
+////
+
+using namespace calc;
+
+namespace
+{
+
+std::string temp_path(const char* name)
+{
+	return (std::filesystem::temp_directory_path() / name).string();
+}
+
+gfx::DistanceField bake(const char* name,
+	const std::vector<Vec3>& positions, const std::vector<unsigned>& indices)
+{
+	auto path = temp_path(name);
+	scenes::write_obj(path, positions, indices);
+	auto mesh = gfx::Model::load_from_obj_file(path, gfx::vertex_attrib::Pos);
+	std::filesystem::remove(path);
+	return gfx::DistanceField::bake(mesh, 48);
+}
+
+}
+
+int main()
+{
+	std::vector<Vec3> positions;
+	std::vector<unsigned> indices;
+	scenes::bumpy_sphere(32, positions, indices);
+
+	// Closed: inside is negative, in and out of the band.
+	{
+		auto sdf = bake("sdf_test_closed.obj", positions, indices);
+		CHECK(sdf.distance(Vec3{}) == -sdf.band());
+		CHECK(sdf.distance(Vec3{ .5f, 0, 0 }) == -sdf.band());
+		CHECK(sdf.distance(Vec3{ 0, 0, 1.3f }) > 0.f);
+		CHECK(sdf.distance(Vec3{ 1.2f, 1.2f, 1.2f }) > 0.f);
+
+		// Near the surface, against the closest triangle.
+		for (std::size_t v = 40; v < positions.size() - 40; v += 37)
+			for (float scale : { .95f, 1.05f }) {
+				Vec3 p = scale * positions[v];
+				float exact = std::numeric_limits<float>::max();
+				for (std::size_t t = 0; t < indices.size(); t += 3) {
+					int feature;
+					auto q = gfx::closest_point_on_triangle(p, positions[indices[t]],
+						positions[indices[t + 1]], positions[indices[t + 2]], feature);
+					exact = std::min(exact, length(p - q));
+				}
+				float d = sdf.distance(p);
+				CHECK((d < 0.f) == (scale < 1.f));
+				CHECK(std::abs(std::abs(d) - exact) < .5f * sdf.cell_size());
+			}
+	}
+
+	// Open: without its top cap, the sphere has no inside.
+	{
+		std::vector<unsigned> open(indices.begin() + 6 * 32 * 8, indices.end());
+		auto sdf = bake("sdf_test_open.obj", positions, open);
+		CHECK(sdf.distance(Vec3{}) == sdf.band());
+		CHECK(sdf.distance(Vec3{ 0, -.5f, 0 }) == sdf.band());
+		CHECK(sdf.distance(Vec3{ 1.2f, 0, 0 }) > 0.f);
+	}
+
+	// Single sheet facing -x: both sides are outside.
+	{
+		std::vector<Vec3> sheet{ { 0, -1, -1 }, { 0, 1, -1 }, { 0, 1, 1 }, { 0, -1, 1 } };
+		std::vector<unsigned> quad{ 0, 2, 1, 0, 3, 2 };
+		auto sdf = bake("sdf_test_sheet.obj", sheet, quad);
+		float x = sdf.band() + sdf.cell_size();
+		for (float y : { -.8f, 0.f, .8f }) {
+			CHECK(sdf.distance(Vec3{ -x, y, 0 }) > 0.f);
+			CHECK(sdf.distance(Vec3{ x, y, 0 }) > 0.f);
+		}
+	}
+
+	// Cache files must hold exactly the samples of their header.
+	{
+		auto sdf = bake("sdf_test_cache.obj", positions, indices);
+		auto path = temp_path("sdf_test.sdf");
+		CHECK(sdf.save(path));
+		gfx::DistanceField loaded;
+		CHECK(loaded.load(path));
+		CHECK(loaded.size() == sdf.size());
+		CHECK(loaded.distance(Vec3{}) == sdf.distance(Vec3{}));
+
+		auto num_bytes = std::filesystem::file_size(path);
+		std::filesystem::resize_file(path, num_bytes - 4);
+		CHECK(!loaded.load(path));
+
+		// A huge size must not be trusted for the allocation.
+		CHECK(sdf.save(path));
+		{
+			std::fstream fp(path, std::ios::binary | std::ios::in | std::ios::out);
+			fp.seekp(16);
+			iVec3 huge{ 1 << 30, 1 << 30, 1 << 30 };
+			fp.write(reinterpret_cast<const char*>(&huge), sizeof(huge));
+		}
+		CHECK(!loaded.load(path));
+		std::filesystem::remove(path);
+	}
+
+	return check::result();
+}
@@ -1,15 +1,202 @@
 #include "utility.h"
 
-#include <fstream>
 #include <cassert>
+#include <cstring>
+#include <utility>
 #include "calc.h"
 
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+#endif
+
 namespace util
 {
 
-std::string format(const std::string& fmt)
+std::string& format_buffer()
+{
+    thread_local std::string buffer;
+    return buffer;
+}
+
+FileLogSink::FileLogSink(const std::string& path)
+    : file_{std::fopen(path.c_str(), "ab")}, owned_{true}
+{
+    if (file_ == nullptr) {
+        std::cerr << "Failed to open " << path << ".\n";
+        exit(1);
+    }
+}
+
+FileLogSink::~FileLogSink()
 {
-    return fmt;
+    if (owned_)
+        std::fclose(file_);
+}
+
+void FileLogSink::write(std::string_view text)
+{
+    std::fwrite(text.data(), 1, text.size(), file_);
+    std::fflush(file_);
+}
+
+void MemoryLogSink::write(std::string_view text)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    text_ += text;
+}
+
+std::string MemoryLogSink::text() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return text_;
+}
+
+Logger::Logger(std::unique_ptr<LogSink> sink, int num_slots)
+    : sink_{std::move(sink)}
+{
+    std::size_t size = 2;
+    while (size < static_cast<std::size_t>(num_slots))
+        size *= 2;
+    slots_.reset(new Slot[size]);
+    for (std::size_t i = 0; i < size; ++i)
+        slots_[i].seq.store(i, std::memory_order_relaxed);
+    mask_ = size - 1;
+    max_slots_per_message_ = std::max<std::size_t>(1, size / 4);
+
+    thread_ = std::thread([this]() { run(); });
+}
+
+Logger::~Logger()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+}
+
+void Logger::push(std::string_view text)
+{
+    std::size_t num_slots = std::min(max_slots_per_message_, 
+        std::max<std::size_t>(1, (text.size() + slot_text_size - 1) / slot_text_size));
+    bool truncated = text.size() > num_slots * slot_text_size;
+    bool newline = !text.empty() && text.back() == '\n';
+    text = text.substr(0, num_slots * slot_text_size);
+
+    ////
+    // Claim num_slots consecutive positions. A slot 
+    // is free for position pos once its seq is pos, 
+    // and only the claimant of a position, through
+    // the CAS, writes its slot.
+    ////
+
+    std::size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+        std::size_t num_free = 0;
+        while (num_free < num_slots && 
+                slots_[(pos + num_free) & mask_].seq.load(std::memory_order_acquire) 
+                == pos + num_free)
+            ++num_free;
+
+        if (num_free == num_slots) {
+            if (enqueue_pos_.compare_exchange_weak(pos, pos + num_slots, 
+                    std::memory_order_relaxed))
+                break;
+        }
+        else {
+            auto current = enqueue_pos_.load(std::memory_order_relaxed);
+            // Full, wait for the logger thread to catch up.
+            if (current == pos)
+                std::this_thread::yield();
+            pos = current;
+        }
+    }
+
+    for (std::size_t i = 0; i < num_slots; ++i) {
+        auto& slot = slots_[(pos + i) & mask_];
+        auto chunk = text.substr(i * slot_text_size, slot_text_size);
+        std::memcpy(slot.text, chunk.data(), chunk.size());
+        slot.size = static_cast<int>(chunk.size());
+        // Truncated lines still end the line.
+        if (truncated && newline && i + 1 == num_slots)
+            slot.text[slot.size - 1] = '\n';
+        slot.seq.store(pos + i + 1, std::memory_order_release);
+    }
+
+    // The logger thread polls, wake it early only every half ring.
+    std::size_t half = (mask_ + 1) / 2;
+    if (pos / half != (pos + num_slots) / half)
+        wake_.notify_one();
+}
+
+bool Logger::drain(std::string& batch)
+{
+    bool any = false;
+    for (;;) {
+        auto& slot = slots_[dequeue_pos_ & mask_];
+        if (slot.seq.load(std::memory_order_acquire) != dequeue_pos_ + 1)
+            return any;
+        batch.append(slot.text, slot.size);
+        slot.seq.store(dequeue_pos_ + mask_ + 1, std::memory_order_release);
+        ++dequeue_pos_;
+        any = true;
+    }
+}
+
+void Logger::run()
+{
+    std::string batch;
+    for (;;) {
+        batch.clear();
+        if (drain(batch)) {
+            {
+                std::lock_guard<std::mutex> lock(sink_mutex_);
+                sink_->write(batch);
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            written_pos_ = dequeue_pos_;
+            written_.notify_all();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (stop_)
+            return;
+        wake_.wait_for(lock, std::chrono::milliseconds(1));
+    }
+}
+
+void Logger::flush()
+{
+    auto pos = enqueue_pos_.load(std::memory_order_relaxed);
+    std::unique_lock<std::mutex> lock(mutex_);
+    wake_.notify_one();
+    written_.wait(lock, [this, pos]() { return written_pos_ >= pos; });
+}
+
+void Logger::set_sink(std::unique_ptr<LogSink> sink)
+{
+    flush();
+    std::lock_guard<std::mutex> lock(sink_mutex_);
+    sink_ = std::move(sink);
+}
+
+Logger& logger()
+{
+    static Logger logger{std::make_unique<FileLogSink>(stderr)};
+    return logger;
 }
 
 void quat_ostream(std::ostream& os, const calc::Quat& q)
@@ -24,21 +211,114 @@ std::ostream& operator<<(std::ostream& os, const calc::Quat& q)
     return os;
 }
 
-std::string read_file(const std::string& path)
+MappedFile::MappedFile(const std::string& path, unsigned hints)
 {
-	std::ifstream fin(path, std::ios_base::binary);
+#if defined(_WIN32)
+    // Large pages cannot back file views, HugePages is ignored.
+    DWORD flags = (hints & Sequential) ? 
+        FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL;
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 
+        nullptr, OPEN_EXISTING, flags, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size)) {
+        // An empty file is open with an empty view, mapping would fail.
+        if (size.QuadPart > 0) {
+            // The view keeps the mapping, and so the file, open.
+            HANDLE mapping = CreateFileMappingA(
+                file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping != nullptr) {
+                data_ = static_cast<const char*>(
+                    MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                CloseHandle(mapping);
+            }
+            if (data_ != nullptr) {
+                size_ = static_cast<std::size_t>(size.QuadPart);
+                open_ = true;
+            }
+        }
+        else {
+            open_ = true;
+        }
+    }
+    CloseHandle(file);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
 
-	assert(!fin.fail());
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        // An empty file is open with an empty view, mmap would fail.
+        if (st.st_size > 0) {
+            void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                if (hints & Sequential)
+                    madvise(p, st.st_size, MADV_SEQUENTIAL);
+#if defined(MADV_HUGEPAGE)
+                if (hints & HugePages)
+                    madvise(p, st.st_size, MADV_HUGEPAGE);
+#endif
+                data_ = static_cast<const char*>(p);
+                size_ = static_cast<std::size_t>(st.st_size);
+                open_ = true;
+            }
+        }
+        else {
+            open_ = true;
+        }
+    }
+    // The map keeps the file open.
+    ::close(fd);
+#endif
+}
 
-	fin.ignore(std::numeric_limits<std::streamsize>::max());
-	auto size = fin.gcount();
-	fin.clear();
+MappedFile::~MappedFile()
+{
+    close();
+}
 
-	fin.seekg(0, std::ios_base::beg);
-	auto source = std::unique_ptr<char>(new char[size]);
-	fin.read(source.get(), size);
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : data_{std::exchange(other.data_, nullptr)}, 
+    size_{std::exchange(other.size_, 0)}, 
+    open_{std::exchange(other.open_, false)}
+{}
 
-	return std::string(source.get(), static_cast<std::string::size_type>(size));
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other) {
+        close();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        open_ = std::exchange(other.open_, false);
+    }
+    return *this;
+}
+
+void MappedFile::close()
+{
+    if (data_ != nullptr) {
+#if defined(_WIN32)
+        UnmapViewOfFile(data_);
+#else
+        munmap(const_cast<char*>(data_), size_);
+#endif
+    }
+    data_ = nullptr;
+    size_ = 0;
+    open_ = false;
+}
+
+std::string read_file(const std::string& path)
+{
+    MappedFile file(path, MappedFile::Sequential);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open " << path << ".\n";
+        exit(1);
+    }
+    return std::string(file.view());
 }
 
 std::string get_file_base_dir(const std::string& filename)
@@ -59,4 +339,206 @@ std::string get_file_extension(const std::string& filename)
     return filename.substr(found);
 }
 
-}
\ No newline at end of file
+int default_num_threads()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+namespace
+{
+
+// Scheduler and queue of the calling thread, if it is a worker.
+thread_local const Scheduler* current_scheduler = nullptr;
+thread_local int current_queue = -1;
+
+void pin_thread(std::thread& thread, int core)
+{
+#if defined(_WIN32)
+    SetThreadAffinityMask(thread.native_handle(), DWORD_PTR(1) << core);
+#elif defined(__linux__)
+    cpu_set_t cores;
+    CPU_ZERO(&cores);
+    CPU_SET(core, &cores);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(cores), &cores);
+#endif
+}
+
+}
+
+Scheduler::Scheduler(int num_threads, bool pin_threads)
+{
+    int num_workers = std::max(num_threads, 1) - 1;
+    for (int q = 0; q <= num_workers; ++q)
+        queues_.push_back(std::make_unique<Queue>());
+    for (int w = 0; w < num_workers; ++w) {
+        workers_.emplace_back([this, w]() { work(w); });
+        if (pin_threads)
+            pin_thread(workers_.back(), (w + 1) % default_num_threads());
+    }
+}
+
+Scheduler::~Scheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_)
+        worker.join();
+}
+
+void Scheduler::push(Task task)
+{
+    int q = current_scheduler == this ? current_queue : queues_.size() - 1;
+    {
+        std::lock_guard<std::mutex> lock(queues_[q]->mutex);
+        queues_[q]->tasks.push_back(std::move(task));
+    }
+
+    ////
+    // A worker going to sleep counts itself before
+    // checking num_queued_, so either it sees this
+    // task or it is seen here, and woken under the
+    // mutex, once it waits.
+    ////
+    num_queued_++;
+    if (num_sleeping_ > 0) {
+        { std::lock_guard<std::mutex> lock(sleep_mutex_); }
+        wake_.notify_one();
+    }
+}
+
+bool Scheduler::run_one()
+{
+    if (num_queued_ == 0)
+        return false;
+
+    int num_queues = queues_.size();
+    int own = current_scheduler == this ? current_queue : num_queues - 1;
+    Task task;
+    bool found = false;
+    for (int k = 0; k < num_queues && !found; ++k) {
+        auto& queue = *queues_[(own + k) % num_queues];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            continue;
+        if (k == 0) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        found = true;
+    }
+    if (!found)
+        return false;
+
+    num_queued_--;
+    task.f();
+    task.group->pending_.fetch_sub(1, std::memory_order_release);
+    return true;
+}
+
+void Scheduler::work(int index)
+{
+    current_scheduler = this;
+    current_queue = index;
+    while (!stop_) {
+        if (run_one())
+            continue;
+
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        num_sleeping_++;
+        wake_.wait(lock, [this]() { return stop_ || num_queued_ > 0; });
+        num_sleeping_--;
+    }
+}
+
+Scheduler& scheduler()
+{
+    static Scheduler s;
+    return s;
+}
+
+void TaskGroup::wait()
+{
+    while (pending_.load(std::memory_order_acquire) > 0) {
+        if (!scheduler_.run_one())
+            std::this_thread::yield();
+    }
+}
+
+void radix_sort(
+    std::vector<unsigned>& keys, 
+    std::vector<int>& values, 
+    int key_bits)
+{
+    assert(keys.size() == values.size());
+    int n = keys.size();
+    int num_chunks = std::max(1, std::min<int>(
+        4 * scheduler().num_threads(), n / 4096));
+    int chunk = (n + num_chunks - 1) / num_chunks;
+
+    std::vector<unsigned> sorted_keys(n);
+    std::vector<int> sorted_values(n);
+    // Per chunk, the output offset of each digit.
+    std::vector<int> offsets(num_chunks * 256);
+
+    for (int shift = 0; shift < key_bits; shift += 8) {
+        std::fill(offsets.begin(), offsets.end(), 0);
+        parallel_for(0, num_chunks, 1, [&](int lo, int hi) {
+            for (int c = lo; c < hi; ++c) {
+                int* histogram = &offsets[c * 256];
+                int end = std::min(n, (c + 1) * chunk);
+                for (int i = c * chunk; i < end; ++i)
+                    ++histogram[(keys[i] >> shift) & 0xff];
+            }
+        });
+
+        // Scan in digit major order, so equal digits keep chunk order.
+        int sum = 0;
+        for (int d = 0; d < 256; ++d) {
+            for (int c = 0; c < num_chunks; ++c) {
+                int count = offsets[c * 256 + d];
+                offsets[c * 256 + d] = sum;
+                sum += count;
+            }
+        }
+
+        parallel_for(0, num_chunks, 1, [&](int lo, int hi) {
+            for (int c = lo; c < hi; ++c) {
+                int* offset = &offsets[c * 256];
+                int end = std::min(n, (c + 1) * chunk);
+                for (int i = c * chunk; i < end; ++i) {
+                    int dst = offset[(keys[i] >> shift) & 0xff]++;
+                    sorted_keys[dst] = keys[i];
+                    sorted_values[dst] = values[i];
+                }
+            }
+        });
+
+        keys.swap(sorted_keys);
+        values.swap(sorted_values);
+    }
+}
+
+std::vector<int> morton_order(const std::vector<calc::Vec3>& points)
+{
+    auto bounds = calc::box_from_points(points);
+    int n = points.size();
+    std::vector<unsigned> codes(n);
+    std::vector<int> order(n);
+    parallel_for(0, n, 4096, [&](int lo, int hi) {
+        for (int i = lo; i < hi; ++i) {
+            codes[i] = calc::morton_code(points[i], bounds);
+            order[i] = i;
+        }
+    });
+    radix_sort(codes, order, 30);
+    return order;
+}
+
+}
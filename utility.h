@@ -3,113 +3,511 @@
 
 
 #include <iostream>
+#include <cstdio>
 #include <iomanip>
 #include <string>
+#include <string_view>
+#include <charconv>
+#include <array>
+#include <tuple>
+#include <utility>
+#include <type_traits>
 #include <sstream>
 #include <stdexcept>
 #include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <algorithm>
 #include "calc.h"
 
 namespace util
 {
 
-std::string format(const std::string& fmt);
+////
+// format("x={}, t={:.3}ms\n", x, t) replaces each
+// {} with the next argument, as written by an
+// ostream, and {:.N} sets the precision of floats
+// and of float matrices and quaternions, ignored if
+// N is not a number. {{ and }} are literal braces
+// up to the last argument, and the text after it
+// is copied as is, so too few arguments leave their
+// placeholders in place. Numbers are written with
+// std::to_chars, and print formats into one buffer
+// per thread, so it allocates nothing once warm.
+//
+// Format strings wrapped in UTIL_FMT are parsed at
+// compile time, and a bad format string or wrong
+// number of arguments fails to compile. Others are
+// parsed as they are written, and throw
+// std::invalid_argument on unmatched braces before
+// the last argument, or on too many arguments.
+////
 
-template<typename First, typename ... Others>
-std::string format(
-    const std::string& fmt, 
-    First first, 
-    Others ... others)
+class FormatPiece {
+public:
+    // Literal text fmt[begin, begin+size) if arg < 0, else the 
+    // placeholder of argument arg.
+    int begin = 0;
+    int size = 0;
+    int arg = -1;
+    // Digits after the '.' of the placeholder, -1 if none.
+    int precision = -1;
+};
+
+// Parses the piece of fmt at pos, with arg 0 for a placeholder. 
+// Returns the position after it, or -1 if its braces do not match.
+constexpr int parse_format_piece(std::string_view fmt, int pos, FormatPiece& piece)
 {
-    auto is_op_delim = [&fmt](int idx){
-        if (fmt[idx]=='{') 
-            return true;
-        return false;
-    };
+    int size = static_cast<int>(fmt.size());
+    char c = fmt[pos];
+    piece = FormatPiece{};
+    piece.begin = pos;
 
-    auto is_ed_delim = [&fmt](int idx){
-        if (fmt[idx]=='}') 
-            return true;
-        return false;
-    };
+    if ((c == '{' || c == '}') && pos + 1 < size && fmt[pos + 1] == c) {
+        piece.size = 1;
+        return pos + 2;
+    }
+    if (c == '}')
+        return -1;
 
-    auto is_delim_escape = [&fmt](int idx) {
-        if (idx+1>=fmt.size()) return false;
-        if ((fmt[idx]=='{' && fmt[idx+1]=='{') || 
-			    (fmt[idx]=='}' && fmt[idx+1]=='}'))
-            return true;
-        return false;
-    };
+    if (c == '{') {
+        int end = pos + 1, dot = -1;
+        for (; end < size && fmt[end] != '}'; ++end) {
+            if (fmt[end] == '{')
+                return -1;
+            if (fmt[end] == '.' && dot < 0)
+                dot = end;
+        }
+        if (end == size)
+            return -1;
 
-    std::string first_part, format_part;
-    int state = 0, first_part_ed = 0;
-    for (int idx = 0; idx < fmt.size(); ++idx) {
-        if (is_delim_escape(idx)) {
-            if (state == 0)
-                first_part += fmt[idx+1];
-            else if (state == 1)
-                format_part += fmt[idx+1];
-            idx++;
+        piece.arg = 0;
+        // Leading digits, as std::stoi did. Without any, the
+        // precision is ignored rather than thrown on.
+        if (dot >= 0 && dot + 1 < end && fmt[dot + 1] >= '0' && fmt[dot + 1] <= '9') {
+            piece.precision = 0;
+            for (int i = dot + 1; i < end && fmt[i] >= '0' && fmt[i] <= '9'; ++i)
+                piece.precision = 10 * piece.precision + (fmt[i] - '0');
         }
-        else if (is_op_delim(idx)) {
-            if (state == 0)
-                state = 1;
-            else
-                throw std::invalid_argument("Delimiter mismatch");
+        return end + 1;
+    }
+
+    int end = pos;
+    while (end < size && fmt[end] != '{' && fmt[end] != '}')
+        ++end;
+    piece.size = end - pos;
+    return end;
+}
+
+// Number of pieces of fmt, or -1 if it is malformed. Placeholders
+// are numbered in order, and the text after the last one is one
+// piece, as is. The pieces are written to pieces if not null.
+constexpr int parse_format(std::string_view fmt, FormatPiece* pieces)
+{
+    int size = static_cast<int>(fmt.size()), tail = 0;
+    for (int pos = 0; pos < size;) {
+        FormatPiece piece;
+        pos = parse_format_piece(fmt, pos, piece);
+        if (pos < 0)
+            return -1;
+        if (piece.arg >= 0)
+            tail = pos;
+    }
+
+    int num_pieces = 0, num_args = 0;
+    for (int pos = 0; pos < tail; ++num_pieces) {
+        FormatPiece piece;
+        pos = parse_format_piece(fmt, pos, piece);
+        if (piece.arg >= 0)
+            piece.arg = num_args++;
+        if (pieces != nullptr)
+            pieces[num_pieces] = piece;
+    }
+    if (tail < size) {
+        if (pieces != nullptr) {
+            pieces[num_pieces] = FormatPiece{};
+            pieces[num_pieces].begin = tail;
+            pieces[num_pieces].size = size - tail;
         }
-        else if (is_ed_delim(idx)) {
-            if (state == 1) {
-                state = 2;
-                first_part_ed = idx+1;
+        ++num_pieces;
+    }
+    return num_pieces;
+}
+
+template<std::size_t NumPieces>
+constexpr std::array<FormatPiece, NumPieces> parse_format(std::string_view fmt)
+{
+    std::array<FormatPiece, NumPieces> pieces{};
+    parse_format(fmt, pieces.data());
+    return pieces;
+}
+
+template<std::size_t NumPieces>
+constexpr int count_format_args(const std::array<FormatPiece, NumPieces>& pieces)
+{
+    int num_args = 0;
+    for (const auto& piece : pieces)
+        num_args += piece.arg >= 0;
+    return num_args;
+}
+
+// Reused by print, per thread.
+std::string& format_buffer();
+
+template<typename T>
+void format_float(std::string& out, T value, int precision)
+{
+    // As an ostream in its default float format, i.e. %.Ng.
+    char buf[64];
+    auto result = std::to_chars(buf, buf + sizeof(buf), value, 
+        std::chars_format::general, precision < 0 ? 6 : precision);
+    if (result.ec == std::errc()) {
+        out.append(buf, result.ptr);
+        return;
+    }
+    // Only huge precisions overflow buf.
+    std::ostringstream ss;
+    ss.precision(precision);
+    ss << value;
+    out += ss.str();
+}
+
+template<typename T>
+void format_value(std::string& out, const T& value, int precision)
+{
+    if constexpr (std::is_same<T, bool>::value) {
+        out += value ? '1' : '0';
+    }
+    else if constexpr (std::is_same<T, char>::value || 
+            std::is_same<T, signed char>::value || 
+            std::is_same<T, unsigned char>::value) {
+        out += static_cast<char>(value);
+    }
+    else if constexpr (std::is_integral<T>::value) {
+        char buf[24];
+        auto result = std::to_chars(buf, buf + sizeof(buf), value);
+        out.append(buf, result.ptr);
+    }
+    else if constexpr (std::is_floating_point<T>::value) {
+        format_float(out, value, precision);
+    }
+    else if constexpr (std::is_convertible<const T&, std::string_view>::value) {
+        out += std::string_view(value);
+    }
+    else if constexpr (calc::is_Mat<T>::value) {
+        // As matrix_ostream.
+        constexpr int num_rows = T::num_rows, num_cols = T::num_cols;
+        auto p = calc::begin(value);
+        out += '{';
+        for (int row = 0; row < num_rows; ++row) {
+            if (num_cols != 1)
+                out += '{';
+            for (int col = 0; col < num_cols; ++col) {
+                format_value(out, p[col*num_rows+row], precision);
+                if (col != num_cols-1)
+                    out += ',';
             }
-            else
-                throw std::invalid_argument("Delimiter mismatch");
-            break;
-        }
-        else {
-            if (state == 0)
-                first_part += fmt[idx];
-            else if (state == 1)
-                format_part += fmt[idx];
+            if (num_cols != 1)
+                out += '}';
+            if (row != num_rows-1)
+                out += ',';
         }
+        out += '}';
+    }
+    else if constexpr (std::is_same<T, calc::Quat>::value) {
+        // As quat_ostream.
+        format_float(out, value.w, precision);
+        out += '+';
+        format_float(out, value.x, precision);
+        out += "i+";
+        format_float(out, value.y, precision);
+        out += "j+";
+        format_float(out, value.z, precision);
+        out += 'k';
+    }
+    else {
+        std::ostringstream ss;
+        ss << value;
+        out += ss.str();
     }
-    if (state != 2)
-        throw std::invalid_argument("Delimiter mismatch");
-    auto remaining_part = fmt.substr(
-        first_part_ed, fmt.size() - first_part_ed);
-    std::stringstream ss;
-
-	if (std::is_floating_point<First>::value || 
-		    calc::is_Mat<First>::value || 
-			std::is_same<calc::Quat,First>::value) {
-		// Setting precision of a floating point number.
-		// Changing width of the integral part: Unsupported.
-		auto pos = format_part.find('.');
-		if (pos != std::string::npos && pos < format_part.size()-1) {
-            auto curr_prec = std::stoi(format_part.substr(pos+1));
-			auto prev_prec = ss.precision(curr_prec);
-            ss << first;
-			ss.precision(prev_prec);
-		}
-		else
-			ss << first;
-	}
-	else
-		ss << first;
-	
-    return first_part + ss.str() + format(remaining_part, others...);
 }
 
-template<typename ...Args>
-void print(const std::string& fmt, Args... args)
+// Without arguments, for format strings that need none.
+inline void format_arg(std::string&, int, int) {}
+
+template<typename ... Args>
+void format_arg(std::string& out, int arg, int precision, const Args& ... args)
 {
-	std::cout << format(fmt, args...);
+    int i = 0;
+    ((i++ == arg ? format_value(out, args, precision) : void()), ...);
 }
 
-template<typename ...Args>
-void print(std::ostream& out, const std::string& fmt, Args... args)
+// Appends the formatted string to out.
+template<typename ... Args>
+void format_to(std::string& out, std::string_view fmt, const Args& ... args)
 {
-	out << format(fmt, args...);
+    int num_args = 0, pos = 0;
+    while (num_args < static_cast<int>(sizeof...(Args))) {
+        if (pos == static_cast<int>(fmt.size()))
+            throw std::invalid_argument("Too many arguments");
+        FormatPiece piece;
+        pos = parse_format_piece(fmt, pos, piece);
+        if (pos < 0)
+            throw std::invalid_argument("Delimiter mismatch");
+        if (piece.arg < 0)
+            out.append(fmt.data() + piece.begin, piece.size);
+        else
+            format_arg(out, num_args++, piece.precision, args...);
+    }
+    out.append(fmt.data() + pos, fmt.size() - pos);
+}
+
+// Base of the format strings made by UTIL_FMT.
+class FormatString {};
+
+#define UTIL_FMT(str) [] { \
+        class Str : public util::FormatString { \
+        public: \
+            static constexpr std::string_view get() { return str; } \
+        }; \
+        return Str{}; \
+    }()
+
+template<typename Str>
+class CompiledFormat {
+public:
+
+    static constexpr std::string_view fmt = Str::get();
+    static constexpr int num_pieces = parse_format(fmt, nullptr);
+    static_assert(num_pieces >= 0, "Malformed format string.");
+    static constexpr auto pieces = parse_format<(num_pieces > 0 ? num_pieces : 0)>(fmt);
+    static constexpr int num_args = count_format_args(pieces);
+
+    template<typename ... Args>
+    static void write(std::string& out, const Args& ... args)
+    {
+        static_assert(num_args == sizeof...(Args), 
+            "Number of arguments does not match the format string.");
+        write(out, std::forward_as_tuple(args...), 
+            std::make_index_sequence<pieces.size()>{});
+    }
+
+private:
+
+    template<typename Tuple, std::size_t ... Indices>
+    static void write(std::string& out, const Tuple& args, std::index_sequence<Indices...>)
+    {
+        (write_piece<Indices>(out, args), ...);
+    }
+
+    template<std::size_t Index, typename Tuple>
+    static void write_piece(std::string& out, const Tuple& args)
+    {
+        constexpr FormatPiece piece = pieces[Index];
+        if constexpr (piece.arg < 0)
+            out.append(fmt.data() + piece.begin, piece.size);
+        else
+            format_value(out, std::get<piece.arg>(args), piece.precision);
+    }
+};
+
+template<typename Str, typename ... Args>
+typename std::enable_if<std::is_base_of<FormatString, Str>::value>::type 
+format_to(std::string& out, Str, const Args& ... args)
+{
+    CompiledFormat<Str>::write(out, args...);
+}
+
+template<typename Format, typename ... Args>
+std::string format(const Format& fmt, const Args& ... args)
+{
+    std::string out;
+    format_to(out, fmt, args...);
+    return out;
+}
+
+template<typename Format, typename ... Args>
+void print(std::ostream& out, const Format& fmt, const Args& ... args)
+{
+    auto& buffer = format_buffer();
+    buffer.clear();
+    format_to(buffer, fmt, args...);
+    out.write(buffer.data(), buffer.size());
+}
+
+template<typename Format, typename ... Args>
+typename std::enable_if<!std::is_base_of<std::ostream, Format>::value>::type 
+print(const Format& fmt, const Args& ... args)
+{
+    print(std::cout, fmt, args...);
+}
+
+////
+// Asynchronous logging. Producers format into
+// their thread's buffer and copy the text into a
+// lock-free ring of fixed size slots, claiming as
+// many consecutive slots as it needs. A background
+// thread polls the ring every millisecond, or
+// when woken every half ring, and writes what it
+// finds to a sink in one batch. A full ring makes
+// producers wait, so nothing is dropped. Levels
+// below UTIL_LOG_LEVEL are compiled out.
+////
+
+enum class LogLevel : int {
+    Debug = 0,
+    Info = 1,
+    Warning = 2,
+    Error = 3,
+};
+
+#ifndef UTIL_LOG_LEVEL
+#ifdef NDEBUG
+#define UTIL_LOG_LEVEL 1
+#else
+#define UTIL_LOG_LEVEL 0
+#endif
+#endif
+
+class LogSink {
+public:
+    virtual ~LogSink() {}
+    // Called from the logger's thread only.
+    virtual void write(std::string_view text) = 0;
+};
+
+class FileLogSink : public LogSink {
+public:
+    // Appends to the file at path, exits if it cannot be opened.
+    explicit FileLogSink(const std::string& path);
+    // Writes to file, e.g. stderr, which stays open.
+    explicit FileLogSink(std::FILE* file) : file_{file} {}
+    ~FileLogSink();
+
+    FileLogSink(const FileLogSink&) = delete;
+    FileLogSink& operator=(const FileLogSink&) = delete;
+
+    void write(std::string_view text) override;
+
+private:
+    std::FILE* file_ = nullptr;
+    bool owned_ = false;
+};
+
+class MemoryLogSink : public LogSink {
+public:
+    void write(std::string_view text) override;
+    // Everything written so far.
+    std::string text() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::string text_;
+};
+
+class Logger {
+public:
+
+    // Text per slot.
+    static constexpr int slot_text_size = 244;
+
+    // num_slots is rounded up to a power of two. Messages longer 
+    // than a quarter of the ring are truncated.
+    explicit Logger(std::unique_ptr<LogSink> sink, int num_slots = 1024);
+    // Writes out everything logged before returning.
+    ~Logger();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    template<typename Format, typename ... Args>
+    void log(const Format& fmt, const Args& ... args)
+    {
+        auto& buffer = format_buffer();
+        buffer.clear();
+        format_to(buffer, fmt, args...);
+        push(buffer);
+    }
+
+    void push(std::string_view text);
+
+    // Returns once everything logged before has been written.
+    void flush();
+
+    // Flushes, then writes to sink from then on.
+    void set_sink(std::unique_ptr<LogSink> sink);
+
+private:
+
+    class alignas(64) Slot {
+    public:
+        // Position the slot is free for, plus one once written.
+        std::atomic<std::size_t> seq;
+        int size;
+        char text[slot_text_size];
+    };
+
+    // Appends the text of the written slots to batch and frees 
+    // them. False if there were none.
+    bool drain(std::string& batch);
+    void run();
+
+    std::unique_ptr<Slot[]> slots_;
+    std::size_t mask_;
+    std::size_t max_slots_per_message_;
+    alignas(64) std::atomic<std::size_t> enqueue_pos_{0};
+    // Logger thread only.
+    alignas(64) std::size_t dequeue_pos_ = 0;
+
+    std::mutex sink_mutex_;
+    std::unique_ptr<LogSink> sink_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable written_;
+    bool stop_ = false;
+    // Positions before it have reached the sink.
+    std::size_t written_pos_ = 0;
+};
+
+// Logger writing to stderr, made on first use.
+Logger& logger();
+
+template<LogLevel Level, typename Format, typename ... Args>
+void log_at(const Format& fmt, const Args& ... args)
+{
+    if constexpr (static_cast<int>(Level) >= UTIL_LOG_LEVEL)
+        logger().log(fmt, args...);
+}
+
+template<typename Format, typename ... Args>
+void log_debug(const Format& fmt, const Args& ... args)
+{
+    log_at<LogLevel::Debug>(fmt, args...);
+}
+
+template<typename Format, typename ... Args>
+void log_info(const Format& fmt, const Args& ... args)
+{
+    log_at<LogLevel::Info>(fmt, args...);
+}
+
+template<typename Format, typename ... Args>
+void log_warning(const Format& fmt, const Args& ... args)
+{
+    log_at<LogLevel::Warning>(fmt, args...);
+}
+
+template<typename Format, typename ... Args>
+void log_error(const Format& fmt, const Args& ... args)
+{
+    log_at<LogLevel::Error>(fmt, args...);
 }
 
 template<typename ValType, int NumRows, int NumCols>
@@ -149,8 +547,207 @@ std::ostream& operator<<(
 
 std::ostream& operator<<(std::ostream&, const calc::Quat&);
 
+////
+// Read-only map of a whole file. Pages are read in
+// on first touch, so opening copies nothing, and
+// the view stays valid while the MappedFile lives.
+// The hints are advice to the OS, and ignored
+// where unsupported.
+////
+
+class MappedFile {
+public:
+
+    enum Hints : unsigned {
+        NoHints = 0,
+        // Read front to back: read ahead further, and drop pages
+        // behind the reader earlier.
+        Sequential = 1,
+        // Back the map with huge pages where the OS can.
+        HugePages = 2,
+    };
+
+    MappedFile() {}
+    // Not open if the file could not be opened or mapped.
+    explicit MappedFile(const std::string& path, unsigned hints = NoHints);
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool is_open() const { return open_; }
+    const char* data() const { return data_; }
+    std::size_t size() const { return size_; }
+    std::string_view view() const { return {data_, size_}; }
+
+private:
+
+    void close();
+
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+    bool open_ = false;
+};
+
+// Copy of the file, exits if it cannot be read.
 std::string read_file(const std::string& path);
 
+////
+// Work-stealing task scheduler. Each worker owns
+// a deque of tasks, pushing and popping its own at
+// the back, and idle workers steal from the front
+// of the others', i.e. the oldest and, for split
+// work, largest tasks. Other threads push to one
+// shared queue. Waiting on a TaskGroup runs tasks
+// rather than blocking, so tasks may wait on
+// nested groups.
+////
+
+class TaskGroup;
+
+int default_num_threads();
+
+class Scheduler {
+public:
+
+    // num_threads counts the thread waiting on tasks, so 
+    // num_threads - 1 workers are started. With pin_threads, 
+    // worker i only runs on core i + 1.
+    explicit Scheduler(
+        int num_threads = default_num_threads(), 
+        bool pin_threads = false);
+    ~Scheduler();
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    int num_threads() const { return static_cast<int>(workers_.size()) + 1; }
+
+private:
+    friend class TaskGroup;
+
+    class Task {
+    public:
+        std::function<void()> f;
+        TaskGroup* group;
+    };
+
+    class Queue {
+    public:
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void push(Task task);
+    // Runs a task of the calling thread's queue, or a stolen one.
+    // False if none was found.
+    bool run_one();
+    void work(int index);
+
+    std::vector<std::thread> workers_;
+    // One per worker, then the shared queue.
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::atomic<int> num_queued_{0};
+    std::atomic<int> num_sleeping_{0};
+    std::atomic<bool> stop_{false};
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+};
+
+// Scheduler on all hardware threads, made on first use.
+Scheduler& scheduler();
+
+class TaskGroup {
+public:
+
+    explicit TaskGroup(Scheduler& scheduler = util::scheduler()) 
+        : scheduler_{scheduler}
+    {}
+    ~TaskGroup() { wait(); }
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    template<typename Func>
+    void run(Func f)
+    {
+        pending_.fetch_add(1, std::memory_order_relaxed);
+        scheduler_.push(Scheduler::Task{std::move(f), this});
+    }
+
+    // Returns once all tasks run in the group are done.
+    void wait();
+
+private:
+    friend class Scheduler;
+
+    Scheduler& scheduler_;
+    std::atomic<int> pending_{0};
+};
+
+////
+// Run f(lo, hi) over chunks of [begin, end) of 
+// at most grain items, on the threads of s. The
+// range is halved at chunk boundaries, and the 
+// upper halves are left for other threads.
+////
+
+template<typename Func>
+void parallel_for(Scheduler& s, int begin, int end, int grain, Func f)
+{
+    grain = std::max(grain, 1);
+    if (s.num_threads() == 1 || end - begin <= grain) {
+        for (int lo = begin; lo < end; lo += grain)
+            f(lo, std::min(lo + grain, end));
+        return;
+    }
+
+    class Split {
+    public:
+        void operator()(int lo, int hi) const
+        {
+            while (hi - lo > grain) {
+                int mid = lo + (hi - lo + grain - 1) / grain / 2 * grain;
+                group.run([this, mid, hi]() { (*this)(mid, hi); });
+                hi = mid;
+            }
+            f(lo, hi);
+        }
+
+        TaskGroup& group;
+        const Func& f;
+        int grain;
+    };
+
+    TaskGroup group(s);
+    Split split{group, f, grain};
+    split(begin, end);
+    group.wait();
+}
+
+template<typename Func>
+void parallel_for(int begin, int end, int grain, Func f)
+{
+    parallel_for(scheduler(), begin, end, grain, f);
+}
+
+////
+// Stable LSD radix sort of keys, carrying values 
+// along, 8 bits per pass over the low key_bits 
+// bits. Each pass histograms and scatters chunks 
+// of the keys in parallel.
+////
+
+void radix_sort(
+    std::vector<unsigned>& keys, 
+    std::vector<int>& values, 
+    int key_bits = 32);
+
+// Permutation listing points in Morton order over their bounds.
+std::vector<int> morton_order(const std::vector<calc::Vec3>& points);
+
 // No trailling dirsep.
 std::string get_file_base_dir(const std::string& filename);
 